@@ -0,0 +1,779 @@
+/*
+ * Neptune_Archive
+ *
+ * This app adds the jumps in neptune data files to an archive store
+ * (see neptune_store.h), keyed by the Neptune's serial number and the
+ * jump number, so reports over a whole fleet's downloads no longer
+ * have to read every file again.  It also lists the jumps in a store,
+ * or writes them out as a neptune data file, picked by serial number,
+ * jump number, date and jump type, and compacts a store down to the
+ * latest copy of each jump.
+ *
+ * It can also watch a directory, such as the share a kiosk drops its
+ * downloads into, adding each data file written or changed there as
+ * soon as it's finished, and regenerating the plots of just the jumps
+ * that file added, and the summaries of their Neptunes and the fleet,
+ * with a pool of neptune_dump processes.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include "neptune_rec.h"
+#include "neptune_stream.h"
+#include "neptune_store.h"
+#include "neptune_watch.h"
+
+/* Defines */
+#define VERSION 100
+#define MAX_OUTPUT_PATH     1024
+#define DEFAULT_WORKERS     4           /* neptune_dump processes run at once */
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Custom Types */
+typedef struct ingest_state
+{
+    STORE_SESSION session;          /* The download being read */
+    long        nJumpAlloc;
+    uint8_t     *pProfiles;         /* Its profiles */
+    long        nProfileAlloc;
+    long        nProfile;           /* Jump of the profile being read, or -1 */
+    long        nSessions;          /* Totals */
+    long        nBadRecords;
+} INGEST_STATE;
+
+typedef struct output_job           /* A report regenerated by neptune_dump */
+{
+    char        strSerialNo[STORE_SERIAL_SIZE+1];   /* Neptune, or "" for the fleet */
+    char        strJump[16];        /* <jump-num> */
+    const char  *pType;             /* <dump-type> */
+    char        strOutput[MAX_OUTPUT_PATH];
+    pid_t       nPid;
+} OUTPUT_JOB;
+
+/* Globals */
+unsigned char databuff[MAX_RECORD_SIZE];
+const char *pDumpProgram = "neptune_dump";
+volatile sig_atomic_t bQuit = FALSE;
+
+/* Prototypes */
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
+int ReadLine(void *pSource, DATA_REC *pRecord);
+STORE_JUMP *FindSessionJump(INGEST_STATE *pState, unsigned long nJumpNumber);
+int AddProfileRecord(INGEST_STATE *pState, const REC_FIELDS *pFields);
+void EndProfile(INGEST_STATE *pState);
+int EndSession(NEPTUNE_STORE *pStore, INGEST_STATE *pState);
+int IngestFile(NEPTUNE_STORE *pStore, INGEST_STATE *pState, NEPTUNE_STREAM *pInStream, const char *pInFilename);
+int IngestPath(NEPTUNE_STORE *pStore, INGEST_STATE *pState, const char *pPath);
+void ReportIngest(NEPTUNE_STORE *pStore, INGEST_STATE *pState);
+void ListJumps(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery);
+void HandleSignal(int nSignal);
+int CompareAdded(const void *p1, const void *p2);
+int AddJob(OUTPUT_JOB **ppJobs, long *pNumJobs, const char *pOutDir, const char *pSerialNo,
+                unsigned long nJumpNumber, const char *pType);
+int StartJob(OUTPUT_JOB *pJob, const char *pStorePath);
+int RunJobs(OUTPUT_JOB *pJobs, long nNumJobs, const char *pStorePath, int nWorkers);
+int RegenerateOutputs(STORE_JUMP *pAdded, long nNumAdded, const char *pStorePath, const char *pOutDir, int nWorkers);
+int WatchFolder(const char *pStorePath, const char *pDir, const char *pOutDir, int nWorkers);
+
+/* ========================================================================== */
+
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
+{
+    return (ReadStreamLine((NEPTUNE_STREAM*)pSource, pBuff, nBufSize) > 0);
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    if (!ReadString(pSource, pRecord->buff, sizeof(pRecord->buff))) return FALSE;
+    pRecord->data = pRecord->buff;
+    pRecord->dwSize = strlen((char *)pRecord->buff);
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+STORE_JUMP *FindSessionJump(INGEST_STATE *pState, unsigned long nJumpNumber)
+{
+    STORE_SESSION *pSession = &pState->session;
+    STORE_JUMP *pJump;
+    long i;
+
+    for (i=pSession->nNumJumps-1; i>=0; i--) {
+        if (pSession->pJumps[i].nJumpNumber == nJumpNumber) return &pSession->pJumps[i];
+    }
+
+    if (pSession->nNumJumps >= pState->nJumpAlloc) {
+        pJump = (STORE_JUMP *)realloc(pSession->pJumps, (pState->nJumpAlloc + 256) * sizeof(STORE_JUMP));
+        if (!pJump) return NULL;
+        pSession->pJumps = pJump;
+        pState->nJumpAlloc += 256;
+    }
+    pJump = &pSession->pJumps[pSession->nNumJumps++];
+    memset(pJump, 0, sizeof(STORE_JUMP));
+    memcpy(pJump->strSerialNo, pSession->strSerialNo, STORE_SERIAL_SIZE);
+    pJump->nJumpNumber = nJumpNumber;
+    return pJump;
+}
+
+int AddProfileRecord(INGEST_STATE *pState, const REC_FIELDS *pFields)
+{
+    uint8_t *pNew;
+    long nNumBytes;
+
+    /* Length, type and data, without the checksum */
+    nNumBytes = pFields->nNumBytes - 1;
+    if (nNumBytes < 2) return TRUE;
+    if (pState->session.nProfilesSize + nNumBytes > pState->nProfileAlloc) {
+        pNew = (uint8_t *)realloc(pState->pProfiles, (pState->nProfileAlloc + nNumBytes) * 2);
+        if (!pNew) return FALSE;
+        pState->pProfiles = pNew;
+        pState->nProfileAlloc = (pState->nProfileAlloc + nNumBytes) * 2;
+        pState->session.pProfiles = pNew;
+    }
+    memcpy(&pState->pProfiles[pState->session.nProfilesSize], pFields->bytes, nNumBytes);
+    pState->pProfiles[pState->session.nProfilesSize] = nNumBytes - 1;
+    pState->session.nProfilesSize += nNumBytes;
+    if (pFields->type == 6) pState->session.pJumps[pState->nProfile].nNumPoints++;
+    return TRUE;
+}
+
+void EndProfile(INGEST_STATE *pState)
+{
+    STORE_JUMP *pJump;
+
+    if (pState->nProfile < 0) return;
+    pJump = &pState->session.pJumps[pState->nProfile];
+    pJump->nProfileSize = pState->session.nProfilesSize - pJump->nProfileOffset;
+    pState->nProfile = -1;
+}
+
+int EndSession(NEPTUNE_STORE *pStore, INGEST_STATE *pState)
+{
+    STORE_SESSION *pSession = &pState->session;
+    int bOK;
+
+    EndProfile(pState);
+    bOK = TRUE;
+    if ((pSession->nNumJumps) || (pSession->bHaveDevice)) {
+        pState->nSessions++;
+        bOK = StoreSession(pStore, pSession);
+    }
+
+    memset(pSession->strSerialNo, 0, sizeof(pSession->strSerialNo));
+    pSession->bHaveDevice = FALSE;
+    memset(&pSession->device, 0, sizeof(pSession->device));
+    pSession->nNumJumps = 0;
+    pSession->nProfilesSize = 0;
+    return bOK;
+}
+
+int IngestFile(NEPTUNE_STORE *pStore, INGEST_STATE *pState, NEPTUNE_STREAM *pInStream, const char *pInFilename)
+{
+    STORE_SESSION *pSession = &pState->session;
+    STORE_JUMP *pJump;
+    STORE_JUMP myJump;
+    REC_FIELDS myFields;
+    long nNumBytes;
+    int bSessionEnded;
+    int type;
+    int i;
+
+    /* Check magic tag */
+    if (!ReadString(pInStream, databuff, sizeof(databuff))) {
+        fprintf(stderr, "Couldn't read input file \"%s\"!\n", pInFilename);
+        return FALSE;
+    }
+    for (i=strlen((char *)databuff)-1; ((i>=0) && (isspace(databuff[i]))); i--)
+        databuff[i] = 0;
+    if (strcmp((char *)databuff, "#NEPTUNE") != 0) {
+        fprintf(stderr, "Skipping \"%s\" -- not a Neptune Data File\n", pInFilename);
+        return FALSE;
+    }
+
+    bSessionEnded = FALSE;
+    pState->nProfile = -1;
+    while ((type = GetNextRecord(pInStream, databuff)) != -1) {
+        if (type == -4) {           /* Another download concatenated on */
+            if (!EndSession(pStore, pState)) return FALSE;
+            bSessionEnded = FALSE;
+            continue;
+        }
+        if (bSessionEnded) continue;
+        if (type < 0) {
+            pState->nBadRecords++;
+            continue;
+        }
+        DecodeRecord(type, databuff, &myFields);
+
+        switch (type) {
+            case 2:     /* Starting new Jump Record */
+            case 3:     /* End of all data */
+            case 5:     /* Starting new Jump Profile */
+                EndProfile(pState);
+                break;
+        }
+
+        nNumBytes = myFields.nNumBytes - 1;
+        if (nNumBytes > STORE_DEVICE_BYTES) nNumBytes = STORE_DEVICE_BYTES;
+        switch (type) {
+            case 0:     /* Version Info */
+                if (pSession->bHaveDevice) break;       /* Just the first, in case of damage */
+                SetStoreSerialNo(pSession->strSerialNo, myFields.strText);
+                memcpy(pSession->device.strSerialNo, pSession->strSerialNo, STORE_SERIAL_SIZE);
+                memcpy(pSession->device.version, myFields.bytes, nNumBytes);
+                pSession->device.version[0] = nNumBytes - 1;
+                pSession->bHaveDevice = TRUE;
+                break;
+            case 1:     /* Jump Summary */
+                memcpy(pSession->device.summary, myFields.bytes, nNumBytes);
+                pSession->device.summary[0] = nNumBytes - 1;
+                break;
+            case 2:     /* Jump Record */
+                pJump = FindSessionJump(pState, myFields.nValue[RF_JUMP]);
+                if (!pJump) return FALSE;
+                SetStoreJump(&myJump, pSession->strSerialNo, &myFields);
+                myJump.nFlags |= pJump->nFlags;
+                myJump.nProfileSize = pJump->nProfileSize;
+                myJump.nNumPoints = pJump->nNumPoints;
+                myJump.nProfileOffset = pJump->nProfileOffset;
+                *pJump = myJump;
+                break;
+            case 3:     /* End of all data */
+                bSessionEnded = TRUE;
+                break;
+            case 5:     /* Profile Start */
+                pJump = FindSessionJump(pState, myFields.nValue[RF_JUMP]);
+                if (!pJump) return FALSE;
+                pJump->nFlags |= STORE_HAS_PROFILE;
+                pJump->nProfileOffset = pSession->nProfilesSize;
+                pJump->nNumPoints = 0;
+                pState->nProfile = pJump - pSession->pJumps;
+                if (!AddProfileRecord(pState, &myFields)) return FALSE;
+                break;
+            case 4:     /* Jump Profile Data Stream Type */
+            case 6:     /* Profile Datapoint */
+            case 7:     /* End of Profile */
+                if (pState->nProfile < 0) break;
+                if (!AddProfileRecord(pState, &myFields)) return FALSE;
+                if (type == 7) EndProfile(pState);
+                break;
+        }
+    }
+
+    return EndSession(pStore, pState);
+}
+
+int IngestPath(NEPTUNE_STORE *pStore, INGEST_STATE *pState, const char *pPath)
+{
+    NEPTUNE_STREAM *pInStream;
+    int nResult;
+
+    pInStream = OpenInputStream(pPath);
+    if (!pInStream) {
+        fprintf(stderr, "Failed to open \"%s\" for reading!\n", pPath);
+        return -2;
+    }
+    nResult = 0;
+    if (pInStream->bTar) {
+        while (NextTarMember(pInStream))
+            IngestFile(pStore, pState, pInStream, pInStream->strMember);
+    } else if (!IngestFile(pStore, pState, pInStream, pPath)) {
+        nResult = -3;
+    }
+    if (!CloseInputStream(pInStream)) {
+        fprintf(stderr, "The input file \"%s\" is corrupt or was cut short!\n", pPath);
+        nResult = -5;
+    }
+    return nResult;
+}
+
+void ReportIngest(NEPTUNE_STORE *pStore, INGEST_STATE *pState)
+{
+    printf("Added %ld jumps (%ld profiles) from %ld downloads", pStore->nAdded, pStore->nAddedProfiles, pState->nSessions);
+    if (pStore->nSkipped) printf(", skipping %ld already in the store", pStore->nSkipped);
+    if (pStore->nConflicts) printf(", %ld replacing different copies", pStore->nConflicts);
+    if (pState->nBadRecords) printf(", skipping %ld bad records", pState->nBadRecords);
+    printf("\n");
+}
+
+/* ========================================================================== */
+
+void ListJumps(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery)
+{
+    STORE_JUMP *pJumps;
+    long nNumJumps;
+    long i;
+
+    nNumJumps = QueryStore(pStore, pQuery, &pJumps);
+    if (nNumJumps < 0) return;
+
+    printf("Serial No   Jump  Date        Time   Type  Record  Points\n");
+    for (i=0; i<nNumJumps; i++) {
+        printf("%-10.*s %5lu  %04lu-%02lu-%02lu  %02u:%02u  %4u  %-6s  %6lu\n",
+                    STORE_SERIAL_SIZE, pJumps[i].strSerialNo, (unsigned long)pJumps[i].nJumpNumber,
+                    (unsigned long)(pJumps[i].nDate / 10000), (unsigned long)((pJumps[i].nDate / 100) % 100),
+                    (unsigned long)(pJumps[i].nDate % 100), pJumps[i].nTime / 100, pJumps[i].nTime % 100,
+                    pJumps[i].nJumpType, ((pJumps[i].nFlags & STORE_HAS_RECORD) ? "yes" : "no"),
+                    (unsigned long)pJumps[i].nNumPoints);
+    }
+    printf("%ld jumps\n", nNumJumps);
+    free(pJumps);
+}
+
+/* ========================================================================== */
+
+void HandleSignal(int nSignal)
+{
+    bQuit = TRUE;
+}
+
+int CompareAdded(const void *p1, const void *p2)
+{
+    const STORE_JUMP *pJump1 = (const STORE_JUMP *)p1;
+    const STORE_JUMP *pJump2 = (const STORE_JUMP *)p2;
+    int n;
+
+    n = memcmp(pJump1->strSerialNo, pJump2->strSerialNo, STORE_SERIAL_SIZE);
+    if (n) return n;
+    if (pJump1->nJumpNumber != pJump2->nJumpNumber) return ((pJump1->nJumpNumber < pJump2->nJumpNumber) ? -1 : 1);
+    return 0;
+}
+
+int AddJob(OUTPUT_JOB **ppJobs, long *pNumJobs, const char *pOutDir, const char *pSerialNo,
+                unsigned long nJumpNumber, const char *pType)
+{
+    OUTPUT_JOB *pJob;
+    char strDir[MAX_OUTPUT_PATH];
+    int n;
+    int i;
+
+    pJob = (OUTPUT_JOB *)realloc(*ppJobs, (*pNumJobs + 1) * sizeof(OUTPUT_JOB));
+    if (!pJob) return FALSE;
+    *ppJobs = pJob;
+    pJob = &pJob[*pNumJobs];
+    memset(pJob, 0, sizeof(OUTPUT_JOB));
+    if (pSerialNo) strncpy(pJob->strSerialNo, pSerialNo, STORE_SERIAL_SIZE);
+    snprintf(pJob->strJump, sizeof(pJob->strJump), "%lu", nJumpNumber);
+    pJob->pType = pType;
+
+    /* The fleet's reports at the top, each Neptune's in a directory named for it */
+    if ((mkdir(pOutDir, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "Couldn't make \"%s\":  %s\n", pOutDir, strerror(errno));
+        return FALSE;
+    }
+    if (pSerialNo) {
+        n = snprintf(strDir, sizeof(strDir), "%s/%s", pOutDir, pJob->strSerialNo);
+        if ((n < 0) || (n >= sizeof(strDir))) return FALSE;
+        for (i=strlen(pOutDir)+1; strDir[i]; i++) {
+            if ((!isalnum((unsigned char)strDir[i])) && (strDir[i] != '-')) strDir[i] = '_';
+        }
+        if ((mkdir(strDir, 0755) < 0) && (errno != EEXIST)) {
+            fprintf(stderr, "Couldn't make \"%s\":  %s\n", strDir, strerror(errno));
+            return FALSE;
+        }
+        if (nJumpNumber) {
+            n = snprintf(pJob->strOutput, sizeof(pJob->strOutput), "%s/%lu.plt", strDir, nJumpNumber);
+        } else {
+            n = snprintf(pJob->strOutput, sizeof(pJob->strOutput), "%s/summary.txt", strDir);
+        }
+    } else {
+        n = snprintf(pJob->strOutput, sizeof(pJob->strOutput), "%s/summary.txt", pOutDir);
+    }
+    if ((n < 0) || (n >= sizeof(pJob->strOutput))) return FALSE;
+
+    (*pNumJobs)++;
+    return TRUE;
+}
+
+int StartJob(OUTPUT_JOB *pJob, const char *pStorePath)
+{
+    char strTemp[MAX_OUTPUT_PATH+8];
+    const char *pArgs[8];
+    int fd;
+    int n;
+
+    /* Written to the side and renamed into place when it's done, so whatever
+        is publishing the reports never sees half of one */
+    snprintf(strTemp, sizeof(strTemp), "%s.tmp", pJob->strOutput);
+    fd = open(strTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't write \"%s\":  %s\n", strTemp, strerror(errno));
+        return FALSE;
+    }
+
+    n = 0;
+    pArgs[n++] = pDumpProgram;
+    if (pJob->strSerialNo[0]) {
+        pArgs[n++] = "-S";
+        pArgs[n++] = pJob->strSerialNo;
+    }
+    pArgs[n++] = pJob->strJump;
+    pArgs[n++] = pJob->pType;
+    pArgs[n++] = pStorePath;
+    pArgs[n] = NULL;
+
+    fflush(stdout);
+    pJob->nPid = fork();
+    if (pJob->nPid < 0) {
+        perror("Starting neptune_dump ");
+        close(fd);
+        unlink(strTemp);
+        pJob->nPid = 0;
+        return FALSE;
+    }
+    if (pJob->nPid == 0) {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execvp(pDumpProgram, (char *const *)pArgs);
+        _exit(127);
+    }
+    close(fd);
+
+    return TRUE;
+}
+
+int RunJobs(OUTPUT_JOB *pJobs, long nNumJobs, const char *pStorePath, int nWorkers)
+{
+    char strTemp[MAX_OUTPUT_PATH+8];
+    long nNext;
+    long nRunning;
+    long nDone;
+    pid_t nPid;
+    int nStatus;
+    int bOK;
+    long i;
+
+    bOK = TRUE;
+    nNext = 0;
+    nRunning = 0;
+    nDone = 0;
+    while ((nNext < nNumJobs) || (nRunning)) {
+        /* Up to nWorkers at once, starting the next as each finishes */
+        for (; ((nNext < nNumJobs) && (nRunning < nWorkers)); nNext++) {
+            if (StartJob(&pJobs[nNext], pStorePath)) {
+                nRunning++;
+            } else {
+                bOK = FALSE;
+            }
+        }
+        if (!nRunning) break;
+
+        nPid = waitpid(-1, &nStatus, 0);
+        if (nPid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (i=0; ((i<nNumJobs) && (pJobs[i].nPid != nPid)); i++);
+        if (i >= nNumJobs) continue;
+        pJobs[i].nPid = 0;
+        nRunning--;
+
+        snprintf(strTemp, sizeof(strTemp), "%s.tmp", pJobs[i].strOutput);
+        if ((WIFEXITED(nStatus)) && (WEXITSTATUS(nStatus) == 0) && (rename(strTemp, pJobs[i].strOutput) == 0)) {
+            nDone++;
+        } else {
+            fprintf(stderr, "Couldn't regenerate \"%s\" with %s!\n", pJobs[i].strOutput, pDumpProgram);
+            unlink(strTemp);
+            bOK = FALSE;
+        }
+    }
+
+    printf("Regenerated %ld reports\n", nDone);
+    return bOK;
+}
+
+int RegenerateOutputs(STORE_JUMP *pAdded, long nNumAdded, const char *pStorePath, const char *pOutDir, int nWorkers)
+{
+    OUTPUT_JOB *pJobs;
+    long nNumJobs;
+    long i;
+    int bOK;
+
+    /* The plot of each jump added, however many copies of it came in, the summary
+        of each Neptune they're from, and the fleet's */
+    qsort(pAdded, nNumAdded, sizeof(STORE_JUMP), CompareAdded);
+    pJobs = NULL;
+    nNumJobs = 0;
+    bOK = TRUE;
+    for (i=0; ((bOK) && (i<nNumAdded)); i++) {
+        if ((i) && (CompareAdded(&pAdded[i-1], &pAdded[i]) == 0)) continue;
+        if ((i == 0) || (memcmp(pAdded[i-1].strSerialNo, pAdded[i].strSerialNo, STORE_SERIAL_SIZE) != 0))
+            bOK = AddJob(&pJobs, &nNumJobs, pOutDir, pAdded[i].strSerialNo, 0, "s");
+        if ((bOK) && (pAdded[i].nFlags & STORE_HAS_PROFILE))
+            bOK = AddJob(&pJobs, &nNumJobs, pOutDir, pAdded[i].strSerialNo, pAdded[i].nJumpNumber, "p");
+    }
+    if (bOK) bOK = AddJob(&pJobs, &nNumJobs, pOutDir, NULL, 0, "s");
+
+    if (bOK) bOK = RunJobs(pJobs, nNumJobs, pStorePath, nWorkers);
+    free(pJobs);
+    return bOK;
+}
+
+int WatchFolder(const char *pStorePath, const char *pDir, const char *pOutDir, int nWorkers)
+{
+    NEPTUNE_WATCH *pWatch;
+    NEPTUNE_STORE *pStore;
+    INGEST_STATE myState;
+    STORE_JUMP *pAdded;
+    char strPath[MAX_WATCH_PATH + MAX_WATCH_NAME];
+    uint32_t nFirst;
+    long nNumAdded;
+    long i;
+    int nResult;
+    int n;
+
+    pWatch = OpenWatch(pDir, WATCH_QUIET_SECS);
+    if (!pWatch) return -2;
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&myState, 0, sizeof(myState));
+    nResult = 0;
+    printf("Watching \"%s\"\n", pDir);
+    fflush(stdout);
+    while (!bQuit) {
+        n = NextWatchFile(pWatch, -1.0, strPath, sizeof(strPath));
+        if (n < 0) {
+            nResult = -7;
+            break;
+        }
+        if (n == 0) continue;
+
+        /* The store's only open while adding the files that are ready, so closing it
+            brings its indexes up to date for the reports, and it isn't locked while
+            nothing is landing */
+        pStore = OpenStore(pStorePath, TRUE);
+        if (!pStore) {
+            nResult = -2;
+            break;
+        }
+        pStore->pReport = stdout;
+        nFirst = pStore->nNumJumps;
+        do {
+            pStore->nAdded = 0;
+            pStore->nAddedProfiles = 0;
+            pStore->nSkipped = 0;
+            pStore->nConflicts = 0;
+            myState.nSessions = 0;
+            myState.nBadRecords = 0;
+            IngestPath(pStore, &myState, strPath);
+            printf("%s:  ", strPath);
+            ReportIngest(pStore, &myState);
+        } while ((!bQuit) && (NextWatchFile(pWatch, 0.0, strPath, sizeof(strPath)) > 0));
+
+        nNumAdded = pStore->nNumJumps - nFirst;
+        pAdded = NULL;
+        if ((pOutDir) && (nNumAdded)) {
+            pAdded = (STORE_JUMP *)malloc(nNumAdded * sizeof(STORE_JUMP));
+            if (!pAdded) nNumAdded = 0;
+            for (i=0; i<nNumAdded; i++) {
+                if (!ReadStoreJump(pStore, nFirst + i, &pAdded[i])) break;
+            }
+            nNumAdded = i;
+        }
+        if (!CloseStore(pStore)) nResult = -6;
+        if ((pAdded) && (nNumAdded)) RegenerateOutputs(pAdded, nNumAdded, pStorePath, pOutDir, nWorkers);
+        free(pAdded);
+        fflush(stdout);
+    }
+
+    CloseWatch(pWatch);
+    free(myState.session.pJumps);
+    free(myState.pProfiles);
+    return nResult;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    NEPTUNE_STORE *pStore;
+    INGEST_STATE myState;
+    STORE_QUERY myQuery;
+    const char *pWatchDir;
+    const char *pOutDir;
+    int nWorkers;
+    int bNeedHelp;
+    int bList;
+    int bExport;
+    int bCompact;
+    int nResult;
+    int opt;
+    int n;
+    int i;
+
+    /* Check Arguments */
+    bNeedHelp = FALSE;
+    bList = FALSE;
+    bExport = FALSE;
+    bCompact = FALSE;
+    pWatchDir = NULL;
+    pOutDir = NULL;
+    nWorkers = DEFAULT_WORKERS;
+    memset(&myQuery, 0, sizeof(myQuery));
+    myQuery.nJumpType = -1;
+
+    while ((opt = getopt(argc, argv, "lxcS:j:D:T:w:o:P:d:")) != -1) {
+        switch (opt) {
+            case 'l':
+                bList = TRUE;
+                break;
+            case 'x':
+                bExport = TRUE;
+                break;
+            case 'c':
+                bCompact = TRUE;
+                break;
+            case 'S':
+                if (strlen(optarg) > STORE_SERIAL_SIZE) bNeedHelp = TRUE;
+                SetStoreSerialNo(myQuery.strSerialNo, optarg);
+                break;
+            case 'j':
+                myQuery.nJumpNumber = strtoul(optarg, NULL, 0);
+                break;
+            case 'D':
+                if (!ParseStoreDates(optarg, &myQuery)) bNeedHelp = TRUE;
+                break;
+            case 'T':
+                myQuery.nJumpType = atoi(optarg);
+                if ((myQuery.nJumpType < 0) || (myQuery.nJumpType > 255)) bNeedHelp = TRUE;
+                break;
+            case 'w':
+                pWatchDir = optarg;
+                break;
+            case 'o':
+                pOutDir = optarg;
+                break;
+            case 'P':
+                nWorkers = atoi(optarg);
+                if (nWorkers < 1) bNeedHelp = TRUE;
+                break;
+            case 'd':
+                pDumpProgram = optarg;
+                break;
+            default:
+                bNeedHelp = TRUE;
+                break;
+        }
+    }
+    if ((bList) + (bExport) + (bCompact) + (pWatchDir != NULL) > 1) bNeedHelp = TRUE;
+    if (((bList) || (bExport) || (bCompact) || (pWatchDir)) ? (argc-optind != 1) : (argc-optind < 2)) bNeedHelp = TRUE;
+    if ((pOutDir) && (!pWatchDir)) bNeedHelp = TRUE;
+
+    if (bNeedHelp) {
+        fprintf(stderr, "Neptune Archive V%d.%02d\n", VERSION/100, VERSION%100);
+        fprintf(stderr, "Usage: neptune_archive <store> <input-file> [<input-file> ...]\n");
+        fprintf(stderr, "       neptune_archive -l|-x [<filters>] <store>\n");
+        fprintf(stderr, "       neptune_archive -c <store>\n");
+        fprintf(stderr, "       neptune_archive -w <dir> [-o <out-dir> [-P <workers>] [-d <neptune_dump>]] <store>\n\n");
+        fprintf(stderr, "       Adds the jumps in Neptune data files, which may be several\n");
+        fprintf(stderr, "       concatenated together, tar archives of them, and compressed,\n");
+        fprintf(stderr, "       to the store in directory <store>, creating it if need be.\n");
+        fprintf(stderr, "       The latest download of each jump of each Neptune is the one\n");
+        fprintf(stderr, "       reported on, and jumps already in the store are skipped.\n");
+        fprintf(stderr, "       neptune_dump reads a store directly.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "           -l = List the jumps in the store\n");
+        fprintf(stderr, "           -x = Write them to stdout as a Neptune data file\n");
+        fprintf(stderr, "           -c = Compact the store to the latest copy of each jump,\n");
+        fprintf(stderr, "                   listing the jumps whose copies disagreed\n");
+        fprintf(stderr, "           -w <dir> = Watch the directory, adding each *.nep file\n");
+        fprintf(stderr, "                   written or changed there once it's been left\n");
+        fprintf(stderr, "                   alone for %g seconds, and the ones already there\n", WATCH_QUIET_SECS);
+        fprintf(stderr, "           -o <out-dir> = Then regenerate the plot of each jump added,\n");
+        fprintf(stderr, "                   <serial>/<jump>.plt, and the summaries of its\n");
+        fprintf(stderr, "                   Neptune, <serial>/summary.txt, and the fleet,\n");
+        fprintf(stderr, "                   summary.txt, in <out-dir>\n");
+        fprintf(stderr, "           -P <workers> = neptune_dump processes run at once (default %d)\n", DEFAULT_WORKERS);
+        fprintf(stderr, "           -d <neptune_dump> = The neptune_dump to run (default %s)\n", pDumpProgram);
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Where <filters> are:\n");
+        fprintf(stderr, "           -S <serial> = Just the jumps of that Neptune\n");
+        fprintf(stderr, "           -j <jump> = Just that jump number\n");
+        fprintf(stderr, "           -D <from>[,<to>] = Just the jumps made on those dates\n");
+        fprintf(stderr, "                   (YYYYMMDD), either of which may be left off\n");
+        fprintf(stderr, "           -T <type> = Just that jump type, as recorded (0 = Group 1)\n");
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    if ((bList) || (bExport) || (bCompact)) {
+        if (!IsStore(argv[optind])) {
+            fprintf(stderr, "\"%s\" isn't a Neptune archive store!\n\n", argv[optind]);
+            return -2;
+        }
+        if (bCompact) return (CompactStore(argv[optind], stdout) ? 0 : -3);
+        pStore = OpenStore(argv[optind], FALSE);
+        if (!pStore) return -2;
+        nResult = 0;
+        if (bList) {
+            ListJumps(pStore, &myQuery);
+        } else if (!WriteStoreQuery(pStore, &myQuery, stdout)) {
+            nResult = -3;
+        }
+        CloseStore(pStore);
+        if (fflush(stdout) != 0) nResult = -3;
+        return nResult;
+    }
+
+    if (pWatchDir) return WatchFolder(argv[optind], pWatchDir, pOutDir, nWorkers);
+
+    pStore = OpenStore(argv[optind], TRUE);
+    if (!pStore) return -2;
+    pStore->pReport = stdout;
+
+    memset(&myState, 0, sizeof(myState));
+    nResult = 0;
+    for (i=optind+1; i<argc; i++) {
+        n = IngestPath(pStore, &myState, argv[i]);
+        if (n) nResult = n;
+    }
+
+    ReportIngest(pStore, &myState);
+    if (!CloseStore(pStore)) nResult = -6;
+
+    free(myState.session.pJumps);
+    free(myState.pProfiles);
+    return nResult;
+}
+
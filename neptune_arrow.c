@@ -0,0 +1,626 @@
+/*
+ * Neptune_Arrow
+ *
+ * This module writes tables as Apache Arrow IPC, either a file
+ * (Feather V2) or a stream, with the values of each column going
+ * out in record batches just as they are in memory.
+ *
+ * Each message is a flatbuffer of its metadata followed by the
+ * buffers of the batch.  The flatbuffers are built here from the
+ * back forwards, the way the flatbuffers library does, so that
+ * everything a table points to is already in place when the table
+ * is.  Arrow and flatbuffers are both little-endian, as is anything
+ * this runs on, so numbers go out as they are in memory.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "neptune_arrow.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define ARROW_MAGIC         "ARROW1"
+#define ARROW_CONTINUATION  0xFFFFFFFFu
+#define ARROW_VERSION       4           /* MetadataVersion V5 */
+
+#define ARROW_HEADER_SCHEMA 1           /* MessageHeader union */
+#define ARROW_HEADER_BATCH  3
+
+#define ARROW_TYPE_INT      2           /* Type union */
+#define ARROW_TYPE_FLOAT    3
+#define ARROW_TYPE_UTF8     5
+#define ARROW_TYPE_TIME     10
+
+#define FB_MAX_FIELDS       8           /* Fields of the largest table written */
+
+#define PAD8(n)             (((n) + 7) & ~7l)
+
+typedef struct fb_builder           /* A flatbuffer, built from its end at pBuf[nAlloc] back */
+{
+    uint8_t     *pBuf;
+    long        nAlloc;
+    long        nPos;                   /* Bytes built, so where things are, from the end */
+    long        nTableStart;
+    long        nFieldPos[FB_MAX_FIELDS];
+    int         nNumFields;
+    int         bError;
+} FB_BUILDER;
+
+/* Local Prototypes */
+static int GrowBuffer(ARROW_BUFFER *pBuffer, long nSize);
+static int AppendBuffer(ARROW_BUFFER *pBuffer, const void *pData, long nSize);
+static int TypeWidth(int nType);
+static int FbReserve(FB_BUILDER *pFb, long nSize);
+static void FbAlign(FB_BUILDER *pFb, long nSize, int nAlign);
+static long FbPush(FB_BUILDER *pFb, const void *pData, long nSize, int nAlign);
+static long FbString(FB_BUILDER *pFb, const char *pText);
+static long FbStructs(FB_BUILDER *pFb, const void *pData, long nCount, long nSize);
+static long FbOffsets(FB_BUILDER *pFb, const long *pTargets, long nCount);
+static void FbStartTable(FB_BUILDER *pFb);
+static void FbScalar(FB_BUILDER *pFb, int nId, const void *pValue, int nSize);
+static void FbOffset(FB_BUILDER *pFb, int nId, long nTarget);
+static long FbEndTable(FB_BUILDER *pFb);
+static void FbFinish(FB_BUILDER *pFb, long nRoot);
+static int WriteBytes(ARROW_WRITER *pWriter, const void *pData, long nSize);
+static int WritePadding(ARROW_WRITER *pWriter, long nSize);
+static long BuildSchema(FB_BUILDER *pFb, const ARROW_WRITER *pWriter);
+static long WriteMessage(ARROW_WRITER *pWriter, FB_BUILDER *pFb, int nHeaderType, long nHeader, int64_t nBodyLength);
+static void ResetColumn(ARROW_COLUMN *pColumn);
+
+/* ========================================================================== */
+
+static int GrowBuffer(ARROW_BUFFER *pBuffer, long nSize)
+{
+    uint8_t *pNew;
+    long nAlloc;
+
+    if (pBuffer->nSize + nSize <= pBuffer->nAlloc) return TRUE;
+    nAlloc = ((pBuffer->nAlloc) ? (pBuffer->nAlloc * 2) : 4096);
+    while (nAlloc < pBuffer->nSize + nSize) nAlloc *= 2;
+    pNew = (uint8_t *)realloc(pBuffer->pData, nAlloc);
+    if (!pNew) return FALSE;
+    pBuffer->pData = pNew;
+    pBuffer->nAlloc = nAlloc;
+    return TRUE;
+}
+
+static int AppendBuffer(ARROW_BUFFER *pBuffer, const void *pData, long nSize)
+{
+    if (!GrowBuffer(pBuffer, nSize)) return FALSE;
+    if (pData) {
+        memcpy(&pBuffer->pData[pBuffer->nSize], pData, nSize);
+    } else {
+        memset(&pBuffer->pData[pBuffer->nSize], 0, nSize);
+    }
+    pBuffer->nSize += nSize;
+    return TRUE;
+}
+
+static int TypeWidth(int nType)
+{
+    switch (nType) {
+        case ARROW_UINT8:
+            return 1;
+        case ARROW_INT32:
+        case ARROW_UINT32:
+            return 4;
+        case ARROW_FLOAT64:
+        case ARROW_TIMESTAMP:
+            return 8;
+    }
+    return 0;                           /* Strings */
+}
+
+/* ========================================================================== */
+
+static int FbReserve(FB_BUILDER *pFb, long nSize)
+{
+    uint8_t *pNew;
+    long nAlloc;
+
+    if (pFb->bError) return FALSE;
+    if (pFb->nPos + nSize <= pFb->nAlloc) return TRUE;
+
+    /* What's built moves to the end of the larger buffer */
+    nAlloc = ((pFb->nAlloc) ? (pFb->nAlloc * 2) : 1024);
+    while (nAlloc < pFb->nPos + nSize) nAlloc *= 2;
+    pNew = (uint8_t *)malloc(nAlloc);
+    if (!pNew) {
+        pFb->bError = TRUE;
+        return FALSE;
+    }
+    if (pFb->nPos) memcpy(&pNew[nAlloc - pFb->nPos], &pFb->pBuf[pFb->nAlloc - pFb->nPos], pFb->nPos);
+    free(pFb->pBuf);
+    pFb->pBuf = pNew;
+    pFb->nAlloc = nAlloc;
+    return TRUE;
+}
+
+static void FbAlign(FB_BUILDER *pFb, long nSize, int nAlign)
+{
+    /* Pads so what's pushed next, nSize bytes of it, starts aligned.  With the
+        finished buffer a multiple of 8 long, that's aligned in memory too */
+    long nPad;
+
+    nPad = (nAlign - ((pFb->nPos + nSize) % nAlign)) % nAlign;
+    if ((nPad) && (FbReserve(pFb, nPad))) {
+        pFb->nPos += nPad;
+        memset(&pFb->pBuf[pFb->nAlloc - pFb->nPos], 0, nPad);
+    }
+}
+
+static long FbPush(FB_BUILDER *pFb, const void *pData, long nSize, int nAlign)
+{
+    FbAlign(pFb, nSize, nAlign);
+    if (FbReserve(pFb, nSize)) {
+        pFb->nPos += nSize;
+        memcpy(&pFb->pBuf[pFb->nAlloc - pFb->nPos], pData, nSize);
+    }
+    return pFb->nPos;
+}
+
+static long FbString(FB_BUILDER *pFb, const char *pText)
+{
+    uint32_t nLen = strlen(pText);
+
+    FbAlign(pFb, nLen + 1, 4);
+    FbPush(pFb, pText, nLen + 1, 1);    /* With its terminator */
+    return FbPush(pFb, &nLen, 4, 4);
+}
+
+static long FbStructs(FB_BUILDER *pFb, const void *pData, long nCount, long nSize)
+{
+    /* A vector of structures, each holding 8-byte numbers, after its count */
+    uint32_t nLen = nCount;
+
+    FbAlign(pFb, nCount * nSize, 8);
+    if (nCount) FbPush(pFb, pData, nCount * nSize, 1);
+    return FbPush(pFb, &nLen, 4, 4);
+}
+
+static long FbOffsets(FB_BUILDER *pFb, const long *pTargets, long nCount)
+{
+    /* A vector of offsets, each from itself to what it points to */
+    uint32_t nLen = nCount;
+    uint32_t nOffset;
+    long i;
+
+    for (i=nCount-1; i>=0; i--) {
+        FbAlign(pFb, 4, 4);
+        nOffset = pFb->nPos + 4 - pTargets[i];
+        FbPush(pFb, &nOffset, 4, 4);
+    }
+    return FbPush(pFb, &nLen, 4, 4);
+}
+
+static void FbStartTable(FB_BUILDER *pFb)
+{
+    memset(pFb->nFieldPos, 0, sizeof(pFb->nFieldPos));
+    pFb->nNumFields = 0;
+    pFb->nTableStart = pFb->nPos;
+}
+
+static void FbScalar(FB_BUILDER *pFb, int nId, const void *pValue, int nSize)
+{
+    pFb->nFieldPos[nId] = FbPush(pFb, pValue, nSize, nSize);
+    if (nId >= pFb->nNumFields) pFb->nNumFields = nId + 1;
+}
+
+static void FbOffset(FB_BUILDER *pFb, int nId, long nTarget)
+{
+    uint32_t nOffset;
+
+    FbAlign(pFb, 4, 4);
+    nOffset = pFb->nPos + 4 - nTarget;
+    FbScalar(pFb, nId, &nOffset, 4);
+}
+
+static long FbEndTable(FB_BUILDER *pFb)
+{
+    uint16_t vtable[2 + FB_MAX_FIELDS];
+    int32_t nVTable;
+    long nTable;
+    int i;
+
+    /* The table starts with where its vtable is, which is pushed right before it */
+    nVTable = 0;
+    nTable = FbPush(pFb, &nVTable, 4, 4);
+    vtable[0] = (2 + pFb->nNumFields) * 2;
+    vtable[1] = nTable - pFb->nTableStart;
+    for (i=0; i<pFb->nNumFields; i++) {
+        vtable[2+i] = ((pFb->nFieldPos[i]) ? (nTable - pFb->nFieldPos[i]) : 0);
+    }
+    nVTable = FbPush(pFb, vtable, vtable[0], 2) - nTable;
+    if (!pFb->bError) memcpy(&pFb->pBuf[pFb->nAlloc - nTable], &nVTable, 4);
+    return nTable;
+}
+
+static void FbFinish(FB_BUILDER *pFb, long nRoot)
+{
+    uint32_t nOffset;
+
+    FbAlign(pFb, 4, 8);
+    nOffset = pFb->nPos + 4 - nRoot;
+    FbPush(pFb, &nOffset, 4, 4);
+}
+
+/* ========================================================================== */
+
+static int WriteBytes(ARROW_WRITER *pWriter, const void *pData, long nSize)
+{
+    if ((nSize) && (fwrite(pData, 1, nSize, pWriter->pOutFile) != (size_t)nSize)) pWriter->bError = TRUE;
+    pWriter->nOffset += nSize;
+    return (!pWriter->bError);
+}
+
+static int WritePadding(ARROW_WRITER *pWriter, long nSize)
+{
+    static const uint8_t zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    return WriteBytes(pWriter, zeros, nSize);
+}
+
+static long BuildSchema(FB_BUILDER *pFb, const ARROW_WRITER *pWriter)
+{
+    long nFields[MAX_ARROW_FIELDS];
+    long nName;
+    long nType;
+    long nChildren;
+    uint8_t nTypeType;
+    uint8_t bTrue = TRUE;
+    int32_t nBitWidth;
+    int16_t nShort;
+    int i;
+
+    for (i=0; i<pWriter->nNumFields; i++) {
+        nName = FbString(pFb, pWriter->pFields[i].pName);
+        FbStartTable(pFb);
+        switch (pWriter->pFields[i].nType) {
+            case ARROW_UINT8:
+            case ARROW_INT32:
+            case ARROW_UINT32:
+                nTypeType = ARROW_TYPE_INT;
+                nBitWidth = TypeWidth(pWriter->pFields[i].nType) * 8;
+                FbScalar(pFb, 0, &nBitWidth, 4);
+                if (pWriter->pFields[i].nType == ARROW_INT32) FbScalar(pFb, 1, &bTrue, 1);
+                break;
+            case ARROW_FLOAT64:
+                nTypeType = ARROW_TYPE_FLOAT;
+                nShort = 2;                 /* DOUBLE */
+                FbScalar(pFb, 0, &nShort, 2);
+                break;
+            case ARROW_TIMESTAMP:
+                nTypeType = ARROW_TYPE_TIME;
+                nShort = 0;                 /* SECOND */
+                FbScalar(pFb, 0, &nShort, 2);
+                break;
+            default:
+                nTypeType = ARROW_TYPE_UTF8;
+                break;
+        }
+        nType = FbEndTable(pFb);
+        nChildren = FbOffsets(pFb, NULL, 0);
+
+        FbStartTable(pFb);
+        FbOffset(pFb, 0, nName);
+        FbScalar(pFb, 1, &bTrue, 1);        /* nullable */
+        FbScalar(pFb, 2, &nTypeType, 1);
+        FbOffset(pFb, 3, nType);
+        FbOffset(pFb, 5, nChildren);
+        nFields[i] = FbEndTable(pFb);
+    }
+    nName = FbOffsets(pFb, nFields, pWriter->nNumFields);
+
+    FbStartTable(pFb);
+    nShort = 0;                             /* Little-endian */
+    FbScalar(pFb, 0, &nShort, 2);
+    FbOffset(pFb, 1, nName);
+    return FbEndTable(pFb);
+}
+
+static long WriteMessage(ARROW_WRITER *pWriter, FB_BUILDER *pFb, int nHeaderType, long nHeader, int64_t nBodyLength)
+{
+    /* Writes the message around its header, returning the bytes before its body */
+    uint32_t prefix[2];
+    uint8_t nType = nHeaderType;
+    int16_t nVersion = ARROW_VERSION;
+
+    FbStartTable(pFb);
+    FbScalar(pFb, 3, &nBodyLength, 8);
+    FbOffset(pFb, 2, nHeader);
+    FbScalar(pFb, 0, &nVersion, 2);
+    FbScalar(pFb, 1, &nType, 1);
+    FbFinish(pFb, FbEndTable(pFb));
+    if (pFb->bError) {
+        pWriter->bError = TRUE;
+        return 0;
+    }
+
+    prefix[0] = ARROW_CONTINUATION;
+    prefix[1] = pFb->nPos;
+    WriteBytes(pWriter, prefix, sizeof(prefix));
+    WriteBytes(pWriter, &pFb->pBuf[pFb->nAlloc - pFb->nPos], pFb->nPos);
+    return sizeof(prefix) + pFb->nPos;
+}
+
+static void ResetColumn(ARROW_COLUMN *pColumn)
+{
+    int32_t nZero = 0;
+
+    pColumn->values.nSize = 0;
+    pColumn->offsets.nSize = 0;
+    pColumn->validity.nSize = 0;
+    pColumn->nCount = 0;
+    pColumn->nNulls = 0;
+    AppendBuffer(&pColumn->offsets, &nZero, 4);     /* Strings start at 0 */
+}
+
+/* ========================================================================== */
+
+int OpenArrow(ARROW_WRITER *pWriter, FILE *pOutFile, const ARROW_FIELD *pFields, int nNumFields, int bStream)
+{
+    static const uint16_t nEndian = 1;
+    FB_BUILDER myFb;
+    int i;
+
+    memset(pWriter, 0, sizeof(ARROW_WRITER));
+    if ((nNumFields > MAX_ARROW_FIELDS) || (*(const uint8_t *)&nEndian != 1)) return FALSE;
+    pWriter->pOutFile = pOutFile;
+    pWriter->bStream = bStream;
+    pWriter->pFields = pFields;
+    pWriter->nNumFields = nNumFields;
+    for (i=0; i<nNumFields; i++) ResetColumn(&pWriter->columns[i]);
+
+    if (!bStream) {
+        WriteBytes(pWriter, ARROW_MAGIC, 6);
+        WritePadding(pWriter, 2);
+    }
+    memset(&myFb, 0, sizeof(myFb));
+    WriteMessage(pWriter, &myFb, ARROW_HEADER_SCHEMA, BuildSchema(&myFb, pWriter), 0);
+    free(myFb.pBuf);
+
+    return (!pWriter->bError);
+}
+
+int ArrowValue(ARROW_WRITER *pWriter, int nField, const void *pValue)
+{
+    ARROW_COLUMN *pColumn = &pWriter->columns[nField];
+    int32_t nEnd;
+    int nWidth;
+    long i;
+
+    /* Every value is valid until the first null */
+    if ((!pValue) && (pColumn->nNulls == 0)) {
+        if (!GrowBuffer(&pColumn->validity, PAD8(pColumn->nCount/8 + 1))) {
+            pWriter->bError = TRUE;
+            return FALSE;
+        }
+        pColumn->validity.nSize = pColumn->nCount/8 + 1;
+        memset(pColumn->validity.pData, 0xFF, pColumn->validity.nSize);
+    }
+    if ((pColumn->nNulls) || (!pValue)) {
+        i = pColumn->nCount;
+        if ((i/8 >= pColumn->validity.nSize) && (!AppendBuffer(&pColumn->validity, NULL, 1))) {
+            pWriter->bError = TRUE;
+            return FALSE;
+        }
+        if (pValue) {
+            pColumn->validity.pData[i/8] |= (1 << (i%8));
+        } else {
+            pColumn->validity.pData[i/8] &= ~(1 << (i%8));
+            pColumn->nNulls++;
+        }
+    }
+
+    nWidth = TypeWidth(pWriter->pFields[nField].nType);
+    if (nWidth) {
+        if (!AppendBuffer(&pColumn->values, pValue, nWidth)) pWriter->bError = TRUE;
+    } else {
+        if ((pValue) && (!AppendBuffer(&pColumn->values, pValue, strlen((const char *)pValue))))
+            pWriter->bError = TRUE;
+        nEnd = pColumn->values.nSize;
+        if (!AppendBuffer(&pColumn->offsets, &nEnd, 4)) pWriter->bError = TRUE;
+    }
+    pColumn->nCount++;
+    return (!pWriter->bError);
+}
+
+int ArrowValues(ARROW_WRITER *pWriter, int nField, const void *pValues, long nCount, long nStride)
+{
+    ARROW_COLUMN *pColumn = &pWriter->columns[nField];
+    const uint8_t *pValue = (const uint8_t *)pValues;
+    uint8_t *pOut;
+    int nWidth;
+    long i;
+
+    nWidth = TypeWidth(pWriter->pFields[nField].nType);
+    if ((!nWidth) || (pColumn->nNulls)) {
+        for (i=0; ((i<nCount) && (!pWriter->bError)); i++) ArrowValue(pWriter, nField, &pValue[i*nStride]);
+        return (!pWriter->bError);
+    }
+
+    if (!GrowBuffer(&pColumn->values, nCount * nWidth)) {
+        pWriter->bError = TRUE;
+        return FALSE;
+    }
+    pOut = &pColumn->values.pData[pColumn->values.nSize];
+    if (nStride == nWidth) {
+        memcpy(pOut, pValue, nCount * nWidth);
+    } else {
+        for (i=0; i<nCount; i++) memcpy(&pOut[i*nWidth], &pValue[i*nStride], nWidth);
+    }
+    pColumn->values.nSize += nCount * nWidth;
+    pColumn->nCount += nCount;
+    return TRUE;
+}
+
+long ArrowRows(const ARROW_WRITER *pWriter)
+{
+    return ((pWriter->nNumFields) ? pWriter->columns[0].nCount : 0);
+}
+
+int WriteArrowBatch(ARROW_WRITER *pWriter)
+{
+    int64_t nodes[MAX_ARROW_FIELDS][2];         /* FieldNode: length, null count */
+    int64_t buffers[MAX_ARROW_FIELDS*3][2];     /* Buffer: offset, length in the body */
+    const ARROW_BUFFER *pBody[MAX_ARROW_FIELDS*3];
+    ARROW_COLUMN *pColumn;
+    ARROW_BLOCK *pNew;
+    FB_BUILDER myFb;
+    int64_t nRows;
+    int64_t nBodyLength;
+    int64_t nStart;
+    long nNodes;
+    long nBuffers;
+    long nMeta;
+    int nBuffer;
+    int i;
+
+    nRows = ArrowRows(pWriter);
+    if ((nRows == 0) || (pWriter->bError)) return (!pWriter->bError);
+
+    /* Each column's validity, offsets for strings, and values, each padded to 8 bytes */
+    nBodyLength = 0;
+    nBuffer = 0;
+    for (i=0; i<pWriter->nNumFields; i++) {
+        pColumn = &pWriter->columns[i];
+        if (pColumn->nCount != nRows) {
+            pWriter->bError = TRUE;
+            return FALSE;
+        }
+        nodes[i][0] = nRows;
+        nodes[i][1] = pColumn->nNulls;
+        pBody[nBuffer] = ((pColumn->nNulls) ? &pColumn->validity : NULL);
+        buffers[nBuffer][0] = nBodyLength;
+        buffers[nBuffer][1] = ((pColumn->nNulls) ? (nRows+7)/8 : 0);
+        nBodyLength += PAD8(buffers[nBuffer++][1]);
+        if (!TypeWidth(pWriter->pFields[i].nType)) {
+            pBody[nBuffer] = &pColumn->offsets;
+            buffers[nBuffer][0] = nBodyLength;
+            buffers[nBuffer][1] = pColumn->offsets.nSize;
+            nBodyLength += PAD8(buffers[nBuffer++][1]);
+        }
+        pBody[nBuffer] = &pColumn->values;
+        buffers[nBuffer][0] = nBodyLength;
+        buffers[nBuffer][1] = pColumn->values.nSize;
+        nBodyLength += PAD8(buffers[nBuffer++][1]);
+    }
+
+    memset(&myFb, 0, sizeof(myFb));
+    nNodes = FbStructs(&myFb, nodes, pWriter->nNumFields, sizeof(nodes[0]));
+    nBuffers = FbStructs(&myFb, buffers, nBuffer, sizeof(buffers[0]));
+    FbStartTable(&myFb);
+    FbScalar(&myFb, 0, &nRows, 8);
+    FbOffset(&myFb, 1, nNodes);
+    FbOffset(&myFb, 2, nBuffers);
+    nStart = pWriter->nOffset;
+    nMeta = WriteMessage(pWriter, &myFb, ARROW_HEADER_BATCH, FbEndTable(&myFb), nBodyLength);
+    free(myFb.pBuf);
+
+    for (i=0; i<nBuffer; i++) {
+        if (!pBody[i]) continue;
+        WriteBytes(pWriter, pBody[i]->pData, buffers[i][1]);
+        WritePadding(pWriter, PAD8(buffers[i][1]) - buffers[i][1]);
+    }
+
+    /* The footer of a file lists every batch */
+    if (!pWriter->bStream) {
+        if (pWriter->nNumBlocks >= pWriter->nBlockAlloc) {
+            pNew = (ARROW_BLOCK *)realloc(pWriter->pBlocks, (pWriter->nBlockAlloc + 256) * sizeof(ARROW_BLOCK));
+            if (!pNew) {
+                pWriter->bError = TRUE;
+                return FALSE;
+            }
+            pWriter->pBlocks = pNew;
+            pWriter->nBlockAlloc += 256;
+        }
+        pWriter->pBlocks[pWriter->nNumBlocks].nOffset = nStart;
+        pWriter->pBlocks[pWriter->nNumBlocks].nMetaDataLength = nMeta;
+        pWriter->pBlocks[pWriter->nNumBlocks].nBodyLength = nBodyLength;
+        pWriter->nNumBlocks++;
+    }
+
+    for (i=0; i<pWriter->nNumFields; i++) ResetColumn(&pWriter->columns[i]);
+    return (!pWriter->bError);
+}
+
+int CloseArrow(ARROW_WRITER *pWriter)
+{
+    static const uint32_t EndMarker[2] = { ARROW_CONTINUATION, 0 };
+    uint8_t *pBlocks;
+    FB_BUILDER myFb;
+    int16_t nVersion = ARROW_VERSION;
+    long nSchema;
+    long nBatches;
+    uint32_t nFooter;
+    long i;
+
+    WriteArrowBatch(pWriter);
+    WriteBytes(pWriter, EndMarker, sizeof(EndMarker));
+
+    /* A file ends with its schema again and where its batches are */
+    if (!pWriter->bStream) {
+        memset(&myFb, 0, sizeof(myFb));
+        pBlocks = (uint8_t *)calloc(pWriter->nNumBlocks + 1, 24);
+        if (pBlocks) {
+            for (i=0; i<pWriter->nNumBlocks; i++) {
+                memcpy(&pBlocks[i*24], &pWriter->pBlocks[i].nOffset, 8);
+                memcpy(&pBlocks[i*24+8], &pWriter->pBlocks[i].nMetaDataLength, 4);
+                memcpy(&pBlocks[i*24+16], &pWriter->pBlocks[i].nBodyLength, 8);
+            }
+            nSchema = BuildSchema(&myFb, pWriter);
+            nBatches = FbStructs(&myFb, pBlocks, pWriter->nNumBlocks, 24);
+            FbStartTable(&myFb);
+            FbOffset(&myFb, 1, nSchema);
+            FbOffset(&myFb, 3, nBatches);
+            FbScalar(&myFb, 0, &nVersion, 2);
+            FbFinish(&myFb, FbEndTable(&myFb));
+            free(pBlocks);
+        }
+        if ((!pBlocks) || (myFb.bError)) {
+            pWriter->bError = TRUE;
+        } else {
+            nFooter = myFb.nPos;
+            WriteBytes(pWriter, &myFb.pBuf[myFb.nAlloc - myFb.nPos], myFb.nPos);
+            WriteBytes(pWriter, &nFooter, 4);
+            WriteBytes(pWriter, ARROW_MAGIC, 6);
+        }
+        free(myFb.pBuf);
+    }
+
+    for (i=0; i<pWriter->nNumFields; i++) {
+        free(pWriter->columns[i].values.pData);
+        free(pWriter->columns[i].offsets.pData);
+        free(pWriter->columns[i].validity.pData);
+    }
+    free(pWriter->pBlocks);
+    pWriter->pBlocks = NULL;
+    pWriter->nNumFields = 0;
+
+    if (fflush(pWriter->pOutFile) != 0) pWriter->bError = TRUE;
+    return (!pWriter->bError);
+}
+
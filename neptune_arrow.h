@@ -0,0 +1,110 @@
+/*
+ * Neptune_Arrow
+ *
+ * This module writes tables as Apache Arrow IPC, either a file
+ * (Feather V2) or a stream, with the values of each column going
+ * out in record batches just as they are in memory.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_ARROW_H_
+#define _NEPTUNE_ARROW_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define MAX_ARROW_FIELDS    32
+
+/* Column types, with the C type their values are given as */
+#define ARROW_UINT8         0           /* uint8_t */
+#define ARROW_INT32         1           /* int32_t */
+#define ARROW_UINT32        2           /* uint32_t */
+#define ARROW_FLOAT64       3           /* double */
+#define ARROW_TIMESTAMP     4           /* int64_t, seconds since 1970 without a time zone */
+#define ARROW_UTF8          5           /* const char * */
+
+typedef struct arrow_field
+{
+    const char  *pName;
+    int         nType;                  /* ARROW_xxx */
+} ARROW_FIELD;
+
+typedef struct arrow_buffer
+{
+    uint8_t     *pData;
+    long        nSize;
+    long        nAlloc;
+} ARROW_BUFFER;
+
+typedef struct arrow_column         /* Values of a column waiting for the next batch */
+{
+    ARROW_BUFFER values;                /* Or the characters of strings */
+    ARROW_BUFFER offsets;               /* Where each string starts, and the end of the last */
+    ARROW_BUFFER validity;              /* A bit for each value, once one is null */
+    long        nCount;
+    long        nNulls;
+} ARROW_COLUMN;
+
+typedef struct arrow_block          /* A record batch written, for the footer of a file */
+{
+    int64_t     nOffset;
+    int32_t     nMetaDataLength;
+    int64_t     nBodyLength;
+} ARROW_BLOCK;
+
+typedef struct arrow_writer
+{
+    FILE        *pOutFile;
+    int         bStream;                /* Writing a stream rather than a file */
+    const ARROW_FIELD *pFields;
+    int         nNumFields;
+    ARROW_COLUMN columns[MAX_ARROW_FIELDS];
+    int64_t     nOffset;                /* Bytes written */
+    ARROW_BLOCK *pBlocks;
+    long        nNumBlocks;
+    long        nBlockAlloc;
+    int         bError;                 /* Something couldn't be written */
+} ARROW_WRITER;
+
+/* OpenArrow - Starts writing a table with the nNumFields columns pFields, which are
+        kept rather than copied, to pOutFile, as an IPC stream if bStream, or
+        otherwise as a file.  Returns FALSE if it couldn't be started */
+extern int OpenArrow(ARROW_WRITER *pWriter, FILE *pOutFile, const ARROW_FIELD *pFields, int nNumFields, int bStream);
+
+/* ArrowValue - Adds a value to column nField, pValue pointing to it as the C type of
+        the column (a string itself for ARROW_UTF8), or NULL for a null */
+extern int ArrowValue(ARROW_WRITER *pWriter, int nField, const void *pValue);
+
+/* ArrowValues - Adds nCount values to the fixed-width column nField, straight from an
+        array of them nStride bytes apart, such as one field of an array of
+        structures */
+extern int ArrowValues(ARROW_WRITER *pWriter, int nField, const void *pValues, long nCount, long nStride);
+
+/* ArrowRows - Returns the number of rows waiting for the next batch */
+extern long ArrowRows(const ARROW_WRITER *pWriter);
+
+/* WriteArrowBatch - Writes the rows added since the last batch as a record batch.
+        Every column must have the same number of values */
+extern int WriteArrowBatch(ARROW_WRITER *pWriter);
+
+/* CloseArrow - Writes any rows still waiting and finishes the stream or file,
+        returning FALSE if anything couldn't be written */
+extern int CloseArrow(ARROW_WRITER *pWriter);
+
+#endif  /* _NEPTUNE_ARROW_H_ */
+
@@ -0,0 +1,405 @@
+/*
+ * Neptune_Bench
+ *
+ * This app measures how fast Neptune data files are read and
+ * reported on, so changes to the parsing and report code can be
+ * judged by numbers.  It times the record parsing functions
+ * (ConvHexByte, ReadHexChar and GetNextRecord) directly, and each
+ * of neptune_dump's reports, which is where ReadJumpData's speed
+ * computation and the profile and gnuplot emitters are run, as a
+ * whole, giving the throughput of each in MB/s and records/s.
+ * Use neptune_gen to write files big enough to measure.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "neptune_rec.h"
+#include "neptune_stream.h"
+
+/* Defines */
+#define VERSION 100
+#define SAMPLE_SIZE         (32*1024*1024)  /* Most of a file held in memory for the hex conversion runs */
+#define MIN_RUN_TIME        0.25            /* Seconds:  Small files are run over and over for at least this long */
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Custom Types */
+typedef struct bench_file
+{
+    const char  *pFilename;
+    double      nSize;              /* Bytes in the (uncompressed) file */
+    double      nRecords;           /* Records in it, good or bad */
+    double      nBadRecords;
+    unsigned char *pSample;         /* The first lines of the file, up to SAMPLE_SIZE */
+    long        nSampleSize;
+    long        nSampleLines;
+} BENCH_FILE;
+
+typedef int (*BENCH_FUNC)(BENCH_FILE *pFile, const void *pArg);
+
+typedef struct dump_report
+{
+    const char  *pName;
+    const char  *pType;             /* neptune_dump <dump-type> */
+    const char  *pSubTypes;
+} DUMP_REPORT;
+
+/* Globals */
+static const char *pDumpProgram = "./neptune_dump";
+static volatile unsigned long nSink;        /* Keeps the conversions from being optimized away */
+
+static const DUMP_REPORT DumpReports[] = {
+    { "neptune_dump summary",           "s", "" },
+    { "neptune_dump detail",            "d", "" },
+    { "ReadJumpData+PrintProfile tab",  "t", "" },
+    { "ReadJumpData+PrintProfile csv",  "c", "" },
+    { "ReadJumpData+PrintGnuPlot",      "p", "ats" },
+};
+
+#define NUM_DUMP_REPORTS    (sizeof(DumpReports)/sizeof(DumpReports[0]))
+
+/* Prototypes */
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
+int ReadLine(void *pSource, DATA_REC *pRecord);
+double Now(void);
+int LoadFile(BENCH_FILE *pFile);
+int BenchConvHexByte(BENCH_FILE *pFile, const void *pArg);
+int BenchReadHexChar(BENCH_FILE *pFile, const void *pArg);
+int BenchGetNextRecord(BENCH_FILE *pFile, const void *pArg);
+int BenchDumpReport(BENCH_FILE *pFile, const void *pArg);
+int RunBench(const char *pName, BENCH_FUNC pFunc, BENCH_FILE *pFile, const void *pArg,
+                double nBytes, double nRecords, int nRepeat);
+
+/* ========================================================================== */
+
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
+{
+    return (ReadStreamLine((NEPTUNE_STREAM*)pSource, pBuff, nBufSize) > 0);
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    if (!ReadString(pSource, pRecord->buff, sizeof(pRecord->buff))) return FALSE;
+    pRecord->data = pRecord->buff;
+    pRecord->dwSize = strlen((char*)pRecord->buff);
+    return TRUE;
+}
+
+double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ========================================================================== */
+
+/* LoadFile - Reads the file through once, to size it up and count its records,
+        keeping the first SAMPLE_SIZE bytes of it for the hex conversion runs */
+int LoadFile(BENCH_FILE *pFile)
+{
+    NEPTUNE_STREAM *pStream;
+    unsigned char databuff[MAX_RECORD_SIZE];
+    long nLen;
+    int type;
+
+    pFile->pSample = (unsigned char *)malloc(SAMPLE_SIZE);
+    if (!pFile->pSample) {
+        fprintf(stderr, "Out of memory!\n");
+        return FALSE;
+    }
+    pFile->nSampleSize = 0;
+    pFile->nSampleLines = 0;
+
+    pStream = OpenInputStream(pFile->pFilename);
+    if (!pStream) {
+        fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pFile->pFilename);
+        return FALSE;
+    }
+    while ((nLen = ReadStreamLine(pStream, databuff, sizeof(databuff))) > 0) {
+        if (pFile->nSampleSize + nLen > SAMPLE_SIZE) break;
+        memcpy(pFile->pSample + pFile->nSampleSize, databuff, nLen);
+        pFile->nSampleSize += nLen;
+        pFile->nSampleLines++;
+    }
+    CloseInputStream(pStream);
+
+    pFile->nRecords = 0;
+    pFile->nBadRecords = 0;
+    pStream = OpenInputStream(pFile->pFilename);
+    if (!pStream) return FALSE;
+    while ((type = GetNextRecord(pStream, databuff)) != -1) {
+        if (type == -4) continue;       /* Just the header of the next download in the file */
+        pFile->nRecords++;
+        if (type < 0) pFile->nBadRecords++;
+    }
+    pFile->nSize = pStream->nOffset;
+    if (!CloseInputStream(pStream)) {
+        fprintf(stderr, "\"%s\" is corrupt!\n\n", pFile->pFilename);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+int BenchConvHexByte(BENCH_FILE *pFile, const void *pArg)
+{
+    const unsigned char *pLine;
+    const unsigned char *pEnd;
+    const unsigned char *pNext;
+    unsigned long nSum;
+    long i;
+
+    /* Every hex pair of every line, as GetNextRecord() decodes them */
+    nSum = 0;
+    pLine = pFile->pSample;
+    pEnd = pFile->pSample + pFile->nSampleSize;
+    while (pLine < pEnd) {
+        pNext = memchr(pLine, '\n', pEnd - pLine);
+        pNext = (pNext ? pNext + 1 : pEnd);
+        for (i=0; i+2<=(pNext-pLine); i+=3)
+            nSum += ConvHexByte(pLine + i);
+        pLine = pNext;
+    }
+    nSink += nSum;
+
+    return TRUE;
+}
+
+int BenchReadHexChar(BENCH_FILE *pFile, const void *pArg)
+{
+    DATA_REC myRecord;
+    unsigned char hexbyte[4];
+    const unsigned char *pEnd;
+    const unsigned char *pNext;
+    unsigned long nSum;
+    int c;
+
+    nSum = 0;
+    myRecord.data = pFile->pSample;
+    pEnd = pFile->pSample + pFile->nSampleSize;
+    while (myRecord.data < pEnd) {
+        pNext = memchr(myRecord.data, '\n', pEnd - myRecord.data);
+        pNext = (pNext ? pNext + 1 : pEnd);
+        myRecord.dwSize = pNext - myRecord.data;
+        myRecord.dwReturned = 0;
+        while ((c = ReadHexChar(&myRecord, hexbyte)) != -1)
+            nSum += c;
+        myRecord.data = pNext;
+    }
+    nSink += nSum;
+
+    return TRUE;
+}
+
+int BenchGetNextRecord(BENCH_FILE *pFile, const void *pArg)
+{
+    NEPTUNE_STREAM *pStream;
+    unsigned char databuff[MAX_RECORD_SIZE];
+    unsigned long nSum;
+    int type;
+
+    pStream = OpenInputStream(pFile->pFilename);
+    if (!pStream) {
+        fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pFile->pFilename);
+        return FALSE;
+    }
+    nSum = 0;
+    while ((type = GetNextRecord(pStream, databuff)) != -1)
+        nSum += type;
+    nSink += nSum;
+
+    return CloseInputStream(pStream);
+}
+
+int BenchDumpReport(BENCH_FILE *pFile, const void *pArg)
+{
+    const DUMP_REPORT *pReport = (const DUMP_REPORT *)pArg;
+    pid_t nPid;
+    int nStatus;
+    int fd;
+
+    nPid = fork();
+    if (nPid < 0) {
+        perror("Starting neptune_dump ");
+        return FALSE;
+    }
+    if (nPid == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        /* -n, so every run reads the file rather than timing the cache */
+        if (pReport->pSubTypes[0]) {
+            execl(pDumpProgram, pDumpProgram, "-n", "0", pReport->pType, pReport->pSubTypes,
+                    pFile->pFilename, (char *)NULL);
+        } else {
+            execl(pDumpProgram, pDumpProgram, "-n", "0", pReport->pType, pFile->pFilename, (char *)NULL);
+        }
+        _exit(127);
+    }
+
+    if ((waitpid(nPid, &nStatus, 0) != nPid) || (!WIFEXITED(nStatus)) ||
+        (WEXITSTATUS(nStatus) != 0)) {
+        fprintf(stderr, "\"%s -n 0 %s %s\" failed!\n", pDumpProgram, pReport->pType, pFile->pFilename);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+/* RunBench - Times nRepeat runs of pFunc, each over and over for at least
+        MIN_RUN_TIME, and prints the best throughput of them */
+int RunBench(const char *pName, BENCH_FUNC pFunc, BENCH_FILE *pFile, const void *pArg,
+                double nBytes, double nRecords, int nRepeat)
+{
+    double nStart;
+    double nTime;
+    double nBest;
+    long nPasses;
+    int i;
+
+    nBest = 0;
+    for (i=0; i<nRepeat; i++) {
+        nPasses = 0;
+        nStart = Now();
+        do {
+            if (!pFunc(pFile, pArg)) return FALSE;
+            nPasses++;
+            nTime = Now() - nStart;
+        } while (nTime < MIN_RUN_TIME);
+        nTime /= nPasses;
+        if ((i == 0) || (nTime < nBest)) nBest = nTime;
+    }
+
+    if (nBest <= 0) nBest = 1e-9;
+    printf("    %-32s %10.6f s %10.2f MB/s %12.0f rec/s\n", pName, nBest,
+                nBytes / nBest / (1024*1024), nRecords / nBest);
+    fflush(stdout);
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    BENCH_FILE myFile;
+    int nRepeat;
+    int bNoDump;
+    int bNeedHelp;
+    int bOK;
+    int opt;
+    int i;
+    unsigned int j;
+
+    /* Check Arguments */
+    nRepeat = 3;
+    bNoDump = FALSE;
+    bNeedHelp = FALSE;
+
+    while ((opt = getopt(argc, argv, "r:d:x")) != -1) {
+        switch (opt) {
+            case 'r':
+                nRepeat = atoi(optarg);
+                break;
+            case 'd':
+                pDumpProgram = optarg;
+                break;
+            case 'x':
+                bNoDump = TRUE;
+                break;
+            default:
+                bNeedHelp = TRUE;
+                break;
+        }
+    }
+    if ((argc-optind < 1) || (nRepeat < 1)) bNeedHelp = TRUE;
+
+    if (bNeedHelp) {
+        fprintf(stderr, "Neptune Bench V%d.%02d\n", VERSION/100, VERSION%100);
+        fprintf(stderr, "Usage: neptune_bench [<options>] <neptune-file> [<neptune-file> ...]\n\n");
+        fprintf(stderr, "       Times the record parsing and each neptune_dump report on\n");
+        fprintf(stderr, "       the files, printing the best throughput of several runs.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Where <options> are:\n");
+        fprintf(stderr, "           -r <runs> = Number of timed runs of each (default 3)\n");
+        fprintf(stderr, "           -d <neptune_dump> = The neptune_dump to time (default %s)\n", pDumpProgram);
+        fprintf(stderr, "           -x = Only time the record parsing, not neptune_dump\n");
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    bOK = TRUE;
+    for (i=optind; i<argc; i++) {
+        memset(&myFile, 0, sizeof(myFile));
+        myFile.pFilename = argv[i];
+        if (!LoadFile(&myFile)) {
+            free(myFile.pSample);
+            bOK = FALSE;
+            continue;
+        }
+
+        printf("%s:  %.2f MB, %.0f records (%.0f bad)\n", myFile.pFilename,
+                    myFile.nSize / (1024*1024), myFile.nRecords, myFile.nBadRecords);
+        fflush(stdout);
+
+        if ((!RunBench("ConvHexByte", BenchConvHexByte, &myFile, NULL,
+                        myFile.nSampleSize, myFile.nSampleLines, nRepeat)) ||
+            (!RunBench("ReadHexChar", BenchReadHexChar, &myFile, NULL,
+                        myFile.nSampleSize, myFile.nSampleLines, nRepeat)) ||
+            (!RunBench("GetNextRecord", BenchGetNextRecord, &myFile, NULL,
+                        myFile.nSize, myFile.nRecords, nRepeat))) bOK = FALSE;
+
+        for (j=0; ((!bNoDump) && (j<NUM_DUMP_REPORTS)); j++) {
+            if (!RunBench(DumpReports[j].pName, BenchDumpReport, &myFile, &DumpReports[j],
+                            myFile.nSize, myFile.nRecords, nRepeat)) {
+                bOK = FALSE;
+                break;
+            }
+        }
+
+        free(myFile.pSample);
+        printf("\n");
+    }
+
+    return (bOK ? 0 : -2);
+}
+
@@ -0,0 +1,251 @@
+/*
+ * Neptune_Bus
+ *
+ * This module publishes the decoded records of a download on a
+ * shared memory ring buffer, so any number of other processes can
+ * follow the transfer live, straight out of the shared memory.
+ *
+ * The publisher never waits on or signals the readers:  each slot
+ * carries the sequence number of the record in it, which is cleared
+ * while the slot is being rewritten, so a reader can tell from the
+ * sequence numbers alone whether a record is there yet, was read
+ * intact, or was overwritten before it got to it.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "neptune_rec.h"
+#include "neptune_bus.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Orders the slot writes and reads against the sequence numbers */
+#define MEMORY_BARRIER()    __sync_synchronize()
+
+/* Local Prototypes */
+static int MapBus(NEPTUNE_BUS *pBus, const char *pName, int bPublish);
+
+/* ========================================================================== */
+
+int CreateBus(NEPTUNE_BUS *pBus, const char *pName)
+{
+    BUS_HEADER *pHeader;
+    unsigned long i;
+
+    if (!MapBus(pBus, pName, TRUE)) return FALSE;
+
+    /* Carry on from a ring of the same layout, so readers attached to it
+        just see the records continue, otherwise start a new one */
+    pHeader = pBus->pHeader;
+    if ((pHeader->nMagic != BUS_MAGIC) || (pHeader->nVersion != BUS_VERSION) ||
+        (pHeader->nSlots != BUS_SLOTS) || (pHeader->nSlotSize != sizeof(BUS_RECORD))) {
+        pHeader->nMagic = 0;
+        MEMORY_BARRIER();
+        pHeader->nVersion = BUS_VERSION;
+        pHeader->nSlots = BUS_SLOTS;
+        pHeader->nSlotSize = sizeof(BUS_RECORD);
+        pHeader->nHead = 0;
+        for (i=0; i<BUS_SLOTS; i++)
+            pBus->pSlots[i].nSeq = 0;
+        MEMORY_BARRIER();
+        pHeader->nMagic = BUS_MAGIC;
+    }
+
+    for (i=0; i<BUS_MAX_SOURCES; i++)
+        pBus->nProfileJump[i] = 0;
+
+    return TRUE;
+}
+
+int AttachBus(NEPTUNE_BUS *pBus, const char *pName)
+{
+    BUS_HEADER *pHeader;
+
+    if (!MapBus(pBus, pName, FALSE)) return FALSE;
+
+    pHeader = pBus->pHeader;
+    if ((pHeader->nMagic != BUS_MAGIC) || (pHeader->nVersion != BUS_VERSION) ||
+        (pHeader->nSlots != BUS_SLOTS) || (pHeader->nSlotSize != sizeof(BUS_RECORD))) {
+        fprintf(stderr, "\"%s\" isn't a Neptune record bus (or is from another version)!\n\n", pName);
+        CloseBus(pBus);
+        return FALSE;
+    }
+
+    pBus->nNext = pHeader->nHead + 1;
+    pBus->nLost = 0;
+
+    return TRUE;
+}
+
+void CloseBus(NEPTUNE_BUS *pBus)
+{
+    if (pBus->pHeader) munmap(pBus->pHeader, pBus->nMapSize);
+    pBus->pHeader = NULL;
+    pBus->pSlots = NULL;
+}
+
+/* ========================================================================== */
+
+void PublishRecord(NEPTUNE_BUS *pBus, int nSource, int type, const unsigned char *databuff)
+{
+    BUS_RECORD *pRecord;
+    struct timeval tv;
+    unsigned long nSeq;
+    unsigned long *pProfileJump;
+
+    if (!pBus->pHeader) return;
+
+    gettimeofday(&tv, NULL);
+    nSeq = pBus->pHeader->nHead + 1;
+    if (nSeq == 0) nSeq = 1;            /* 0 marks a slot being written, so skip it on wraparound */
+    pRecord = &pBus->pSlots[nSeq & (BUS_SLOTS-1)];
+
+    /* Take the slot away from any readers while we fill it in */
+    pRecord->nSeq = 0;
+    MEMORY_BARRIER();
+
+    pRecord->nNumBytes = DecodeRecordBytes(databuff, pRecord->bytes, BUS_MAX_BYTES);
+
+    pRecord->nSource = nSource;
+    pRecord->nType = ((pRecord->nNumBytes >= 2) ? pRecord->bytes[1] : -1);
+    pRecord->nStatus = ((type < 0) ? type : 0);
+    pRecord->nTimeSec = tv.tv_sec;
+    pRecord->nTimeUSec = tv.tv_usec;
+
+    /* Jump and profile records carry their jump number, the rest of a profile belongs to it */
+    pProfileJump = &pBus->nProfileJump[((nSource >= 0) ? nSource : 0) % BUS_MAX_SOURCES];
+    pRecord->nJump = 0;
+    switch (pRecord->nType) {
+        case 2:     /* Jump Record */
+        case 5:     /* Profile Start */
+            if (pRecord->nNumBytes >= 4)
+                pRecord->nJump = pRecord->bytes[2] + pRecord->bytes[3]*256ul;
+            if (pRecord->nType == 5) *pProfileJump = pRecord->nJump;
+            break;
+        case 4:     /* Profile Stream Type */
+        case 6:     /* Profile Datapoint */
+        case 7:     /* End of Profile */
+            pRecord->nJump = *pProfileJump;
+            break;
+    }
+
+    /* Then hand it out */
+    MEMORY_BARRIER();
+    pRecord->nSeq = nSeq;
+    pBus->pHeader->nHead = nSeq;
+}
+
+/* ========================================================================== */
+
+const BUS_RECORD *NextBusRecord(NEPTUNE_BUS *pBus, unsigned long *pSeq)
+{
+    const BUS_RECORD *pRecord;
+    unsigned long nHead;
+
+    if (!pBus->pHeader) return NULL;
+
+    while (1) {
+        nHead = pBus->pHeader->nHead;
+        MEMORY_BARRIER();
+        if ((long)(nHead - pBus->nNext) < 0) return NULL;       /* Caught up */
+
+        /* If we fell a whole ring behind, skip ahead to the oldest
+            record that isn't about to be overwritten */
+        if ((nHead - pBus->nNext) >= (BUS_SLOTS-1)) {
+            pBus->nLost += nHead - pBus->nNext - (BUS_SLOTS/2) + 1;
+            pBus->nNext = nHead - (BUS_SLOTS/2) + 1;
+        }
+        if (pBus->nNext == 0) pBus->nNext = 1;
+
+        pRecord = &pBus->pSlots[pBus->nNext & (BUS_SLOTS-1)];
+        *pSeq = pBus->nNext;
+        pBus->nNext++;
+        if (pRecord->nSeq == *pSeq) {
+            MEMORY_BARRIER();
+            return pRecord;
+        }
+        pBus->nLost++;          /* Overwritten already */
+    }
+}
+
+int BusRecordValid(const BUS_RECORD *pRecord, unsigned long nSeq)
+{
+    MEMORY_BARRIER();
+    return (pRecord->nSeq == nSeq);
+}
+
+/* ========================================================================== */
+
+static int MapBus(NEPTUNE_BUS *pBus, const char *pName, int bPublish)
+{
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    pBus->pHeader = NULL;
+    pBus->pSlots = NULL;
+    pBus->nNext = 0;
+    pBus->nLost = 0;
+    snprintf(pBus->strName, sizeof(pBus->strName), "%s%s", ((pName[0] == '/') ? "" : "/"), pName);
+    pBus->nMapSize = sizeof(BUS_HEADER) + BUS_SLOTS * sizeof(BUS_RECORD);
+
+    fd = shm_open(pBus->strName, (bPublish ? (O_RDWR | O_CREAT) : O_RDONLY), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Opening record bus \"%s\" ", pBus->strName);
+        perror("");
+        return FALSE;
+    }
+    if ((bPublish) && (ftruncate(fd, pBus->nMapSize) < 0)) {
+        perror("Sizing record bus ");
+        close(fd);
+        return FALSE;
+    }
+    if ((!bPublish) && ((fstat(fd, &st) < 0) || (st.st_size < pBus->nMapSize))) {
+        fprintf(stderr, "\"%s\" isn't a Neptune record bus (or is from another version)!\n\n", pBus->strName);
+        close(fd);
+        return FALSE;
+    }
+
+    pMap = mmap(NULL, pBus->nMapSize, (bPublish ? (PROT_READ | PROT_WRITE) : PROT_READ), MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+        perror("Mapping record bus ");
+        return FALSE;
+    }
+
+    pBus->pHeader = (BUS_HEADER *)pMap;
+    pBus->pSlots = (BUS_RECORD *)((char *)pMap + sizeof(BUS_HEADER));
+
+    return TRUE;
+}
+
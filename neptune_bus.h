@@ -0,0 +1,92 @@
+/*
+ * Neptune_Bus
+ *
+ * This module publishes the decoded records of a download on a
+ * shared memory ring buffer, so any number of other processes can
+ * follow the transfer live, straight out of the shared memory.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_BUS_H_
+#define _NEPTUNE_BUS_H_
+
+#define BUS_MAGIC           0x4E455042ul    /* "NEPB" */
+#define BUS_VERSION         1
+#define BUS_SLOTS           1024            /* Records held in the ring, must be a power of two */
+#define BUS_MAX_BYTES       MAX_RECORD_BYTES
+#define BUS_MAX_SOURCES     16              /* Sources (devices) tracked separately */
+
+typedef struct bus_record
+{
+    volatile unsigned long nSeq;    /* Sequence number of the record in the slot, 0 while it's being written */
+    int         nSource;            /* Device number the record came from */
+    int         nType;              /* Record type byte or -1 if the record was too short to have one */
+    int         nStatus;            /* 0 if valid, else GetNextRecord() error (-2 = too short, -3 = bad checksum) */
+    unsigned long nJump;            /* Jump number the record belongs to (0 if none) */
+    long        nTimeSec;           /* Time the record was received */
+    long        nTimeUSec;
+    long        nNumBytes;          /* Number of bytes in bytes[] */
+    unsigned char bytes[BUS_MAX_BYTES];     /* Record bytes from the length through the checksum */
+} BUS_RECORD;
+
+typedef struct bus_header
+{
+    unsigned long nMagic;
+    unsigned long nVersion;
+    unsigned long nSlots;           /* Number of record slots following the header */
+    unsigned long nSlotSize;        /* sizeof(BUS_RECORD) */
+    volatile unsigned long nHead;   /* Sequence number of the last record published (0 = none yet) */
+} BUS_HEADER;
+
+typedef struct neptune_bus
+{
+    char        strName[256];       /* Shared memory object name */
+    BUS_HEADER  *pHeader;           /* Mapping or NULL if not open */
+    BUS_RECORD  *pSlots;
+    long        nMapSize;
+    unsigned long nNext;            /* Reader:  Sequence number of the next record to read */
+    unsigned long nLost;            /* Reader:  Records overwritten before they could be read */
+    unsigned long nProfileJump[BUS_MAX_SOURCES];    /* Publisher:  Jump of the profile being sent by each source */
+} NEPTUNE_BUS;
+
+/* CreateBus - Creates (or takes over) the named shared memory ring and maps it for
+        publishing.  Sequence numbers carry on from an existing ring of the same layout */
+extern int CreateBus(NEPTUNE_BUS *pBus, const char *pName);
+
+/* AttachBus - Maps an existing ring read-only for following it, starting with the
+        next record published */
+extern int AttachBus(NEPTUNE_BUS *pBus, const char *pName);
+
+/* CloseBus - Unmaps the ring, which stays around for the next publisher */
+extern void CloseBus(NEPTUNE_BUS *pBus);
+
+/* PublishRecord - Decodes a record, where type and databuff are as returned by
+        GetNextRecord(), and puts it on the ring tagged with its source number */
+extern void PublishRecord(NEPTUNE_BUS *pBus, int nSource, int type, const unsigned char *databuff);
+
+/* NextBusRecord - Returns the next record on the ring, in place, or NULL if there isn't
+        one yet.  Records overwritten before they could be read are counted in nLost.
+        Use BusRecordValid() after reading the record to make sure it wasn't
+        overwritten while it was being read */
+extern const BUS_RECORD *NextBusRecord(NEPTUNE_BUS *pBus, unsigned long *pSeq);
+
+/* BusRecordValid - Returns TRUE if the record in the slot is still record nSeq */
+extern int BusRecordValid(const BUS_RECORD *pRecord, unsigned long nSeq);
+
+#endif  /* _NEPTUNE_BUS_H_ */
+
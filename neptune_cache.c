@@ -0,0 +1,241 @@
+/*
+ * Neptune_Cache
+ *
+ * This module keeps the results of reading a data file in an
+ * on-disk cache, so a run against the same file with the same
+ * settings can pick them up instead of reading the file again.
+ *
+ * Hashing all of a multi-gigabyte file would take nearly as long as
+ * reading it, so the content hash only covers its first and last
+ * blocks and blocks spread evenly in between, and could easily miss
+ * an edit.  Entries are also keyed by the file's device, inode and
+ * change time.  Unlike the modification time, which cp -p, rsync -t
+ * and touch -r all set back, the change time can't be set by a user,
+ * so a file written in any way, or replaced by another, is read again.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "neptune_cache.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define HASH_BLOCK_SIZE     65536       /* Size of each block hashed */
+#define HASH_BLOCKS         16          /* Blocks hashed between the first and last */
+
+#define FNV_OFFSET          0xCBF29CE484222325ull
+#define FNV_PRIME           0x100000001B3ull
+
+/* Local Prototypes */
+static unsigned long long HashBytes(unsigned long long nHash, const void *pData, long nSize);
+static int HashFile(int fd, off_t nSize, unsigned long long *pHash);
+static int CacheDirectory(char *pPath, long nPathSize);
+
+/* ========================================================================== */
+
+static unsigned long long HashBytes(unsigned long long nHash, const void *pData, long nSize)
+{
+    const unsigned char *p = (const unsigned char *)pData;
+    long i;
+
+    /* FNV-1a */
+    for (i=0; i<nSize; i++) {
+        nHash ^= p[i];
+        nHash *= FNV_PRIME;
+    }
+    return nHash;
+}
+
+static int HashFile(int fd, off_t nSize, unsigned long long *pHash)
+{
+    static unsigned char buff[HASH_BLOCK_SIZE];
+    unsigned long long nHash;
+    off_t nOffset;
+    ssize_t nRead;
+    int i;
+
+    nHash = FNV_OFFSET;
+    for (i=0; i<=HASH_BLOCKS+1; i++) {
+        /* First block, HASH_BLOCKS spread between, then the last */
+        if (i == HASH_BLOCKS+1) {
+            nOffset = nSize - HASH_BLOCK_SIZE;
+        } else {
+            nOffset = (nSize / (HASH_BLOCKS+1)) * i;
+        }
+        if (nOffset < 0) nOffset = 0;
+        nRead = pread(fd, buff, sizeof(buff), nOffset);
+        if (nRead < 0) return FALSE;
+        nHash = HashBytes(nHash, &nOffset, sizeof(nOffset));
+        nHash = HashBytes(nHash, buff, nRead);
+        if (nSize <= HASH_BLOCK_SIZE) break;        /* That was all of it */
+    }
+
+    *pHash = nHash;
+    return TRUE;
+}
+
+static int CacheDirectory(char *pPath, long nPathSize)
+{
+    const char *pDir;
+    int n;
+
+    pDir = getenv("NEPTUNE_CACHE_DIR");
+    if (pDir) {
+        if (pDir[0] == 0) return FALSE;         /* Set to nothing turns the cache off */
+        n = snprintf(pPath, nPathSize, "%s", pDir);
+    } else if ((pDir = getenv("XDG_CACHE_HOME")) && (pDir[0])) {
+        mkdir(pDir, 0700);
+        n = snprintf(pPath, nPathSize, "%s/neptune", pDir);
+    } else if ((pDir = getenv("HOME")) && (pDir[0])) {
+        n = snprintf(pPath, nPathSize, "%s/.cache", pDir);
+        if ((n < 0) || (n >= nPathSize)) return FALSE;
+        mkdir(pPath, 0700);
+        n = snprintf(pPath, nPathSize, "%s/.cache/neptune", pDir);
+    } else {
+        return FALSE;
+    }
+    if ((n < 0) || (n >= nPathSize)) return FALSE;
+
+    if ((mkdir(pPath, 0755) < 0) && (errno != EEXIST)) return FALSE;
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+int CacheKey(NEPTUNE_CACHE *pCache, const char *pFilename, const void *pParams, long nParamSize)
+{
+    struct stat st;
+    char strDir[MAX_CACHE_PATH];
+    int fd;
+    int n;
+
+    pCache->pMap = NULL;
+    pCache->nMapSize = 0;
+    if (strcmp(pFilename, "-") == 0) return FALSE;
+
+    fd = open(pFilename, O_RDONLY);
+    if (fd < 0) return FALSE;
+    if ((fstat(fd, &st) < 0) || (!S_ISREG(st.st_mode))) {
+        close(fd);
+        return FALSE;
+    }
+    pCache->key.nSize = st.st_size;
+    pCache->key.nMTime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+    pCache->key.nCTime = st.st_ctim.tv_sec * 1000000000ull + st.st_ctim.tv_nsec;
+    pCache->key.nDevice = st.st_dev;
+    pCache->key.nInode = st.st_ino;
+    if (!HashFile(fd, st.st_size, &pCache->key.nContentHash)) {
+        close(fd);
+        return FALSE;
+    }
+    close(fd);
+    pCache->key.nParamHash = HashBytes(FNV_OFFSET, pParams, nParamSize);
+
+    if (!CacheDirectory(strDir, sizeof(strDir))) return FALSE;
+    /* Named for the file and settings alone, so a changed file's entry is
+        replaced by the next save rather than left behind -- the whole key
+        in the header is what says if it's still good */
+    n = snprintf(pCache->strPath, sizeof(pCache->strPath), "%s/%llx-%llx-%016llx.nepc", strDir,
+                    pCache->key.nDevice, pCache->key.nInode, pCache->key.nParamHash);
+    if ((n < 0) || (n >= sizeof(pCache->strPath))) return FALSE;
+
+    return TRUE;
+}
+
+const void *OpenCache(NEPTUNE_CACHE *pCache, long *pSize)
+{
+    const CACHE_HEADER *pHeader;
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    fd = open(pCache->strPath, O_RDONLY);
+    if (fd < 0) return NULL;
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(CACHE_HEADER)) ||
+        (st.st_size > 0x7FFFFFFFl)) {
+        close(fd);
+        return NULL;
+    }
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) return NULL;
+
+    /* Make sure it's really ours, for this file, and all there */
+    pHeader = (const CACHE_HEADER *)pMap;
+    if ((pHeader->nMagic != CACHE_MAGIC) || (pHeader->nVersion != CACHE_VERSION) ||
+        (memcmp(&pHeader->key, &pCache->key, sizeof(CACHE_KEY)) != 0) ||
+        (pHeader->nDataSize != (unsigned long long)(st.st_size - sizeof(CACHE_HEADER)))) {
+        munmap(pMap, st.st_size);
+        return NULL;
+    }
+
+    pCache->pMap = pMap;
+    pCache->nMapSize = st.st_size;
+    *pSize = pHeader->nDataSize;
+    return (const char *)pMap + sizeof(CACHE_HEADER);
+}
+
+void CloseCache(NEPTUNE_CACHE *pCache)
+{
+    if (pCache->pMap) munmap(pCache->pMap, pCache->nMapSize);
+    pCache->pMap = NULL;
+    pCache->nMapSize = 0;
+}
+
+int SaveCache(const NEPTUNE_CACHE *pCache, const void *pData, long nSize)
+{
+    CACHE_HEADER myHeader;
+    char strTemp[MAX_CACHE_PATH+32];
+    FILE *pFile;
+    int bOK;
+
+    memset(&myHeader, 0, sizeof(myHeader));
+    myHeader.nMagic = CACHE_MAGIC;
+    myHeader.nVersion = CACHE_VERSION;
+    myHeader.key = pCache->key;
+    myHeader.nDataSize = nSize;
+
+    /* Written to the side and renamed into place, so another run never sees half of it */
+    snprintf(strTemp, sizeof(strTemp), "%s.%ld", pCache->strPath, (long)getpid());
+    pFile = fopen(strTemp, "wb");
+    if (!pFile) return FALSE;
+    bOK = ((fwrite(&myHeader, sizeof(myHeader), 1, pFile) == 1) &&
+            ((nSize == 0) || (fwrite(pData, nSize, 1, pFile) == 1)));
+    if (fclose(pFile) != 0) bOK = FALSE;
+    if ((bOK) && (rename(strTemp, pCache->strPath) < 0)) bOK = FALSE;
+    if (!bOK) unlink(strTemp);
+
+    return bOK;
+}
+
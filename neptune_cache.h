@@ -0,0 +1,82 @@
+/*
+ * Neptune_Cache
+ *
+ * This module keeps the results of reading a data file in an
+ * on-disk cache, so a run against the same file with the same
+ * settings can pick them up instead of reading the file again.
+ * Entries are found by a key made from the file's size, modification
+ * time and a hash of its contents, and the caller's own settings,
+ * and are mapped straight into memory when they're loaded.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_CACHE_H_
+#define _NEPTUNE_CACHE_H_
+
+#define CACHE_MAGIC         0x4350454Eul    /* "NEPC" */
+#define CACHE_VERSION       2
+#define MAX_CACHE_PATH      1024
+
+typedef struct cache_key
+{
+    unsigned long long nSize;           /* Size of the data file */
+    unsigned long long nMTime;          /*      its modification time (nanoseconds) */
+    unsigned long long nCTime;          /*      its change time (nanoseconds) */
+    unsigned long long nDevice;         /*      the device it's on */
+    unsigned long long nInode;          /*      and its inode there */
+    unsigned long long nContentHash;    /*      a hash of its contents */
+    unsigned long long nParamHash;      /* Hash of the caller's settings */
+} CACHE_KEY;
+
+typedef struct cache_header
+{
+    unsigned long nMagic;
+    unsigned long nVersion;
+    CACHE_KEY   key;
+    unsigned long long nDataSize;       /* Bytes of data following the header */
+} CACHE_HEADER;
+
+typedef struct neptune_cache
+{
+    char        strPath[MAX_CACHE_PATH];    /* Cache entry file */
+    CACHE_KEY   key;
+    void        *pMap;                  /* Mapping of the entry once opened, or NULL */
+    long        nMapSize;
+} NEPTUNE_CACHE;
+
+/* CacheKey - Works out the key and entry name for a data file read with the
+        settings in pParams.  The name is just the file's device and inode and
+        the settings, so a file has one entry for each set of settings.  The
+        cache directory is $NEPTUNE_CACHE_DIR, or neptune under $XDG_CACHE_HOME
+        or ~/.cache.  Returns FALSE if the file can't be cached, such as stdin
+        or a pipe */
+extern int CacheKey(NEPTUNE_CACHE *pCache, const char *pFilename, const void *pParams, long nParamSize);
+
+/* OpenCache - Maps the entry for the key, returning its data and setting *pSize,
+        or NULL if there isn't a (good) one */
+extern const void *OpenCache(NEPTUNE_CACHE *pCache, long *pSize);
+
+/* CloseCache - Unmaps an entry opened with OpenCache() */
+extern void CloseCache(NEPTUNE_CACHE *pCache);
+
+/* SaveCache - Writes the entry for the key, replacing any there, so it appears
+        all at once or not at all.  Returns FALSE if it couldn't be written */
+extern int SaveCache(const NEPTUNE_CACHE *pCache, const void *pData, long nSize);
+
+#endif  /* _NEPTUNE_CACHE_H_ */
+
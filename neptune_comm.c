@@ -0,0 +1,1125 @@
+/*
+ * Neptune_Comm
+ *
+ * This module handles the communications link to the Neptune
+ * Altimeter.  Each kind of link (IrDA TinyTP socket with IrCOMM
+ * emulation, IrCOMM tty device driver, TCP or Unix socket) is a
+ * transport with its own open, connect, send and receive methods.
+ *
+ * Written May 8, 2004 by Donna Whisnant
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/un.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <netdb.h>
+
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <fcntl.h>
+
+#include "neptune_rec.h"
+#include "neptune_comm.h"
+
+/* Defines */
+//#define EXTRA_DEBUG 1
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Memory allocation for discovery */
+#define DISC_MAX_DEVICES 10
+#define DISC_BUF_LEN	sizeof(struct irda_device_list) + \
+			sizeof(struct irda_device_info) * DISC_MAX_DEVICES
+
+/* Local Prototypes */
+static int IrdaOpen(COMM_PORT *port, const char *pDevice);
+static int IrdaAttach(COMM_PORT *port);
+static int IrdaConnect(COMM_PORT *port);
+static int IrdaSend(COMM_PORT *port, const unsigned char *pData, long nSize);
+static int IrdaSetRate(COMM_PORT *port, long nRate);
+static long IrdaReceive(COMM_PORT *port);
+static void IrcommControl(COMM_PORT *port, const unsigned char *pParams, int nSize);
+static int Discover(COMM_PORT *port, const char* pDevice);
+static void ReleaseDevice(COMM_PORT *port);
+static int TtyOpen(COMM_PORT *port, const char *pDevice);
+static int TtySetRate(COMM_PORT *port, long nRate);
+static int StreamAttach(COMM_PORT *port);
+static int StreamConnect(COMM_PORT *port);
+static int StreamSend(COMM_PORT *port, const unsigned char *pData, long nSize);
+static long StreamReceive(COMM_PORT *port);
+static int TcpOpen(COMM_PORT *port, const char *pDevice);
+static int UnixOpen(COMM_PORT *port, const char *pDevice);
+#ifdef EXTRA_DEBUG
+static int DumpParamTuple(unsigned char *pParam);
+#endif
+
+/* Transports */
+const COMM_TRANSPORT IrdaTransport =
+    { "IrDA TinyTP", "irda", IRDA_RX_FRAME_SIZE, TRUE, IrdaOpen, IrdaAttach, IrdaConnect, IrdaSend, IrdaSetRate, IrdaReceive };
+const COMM_TRANSPORT TtyTransport =
+    { "IrCOMM Device", NULL, TTY_RX_FRAME_SIZE, FALSE, TtyOpen, StreamAttach, StreamConnect, StreamSend, TtySetRate, StreamReceive };
+const COMM_TRANSPORT TcpTransport =
+    { "TCP", "tcp:", SOCKET_RX_FRAME_SIZE, TRUE, TcpOpen, StreamAttach, StreamConnect, StreamSend, NULL, StreamReceive };
+const COMM_TRANSPORT UnixTransport =
+    { "Unix Socket", "unix:", SOCKET_RX_FRAME_SIZE, TRUE, UnixOpen, StreamAttach, StreamConnect, StreamSend, NULL, StreamReceive };
+
+/* Line rates to try, fastest first */
+static const long LinkRates[] = { 115200, 57600, 38400, 19200, 9600, 0 };
+
+/* IrDA device addresses currently linked by one of our ports, so several
+    ports discovering at once don't all grab the same Neptune */
+static __u32 ClaimedDevices[DISC_MAX_DEVICES];
+static int nNumClaimedDevices = 0;
+
+/* ========================================================================== */
+
+void InitPort(COMM_PORT *port)
+{
+    /* Initialize our port struct: */
+    memset(port, 0, sizeof(COMM_PORT));
+    port->pTransport = NULL;
+    port->desc = -1;
+    port->nRate = DEFAULT_LINK_RATE;
+    port->n_lsap_sel = LSAP_ANY;
+    port->rx_bufsize = 0;
+    port->rxbuf = NULL;
+    port->dwRead = 0;
+    port->dwReturned = 0;
+    port->bNonBlocking = FALSE;
+}
+
+int OpenPort(COMM_PORT *port, const char *pDevice)
+{
+    const COMM_TRANSPORT *pTransport;
+
+    /* close port if one is open */
+    ClosePort(port);
+
+    /* Select the transport from the device name -- no device means
+        we emulate the IrCOMM layer on a TinyTP socket */
+    if ((pDevice == NULL) || (strcmp(pDevice, IrdaTransport.pPrefix) == 0)) {
+        pTransport = &IrdaTransport;
+    } else if (strncmp(pDevice, TcpTransport.pPrefix, strlen(TcpTransport.pPrefix)) == 0) {
+        pTransport = &TcpTransport;
+    } else if (strncmp(pDevice, UnixTransport.pPrefix, strlen(UnixTransport.pPrefix)) == 0) {
+        pTransport = &UnixTransport;
+    } else {
+        pTransport = &TtyTransport;
+    }
+
+    /* Room for several frames, plus a partial line moved back from the end */
+    port->rxbuf = (unsigned char *)malloc(pTransport->nFrameSize*RX_BUFFER_FRAMES + MAX_RECORD_SIZE);
+    if (port->rxbuf == NULL) {
+        fprintf(stderr, "Out of memory allocating receive buffer!\n");
+        return FALSE;
+    }
+    port->rx_bufsize = pTransport->nFrameSize*RX_BUFFER_FRAMES + MAX_RECORD_SIZE;
+    port->dwRead = 0;
+    port->dwReturned = 0;
+    port->pTransport = pTransport;
+
+    if (!pTransport->Open(port, pDevice)) {
+        ClosePort(port);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int AttachPort(COMM_PORT *port)
+{
+    if ((port->pTransport == NULL) ||
+        (port->desc < 0)) return -1;
+
+    return port->pTransport->Attach(port);
+}
+
+int ConnectPort(COMM_PORT *port)
+{
+    if ((port->pTransport == NULL) ||
+        (port->desc < 0)) return FALSE;
+
+    printf("Start Neptune Transmitting");
+    fflush(stdout);
+
+    if (!port->pTransport->Connect(port)) return FALSE;
+
+    fflush(stdout);
+    SleepFine(5, 0);
+
+    return TRUE;
+}
+
+int ClosePort(COMM_PORT *port)
+{
+    ReleaseDevice(port);
+    if (port->desc >= 0) {
+        close(port->desc);
+        port->desc = -1;
+    }
+    if (port->rxbuf) {
+        free(port->rxbuf);
+        port->rxbuf = NULL;
+    }
+    port->rx_bufsize = 0;
+    port->dwRead = 0;
+    port->dwReturned = 0;
+    port->pTransport = NULL;
+
+    return TRUE;
+}
+
+int SendString(COMM_PORT *port, const char *pString)
+{
+    if (port->pTransport == NULL) return FALSE;
+    return port->pTransport->Send(port, (const unsigned char *)pString, strlen(pString));
+}
+
+int PutChar(COMM_PORT *port, const char c)
+{
+    if (port->pTransport == NULL) return FALSE;
+    return port->pTransport->Send(port, (const unsigned char *)&c, 1);
+}
+
+int SetPortRate(COMM_PORT *port, long nRate)
+{
+    /* Note: The rate is remembered even if the port isn't open yet, and
+                is applied when it is */
+    if (!IsLinkRate(nRate)) return FALSE;
+    port->nRate = nRate;
+    if ((port->pTransport == NULL) ||
+        (port->pTransport->SetRate == NULL) ||
+        (port->desc < 0)) return TRUE;
+
+    return port->pTransport->SetRate(port, nRate);
+}
+
+long PortRate(const COMM_PORT *port)
+{
+    /* Returns the line rate in use or 0 if the link doesn't have one */
+    if ((port->pTransport == NULL) ||
+        (port->pTransport->SetRate == NULL)) return 0;
+
+    return port->nRate;
+}
+
+long NextLowerRate(long nRate)
+{
+    int i;
+
+    for (i=0; LinkRates[i]; i++) {
+        if (LinkRates[i] < nRate) return LinkRates[i];
+    }
+
+    return 0;
+}
+
+int IsLinkRate(long nRate)
+{
+    int i;
+
+    for (i=0; LinkRates[i]; i++) {
+        if (LinkRates[i] == nRate) return TRUE;
+    }
+
+    return FALSE;
+}
+
+int CheckForData(COMM_PORT *port)
+{
+    fd_set rfds;
+    struct timeval tv;
+    int retval;
+
+    FD_ZERO(&rfds);
+    FD_SET(port->desc, &rfds);
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+
+    retval = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
+    /* Note: Don't rely on value of tv now! */
+
+    return retval;
+}
+
+long FillPort(COMM_PORT *port)
+{
+    long nUnread;
+
+    if (port->pTransport == NULL) return 0;
+
+    /* Frames are appended to the receive buffer at dwRead and lines handed
+        out from dwReturned.  Once everything has been handed out it starts
+        over at the front, and only when there's no longer room for a whole
+        frame at the end is the unread part (a partial line, if anything)
+        moved back to the front to make room */
+    nUnread = port->dwRead - port->dwReturned;
+    if (nUnread == 0) {
+        port->dwRead = 0;
+        port->dwReturned = 0;
+    } else if ((port->rx_bufsize - port->dwRead) < port->pTransport->nFrameSize) {
+        memmove(port->rxbuf, &port->rxbuf[port->dwReturned], nUnread);
+        port->dwRead = nUnread;
+        port->dwReturned = 0;
+    }
+
+    return port->pTransport->Receive(port);
+}
+
+void FlushPort(COMM_PORT *port)
+{
+    /* Throws away everything received and not yet read, along with anything
+        still queued on a tty, so nothing left over from a transfer at another
+        rate is taken for the answer to the next command */
+    port->dwRead = 0;
+    port->dwReturned = 0;
+    if ((port->pTransport == &TtyTransport) && (port->desc >= 0)) tcflush(port->desc, TCIOFLUSH);
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    /* Hands out each line as a view straight into the receive buffer -- it
+        stays valid until the next ReadLine() or FillPort() on the port */
+    COMM_PORT *port = (COMM_PORT*)pSource;
+    const unsigned char *pLine;
+    const unsigned char *pEnd;
+    long nSize;
+    long nMaxSize;
+
+    if (port->pTransport == NULL) return FALSE;
+
+    nMaxSize = MAX_RECORD_SIZE - 1;
+
+    while (1) {
+        pLine = &port->rxbuf[port->dwReturned];
+        nSize = port->dwRead - port->dwReturned;
+        if (nSize > nMaxSize) nSize = nMaxSize;
+        pEnd = memchr(pLine, '\n', nSize);
+        if (pEnd) {
+            nSize = pEnd - pLine + 1;
+            break;
+        }
+        if (nSize == nMaxSize) break;       /* Overlong line -- hand back a buffer's worth */
+
+        /* Only hand back complete lines, leaving partial lines to be finished by the next FillPort() */
+        if (port->bNonBlocking) return FALSE;
+
+        /* Wait for more, or take what we have if that's all there is */
+        if ((!CheckForData(port)) ||
+            (FillPort(port) == 0)) {
+            pLine = &port->rxbuf[port->dwReturned];
+            nSize = port->dwRead - port->dwReturned;
+            if (nSize == 0) return FALSE;
+            break;
+        }
+    }
+    port->dwReturned += nSize;
+
+    /* A nul in the line ends it, as it would any string */
+    pEnd = memchr(pLine, 0, nSize);
+    if (pEnd) nSize = pEnd - pLine;
+
+    pRecord->data = pLine;
+    pRecord->dwSize = nSize;
+    return TRUE;
+}
+
+/* ========================================================================== */
+/* IrDA TinyTP transport -- Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
+
+static int IrdaOpen(COMM_PORT *port, const char *pDevice)
+{
+    port->desc = socket(AF_IRDA, SOCK_STREAM /* SOCK_SEQPACKET */, 0);
+    if (port->desc < 0) {
+        perror("Creating IrDA socket (no IrDA stack?) ");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int IrdaAttach(COMM_PORT *port)
+{
+    struct sockaddr_irda peer;
+    const unsigned char pServiceSelectMessage[] =
+            { 0x03,
+                0x00, 0x01, 0x04                        /* Select 9-Wire Cooked */
+            };
+    unsigned char pConnectSettingsMessage[] =
+            { 0x0F,
+                0x10, 0x04, 0x00, 0x00, 0x25, 0x80,     /* Baud = 9600 (filled in below) */
+                0x11, 0x01, 0x03,                       /* N, 8, 1 */
+                0x12, 0x01, 0x00,                       /* No Flow Control */
+                0x20, 0x01, 0xC0                        /* DTR=RTS=on, no delta */
+            };
+
+    pConnectSettingsMessage[3] = (port->nRate >> 24) & 0xFF;
+    pConnectSettingsMessage[4] = (port->nRate >> 16) & 0xFF;
+    pConnectSettingsMessage[5] = (port->nRate >> 8) & 0xFF;
+    pConnectSettingsMessage[6] = port->nRate & 0xFF;
+
+    /* Search IrDA for Neptune Device: */
+    if (!Discover(port, "Neptune")) return 0;
+
+    peer.sir_family = AF_IRDA;
+    peer.sir_lsap_sel = port->n_lsap_sel;
+    peer.sir_addr = port->info.daddr;
+    strncpy(peer.sir_name, "NeptuneRead:IrDA:TinyTP", 25);
+
+    if (connect(port->desc, (struct sockaddr*) &peer, sizeof(struct sockaddr_irda))) {
+        perror("Connect to IrDA socket ");
+        ReleaseDevice(port);
+        return -1;
+    }
+
+    if (send(port->desc, pServiceSelectMessage, sizeof(pServiceSelectMessage), 0) == -1)
+        perror("Error Sending Service Type Select ");
+
+    if (send(port->desc, pConnectSettingsMessage, sizeof(pConnectSettingsMessage), 0) == -1)
+        perror("Error Sending Connect Settings ");
+
+    return 1;
+}
+
+static int IrdaConnect(COMM_PORT *port)
+{
+    int retval;
+
+    while ((retval = IrdaAttach(port)) == 0) {
+        SleepFine(1, 0);
+        printf(".");
+        fflush(stdout);
+    }
+    if (retval < 0) return FALSE;
+
+    printf("Connected\n");
+    fflush(stdout);
+
+    printf("Sending Wakeup");
+    fflush(stdout);
+    while (!PutChar(port, ' ')) {
+        SleepFine(1, 0);
+        printf(".");
+        fflush(stdout);
+    }
+    printf("\n");
+
+    return TRUE;
+}
+
+static int IrdaSend(COMM_PORT *port, const unsigned char *pData, long nSize)
+{
+    long len;
+    unsigned char txbuf[MAX_TX_FRAME];
+
+    len = nSize;
+    if (len > (MAX_TX_FRAME-2)) len = MAX_TX_FRAME-2;
+    txbuf[0] = 0;   /* No control stream bytes */
+    memcpy(&txbuf[1], pData, len);
+    if (send(port->desc, txbuf, len+1, 0) != -1)
+        return TRUE;
+
+    return FALSE;
+}
+
+static int IrdaSetRate(COMM_PORT *port, long nRate)
+{
+    /* The IrCOMM Data Rate parameter, sent on its own on the control channel */
+    unsigned char pRateMessage[] =
+            { 0x06,
+                0x10, 0x04, 0x00, 0x00, 0x25, 0x80      /* Baud = 9600 (filled in below) */
+            };
+
+    pRateMessage[3] = (nRate >> 24) & 0xFF;
+    pRateMessage[4] = (nRate >> 16) & 0xFF;
+    pRateMessage[5] = (nRate >> 8) & 0xFF;
+    pRateMessage[6] = nRate & 0xFF;
+
+    if (send(port->desc, pRateMessage, sizeof(pRateMessage), 0) == -1) {
+        perror("Error Sending Data Rate ");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static long IrdaReceive(COMM_PORT *port)
+{
+    unsigned char nCtlSize;
+    unsigned char pCtlParams[256];
+    unsigned char *pData;
+    struct iovec iov[2];
+    struct msghdr msg;
+    long nFrameSize;
+    long nSpace;
+    long nData;
+
+    /* Each IrCOMM frame starts with the length of its control parameters.  Scatter
+        the length byte off on its own and the rest straight into the receive buffer,
+        since nearly every frame is all data and needs no further moving around */
+    pData = &port->rxbuf[port->dwRead];
+    nSpace = port->rx_bufsize - port->dwRead;
+    iov[0].iov_base = &nCtlSize;
+    iov[0].iov_len = 1;
+    iov[1].iov_base = pData;
+    iov[1].iov_len = nSpace;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    nFrameSize = recvmsg(port->desc, &msg, MSG_TRUNC);
+    if (nFrameSize == -1) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return -1;
+        if ((errno != EIO) && (errno != ECONNRESET)) perror("Reading Packet ");
+        return 0;       /* The link is gone */
+    }
+    if (nFrameSize == 0) return 0;      /* Disconnected -- TinyTP never sends an empty frame */
+    if (nFrameSize > nSpace+1) {
+        fprintf(stderr, "\n    *** Warning: Truncated packet : Size = %ld  Max Allowed = %ld\n", nFrameSize, nSpace+1);
+        nFrameSize = nSpace+1;
+    }
+
+// Warning: Enabling the following causes so much overhead data loss will be experienced!
+//#ifdef EXTRA_DEBUG
+//    fprintf(stderr, "RxData: %02X", nCtlSize);
+//    for (i=0; i<nFrameSize-1; i++) {
+//        fprintf(stderr, " %02X", pData[i]);
+//    }
+//    fprintf(stderr, "\n");
+//    fflush(stderr);
+//#endif
+
+    /* Pull off the control channel info, leaving just the data bytes in the buffer */
+    nData = nFrameSize - 1;
+    if (nCtlSize) {
+        if (nCtlSize > nData) nCtlSize = nData;
+        memcpy(pCtlParams, pData, nCtlSize);
+        nData -= nCtlSize;
+        memmove(pData, &pData[nCtlSize], nData);
+        IrcommControl(port, pCtlParams, nCtlSize);
+    }
+    if (nData <= 0) return -1;      /* Control channel only, no data */
+    port->dwRead += nData;
+
+    return nData;
+}
+
+static void IrcommControl(COMM_PORT *port, const unsigned char *pParams, int nSize)
+{
+    int len;
+    const unsigned char pDTESettingsMessage[] = { 0x03, 0x20, 0x01, 0xC0 };   /* DTR=RTS=on, no delta */
+
+#ifdef EXTRA_DEBUG
+    fprintf(stderr, "    Num Control Bytes: %d\n", nSize);
+    for (len=0; len<nSize; len += DumpParamTuple((unsigned char *)&pParams[len]));
+    fflush(stderr);
+#endif
+
+    /* Look for and process any request for line status and we'll ignore everything else */
+    while (nSize >= 2) {
+        len = pParams[1] + 2;
+        if (pParams[0] == 0x22) {
+            if (send(port->desc, pDTESettingsMessage, sizeof(pDTESettingsMessage), 0) == -1)
+                perror("Error Sending Requested Line Status ");
+        }
+        nSize -= len;
+        pParams += len;
+    }
+}
+
+static int Discover(COMM_PORT *port, const char* pDevice)
+{
+    struct irda_device_list *list;      /* List of device */
+    unsigned char buf[DISC_BUF_LEN];    /* Actual memory allocation */
+    int len;
+    int i;
+    int j;
+//    struct irda_ias_set ias_query;
+//    unsigned char *pParam;
+    
+
+    /* Set the list to point to the correct place */
+    list = (struct irda_device_list *) buf;
+    len = DISC_BUF_LEN;
+
+    /* Ask for the discovery log */
+    if (getsockopt(port->desc, SOL_IRLMP, IRLMP_ENUMDEVICES, buf, &len)) {
+        /* Discovery log empty (normal case) or error */
+        return FALSE;
+    }
+    /* Is there any addresses ? */
+    if (list->len <= 0)
+        /* Discovery log empty (exceptional case) */
+        return FALSE;
+
+    /* Dump list found: */
+#ifdef EXTRA_DEBUG
+    fprintf(stderr, "\nDiscovered %ld devices:\n", list->len);
+    for (i=0; i < list->len; i++) {
+        fprintf(stderr, "    \"%s\"%s\n", list->dev[i].info,
+                ((strcmp(list->dev[i].info, pDevice) == 0) ? " -- Found" : ""));
+    }
+    fflush(stderr);
+#endif
+
+    /* Go through the list */
+    for (i=0; i < list->len; i++) {
+        if (strcmp(list->dev[i].info, pDevice) == 0) {
+            /* Skip devices another of our ports already has */
+            for (j=0; j<nNumClaimedDevices; j++) {
+                if (ClaimedDevices[j] == list->dev[i].daddr) break;
+            }
+            if ((j < nNumClaimedDevices) || (nNumClaimedDevices >= DISC_MAX_DEVICES)) continue;
+            ClaimedDevices[nNumClaimedDevices++] = list->dev[i].daddr;
+
+            /* Copy device info for our device: */
+            memcpy(&port->info, &list->dev[i], sizeof(struct irda_device_info));
+            port->n_lsap_sel = LSAP_ANY;
+
+//
+// TODO -- Figure out why the following doesn't work:
+//              Returns an LSEL of 0x04 instead of 0x37 and
+//              the parameters query flat out fails:
+//
+//            /* Query the LSAP Selector number for the TinyTP (standard 3-Wire Cooked and 9-Wire Cooked modes) */
+//            len = sizeof(ias_query);
+//            ias_query.daddr = list->dev[i].daddr;
+//            strcpy(ias_query.irda_class_name, "IrCOMM");
+//            strcpy(ias_query.irda_attrib_name, "IrDA:TinyTP:LsapSel");
+//            if ((getsockopt(port->desc, SOL_IRLMP, IRLMP_IAS_QUERY, &ias_query, &len) == 0) &&
+//                (ias_query.irda_attrib_type == IAS_INTEGER)) {
+//                port->n_lsap_sel = ias_query.attribute.irda_attrib_int;
+//#ifdef EXTRA_DEBUG
+//                fprintf(stderr, "LSAP Selector: %d\n", port->n_lsap_sel);
+//#endif
+//            } else {
+//                perror("Couldn't get LSAP Selector -- using LSAP_ANY ");
+//                port->n_lsap_sel = LSAP_ANY;
+//            }
+//
+//#ifdef EXTRA_DEBUG
+//            fprintf(stderr, "\nIrCOMM Parameters :");
+//            len = sizeof(ias_query);
+//            ias_query.daddr = list->dev[i].daddr;
+//            strcpy(ias_query.irda_class_name, "IrCOMM");
+//            strcpy(ias_query.irda_attrib_name, "Parameters");
+//            if ((getsockopt(port->desc, SOL_IRLMP, IRLMP_IAS_QUERY, &ias_query, &len) == 0) &&
+//                (ias_query.irda_attrib_type == IAS_OCT_SEQ)) {
+//                for (j=0; j<ias_query.attribute.irda_attrib_octet_seq.len; j++) {
+//                    fprintf(stderr, " %02X", ias_query.attribute.irda_attrib_octet_seq.octet_seq[j]);
+//                }
+//                fprintf(stderr, "\n");
+//                j = ias_query.attribute.irda_attrib_octet_seq.len;
+//                pParam = &ias_query.attribute.irda_attrib_octet_seq.octet_seq[0];
+//                while (j>0) {
+//                    len = DumpParamTuple(pParam);
+//                    j -= len;
+//                    pParam += len;
+//                }
+//            } else {
+//                fprintf(stderr, " *** Error Couldn't Read Parameters ***\n");
+//            }
+//            fflush(stderr);
+//#endif
+
+            return TRUE;
+        }
+    }
+
+    /* Dump list found: */
+#ifdef EXTRA_DEBUG
+    fprintf(stderr, "Looking for: \"%s\" -- NOT FOUND\n", pDevice);
+#endif
+
+    /* No match */
+    return FALSE;
+}
+
+static void ReleaseDevice(COMM_PORT *port)
+{
+    int i;
+
+    if (port->info.daddr == 0) return;
+    for (i=0; i<nNumClaimedDevices; i++) {
+        if (ClaimedDevices[i] == port->info.daddr) {
+            ClaimedDevices[i] = ClaimedDevices[--nNumClaimedDevices];
+            break;
+        }
+    }
+    port->info.daddr = 0;
+}
+
+#ifdef EXTRA_DEBUG
+static int DumpParamTuple(unsigned char *pParam)
+{
+    int nSize;
+    const char strParamLabel[] = "    Param(%s) =";
+    int i;
+
+    nSize = pParam[1] + 2;      /* Total Param Size is the PL field value +2 -- one for PI and one for PL */
+
+    switch (pParam[0]) {
+        case 0x00:
+        case 0x80:
+            fprintf(stderr, strParamLabel, "Service Type");
+            if (pParam[1]) {
+                if (pParam[2] & 0x01) fprintf(stderr, " 3-WireRaw ");
+                if (pParam[2] & 0x02) fprintf(stderr, " 3-Wire ");
+                if (pParam[2] & 0x04) fprintf(stderr, " 9-Wire ");
+                if (pParam[2] & 0x08) fprintf(stderr, " Centronics ");
+                if (!pParam[2]) fprintf(stderr, " <none>");
+            } else {
+                fprintf(stderr, " ???");
+            }
+            fprintf(stderr, "\n");
+            break;
+        case 0x01:
+        case 0x81:
+            fprintf(stderr, strParamLabel, "Port Type");
+            if (pParam[1]) {
+                if (pParam[2] & 0x01) fprintf(stderr, " Serial ");
+                if (pParam[2] & 0x02) fprintf(stderr, " Parallel ");
+                if (!pParam[2]) fprintf(stderr, " <none>");
+            } else {
+                fprintf(stderr, " ???");
+            }
+            fprintf(stderr, "\n");
+            break;
+        case 0x02:
+        case 0x82:
+            fprintf(stderr, strParamLabel, "Fixed Port Name");
+            fprintf(stderr, " \"");
+            for (i=0; i<(int)pParam[1]; i++) {
+                fprintf(stderr, "%c", pParam[2+i]);
+            }
+            fprintf(stderr, "\"\n");
+            break;
+        case 0x10:
+            fprintf(stderr, strParamLabel, "Data Rate");
+            if (pParam[1] == 4) {
+                fprintf(stderr, " %lu\n", pParam[2]*16777216ul + pParam[3]*65536ul + pParam[4]*256ul + pParam[5]);
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x11:
+            fprintf(stderr, strParamLabel, "Data Format");
+            if (pParam[1]) {
+                if (pParam[2] & 0x08) {
+                    switch (pParam[2] & 0x30) {
+                        case 0x00:
+                            fprintf(stderr, "O,");
+                            break;
+                        case 0x10:
+                            fprintf(stderr, "E,");
+                            break;
+                        case 0x20:
+                            fprintf(stderr, "M,");
+                            break;
+                        case 0x30:
+                            fprintf(stderr, "S,");
+                            break;
+                    }
+                } else {
+                    fprintf(stderr, "N,");
+                }
+                switch (pParam[2] & 0x03) {
+                    case 0:
+                        fprintf(stderr, "5,");
+                        break;
+                    case 1:
+                        fprintf(stderr, "6,");
+                        break;
+                    case 2:
+                        fprintf(stderr, "7,");
+                        break;
+                    case 3:
+                        fprintf(stderr, "8,");
+                        break;
+                }
+                if (pParam[2] & 0x04) {
+                    if (pParam[2] & 0x03) {
+                        fprintf(stderr, "2\n");
+                    } else {
+                        fprintf(stderr, "1.5\n");
+                    }
+                } else {
+                    fprintf(stderr, "1\n");
+                }
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x12:
+            fprintf(stderr, strParamLabel, "Flow Control");
+            if (pParam[1]) {
+                if (pParam[2] & 0x01) fprintf(stderr, " XON/XOFF(in) ");
+                if (pParam[2] & 0x02) fprintf(stderr, " XON/XOFF(out) ");
+                if (pParam[2] & 0x04) fprintf(stderr, " RTS/CTS(in) ");
+                if (pParam[2] & 0x08) fprintf(stderr, " RTS/CTS(out) ");
+                if (pParam[2] & 0x10) fprintf(stderr, " DSR/DTR(in) ");
+                if (pParam[2] & 0x20) fprintf(stderr, " DSR/DTR(out) ");
+                if (pParam[2] & 0x40) fprintf(stderr, " ENQ/ACK(in) ");
+                if (pParam[2] & 0x80) fprintf(stderr, " ENQ/ACK(out) ");
+                if (!pParam[2]) fprintf(stderr, " <none>");
+                fprintf(stderr, "\n");
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x13:
+            fprintf(stderr, strParamLabel, "XON/XOFF Chars");
+            if (pParam[1] == 2) {
+                fprintf(stderr, " XON=0x%02X  XOFF=0x%02X\n", pParam[2], pParam[3]);
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x14:
+            fprintf(stderr, strParamLabel, "ENQ/ACK Chars");
+            if (pParam[1] == 2) {
+                fprintf(stderr, " ENQ=0x%02X  ACK=0x%02X\n", pParam[2], pParam[3]);
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x15:
+            fprintf(stderr, strParamLabel, "Line Status");
+            if (pParam[1]) {
+                if (pParam[2] & 0x02) fprintf(stderr, " Overrun ");
+                if (pParam[2] & 0x04) fprintf(stderr, " Parity ");
+                if (pParam[2] & 0x08) fprintf(stderr, " Framing ");
+                if (!pParam[2]) {
+                    fprintf(stderr, " <none>");
+                } else {
+                    fprintf(stderr, " Error(s)");
+                }
+                fprintf(stderr, "\n");
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x16:
+            fprintf(stderr, strParamLabel, "Break");
+            if (pParam[1]) {
+                if (pParam[2] & 0x01) {
+                    fprintf(stderr, " Set");
+                } else {
+                    fprintf(stderr, " Clr");
+                }
+                fprintf(stderr, "\n");
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x20:
+            fprintf(stderr, strParamLabel, "DTE Lines");
+            if (pParam[1]) {
+                if (pParam[2] & 0x04) {
+                    fprintf(stderr, "DTR=ON");
+                } else {
+                    fprintf(stderr, "DTR=OFF");
+                }
+                if (pParam[2] & 0x01) fprintf(stderr, "**");
+                fprintf(stderr, "  ");
+                if (pParam[2] & 0x08) {
+                    fprintf(stderr, "RTS=ON");
+                } else {
+                    fprintf(stderr, "RTS=OFF");
+                }
+                if (pParam[2] & 0x02) fprintf(stderr, "**");
+                fprintf(stderr, "\n");
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x21:
+            fprintf(stderr, strParamLabel, "DCE Lines");
+            if (pParam[1]) {
+                if (pParam[2] & 0x10) {
+                    fprintf(stderr, "CTS=ON");
+                } else {
+                    fprintf(stderr, "CTS=OFF");
+                }
+                if (pParam[2] & 0x01) fprintf(stderr, "**");
+                fprintf(stderr, "  ");
+                if (pParam[2] & 0x20) {
+                    fprintf(stderr, "DSR=ON");
+                } else {
+                    fprintf(stderr, "DSR=OFF");
+                }
+                if (pParam[2] & 0x02) fprintf(stderr, "**");
+                fprintf(stderr, "  ");
+                if (pParam[2] & 0x40) {
+                    fprintf(stderr, "RI=ON");
+                } else {
+                    fprintf(stderr, "RI=OFF");
+                }
+                if (pParam[2] & 0x04) fprintf(stderr, "**");
+                fprintf(stderr, "  ");
+                if (pParam[2] & 0x80) {
+                    fprintf(stderr, "CD=ON");
+                } else {
+                    fprintf(stderr, "CD=OFF");
+                }
+                if (pParam[2] & 0x08) fprintf(stderr, "**");
+                fprintf(stderr, "\n");
+            } else {
+                fprintf(stderr, " ???\n");
+            }
+            break;
+        case 0x22:
+            fprintf(stderr, "    Param(Line Settings Poll Request)\n");
+            break;
+        default:
+            fprintf(stderr, strParamLabel, "Unknown");
+            for (i=0; i<(int)pParam[1]+2; i++) {
+                fprintf(stderr, " %02X", pParam[i]);
+            }
+            fprintf(stderr, "\n");
+            break;
+    }
+
+    return nSize;
+}
+#endif
+
+/* ========================================================================== */
+/* Stream transports -- Here if using real kernel module IrCOMM device driver or
+    a TCP/Unix socket, where the data is a raw byte stream with no control channel */
+
+static int TtyOpen(COMM_PORT *port, const char *pDevice)
+{
+    struct termios terminfo;
+
+    port->desc = open(pDevice, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if  (port->desc < 0) {
+        perror("Opening Device ");
+        return FALSE;
+    }
+
+    tcgetattr(port->desc, &terminfo);
+    terminfo.c_iflag = 0;   /* IGNBRK | IGNPAR; */
+    terminfo.c_oflag = 0;
+    terminfo.c_cflag = CS8|CREAD|CLOCAL;
+    terminfo.c_lflag = 0;
+    terminfo.c_cc[4] = 0;
+    terminfo.c_cc[5] = 5;
+
+    if (tcsetattr(port->desc, TCSANOW, &terminfo) != 0) {
+        perror( "Configuring Device " );
+        return FALSE;
+    }
+
+    if (!TtySetRate(port, port->nRate)) return FALSE;
+
+    if (fcntl(port->desc, F_SETFL, O_NONBLOCK) < 0) {
+        perror("Device Setup ");
+        return FALSE;
+    }
+
+    if (tcflush(port->desc, TCIOFLUSH ) == -1) {
+        perror( "Flushing Device " );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int TtySetRate(COMM_PORT *port, long nRate)
+{
+    /* The IrCOMM driver passes this on to the Neptune as its Data Rate parameter */
+    struct termios terminfo;
+    speed_t nSpeed;
+
+    switch (nRate) {
+        case 115200:    nSpeed = B115200;   break;
+        case 57600:     nSpeed = B57600;    break;
+        case 38400:     nSpeed = B38400;    break;
+        case 19200:     nSpeed = B19200;    break;
+        default:        nSpeed = B9600;     break;
+    }
+
+    tcgetattr(port->desc, &terminfo);
+    cfsetospeed(&terminfo, nSpeed);
+    cfsetispeed(&terminfo, nSpeed);
+
+    if (tcsetattr(port->desc, TCSADRAIN, &terminfo) != 0) {
+        perror( "Setting Device Rate " );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int StreamAttach(COMM_PORT *port)
+{
+    /* The device or socket is already there once it's open, it's the wakeup that tells us
+        if the Neptune is listening */
+    return 1;
+}
+
+static int StreamConnect(COMM_PORT *port)
+{
+    while (!PutChar(port, ' ')) {
+        SleepFine(1, 0);
+        printf(".");
+        fflush(stdout);
+    }
+    printf("Connected\n");
+
+    return TRUE;
+}
+
+static int StreamSend(COMM_PORT *port, const unsigned char *pData, long nSize)
+{
+    return (write(port->desc, pData, nSize) == nSize);
+}
+
+static long StreamReceive(COMM_PORT *port)
+{
+    long nRead;
+
+    nRead = read(port->desc, &port->rxbuf[port->dwRead], port->rx_bufsize - port->dwRead);
+
+// Warning: Enabling the following causes so much overhead data loss will be experienced!
+//#ifdef EXTRA_DEBUG
+//    fprintf(stderr, "RxData:");
+//    for (i=0; i<nRead; i++) {
+//        fprintf(stderr, " %02X", port->rxbuf[port->dwRead+i]);
+//    }
+//    fprintf(stderr, "\n");
+//    fflush(stderr);
+//#endif
+
+    if (nRead < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return -1;    /* Nothing ready -- try again */
+        if ((errno != EIO) && (errno != ECONNRESET)) perror("Reading Data ");
+        return 0;       /* The link is gone -- a hung up tty reads EIO, a dropped socket ECONNRESET */
+    }
+    port->dwRead += nRead;
+
+    return nRead;
+}
+
+static int TcpOpen(COMM_PORT *port, const char *pDevice)
+{
+    struct addrinfo hints;
+    struct addrinfo *pAddrList;
+    struct addrinfo *pAddr;
+    char strHost[256];
+    const char *pHost;
+    const char *pService;
+    int nHostLen;
+    int retval;
+
+    /* Address is "tcp:<host>:<port>" or "tcp:<port>" for the local host */
+    pHost = pDevice + strlen(TcpTransport.pPrefix);
+    pService = strrchr(pHost, ':');
+    if (pService) {
+        nHostLen = pService - pHost;
+        if (nHostLen >= (int)sizeof(strHost)) nHostLen = sizeof(strHost)-1;
+        strncpy(strHost, pHost, nHostLen);
+        strHost[nHostLen] = 0;
+        pService++;
+    } else {
+        strHost[0] = 0;
+        pService = pHost;
+    }
+    if (strHost[0] == 0) strcpy(strHost, "localhost");
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    retval = getaddrinfo(strHost, pService, &hints, &pAddrList);
+    if (retval != 0) {
+        fprintf(stderr, "Resolving \"%s\" : %s\n", pDevice, gai_strerror(retval));
+        return FALSE;
+    }
+
+    for (pAddr = pAddrList; pAddr; pAddr = pAddr->ai_next) {
+        port->desc = socket(pAddr->ai_family, pAddr->ai_socktype, pAddr->ai_protocol);
+        if (port->desc < 0) continue;
+        if (connect(port->desc, pAddr->ai_addr, pAddr->ai_addrlen) == 0) break;
+        close(port->desc);
+        port->desc = -1;
+    }
+    freeaddrinfo(pAddrList);
+
+    if (port->desc < 0) {
+        perror("Connect to TCP socket ");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int UnixOpen(COMM_PORT *port, const char *pDevice)
+{
+    struct sockaddr_un peer;
+
+    /* Address is "unix:<path>" */
+    memset(&peer, 0, sizeof(peer));
+    peer.sun_family = AF_UNIX;
+    strncpy(peer.sun_path, pDevice + strlen(UnixTransport.pPrefix), sizeof(peer.sun_path)-1);
+
+    port->desc = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (port->desc < 0) {
+        perror("Creating Unix socket ");
+        return FALSE;
+    }
+
+    if (connect(port->desc, (struct sockaddr*) &peer, sizeof(peer))) {
+        perror("Connect to Unix socket ");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+void SleepFine(long nSeconds, long nuSeconds)
+{
+    struct timeval tv;
+
+    tv.tv_sec = nSeconds;
+    tv.tv_usec = nuSeconds;
+
+    /* Use the select method as a fine-grained sleep */
+    select(0, NULL, NULL, NULL, &tv);
+    /* Note: Don't rely on value of tv now! */
+}
+
+
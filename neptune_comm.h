@@ -0,0 +1,120 @@
+/*
+ * Neptune_Comm
+ *
+ * This module handles the communications link to the Neptune
+ * Altimeter.  Each kind of link (IrDA TinyTP socket with IrCOMM
+ * emulation, IrCOMM tty device driver, TCP or Unix socket) is a
+ * transport with its own open, connect, send and receive methods.
+ *
+ * Written May 8, 2004 by Donna Whisnant
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_COMM_H_
+#define _NEPTUNE_COMM_H_
+
+#include <linux/types.h>
+#include <linux/irda.h>
+
+#define MAX_TX_FRAME 64
+
+/* Natural receive frame sizes of each transport */
+#define IRDA_RX_FRAME_SIZE      2048    /* Largest IrLAP data frame */
+#define TTY_RX_FRAME_SIZE       4096    /* Size of the tty line discipline buffer */
+#define SOCKET_RX_FRAME_SIZE    65536   /* Size of a full loopback/TCP segment */
+
+#define RX_BUFFER_FRAMES        8       /* Receive buffer size in frames */
+
+/* Line rates (bits/sec) */
+#define DEFAULT_LINK_RATE       9600    /* Rate the Neptune always understands */
+#define MAX_LINK_RATE           115200  /* Highest rate we try */
+
+typedef struct comm_port COMM_PORT;
+
+typedef struct comm_transport
+{
+    const char  *pName;             /* Transport name for messages */
+    const char  *pPrefix;           /* Device name prefix that selects this transport or NULL */
+    long        nFrameSize;         /* Natural receive frame size */
+    int         bHangUp;            /* Closing the link stops a transfer in progress */
+
+    /* Open - Opens the transport using the device name (with prefix) */
+    int         (*Open)(COMM_PORT *port, const char *pDevice);
+
+    /* Attach - Makes one attempt, without waiting, to find and link to the Neptune.
+            Returns 1 when linked, 0 if it isn't there yet, or -1 on error */
+    int         (*Attach)(COMM_PORT *port);
+
+    /* Connect - Waits for the Neptune to be reachable and wakes it up */
+    int         (*Connect)(COMM_PORT *port);
+
+    /* Send - Sends a block of data bytes to the Neptune */
+    int         (*Send)(COMM_PORT *port, const unsigned char *pData, long nSize);
+
+    /* SetRate - Sets the line rate, or NULL if the transport has none (sockets) */
+    int         (*SetRate)(COMM_PORT *port, long nRate);
+
+    /* Receive - Reads the next frame and appends its data bytes to the receive buffer at dwRead.
+            Returns the number of data bytes added, 0 if the link was closed or lost, or -1 if nothing was read */
+    long        (*Receive)(COMM_PORT *port);
+} COMM_TRANSPORT;
+
+struct comm_port
+{
+    const COMM_TRANSPORT *pTransport;   /* Transport in use or NULL if not open */
+    int         desc;               /* Socket or File Descriptor for the transport or -1 */
+    long        nRate;              /* Line rate (bits/sec) to use or in use, kept across opens */
+
+    struct irda_device_info info;   /* IrDA Device Info from enumeration */
+    __u8        n_lsap_sel;         /* IrDA:TinyTP LSAP Selector for Neptune */
+
+    long        rx_bufsize;         /* size of the receive buffer */
+    unsigned char *rxbuf;           /* receive buffer */
+    long        dwRead;             /* End of the received data in rxbuf */
+    long        dwReturned;         /* End of the lines handed out from rxbuf */
+
+    int         bNonBlocking;       /* ReadLine only returns lines already received and never waits */
+};
+
+/* Transports */
+extern const COMM_TRANSPORT IrdaTransport;
+extern const COMM_TRANSPORT TtyTransport;
+extern const COMM_TRANSPORT TcpTransport;
+extern const COMM_TRANSPORT UnixTransport;
+
+/* Comm Prototypes */
+extern void InitPort(COMM_PORT *port);
+extern int OpenPort(COMM_PORT *port, const char *pDevice);
+extern int AttachPort(COMM_PORT *port);
+extern int ConnectPort(COMM_PORT *port);
+extern int ClosePort(COMM_PORT *port);
+extern int PutChar(COMM_PORT *port, const char c);
+extern int SendString(COMM_PORT *port, const char *pString);
+extern int CheckForData(COMM_PORT *port);
+extern long FillPort(COMM_PORT *port);
+extern void FlushPort(COMM_PORT *port);
+extern int ReadLine(void *pSource, DATA_REC *pRecord);
+extern int SetPortRate(COMM_PORT *port, long nRate);
+extern long PortRate(const COMM_PORT *port);
+extern long NextLowerRate(long nRate);
+extern int IsLinkRate(long nRate);
+
+/* Misc Prototypes */
+extern void SleepFine(long nSeconds, long nuSeconds);
+
+#endif  /* _NEPTUNE_COMM_H_ */
+
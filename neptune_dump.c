@@ -23,16 +23,36 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <signal.h>
+#include <time.h>
 
 #include <math.h>
 
 #include "neptune_rec.h"
+#include "neptune_stream.h"
+#include "neptune_perf.h"
+#include "neptune_cache.h"
+#include "neptune_store.h"
+#include "neptune_arrow.h"
+#include "neptune_stats.h"
+
+#ifdef HAVE_SQLITE
+#include <sqlite3.h>
+#endif
 
 /* Local Defines */
 #define VERSION 100
@@ -48,18 +68,33 @@
 #define DT_PROFILE_TAB  3
 #define DT_PROFILE_CSV  4
 #define DT_GNUPLOT      5
+#define DT_ARROW        6
+#define DT_SQLITE       7
+#define DT_STATS        8
 
 #define PT_AIRCRAFT     0
 #define PT_FREEFALL     1
 #define PT_CANOPY       2
 
-#define MAX_JUMP_RECORDS    200
-#define MAX_JUMP_PROFILES   10
 #define MAX_PROFILE_DATA    2000
 
+#define DEFAULT_MAX_LOGGED  10      /* Bad records printed in recovery mode */
+
+#define SPEED_INTERVAL      6.0     /* Seconds of datapoints each speed is worked out over */
+#define JUMP_CACHE_FORMAT   2       /* Layout of the cached jump data */
+#define ARROW_BATCH_ROWS    65536   /* Rows of the Arrow tables written in each record batch */
+#define SQLITE_BATCH_ROWS   500000  /* Profile points loaded into SQLite in each transaction */
+
+#define DEFAULT_WORKERS     4       /* Processes serving requests */
+#define MAX_WORKERS         64
+#define MAX_REQUEST_SIZE    4096
+#define MAX_REQUEST_FIELDS  16
+#define REQUEST_TIMEOUT     10      /* Seconds a client has to send its request */
+
 /* Type Definitions */
 typedef struct jump_rec
 {
+    char strSerialNo[10];
     unsigned long nJumpNumber;
     int nJumpType;
     double nExitAltitude;
@@ -80,7 +115,9 @@ typedef struct jump_datapt
 
 typedef struct jump_prof
 {
+    char strSerialNo[10];
     unsigned long nJumpNumber;
+    unsigned long nSession;
     int nAircraftPoints;
     int nFreefallPoints;
     int nCanopyPoints;
@@ -88,6 +125,58 @@ typedef struct jump_prof
     JUMP_DATAPT DataPoints[MAX_PROFILE_DATA];
 } JUMP_PROF;
 
+typedef struct jump_row            /* A row of the jump table of an export, waiting for its profile */
+{
+    char strSerialNo[10];
+    uint32_t nJumpNumber;
+    int bRecord;                        /* Its Jump Record was read */
+    int bDateTime;
+    int64_t nDateTime;
+    int nJumpType;
+    char strDataVersion[16];
+    uint8_t nSWType;
+    double nSpeeds[6];                  /* Max, 12K, 9K, 6K, 3K and average */
+    double nExitAltitude;
+    double nDeployAltitude;
+    uint32_t nFreefallTime;
+    int bProfile;                       /* Its Profile Start was read */
+    double nGroundAltitude;
+    double nFreefallStartTime;
+    double nCanopyStartTime;
+    int32_t nPoints[3];                 /* Aircraft, Freefall and Canopy */
+} JUMP_ROW;
+
+typedef struct jump_cache_params
+{
+    int nFormat;
+    unsigned long nJumpNumber;
+    double nSpeedInterval;
+    int nMaxProfileData;
+    int nJumpRecSize;
+} JUMP_CACHE_PARAMS;
+
+/* The cached jump data is a JUMP_CACHE_DATA, the JumpRecords[], then each profile
+    as a JUMP_CACHE_PROF and its columns (time, altitude, TAS and SAS as doubles,
+    then the point types as bytes, padded to 8), then the session log text */
+typedef struct jump_cache_data
+{
+    long nNumJumpRecords;
+    long nNumJumpProfiles;
+    long nSessionLogSize;
+    long nReserved;
+} JUMP_CACHE_DATA;
+
+typedef struct jump_cache_prof
+{
+    char strSerialNo[10];
+    unsigned long nJumpNumber;
+    unsigned long nSession;
+    int nAircraftPoints;
+    int nFreefallPoints;
+    int nCanopyPoints;
+    int nNumDataPoints;
+} JUMP_CACHE_PROF;
+
 /* Constants */
 #define NUM_JUMP_TYPES 16
 const char *strJumpTypes[NUM_JUMP_TYPES+1] = {
@@ -102,81 +191,539 @@ const char *strPointTypes[3] = {
                     "Aircraft", "Freefall", "Canopy"
                 };
 
+/* Columns of the Arrow tables, the first, File, just being there for a tar archive */
+#define AJ_FILE             0
+#define AJ_SERIAL           1
+#define AJ_JUMP             2
+#define AJ_DATE_TIME        3
+#define AJ_TYPE             4
+#define AJ_DATA_VERSION     5
+#define AJ_SW_TYPE          6
+#define AJ_SPEEDS           7       /* Through 12 */
+#define AJ_EXIT_ALT         13
+#define AJ_DEPLOY_ALT       14
+#define AJ_FF_TIME          15
+#define AJ_GROUND_ALT       16
+#define AJ_FF_START         17
+#define AJ_CANOPY_START     18
+#define AJ_POINTS           19      /* Through 21 */
+#define NUM_ARROW_JUMP_FIELDS 22
+const ARROW_FIELD ArrowJumpFields[NUM_ARROW_JUMP_FIELDS] = {
+                    { "File", ARROW_UTF8 }, { "Serial", ARROW_UTF8 }, { "Jump", ARROW_UINT32 },
+                    { "DateTime", ARROW_TIMESTAMP }, { "Type", ARROW_UTF8 }, { "DataVersion", ARROW_UTF8 },
+                    { "SWType", ARROW_UINT8 }, { "MaxSpeed", ARROW_FLOAT64 }, { "Speed12K", ARROW_FLOAT64 },
+                    { "Speed9K", ARROW_FLOAT64 }, { "Speed6K", ARROW_FLOAT64 }, { "Speed3K", ARROW_FLOAT64 },
+                    { "AvgSpeed", ARROW_FLOAT64 }, { "ExitAltitude", ARROW_FLOAT64 },
+                    { "DeployAltitude", ARROW_FLOAT64 }, { "FreefallTime", ARROW_UINT32 },
+                    { "GroundAltitude", ARROW_FLOAT64 }, { "FreefallStartTime", ARROW_FLOAT64 },
+                    { "CanopyStartTime", ARROW_FLOAT64 }, { "AircraftPoints", ARROW_INT32 },
+                    { "FreefallPoints", ARROW_INT32 }, { "CanopyPoints", ARROW_INT32 }
+                };
+
+#define AP_FILE             0
+#define AP_SERIAL           1
+#define AP_JUMP             2
+#define AP_POINT            3
+#define AP_TYPE             4
+#define AP_TIME             5
+#define AP_ALTITUDE         6
+#define AP_TAS              7
+#define AP_SAS              8
+#define NUM_ARROW_PROF_FIELDS 9
+const ARROW_FIELD ArrowProfileFields[NUM_ARROW_PROF_FIELDS] = {
+                    { "File", ARROW_UTF8 }, { "Serial", ARROW_UTF8 }, { "Jump", ARROW_UINT32 },
+                    { "Point", ARROW_INT32 }, { "Type", ARROW_UTF8 }, { "Time", ARROW_FLOAT64 },
+                    { "Altitude", ARROW_FLOAT64 }, { "TASpeed", ARROW_FLOAT64 }, { "SASpeed", ARROW_FLOAT64 }
+                };
+
+/* Fields of the Jump Record in the fleet statistics, with what to multiply their raw
+    values by for the report.  The names are those in partial aggregates */
+#define NUM_STATS_FIELDS    8
+const char * const strStatsFields[NUM_STATS_FIELDS] = {
+                    "ExitAltitude", "DeployAltitude", "FreefallTime", "MaxSpeed",
+                    "Speed12K", "Speed9K", "Speed6K", "Speed3K"
+                };
+const int nStatsRecFields[NUM_STATS_FIELDS] = {
+                    RF_EXIT_ALT, RF_DEPLOY_ALT, RF_FF_TIME, RF_MAX_SPEED,
+                    RF_SPEED_12K, RF_SPEED_9K, RF_SPEED_6K, RF_SPEED_3K
+                };
+const double nStatsScales[NUM_STATS_FIELDS] = {
+                    3.28084, 3.28084, 1.0, 2.23694,         /* feet, seconds and mph */
+                    2.23694, 2.23694, 2.23694, 2.23694
+                };
+#define NUM_STATS_QUANTILES 5
+const double nStatsQuantiles[NUM_STATS_QUANTILES] = { 0.05, 0.25, 0.5, 0.75, 0.95 };
+
+#ifdef HAVE_SQLITE
+/* Tables of the SQLite export.  The points are only indexed once they're loaded */
+const char *strSQLSchema =
+                    "CREATE TABLE IF NOT EXISTS jumps (serial TEXT NOT NULL, jump INTEGER NOT NULL, "
+                        "date_time TEXT, jump_type TEXT, data_version TEXT, sw_type INTEGER, "
+                        "max_speed REAL, speed_12k REAL, speed_9k REAL, speed_6k REAL, speed_3k REAL, "
+                        "avg_speed REAL, exit_altitude REAL, deploy_altitude REAL, freefall_time INTEGER, "
+                        "ground_altitude REAL, freefall_start_time REAL, canopy_start_time REAL, "
+                        "aircraft_points INTEGER, freefall_points INTEGER, canopy_points INTEGER, "
+                        "PRIMARY KEY (serial, jump));"
+                    "CREATE TABLE IF NOT EXISTS points (serial TEXT NOT NULL, jump INTEGER NOT NULL, "
+                        "point INTEGER NOT NULL, type TEXT, time REAL, altitude REAL, "
+                        "ta_speed REAL, sa_speed REAL);";
+const char *strSQLIndexes =
+                    "CREATE INDEX IF NOT EXISTS points_jump ON points (serial, jump, point);"
+                    "CREATE INDEX IF NOT EXISTS jumps_date_time ON jumps (date_time);"
+                    "CREATE INDEX IF NOT EXISTS jumps_jump_type ON jumps (jump_type);";
+
+/* Statements of the SQLite export, prepared once for the whole load.  A jump
+    already there is updated with the fields just read, so loading overlapping
+    downloads again only replaces what they have */
+#define SQL_RECORD          0
+#define SQL_PROFILE         1
+#define SQL_HAS_POINTS      2
+#define SQL_DELETE_POINTS   3
+#define SQL_POINT           4
+#define NUM_SQL_STMTS       5
+const char *strSQLStmts[NUM_SQL_STMTS] = {
+                    "INSERT INTO jumps (serial, jump, date_time, jump_type, data_version, sw_type, "
+                        "max_speed, speed_12k, speed_9k, speed_6k, speed_3k, avg_speed, "
+                        "exit_altitude, deploy_altitude, freefall_time) "
+                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15) "
+                        "ON CONFLICT (serial, jump) DO UPDATE SET date_time = excluded.date_time, "
+                        "jump_type = excluded.jump_type, data_version = excluded.data_version, "
+                        "sw_type = excluded.sw_type, max_speed = excluded.max_speed, "
+                        "speed_12k = excluded.speed_12k, speed_9k = excluded.speed_9k, "
+                        "speed_6k = excluded.speed_6k, speed_3k = excluded.speed_3k, "
+                        "avg_speed = excluded.avg_speed, exit_altitude = excluded.exit_altitude, "
+                        "deploy_altitude = excluded.deploy_altitude, freefall_time = excluded.freefall_time",
+                    "INSERT INTO jumps (serial, jump, ground_altitude, freefall_start_time, canopy_start_time, "
+                        "aircraft_points, freefall_points, canopy_points) "
+                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8) "
+                        "ON CONFLICT (serial, jump) DO UPDATE SET ground_altitude = excluded.ground_altitude, "
+                        "freefall_start_time = excluded.freefall_start_time, "
+                        "canopy_start_time = excluded.canopy_start_time, "
+                        "aircraft_points = excluded.aircraft_points, freefall_points = excluded.freefall_points, "
+                        "canopy_points = excluded.canopy_points",
+                    "SELECT aircraft_points IS NOT NULL FROM jumps WHERE serial = ?1 AND jump = ?2",
+                    "DELETE FROM points WHERE serial = ?1 AND jump = ?2",
+                    "INSERT INTO points (serial, jump, point, type, time, altitude, ta_speed, sa_speed) "
+                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)"
+                };
+#endif
+
 /* Globals */
 unsigned char databuff[MAX_RECORD_SIZE];
-JUMP_REC JumpRecords[MAX_JUMP_RECORDS];
+REC_RECOVERY myRecovery;
+PERF_COUNTERS myPerf;
+off_t nLineOffset = 0;                  /* Offset of the last line read */
+unsigned long nSession = 1;             /* Session (download) of the file being read */
+off_t nSessionOffset = 0;               /* Offset of its #NEPTUNE header */
+int bSessionEnded = FALSE;              /* Its End of all data record has been read */
+char strSessionSerialNo[10] = "";       /* Its Neptune serial number */
+char strFirstSession[80] = "";          /* Description of the first session, saved in case there are more */
+const char *pMemberName = NULL;         /* Name of the tar archive member being read, if any */
+int bFirstMember = TRUE;                /* It's the first one, so needs column headings */
+JUMP_REC *JumpRecords = NULL;           /* The jumps read, grown as they're found */
 int nNumJumpRecords = 0;
-JUMP_PROF JumpProfiles[MAX_JUMP_PROFILES];
+int nJumpRecordAlloc = 0;
+JUMP_PROF *JumpProfiles = NULL;
 int nNumJumpProfiles = 0;
+int nJumpProfileAlloc = 0;
+int bJumpsLeftOut = FALSE;              /* There wasn't the memory for all of them */
+long nBadRecords = 0;                   /* Bad records read */
+NEPTUNE_CACHE myCache;
+int bSaveCache = FALSE;                 /* Save the jump data in the cache when we're done */
+char *pSessionLog = NULL;               /* The sessions reported on stderr, for the cache */
+long nSessionLogSize = 0;
+long nSessionLogAlloc = 0;
+NEPTUNE_STORE *pStore = NULL;           /* Archive store being read instead of a file */
+STORE_QUERY myQuery;                    /*      and the jumps wanted from it */
+STORE_READER myStoreReader;             /*      read straight into each record's fields */
+int bLogSessions = TRUE;                /* Report the sessions on stderr */
+ARROW_WRITER myArrow;                   /* Arrow table being written, across tar members */
+int bArrowOpen = FALSE;
+int nArrowSkip = 0;                     /*      1 when it has no File column */
+JUMP_ROW *pArrowJumps = NULL;           /* Rows of the jump table of the session being read */
+long nNumArrowJumps = 0;
+long nArrowJumpAlloc = 0;
+JUMP_PROF myExportProfile;              /* Profile being read for an export */
+const char *pSQLitePath = NULL;         /* Database the SQLite export loads */
+#ifdef HAVE_SQLITE
+sqlite3 *pSQLite = NULL;                /*      once it's open */
+sqlite3_stmt *pSQLiteStmts[NUM_SQL_STMTS];
+int bPointsIndexed = FALSE;             /*      its points are indexed by jump while they're loaded */
+long nSQLiteRows = 0;                   /*      points loaded since the last commit */
+int bSQLiteError = FALSE;
+#endif
+JUMP_STATS myStats;                     /* Fleet statistics, across tar members */
+int bStatsOpen = FALSE;
+int bStatsError = FALSE;
+volatile sig_atomic_t bQuit = FALSE;    /* Set by a signal to stop serving */
 
 /* Prototypes */
 int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
-void PrintSummary(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
-void PrintDetail(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
-void PrintProfile(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
-void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+int ReadLine(void *pSource, DATA_REC *pRecord);
+int GetSessionRecord(NEPTUNE_STREAM *pInStream, REC_FIELDS *pFields);
+void LogSession(const char *pText);
+int ReserveJumpData(long nRecords, long nProfiles);
+int LoadJumpCache(NEPTUNE_CACHE *pCache);
+int SaveJumpCache(const NEPTUNE_CACHE *pCache);
+int DumpFile(NEPTUNE_STREAM *pInStream, const char *pInFilename, int nDumpType, unsigned long nJumpNumber,
+                const char *pSubTypes, const char *pLocation);
+void PrintSummary(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+void PrintDetail(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+void PrintProfile(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+void PrintGnuPlot(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+void PrintGnuPlotFormat(long nCount, int bBinary);
+void PrintGnuPlotData(const double *pTimes, const double *pValues, long nCount, long nStride, int bBinary);
+void WorkOutSpeeds(JUMP_PROF *pProfile);
+int JumpDateTime(const unsigned long *pValue, int64_t *pDateTime);
+JUMP_ROW *ArrowJump(const char *pSerialNo, unsigned long nJumpNumber, int bFind);
+void RecordRow(JUMP_ROW *pJump, const unsigned long *pValue);
+void ProfileRow(JUMP_ROW *pJump, const unsigned long *pValue);
+void WriteArrowJumps(void);
+void WriteArrowProfile(void);
+void PrintArrow(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+int FinishArrow(void);
+#ifdef HAVE_SQLITE
+int SQLiteFailed(const char *pWhat);
+int OpenSQLite(void);
+int SQLiteRecord(const JUMP_ROW *pJump);
+int SQLiteProfile(const JUMP_ROW *pJump);
+void PrintSQLite(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+int FinishSQLite(void);
+#endif
+void PrintStats(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation);
+int LoadStats(NEPTUNE_STREAM *pInStream, const char *pInFilename);
+int FinishStats(const char *pSubTypes);
+int ParseFilter(const char *pOption, const char *pValue, STORE_QUERY *pQuery);
+int ParseReport(int argc, char *argv[], unsigned long *pJumpNumber, int *pDumpType, char **ppSubTypes, char **ppLocation);
+void HandleSignal(int nSignal);
+int ReadRequest(int fd, char *pBuff, long nBufSize);
+int ServeRequest(int fdConn, const char *pStorePath, int fdStdout);
+int ServeWorker(int fdListen, const char *pStorePath);
+pid_t StartWorker(int fdListen, const char *pStorePath);
+int ServeStore(const char *pSocketPath, int nWorkers, const char *pStorePath);
 
 /* ========================================================================== */
 
 int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
 {
-    FILE *pFile = (FILE*)pSource;
+    NEPTUNE_STREAM *pStream = (NEPTUNE_STREAM*)pSource;
+
+    nLineOffset = pStream->nOffset;
+    return (ReadStreamLine(pStream, pBuff, nBufSize) > 0);
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    if (!ReadString(pSource, pRecord->buff, sizeof(pRecord->buff))) return FALSE;
+    pRecord->data = pRecord->buff;
+    pRecord->dwSize = strlen(pRecord->buff);
+    return TRUE;
+}
+
+int GetSessionRecord(NEPTUNE_STREAM *pInStream, REC_FIELDS *pFields)
+{
+    /* Note: This is GetNextRecord() for files of several sessions (downloads)
+                concatenated together, each with its own #NEPTUNE header, and
+                decodes the valid records into pFields.  Anything following
+                a session's End of all data record, up to the next header,
+                is skipped.  Each session is reported on stderr when there's
+                more than one, with its serial number and software version.
+                The records of an archive store come already decoded */
+    char strSession[80];
+    int nNepVersionHi;
+    int nNepVersionLo;
+    int nNepVersionRev;
+    int nPhase;
+    int type;
+
+    nPhase = PerfPhase(&myPerf, PERF_FRAMING);
+    while (1) {
+        if (pStore) {
+            PerfPhase(&myPerf, PERF_DECODE);
+            type = NextStoreRecord(&myStoreReader, pFields);
+            PerfPhase(&myPerf, nPhase);
+            nLineOffset = myStoreReader.nOffset;
+        } else {
+            type = GetNextRecord(pInStream, databuff);
+        }
+        if (type == -1) break;
+        if (type == -4) {
+            PerfPhase(&myPerf, nPhase);
+            if (nSession == 1) LogSession(strFirstSession);
+            nSession++;
+            nSessionOffset = nLineOffset;
+            bSessionEnded = FALSE;
+            strSessionSerialNo[0] = 0;
+            return type;
+        }
+        if (bSessionEnded) continue;
+        myPerf.nRecords++;
+        if (type < 0) {
+            nBadRecords++;
+            PerfPhase(&myPerf, nPhase);
+            return type;
+        }
+
+        if (!pStore) {
+            PerfPhase(&myPerf, PERF_DECODE);
+            DecodeRecord(type, databuff, pFields);
+            PerfPhase(&myPerf, nPhase);
+        }
+        switch (type) {
+            case 0:     /* Version Info */
+                if (strSessionSerialNo[0]) break;       /* Just the first, in case of damage */
+                nNepVersionHi = (pFields->nValue[RF_VERSION] >> 4) & 0x0F;
+                nNepVersionLo = pFields->nValue[RF_VERSION] & 0x0F;
+                nNepVersionRev = pFields->nValue[RF_VERSION_REV];
+                if ((nNepVersionHi == 0) && (nNepVersionLo == 0) && (nNepVersionRev < 14))
+                    nNepVersionHi = 2;
+                strcpy(strSessionSerialNo, pFields->strText);
+                snprintf(strSession, sizeof(strSession), "Session %lu at offset %lld:  Serial No %s, Software v%u.%u.%u",
+                            nSession, (long long)nSessionOffset, strSessionSerialNo,
+                            nNepVersionHi, nNepVersionLo, nNepVersionRev);
+                if (nSession == 1) {
+                    strcpy(strFirstSession, strSession);
+                } else {
+                    LogSession(strSession);
+                }
+                break;
+            case 3:     /* End of all data */
+                bSessionEnded = TRUE;
+                break;
+        }
+        return type;
+    }
+    PerfPhase(&myPerf, nPhase);
+
+    return -1;
+}
+
+void LogSession(const char *pText)
+{
+    long nLen;
+    char *pNew;
+
+    if (bLogSessions) fprintf(stderr, "%s\n", pText);
+    if (!bSaveCache) return;
+
+    /* Kept for the cache, so a run from it reports the same sessions */
+    nLen = strlen(pText) + 1;
+    if (nSessionLogSize + nLen > nSessionLogAlloc) {
+        pNew = (char *)realloc(pSessionLog, (nSessionLogAlloc + nLen) * 2);
+        if (!pNew) {
+            bSaveCache = FALSE;
+            return;
+        }
+        pSessionLog = pNew;
+        nSessionLogAlloc = (nSessionLogAlloc + nLen) * 2;
+    }
+    memcpy(&pSessionLog[nSessionLogSize], pText, nLen-1);
+    pSessionLog[nSessionLogSize+nLen-1] = '\n';
+    nSessionLogSize += nLen;
+}
+
+/* ========================================================================== */
+
+#define CACHE_ALIGN(n)      (((n) + 7) & ~7l)
+
+int ReserveJumpData(long nRecords, long nProfiles)
+{
+    /* Grows the jump records and profiles to hold at least this many of each */
+    JUMP_REC *pRecords;
+    JUMP_PROF *pProfiles;
+    long nAlloc;
+
+    if (nRecords > nJumpRecordAlloc) {
+        nAlloc = (nJumpRecordAlloc ? nJumpRecordAlloc*2 : 256);
+        if (nAlloc < nRecords) nAlloc = nRecords;
+        pRecords = (JUMP_REC *)realloc(JumpRecords, nAlloc * sizeof(JUMP_REC));
+        if (!pRecords) return FALSE;
+        JumpRecords = pRecords;
+        nJumpRecordAlloc = nAlloc;
+    }
+    if (nProfiles > nJumpProfileAlloc) {
+        nAlloc = (nJumpProfileAlloc ? nJumpProfileAlloc*2 : 16);
+        if (nAlloc < nProfiles) nAlloc = nProfiles;
+        pProfiles = (JUMP_PROF *)realloc(JumpProfiles, nAlloc * sizeof(JUMP_PROF));
+        if (!pProfiles) return FALSE;
+        JumpProfiles = pProfiles;
+        nJumpProfileAlloc = nAlloc;
+    }
+    return TRUE;
+}
+
+int LoadJumpCache(NEPTUNE_CACHE *pCache)
+{
+    const JUMP_CACHE_DATA *pData;
+    const JUMP_CACHE_PROF *pProf;
+    const char *pBase;
+    const double *pColumn;
+    const unsigned char *pTypes;
+    JUMP_PROF *pProfile;
+    long nSize;
+    long nPos;
+    long nPoints;
+    int i, j;
+
+    pBase = (const char *)OpenCache(pCache, &nSize);
+    if (!pBase) return FALSE;
+
+    /* Check every section is there before taking any of it */
+    pData = (const JUMP_CACHE_DATA *)pBase;
+    nPos = CACHE_ALIGN(sizeof(JUMP_CACHE_DATA));
+    if ((nSize < nPos) || (pData->nNumJumpRecords < 0) || (pData->nNumJumpRecords > nSize / (long)sizeof(JUMP_REC)) ||
+        (pData->nNumJumpProfiles < 0) || (pData->nNumJumpProfiles > nSize / (long)sizeof(JUMP_CACHE_PROF))) {
+        CloseCache(pCache);
+        return FALSE;
+    }
+    nPos += CACHE_ALIGN(pData->nNumJumpRecords * sizeof(JUMP_REC));
+    for (i=0; ((i<pData->nNumJumpProfiles) && (nPos + (long)sizeof(JUMP_CACHE_PROF) <= nSize)); i++) {
+        pProf = (const JUMP_CACHE_PROF *)(pBase + nPos);
+        if ((pProf->nNumDataPoints < 0) || (pProf->nNumDataPoints > MAX_PROFILE_DATA)) break;
+        nPos += CACHE_ALIGN(sizeof(JUMP_CACHE_PROF));
+        nPos += 4 * pProf->nNumDataPoints * sizeof(double) + CACHE_ALIGN(pProf->nNumDataPoints);
+    }
+    if ((i < pData->nNumJumpProfiles) || (pData->nSessionLogSize < 0) || (nPos + pData->nSessionLogSize != nSize) ||
+        (!ReserveJumpData(pData->nNumJumpRecords, pData->nNumJumpProfiles))) {
+        CloseCache(pCache);
+        return FALSE;
+    }
+
+    nPos = CACHE_ALIGN(sizeof(JUMP_CACHE_DATA));
+    nNumJumpRecords = pData->nNumJumpRecords;
+    memcpy(JumpRecords, pBase + nPos, nNumJumpRecords * sizeof(JUMP_REC));
+    nPos += CACHE_ALIGN(nNumJumpRecords * sizeof(JUMP_REC));
+
+    nNumJumpProfiles = pData->nNumJumpProfiles;
+    for (i=0; i<nNumJumpProfiles; i++) {
+        pProf = (const JUMP_CACHE_PROF *)(pBase + nPos);
+        pProfile = &JumpProfiles[i];
+        memcpy(pProfile->strSerialNo, pProf->strSerialNo, sizeof(pProfile->strSerialNo));
+        pProfile->nJumpNumber = pProf->nJumpNumber;
+        pProfile->nSession = pProf->nSession;
+        pProfile->nAircraftPoints = pProf->nAircraftPoints;
+        pProfile->nFreefallPoints = pProf->nFreefallPoints;
+        pProfile->nCanopyPoints = pProf->nCanopyPoints;
+        pProfile->nNumDataPoints = nPoints = pProf->nNumDataPoints;
+        nPos += CACHE_ALIGN(sizeof(JUMP_CACHE_PROF));
+
+        pColumn = (const double *)(pBase + nPos);
+        pTypes = (const unsigned char *)(pColumn + 4*nPoints);
+        for (j=0; j<nPoints; j++) {
+            pProfile->DataPoints[j].nTime = pColumn[j];
+            pProfile->DataPoints[j].nAltitude = pColumn[nPoints + j];
+            pProfile->DataPoints[j].nTASpeed = pColumn[2*nPoints + j];
+            pProfile->DataPoints[j].nSASpeed = pColumn[3*nPoints + j];
+            pProfile->DataPoints[j].nPointType = pTypes[j];
+        }
+        nPos += 4 * nPoints * sizeof(double) + CACHE_ALIGN(nPoints);
+    }
 
-    if (!fgets(pBuff, nBufSize, pFile)) return FALSE;
+    fwrite(pBase + nPos, 1, pData->nSessionLogSize, stderr);
+
+    CloseCache(pCache);
     return TRUE;
 }
 
+int SaveJumpCache(const NEPTUNE_CACHE *pCache)
+{
+    JUMP_CACHE_DATA *pData;
+    JUMP_CACHE_PROF *pProf;
+    const JUMP_PROF *pProfile;
+    char *pBase;
+    double *pColumn;
+    unsigned char *pTypes;
+    long nSize;
+    long nPos;
+    long nPoints;
+    int bOK;
+    int i, j;
+
+    nSize = CACHE_ALIGN(sizeof(JUMP_CACHE_DATA)) + CACHE_ALIGN(nNumJumpRecords * sizeof(JUMP_REC));
+    for (i=0; i<nNumJumpProfiles; i++)
+        nSize += CACHE_ALIGN(sizeof(JUMP_CACHE_PROF)) +
+                    4 * JumpProfiles[i].nNumDataPoints * sizeof(double) + CACHE_ALIGN(JumpProfiles[i].nNumDataPoints);
+    nSize += nSessionLogSize;
+
+    pBase = (char *)calloc(1, nSize);
+    if (!pBase) return FALSE;
+
+    pData = (JUMP_CACHE_DATA *)pBase;
+    pData->nNumJumpRecords = nNumJumpRecords;
+    pData->nNumJumpProfiles = nNumJumpProfiles;
+    pData->nSessionLogSize = nSessionLogSize;
+    nPos = CACHE_ALIGN(sizeof(JUMP_CACHE_DATA));
+    memcpy(pBase + nPos, JumpRecords, nNumJumpRecords * sizeof(JUMP_REC));
+    nPos += CACHE_ALIGN(nNumJumpRecords * sizeof(JUMP_REC));
+
+    for (i=0; i<nNumJumpProfiles; i++) {
+        pProfile = &JumpProfiles[i];
+        pProf = (JUMP_CACHE_PROF *)(pBase + nPos);
+        memcpy(pProf->strSerialNo, pProfile->strSerialNo, sizeof(pProf->strSerialNo));
+        pProf->nJumpNumber = pProfile->nJumpNumber;
+        pProf->nSession = pProfile->nSession;
+        pProf->nAircraftPoints = pProfile->nAircraftPoints;
+        pProf->nFreefallPoints = pProfile->nFreefallPoints;
+        pProf->nCanopyPoints = pProfile->nCanopyPoints;
+        pProf->nNumDataPoints = nPoints = pProfile->nNumDataPoints;
+        nPos += CACHE_ALIGN(sizeof(JUMP_CACHE_PROF));
+
+        pColumn = (double *)(pBase + nPos);
+        pTypes = (unsigned char *)(pColumn + 4*nPoints);
+        for (j=0; j<nPoints; j++) {
+            pColumn[j] = pProfile->DataPoints[j].nTime;
+            pColumn[nPoints + j] = pProfile->DataPoints[j].nAltitude;
+            pColumn[2*nPoints + j] = pProfile->DataPoints[j].nTASpeed;
+            pColumn[3*nPoints + j] = pProfile->DataPoints[j].nSASpeed;
+            pTypes[j] = pProfile->DataPoints[j].nPointType;
+        }
+        nPos += 4 * nPoints * sizeof(double) + CACHE_ALIGN(nPoints);
+    }
+
+    if (nSessionLogSize) memcpy(pBase + nPos, pSessionLog, nSessionLogSize);
+
+    bOK = SaveCache(pCache, pBase, nSize);
+    free(pBase);
+    return bOK;
+}
+
 /* ========================================================================== */
 
-void PrintSummary(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+void PrintSummary(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
 {
-    int i;
     int type;
-    int done;
     int nNepVersionHi;
     int nNepVersionLo;
     int nNepVersionRev;
-    char strNepSerialNo[10];
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
 
-    done = FALSE;
-    while ((!done) &&
-            ((type = GetNextRecord(pInFile, databuff)) != -1)) {
+    PerfPhase(&myPerf, PERF_OUTPUT);
+    while ((type = GetSessionRecord(pInStream, &myFields)) != -1) {
 
         switch (type) {
             case 0:     /* Version Info */
-                nNepVersionHi = (ConvHexByte(&databuff[9]) >> 4) & 0x0F;
-                nNepVersionLo = ConvHexByte(&databuff[9]) & 0x0F;
-                nNepVersionRev = ConvHexByte(&databuff[12]);
+                nNepVersionHi = (pValue[RF_VERSION] >> 4) & 0x0F;
+                nNepVersionLo = pValue[RF_VERSION] & 0x0F;
+                nNepVersionRev = pValue[RF_VERSION_REV];
                 if ((nNepVersionHi == 0) && (nNepVersionLo == 0) && (nNepVersionRev < 14))
                     nNepVersionHi = 2;
                 printf("Neptune Software v%u.%u.%u\n",
                             nNepVersionHi, nNepVersionLo, nNepVersionRev);
-                for (i=0; i<9; i++) {
-                    strNepSerialNo[i] = ConvHexByte(&databuff[i*3+15]);
-                    if (strNepSerialNo[i] == 0x20) strNepSerialNo[i] = 0x00;    /* String is right padded with spaces, so whitespace trim */
-                }
-                strNepSerialNo[9] = 0;
-                printf("Neptune Serial No: %s\n", strNepSerialNo);
+                printf("Neptune Serial No: %s\n", myFields.strText);
                 printf("\n");
                 break;
             case 1:     /* Jump Summary */
-                printf("Number Jump Records   = %lu\n",
-                            ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul);
-                printf("Number Jump Profiles  = %u\n",
-                            ConvHexByte(&databuff[12]));
-                printf("Total Jumps Made      = %lu\n",
-                            ConvHexByte(&databuff[15]) + ConvHexByte(&databuff[18])*256ul);
-                printf("Total FreeFall Time   = %lu sec\n",
-                            ConvHexByte(&databuff[21]) + ConvHexByte(&databuff[24])*256ul +
-                            ConvHexByte(&databuff[27])*65536ul + ConvHexByte(&databuff[30])*16777216ul);
-                printf("Last Jump Number      = %lu\n",
-                            ConvHexByte(&databuff[33]) + ConvHexByte(&databuff[36])*256ul + 1ul);
+                printf("Number Jump Records   = %lu\n", pValue[RF_NUM_JUMP_RECORDS]);
+                printf("Number Jump Profiles  = %lu\n", pValue[RF_NUM_JUMP_PROFILES]);
+                printf("Total Jumps Made      = %lu\n", pValue[RF_TOTAL_JUMPS]);
+                printf("Total FreeFall Time   = %lu sec\n", pValue[RF_TOTAL_FF_TIME]);
+                printf("Last Jump Number      = %lu\n", pValue[RF_LAST_JUMP]);
                 printf("\n");
                 break;
             case 2:     /* Jump Record */
                 break;
             case 3:     /* End of all data */
-                done = TRUE;
                 break;
             case 4:     /* Jump Profile Data Stream Type */
                 break;
@@ -194,30 +741,31 @@ void PrintSummary(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
                 break;
         }
     }
+    PerfPhase(&myPerf, PERF_NONE);
 }
 
-void PrintDetail(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+void PrintDetail(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
 {
     int i;
     long nAltitude;
     double nAvgSpeed;
     double nSpeed;
     int type;
-    int done;
     long datatype;
     unsigned long ulTemp;
     int bFirst;
     int bFindingPoints;
-    int nAircraftPoints;
-    int nFreefallPoints;
-    int nCanopyPoints;
+    int nAircraftPoints = 0;
+    int nFreefallPoints = 0;
+    int nCanopyPoints = 0;
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
 
-    done = FALSE;
     datatype = PT_AIRCRAFT;
     bFirst = FALSE;
     bFindingPoints = FALSE;
-    while ((!done) &&
-            ((type = GetNextRecord(pInFile, databuff)) != -1)) {
+    PerfPhase(&myPerf, PERF_OUTPUT);
+    while ((type = GetSessionRecord(pInStream, &myFields)) != -1) {
 
         switch (type) {
             case 2:     /* Starting new Jump Record */
@@ -239,63 +787,61 @@ void PrintDetail(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
             case 1:     /* Jump Summary */
                 break;
             case 2:     /* Jump Record */
-                ulTemp = ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul;
+                ulTemp = pValue[RF_JUMP];
                 if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
                 if (bFirst) printf("\n");
                 bFirst = TRUE;
                 printf("Jump Number           : %lu\n", ulTemp);
-                printf("Jump Date/Time        = %02u/%02u/%02u  %02u:%02u\n",
-                            ConvHexByte(&databuff[21]), ConvHexByte(&databuff[18]), ConvHexByte(&databuff[24]),
-                            ConvHexByte(&databuff[15]), ConvHexByte(&databuff[12]));
+                printf("Jump Date/Time        = %02lu/%02lu/%02lu  %02lu:%02lu\n",
+                            pValue[RF_MONTH], pValue[RF_DAY], pValue[RF_YEAR],
+                            pValue[RF_HOUR], pValue[RF_MINUTE]);
                 printf("Jump Type             = %s\n",
-                            ((ConvHexByte(&databuff[27]) < NUM_JUMP_TYPES) ? strJumpTypes[ConvHexByte(&databuff[27])+1] : strJumpTypes[0]));
-                printf("Data Version          = %u.%u.%u\n",
-                            ((ConvHexByte(&databuff[57])>>4) & 0x0F) + 1,
-                            (ConvHexByte(&databuff[57]) & 0x0F),
-                            (ConvHexByte(&databuff[60])));
-                printf("Data SW Type          = %u\n", ConvHexByte(&databuff[63]));
+                            ((pValue[RF_JUMP_TYPE] < NUM_JUMP_TYPES) ? strJumpTypes[pValue[RF_JUMP_TYPE]+1] : strJumpTypes[0]));
+                printf("Data Version          = %lu.%lu.%lu\n",
+                            ((pValue[RF_DATA_VERSION]>>4) & 0x0F) + 1,
+                            (pValue[RF_DATA_VERSION] & 0x0F),
+                            pValue[RF_DATA_VERSION_REV]);
+                printf("Data SW Type          = %lu\n", pValue[RF_SW_TYPE]);
                 nAvgSpeed = 0.0;
                 i = 0;
-                nSpeed = (round(ConvHexByte(&databuff[30])*22.3694))/10.0;
+                nSpeed = (round(pValue[RF_MAX_SPEED]*22.3694))/10.0;
                 if (nSpeed) {
                     nAvgSpeed += nSpeed;
                     i++;
                 }
                 printf("Max FF Speed (TAS)    = %.1f mph\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[33])*22.3694)/10.0);
+                nSpeed = (round(pValue[RF_SPEED_12K]*22.3694)/10.0);
                 if (nSpeed) {
                     nAvgSpeed += nSpeed;
                     i++;
                 }
                 printf("12K FF Speed (TAS)    = %.1f mph\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[36])*22.3694)/10.0);
+                nSpeed = (round(pValue[RF_SPEED_9K]*22.3694)/10.0);
                 if (nSpeed) {
                     nAvgSpeed += nSpeed;
                     i++;
                 }
                 printf(" 9K FF Speed (TAS)    = %.1f mph\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[39])*22.3694)/10.0);
+                nSpeed = (round(pValue[RF_SPEED_6K]*22.3694)/10.0);
                 if (nSpeed) {
                     nAvgSpeed += nSpeed;
                     i++;
                 }
                 printf(" 6K FF Speed (TAS)    = %.1f mph\n", nSpeed);
                 printf(" 3K FF Speed (TAS)    = %.1f mph\n",
-                            (round(ConvHexByte(&databuff[42])*22.3694)/10.0));
+                            (round(pValue[RF_SPEED_3K]*22.3694)/10.0));
                 if (i) nAvgSpeed = round((nAvgSpeed*10.0)/i)/10.0;
                 printf("Avg FF Speed (TAS)    = %.1f mph\n", nAvgSpeed);
                 printf("Exit Altitude (AGL)   = %lu ft\n",
-                            (unsigned long)lround((ConvHexByte(&databuff[45]) + ConvHexByte(&databuff[48])*256ul)*3.28084));
+                            (unsigned long)lround(pValue[RF_EXIT_ALT]*3.28084));
                 printf("Deploy Altitude (AGL) = %lu ft\n",
-                            (unsigned long)lround((ConvHexByte(&databuff[51]) + ConvHexByte(&databuff[54])*256ul)*3.28084));
-                printf("Freefall Time         = %lu sec\n",
-                            ConvHexByte(&databuff[66]) + ConvHexByte(&databuff[69])*256ul);
+                            (unsigned long)lround(pValue[RF_DEPLOY_ALT]*3.28084));
+                printf("Freefall Time         = %lu sec\n", pValue[RF_FF_TIME]);
                 break;
             case 3:     /* End of all data */
-                done = TRUE;
                 break;
             case 4:     /* Jump Profile Data Stream Type */
-                switch (ConvHexByte(&databuff[6])) {
+                switch (pValue[RF_STREAM_TYPE]) {
                     case 5:
                         datatype = PT_FREEFALL;
                         break;
@@ -306,18 +852,16 @@ void PrintDetail(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
                 }
                 break;
             case 5:     /* Profile Start */
-                ulTemp = ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul;
+                ulTemp = pValue[RF_JUMP];
                 if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
-                nAltitude = (ConvHexByte(&databuff[12]) + ConvHexByte(&databuff[15])*256ul);
+                nAltitude = pValue[RF_GROUND_ALT];
                 if (nAltitude > 32767l) nAltitude = nAltitude - 65534l;     /* Why is this 65534 in paralog and not 65536 ?? */
                 printf("Ground Altitude (MSL) = %ld ft\n", lround(nAltitude*3.28084));
                 //Type5 Exit Altitude -- Redundant
                 //printf("Exit Altitude (AGL)   = %lu ft\n",
-                //            (unsigned long)lround((ConvHexByte(&databuff[18]) + ConvHexByte(&databuff[21])*256ul)*3.28084));
-                printf("Freefall Start Time   = %.2f sec\n",
-                            (ConvHexByte(&databuff[24]) + ConvHexByte(&databuff[27])*256ul)*0.25);
-                printf("Canopy Start Time     = %.2f sec\n",
-                            (ConvHexByte(&databuff[30]) + ConvHexByte(&databuff[33])*256ul)*0.25);
+                //            (unsigned long)lround(pValue[RF_EXIT_ALT]*3.28084));
+                printf("Freefall Start Time   = %.2f sec\n", pValue[RF_FF_START]*0.25);
+                printf("Canopy Start Time     = %.2f sec\n", pValue[RF_CANOPY_START]*0.25);
 
                 datatype = PT_AIRCRAFT;
                 nAircraftPoints = 0;
@@ -352,30 +896,37 @@ void PrintDetail(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
     }
 
     printf("\n");
+    PerfPhase(&myPerf, PERF_NONE);
 }
 
-void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
+void JumpLeftOut(unsigned long nJumpNumber)
 {
-    int i,j,k;
-    double speedInterval;
-    double nmAltitude;
+    fprintf(stderr, "Out of memory -- jump %lu of %s is left out!\n", nJumpNumber, strSessionSerialNo);
+    bJumpsLeftOut = TRUE;
+}
+
+void ReadJumpData(NEPTUNE_STREAM *pInStream, unsigned long nJumpNumber)
+{
+    int i;
     long nAltitude;
     int type;
-    int done;
     long datatype;
     unsigned long nCurrentJump;
     int bFindingPoints;
     int ndxJumpRecord;
     int ndxJumpProfile;
+    int nPhase;
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
+
+    if ((!pInStream) && (!pStore)) return;      /* Already loaded from the cache */
 
-    done = FALSE;
     datatype = PT_AIRCRAFT;
     bFindingPoints = FALSE;
     nNumJumpRecords = 0;
     nNumJumpProfiles = 0;
 
-    while ((!done) &&
-            ((type = GetNextRecord(pInFile, databuff)) != -1)) {
+    while ((type = GetSessionRecord(pInStream, &myFields)) != -1) {
 
         switch (type) {
             case 2:     /* Starting new Jump Record */
@@ -392,19 +943,24 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
             case 1:     /* Jump Summary */
                 break;
             case 2:     /* Jump Record */
-                nCurrentJump = ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul;
+                nCurrentJump = pValue[RF_JUMP];
                 if ((nJumpNumber != 0) && (nJumpNumber != nCurrentJump)) continue;
 
                 ndxJumpRecord = -1;
                 for (i=0; i<nNumJumpRecords; i++) {
-                    if (JumpRecords[i].nJumpNumber == nCurrentJump) {
+                    if ((JumpRecords[i].nJumpNumber == nCurrentJump) &&
+                        (strcmp(JumpRecords[i].strSerialNo, strSessionSerialNo) == 0)) {
                         ndxJumpRecord = i;
                         break;
                     }
                 }
                 if (ndxJumpRecord == -1) {
-                    if (nNumJumpRecords >= MAX_JUMP_RECORDS) break;
+                    if (!ReserveJumpData(nNumJumpRecords+1, nNumJumpProfiles)) {
+                        JumpLeftOut(nCurrentJump);
+                        break;
+                    }
                     ndxJumpRecord = nNumJumpRecords++;
+                    strcpy(JumpRecords[ndxJumpRecord].strSerialNo, strSessionSerialNo);
                     JumpRecords[ndxJumpRecord].nJumpNumber = nCurrentJump;
                     JumpRecords[ndxJumpRecord].nJumpType = 0;
                     JumpRecords[ndxJumpRecord].nExitAltitude = 0.0;
@@ -414,20 +970,19 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
                     JumpRecords[ndxJumpRecord].nCanopyStartTime = 0.0;
                 }
 
-                if (ConvHexByte(&databuff[27]) < NUM_JUMP_TYPES) {
-                    JumpRecords[ndxJumpRecord].nJumpType = ConvHexByte(&databuff[27])+1;
+                if (pValue[RF_JUMP_TYPE] < NUM_JUMP_TYPES) {
+                    JumpRecords[ndxJumpRecord].nJumpType = pValue[RF_JUMP_TYPE]+1;
                 } else {
                     JumpRecords[ndxJumpRecord].nJumpType = 0;
                 }
-                JumpRecords[ndxJumpRecord].nExitAltitude = (ConvHexByte(&databuff[45]) + ConvHexByte(&databuff[48])*256ul)*3.28084;
-                JumpRecords[ndxJumpRecord].nDeployAltitude = (ConvHexByte(&databuff[51]) + ConvHexByte(&databuff[54])*256ul)*3.28084;
+                JumpRecords[ndxJumpRecord].nExitAltitude = pValue[RF_EXIT_ALT]*3.28084;
+                JumpRecords[ndxJumpRecord].nDeployAltitude = pValue[RF_DEPLOY_ALT]*3.28084;
 
                 break;
             case 3:     /* End of all data */
-                done = TRUE;
                 break;
             case 4:     /* Jump Profile Data Stream Type */
-                switch (ConvHexByte(&databuff[6])) {
+                switch (pValue[RF_STREAM_TYPE]) {
                     case 5:
                         datatype = PT_FREEFALL;
                         break;
@@ -438,19 +993,24 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
                 }
                 break;
             case 5:     /* Profile Start */
-                nCurrentJump = ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul;
+                nCurrentJump = pValue[RF_JUMP];
                 if ((nJumpNumber != 0) && (nJumpNumber != nCurrentJump)) continue;
 
                 ndxJumpRecord = -1;
                 for (i=0; i<nNumJumpRecords; i++) {
-                    if (JumpRecords[i].nJumpNumber == nCurrentJump) {
+                    if ((JumpRecords[i].nJumpNumber == nCurrentJump) &&
+                        (strcmp(JumpRecords[i].strSerialNo, strSessionSerialNo) == 0)) {
                         ndxJumpRecord = i;
                         break;
                     }
                 }
                 if (ndxJumpRecord == -1) {
-                    if (nNumJumpRecords >= MAX_JUMP_RECORDS) break;
+                    if (!ReserveJumpData(nNumJumpRecords+1, nNumJumpProfiles)) {
+                        JumpLeftOut(nCurrentJump);
+                        break;
+                    }
                     ndxJumpRecord = nNumJumpRecords++;
+                    strcpy(JumpRecords[ndxJumpRecord].strSerialNo, strSessionSerialNo);
                     JumpRecords[ndxJumpRecord].nJumpNumber = nCurrentJump;
                     JumpRecords[ndxJumpRecord].nJumpType = 0;
                     JumpRecords[ndxJumpRecord].nExitAltitude = 0.0;
@@ -460,24 +1020,38 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
                     JumpRecords[ndxJumpRecord].nCanopyStartTime = 0.0;
                 }
 
-                nAltitude = (ConvHexByte(&databuff[12]) + ConvHexByte(&databuff[15])*256ul);
+                nAltitude = pValue[RF_GROUND_ALT];
                 if (nAltitude > 32767l) nAltitude = nAltitude - 65534l;     /* Why is this 65534 in paralog and not 65536 ?? */
 
                 JumpRecords[ndxJumpRecord].nGroundAltitude = nAltitude*3.28084;
-                JumpRecords[ndxJumpRecord].nFreefallStartTime = (ConvHexByte(&databuff[24]) + ConvHexByte(&databuff[27])*256ul)*0.25;
-                JumpRecords[ndxJumpRecord].nCanopyStartTime = (ConvHexByte(&databuff[30]) + ConvHexByte(&databuff[33])*256ul)*0.25;
+                JumpRecords[ndxJumpRecord].nFreefallStartTime = pValue[RF_FF_START]*0.25;
+                JumpRecords[ndxJumpRecord].nCanopyStartTime = pValue[RF_CANOPY_START]*0.25;
 
                 ndxJumpProfile = -1;
                 for (i=0; i<nNumJumpProfiles; i++) {
-                    if (JumpProfiles[i].nJumpNumber == nCurrentJump) {
+                    if ((JumpProfiles[i].nJumpNumber == nCurrentJump) &&
+                        (strcmp(JumpProfiles[i].strSerialNo, strSessionSerialNo) == 0)) {
                         ndxJumpProfile = i;
                         break;
                     }
                 }
+                if ((ndxJumpProfile != -1) && (JumpProfiles[ndxJumpProfile].nSession != nSession)) {
+                    /* Downloaded again in a later session, which replaces it */
+                    JumpProfiles[ndxJumpProfile].nSession = nSession;
+                    JumpProfiles[ndxJumpProfile].nAircraftPoints = 0;
+                    JumpProfiles[ndxJumpProfile].nFreefallPoints = 0;
+                    JumpProfiles[ndxJumpProfile].nCanopyPoints = 0;
+                    JumpProfiles[ndxJumpProfile].nNumDataPoints = 0;
+                }
                 if (ndxJumpProfile == -1) {
-                    if (nNumJumpProfiles >= MAX_JUMP_PROFILES) break;
+                    if (!ReserveJumpData(nNumJumpRecords, nNumJumpProfiles+1)) {
+                        JumpLeftOut(nCurrentJump);
+                        break;
+                    }
                     ndxJumpProfile = nNumJumpProfiles++;
+                    strcpy(JumpProfiles[ndxJumpProfile].strSerialNo, strSessionSerialNo);
                     JumpProfiles[ndxJumpProfile].nJumpNumber = nCurrentJump;
+                    JumpProfiles[ndxJumpProfile].nSession = nSession;
                     JumpProfiles[ndxJumpProfile].nAircraftPoints = 0;
                     JumpProfiles[ndxJumpProfile].nFreefallPoints = 0;
                     JumpProfiles[ndxJumpProfile].nCanopyPoints = 0;
@@ -506,9 +1080,9 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
                     }
                     JumpProfiles[ndxJumpProfile].DataPoints[JumpProfiles[ndxJumpProfile].nNumDataPoints].nPointType = datatype;
                     JumpProfiles[ndxJumpProfile].DataPoints[JumpProfiles[ndxJumpProfile].nNumDataPoints].nTime =
-                                (ConvHexByte(&databuff[12]) + ConvHexByte(&databuff[15])*256ul)*0.25;
+                                pValue[RF_TIME]*0.25;
                     JumpProfiles[ndxJumpProfile].DataPoints[JumpProfiles[ndxJumpProfile].nNumDataPoints].nAltitude =
-                                (ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul)*3.28084;
+                                pValue[RF_ALTITUDE]*3.28084;
                     JumpProfiles[ndxJumpProfile].DataPoints[JumpProfiles[ndxJumpProfile].nNumDataPoints].nTASpeed = 0.0;
                     JumpProfiles[ndxJumpProfile].DataPoints[JumpProfiles[ndxJumpProfile].nNumDataPoints].nSASpeed = 0.0;
 
@@ -526,66 +1100,84 @@ void ReadJumpData(FILE *pInFile, unsigned long nJumpNumber)
         }
     }
 
-    speedInterval = 6.0;
-
+    nPhase = PerfPhase(&myPerf, PERF_SPEED);
     for (ndxJumpProfile=0; ndxJumpProfile < nNumJumpProfiles; ndxJumpProfile++) {
-        for (k=0; ((k < JumpProfiles[ndxJumpProfile].nNumDataPoints) &&
-                    ((JumpProfiles[ndxJumpProfile].DataPoints[k].nTime - JumpProfiles[ndxJumpProfile].DataPoints[0].nTime) <
-                        (speedInterval / 2.0))); k++) {
-            JumpProfiles[ndxJumpProfile].DataPoints[k].nTASpeed = 0.0;
-            JumpProfiles[ndxJumpProfile].DataPoints[k].nSASpeed = 0.0;
-        }
-
-        j = 0;
-        i = 0;
-
-        for(; ((k < JumpProfiles[ndxJumpProfile].nNumDataPoints) &&
-                (j < JumpProfiles[ndxJumpProfile].nNumDataPoints)); k++) {
-            while ((i < JumpProfiles[ndxJumpProfile].nNumDataPoints) &&
-                    ((JumpProfiles[ndxJumpProfile].DataPoints[k].nTime - JumpProfiles[ndxJumpProfile].DataPoints[i].nTime) >
-                        (speedInterval / 2.0)))
-                i++;
-            for (; ((j < JumpProfiles[ndxJumpProfile].nNumDataPoints) &&
-                    ((JumpProfiles[ndxJumpProfile].DataPoints[j].nTime - JumpProfiles[ndxJumpProfile].DataPoints[i].nTime) <
-                        speedInterval)); j++);
-            if ((i < JumpProfiles[ndxJumpProfile].nNumDataPoints) &&
-                (j < JumpProfiles[ndxJumpProfile].nNumDataPoints)) {
-                JumpProfiles[ndxJumpProfile].DataPoints[k].nTASpeed =
-                        ((JumpProfiles[ndxJumpProfile].DataPoints[i].nAltitude/3.28084) -
-                            (JumpProfiles[ndxJumpProfile].DataPoints[j].nAltitude/3.28084)) /
-                        (JumpProfiles[ndxJumpProfile].DataPoints[j].nTime - JumpProfiles[ndxJumpProfile].DataPoints[i].nTime);
-                nmAltitude = JumpProfiles[ndxJumpProfile].DataPoints[k].nAltitude/3.28084;
-                JumpProfiles[ndxJumpProfile].DataPoints[k].nSASpeed =
-                        JumpProfiles[ndxJumpProfile].DataPoints[k].nTASpeed /
-                        (1.0 + 0.00004 * nmAltitude + 0.000000001 * nmAltitude * nmAltitude);
-                JumpProfiles[ndxJumpProfile].DataPoints[k].nTASpeed *= 2.236936;
-                JumpProfiles[ndxJumpProfile].DataPoints[k].nSASpeed *= 2.236936;
-            }
-        }
+        myPerf.nDataPoints += JumpProfiles[ndxJumpProfile].nNumDataPoints;
+        WorkOutSpeeds(&JumpProfiles[ndxJumpProfile]);
+    }
+    PerfPhase(&myPerf, nPhase);
+}
+
+void WorkOutSpeeds(JUMP_PROF *pProfile)
+{
+    /* The speeds at each datapoint, from the altitudes SPEED_INTERVAL seconds around it */
+    int i,j,k;
+    double speedInterval;
+    double nmAltitude;
+
+    speedInterval = SPEED_INTERVAL;
+
+    for (k=0; ((k < pProfile->nNumDataPoints) &&
+                ((pProfile->DataPoints[k].nTime - pProfile->DataPoints[0].nTime) <
+                    (speedInterval / 2.0))); k++) {
+        pProfile->DataPoints[k].nTASpeed = 0.0;
+        pProfile->DataPoints[k].nSASpeed = 0.0;
+    }
 
-        for (; (k < JumpProfiles[ndxJumpProfile].nNumDataPoints); k++) {
-            JumpProfiles[ndxJumpProfile].DataPoints[k].nTASpeed = 0.0;
-            JumpProfiles[ndxJumpProfile].DataPoints[k].nSASpeed = 0.0;
+    j = 0;
+    i = 0;
+
+    for(; ((k < pProfile->nNumDataPoints) &&
+            (j < pProfile->nNumDataPoints)); k++) {
+        while ((i < pProfile->nNumDataPoints) &&
+                ((pProfile->DataPoints[k].nTime - pProfile->DataPoints[i].nTime) >
+                    (speedInterval / 2.0)))
+            i++;
+        for (; ((j < pProfile->nNumDataPoints) &&
+                ((pProfile->DataPoints[j].nTime - pProfile->DataPoints[i].nTime) <
+                    speedInterval)); j++);
+        if ((i < pProfile->nNumDataPoints) &&
+            (j < pProfile->nNumDataPoints)) {
+            pProfile->DataPoints[k].nTASpeed =
+                    ((pProfile->DataPoints[i].nAltitude/3.28084) -
+                        (pProfile->DataPoints[j].nAltitude/3.28084)) /
+                    (pProfile->DataPoints[j].nTime - pProfile->DataPoints[i].nTime);
+            nmAltitude = pProfile->DataPoints[k].nAltitude/3.28084;
+            pProfile->DataPoints[k].nSASpeed =
+                    pProfile->DataPoints[k].nTASpeed /
+                    (1.0 + 0.00004 * nmAltitude + 0.000000001 * nmAltitude * nmAltitude);
+            pProfile->DataPoints[k].nTASpeed *= 2.236936;
+            pProfile->DataPoints[k].nSASpeed *= 2.236936;
         }
     }
+
+    for (; (k < pProfile->nNumDataPoints); k++) {
+        pProfile->DataPoints[k].nTASpeed = 0.0;
+        pProfile->DataPoints[k].nSASpeed = 0.0;
+    }
 }
 
-void PrintProfile(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+void PrintProfile(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
 {
     int i,j;
 
-    ReadJumpData(pInFile, nJumpNumber);
+    ReadJumpData(pInStream, nJumpNumber);
+    PerfPhase(&myPerf, PERF_OUTPUT);
 
-    if ((!pSubTypes) || (strpbrk(pSubTypes, "h") == NULL)) {
+    /* Points from the members of a tar archive are tagged with the member's name */
+    if (((!pSubTypes) || (strpbrk(pSubTypes, "h") == NULL)) && (bFirstMember)) {
         switch (nDumpType) {
             case DT_PROFILE_TAB:
                 if ((!pSubTypes) || (strpbrk(pSubTypes, "s") == NULL)) {
+                    if (pMemberName) printf("File\t");
                     printf("Jump\tPoint\tType\tTime\tAltitude\tTASpeed\tSASpeed\n");
                 } else {
+                    if (pMemberName) printf("File                           ");
                     printf("Jump    Point   Type            Time            Altitude        TASpeed         SASpeed\n");
                 }
                 break;
             case DT_PROFILE_CSV:
+                if (pMemberName) printf("File,");
                 printf("Jump,Point,Type,Time,Altitude,TASpeed,SASpeed\n");
                 break;
         }
@@ -593,6 +1185,16 @@ void PrintProfile(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
 
     for (i=0; i<nNumJumpProfiles; i++) {
         for (j=0; j<JumpProfiles[i].nNumDataPoints; j++) {
+            if (pMemberName) {
+                switch (nDumpType) {
+                    case DT_PROFILE_TAB:
+                        printf((((!pSubTypes) || (strpbrk(pSubTypes, "s") == NULL)) ? "%s\t" : "%-30s "), pMemberName);
+                        break;
+                    case DT_PROFILE_CSV:
+                        printf("%s,", pMemberName);
+                        break;
+                }
+            }
             switch (nDumpType) {
                 case DT_PROFILE_TAB:
                     if ((!pSubTypes) || (strpbrk(pSubTypes, "s") == NULL)) {
@@ -628,9 +1230,57 @@ void PrintProfile(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
             }
         }
     }
+    PerfPhase(&myPerf, PERF_NONE);
+}
+
+void PrintGnuPlotFormat(long nCount, int bBinary)
+{
+    /* How gnuplot is to read the inline data of a plot that follows the plot command */
+    if (bBinary) printf(" binary record=(%ld) format='%%float32%%float32' endian=little using 1:2", nCount);
+}
+
+void PrintGnuPlotData(const double *pTimes, const double *pValues, long nCount, long nStride, int bBinary)
+{
+    /* Note: As binary, the points are pairs of little-endian float32s with
+                nothing after them, gnuplot counting them off by the record
+                length of the plot command.  That's plenty for a plot, and
+                it doesn't have to parse any of it */
+    static uint8_t nBuff[MAX_PROFILE_DATA * 8];
+    const uint8_t *pTime = (const uint8_t *)pTimes;
+    const uint8_t *pValue = (const uint8_t *)pValues;
+    uint8_t *pOut;
+    float nFloat;
+    uint32_t nBits;
+    long i;
+    int j;
+
+    if (!bBinary) {
+        for (i=0; i<nCount; i++) {
+            printf("%f %f\n", *(const double *)(pTime + i*nStride), *(const double *)(pValue + i*nStride));
+        }
+        printf("e\n");
+        return;
+    }
+
+    pOut = nBuff;
+    for (i=0; i<nCount; i++) {
+        for (j=0; j<2; j++) {
+            nFloat = *(const double *)((j ? pValue : pTime) + i*nStride);
+            memcpy(&nBits, &nFloat, sizeof(nBits));
+            *pOut++ = nBits & 0xFF;
+            *pOut++ = (nBits >> 8) & 0xFF;
+            *pOut++ = (nBits >> 16) & 0xFF;
+            *pOut++ = (nBits >> 24) & 0xFF;
+        }
+        if ((pOut - nBuff) == sizeof(nBuff)) {
+            fwrite(nBuff, 1, pOut - nBuff, stdout);
+            pOut = nBuff;
+        }
+    }
+    fwrite(nBuff, 1, pOut - nBuff, stdout);
 }
 
-void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+void PrintGnuPlot(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
 {
     int i,j;
     double nMaxAltitude;
@@ -643,10 +1293,13 @@ void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
     int bAltPlot;
     int bTASPlot;
     int bSASPlot;
+    int bBinary;
     int bFirst;
+    double nMarkers[4];
 
-    ReadJumpData(pInFile, nJumpNumber);
+    ReadJumpData(pInStream, nJumpNumber);
     if (nNumJumpProfiles == 0) return;  /* Exit if nothing to do */
+    PerfPhase(&myPerf, PERF_OUTPUT);
 
     bSingleJump = FALSE;
     if ((nNumJumpRecords == 1) &&
@@ -655,6 +1308,7 @@ void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
     bAltPlot = FALSE;
     bTASPlot = FALSE;
     bSASPlot = FALSE;
+    bBinary = ((pSubTypes) && (strpbrk(pSubTypes, "b")));
     if (pSubTypes) {
         if (strpbrk(pSubTypes, "a")) bAltPlot = TRUE;
         if (strpbrk(pSubTypes, "t")) bTASPlot = TRUE;
@@ -746,28 +1400,32 @@ void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
     bFirst = TRUE;
     for (i=0; i<nNumJumpProfiles; i++) {
         if (bAltPlot) {
-            printf("%s '-' title \"Altitude\" with lines",
-                    (bFirst ? "plot" : ", "));
+            printf("%s '-'", (bFirst ? "plot" : ", "));
+            PrintGnuPlotFormat(JumpProfiles[i].nNumDataPoints, bBinary);
+            printf(" title \"Altitude\" with lines");
             bFirst = FALSE;
         }
 
         if (bTASPlot) {
-            printf("%s '-' axes x1y2 title \"TASpeed\" with lines%s",
-                    (bFirst ? "plot" : ", "),
+            printf("%s '-'", (bFirst ? "plot" : ", "));
+            PrintGnuPlotFormat(JumpProfiles[i].nNumDataPoints, bBinary);
+            printf(" axes x1y2 title \"TASpeed\" with lines%s",
                     ((bSingleJump && !bSASPlot) ? " 3" : ""));
             bFirst = FALSE;
         }
 
         if (bSASPlot) {
-            printf("%s '-' axes x1y2 title \"SASpeed\" with lines%s",
-                    (bFirst ? "plot" : ", "),
+            printf("%s '-'", (bFirst ? "plot" : ", "));
+            PrintGnuPlotFormat(JumpProfiles[i].nNumDataPoints, bBinary);
+            printf(" axes x1y2 title \"SASpeed\" with lines%s",
                     ((bSingleJump && !bTASPlot) ? " 3" : ""));
             bFirst = FALSE;
         }
 
         if ((bSingleJump) && (bAltPlot)) {
-            printf("%s '-' notitle with points ls 1",
-                    (bFirst ? "plot" : ", "));
+            printf("%s '-'", (bFirst ? "plot" : ", "));
+            PrintGnuPlotFormat(2, bBinary);
+            printf(" notitle with points ls 1");
             bFirst = FALSE;
         }
     }
@@ -775,112 +1433,1191 @@ void PrintGnuPlot(FILE *pInFile, int nDumpType, unsigned long nJumpNumber, const
 
     /* Print Plot Data */
     for (i=0; i<nNumJumpProfiles; i++) {
-        if (bAltPlot) {
-            for (j=0; j<JumpProfiles[i].nNumDataPoints; j++) {
-                printf("%f %f\n", JumpProfiles[i].DataPoints[j].nTime,
-                                JumpProfiles[i].DataPoints[j].nAltitude);
-            }
-            printf("e\n");
-        }
+        if (bAltPlot)
+            PrintGnuPlotData(&JumpProfiles[i].DataPoints[0].nTime, &JumpProfiles[i].DataPoints[0].nAltitude,
+                                JumpProfiles[i].nNumDataPoints, sizeof(JUMP_DATAPT), bBinary);
 
-        if (bTASPlot) {
-            for (j=0; j<JumpProfiles[i].nNumDataPoints; j++) {
-                printf("%f %f\n", JumpProfiles[i].DataPoints[j].nTime,
-                                JumpProfiles[i].DataPoints[j].nTASpeed);
-            }
-            printf("e\n");
-        }
+        if (bTASPlot)
+            PrintGnuPlotData(&JumpProfiles[i].DataPoints[0].nTime, &JumpProfiles[i].DataPoints[0].nTASpeed,
+                                JumpProfiles[i].nNumDataPoints, sizeof(JUMP_DATAPT), bBinary);
 
-        if (bSASPlot) {
-            for (j=0; j<JumpProfiles[i].nNumDataPoints; j++) {
-                printf("%f %f\n", JumpProfiles[i].DataPoints[j].nTime,
-                                JumpProfiles[i].DataPoints[j].nSASpeed);
-            }
-            printf("e\n");
-        }
+        if (bSASPlot)
+            PrintGnuPlotData(&JumpProfiles[i].DataPoints[0].nTime, &JumpProfiles[i].DataPoints[0].nSASpeed,
+                                JumpProfiles[i].nNumDataPoints, sizeof(JUMP_DATAPT), bBinary);
 
         if ((bSingleJump) && (bAltPlot)) {
-            printf("%f %f\n", nFreefallStartTime, nExitAltitude);
-            printf("%f %f\n", nCanopyStartTime, nDeployAltitude);
-            printf("e\n");
+            nMarkers[0] = nFreefallStartTime;
+            nMarkers[1] = nExitAltitude;
+            nMarkers[2] = nCanopyStartTime;
+            nMarkers[3] = nDeployAltitude;
+            PrintGnuPlotData(&nMarkers[0], &nMarkers[1], 2, 2*sizeof(double), bBinary);
         }
     }
 
     if ((pSubTypes) && (strpbrk(pSubTypes, "p")))
         printf("pause -1 \"Hit return to continue\"\n");
+    PerfPhase(&myPerf, PERF_NONE);
 }
 
-/* ========================================================================== */
+int JumpDateTime(const unsigned long *pValue, int64_t *pDateTime)
+{
+    /* Seconds since 1970 of the date and time the jump was recorded */
+    long nYear;
+    long nMonth;
+    long nEra;
+    long nYearOfEra;
+    long nDayOfEra;
+
+    nYear = pValue[RF_YEAR];
+    if (nYear < 100) nYear += 2000;
+    nMonth = pValue[RF_MONTH];
+    if ((nMonth < 1) || (nMonth > 12) || (pValue[RF_DAY] < 1) || (pValue[RF_DAY] > 31) ||
+        (pValue[RF_HOUR] > 23) || (pValue[RF_MINUTE] > 59)) return FALSE;
+
+    /* Days counted from March, so the leap day is the last of the year */
+    if (nMonth <= 2) nYear--;
+    nEra = nYear / 400;
+    nYearOfEra = nYear - nEra * 400;
+    nDayOfEra = nYearOfEra * 365 + nYearOfEra/4 - nYearOfEra/100 +
+                (153 * (nMonth + ((nMonth > 2) ? -3 : 9)) + 2)/5 + pValue[RF_DAY] - 1;
+    *pDateTime = ((int64_t)(nEra * 146097 + nDayOfEra - 719468)) * 86400 +
+                    pValue[RF_HOUR] * 3600 + pValue[RF_MINUTE] * 60;
+    return TRUE;
+}
 
-int main(int argc, char *argv[])
+JUMP_ROW *ArrowJump(const char *pSerialNo, unsigned long nJumpNumber, int bFind)
 {
-    FILE *pInFile;
-    char *pInFilename;
-    char *pLocation;
-    unsigned long nJumpNumber;
-    int nDumpType;
-    char *pSubTypes;
+    /* The jump table row of a jump, a new one if it isn't found or !bFind */
+    static long nHint = 0;
+    JUMP_ROW *pNew;
+    long i;
+
+    /* The profiles follow the records in the same order, so the next row is usually it */
+    for (i=0; ((bFind) && (i<nNumArrowJumps)); i++) {
+        pNew = &pArrowJumps[(nHint + i) % nNumArrowJumps];
+        if ((pNew->nJumpNumber == nJumpNumber) && (strcmp(pNew->strSerialNo, pSerialNo) == 0)) {
+            nHint = (nHint + i + 1) % nNumArrowJumps;
+            return pNew;
+        }
+    }
+
+    if (nNumArrowJumps >= nArrowJumpAlloc) {
+        pNew = (JUMP_ROW *)realloc(pArrowJumps, (nArrowJumpAlloc + 256) * sizeof(JUMP_ROW));
+        if (!pNew) return NULL;
+        pArrowJumps = pNew;
+        nArrowJumpAlloc += 256;
+    }
+    pNew = &pArrowJumps[nNumArrowJumps++];
+    memset(pNew, 0, sizeof(JUMP_ROW));
+    strcpy(pNew->strSerialNo, pSerialNo);
+    pNew->nJumpNumber = nJumpNumber;
+    return pNew;
+}
+
+void RecordRow(JUMP_ROW *pJump, const unsigned long *pValue)
+{
+    /* The fields of a jump from its Jump Record, as the detail has them */
+    int i,j;
+    double nAvgSpeed;
+
+    pJump->bRecord = TRUE;
+    pJump->bDateTime = JumpDateTime(pValue, &pJump->nDateTime);
+    pJump->nJumpType = ((pValue[RF_JUMP_TYPE] < NUM_JUMP_TYPES) ? (pValue[RF_JUMP_TYPE]+1) : 0);
+    snprintf(pJump->strDataVersion, sizeof(pJump->strDataVersion), "%lu.%lu.%lu",
+                ((pValue[RF_DATA_VERSION]>>4) & 0x0F) + 1,
+                (pValue[RF_DATA_VERSION] & 0x0F),
+                pValue[RF_DATA_VERSION_REV]);
+    pJump->nSWType = pValue[RF_SW_TYPE];
+
+    /* The speeds to the tenth of a mph */
+    pJump->nSpeeds[0] = (round(pValue[RF_MAX_SPEED]*22.3694))/10.0;
+    pJump->nSpeeds[1] = (round(pValue[RF_SPEED_12K]*22.3694)/10.0);
+    pJump->nSpeeds[2] = (round(pValue[RF_SPEED_9K]*22.3694)/10.0);
+    pJump->nSpeeds[3] = (round(pValue[RF_SPEED_6K]*22.3694)/10.0);
+    pJump->nSpeeds[4] = (round(pValue[RF_SPEED_3K]*22.3694)/10.0);
+    nAvgSpeed = 0.0;
+    for (i=0, j=0; i<4; i++) {
+        if (pJump->nSpeeds[i]) {
+            nAvgSpeed += pJump->nSpeeds[i];
+            j++;
+        }
+    }
+    if (j) nAvgSpeed = round((nAvgSpeed*10.0)/j)/10.0;
+    pJump->nSpeeds[5] = nAvgSpeed;
+    pJump->nExitAltitude = pValue[RF_EXIT_ALT]*3.28084;
+    pJump->nDeployAltitude = pValue[RF_DEPLOY_ALT]*3.28084;
+    pJump->nFreefallTime = pValue[RF_FF_TIME];
+}
+
+void ProfileRow(JUMP_ROW *pJump, const unsigned long *pValue)
+{
+    /* The fields of a jump from the start of its profile */
+    long nAltitude;
+
+    nAltitude = pValue[RF_GROUND_ALT];
+    if (nAltitude > 32767l) nAltitude = nAltitude - 65534l;     /* As the detail has it */
+    pJump->bProfile = TRUE;
+    pJump->nGroundAltitude = nAltitude*3.28084;
+    pJump->nFreefallStartTime = pValue[RF_FF_START]*0.25;
+    pJump->nCanopyStartTime = pValue[RF_CANOPY_START]*0.25;
+    memset(pJump->nPoints, 0, sizeof(pJump->nPoints));
+}
+
+void WriteArrowJumps(void)
+{
+    /* The rows of the session's jumps, now that its profiles have been read */
+    JUMP_ROW *pJump;
+    long i;
+    int j;
+
+    for (i=0; i<nNumArrowJumps; i++) {
+        pJump = &pArrowJumps[i];
+        if (!nArrowSkip) ArrowValue(&myArrow, AJ_FILE, pMemberName);
+        ArrowValue(&myArrow, AJ_SERIAL - nArrowSkip, pJump->strSerialNo);
+        ArrowValue(&myArrow, AJ_JUMP - nArrowSkip, &pJump->nJumpNumber);
+        ArrowValue(&myArrow, AJ_DATE_TIME - nArrowSkip, (pJump->bDateTime ? &pJump->nDateTime : NULL));
+        ArrowValue(&myArrow, AJ_TYPE - nArrowSkip, (pJump->bRecord ? strJumpTypes[pJump->nJumpType] : NULL));
+        ArrowValue(&myArrow, AJ_DATA_VERSION - nArrowSkip, (pJump->bRecord ? pJump->strDataVersion : NULL));
+        ArrowValue(&myArrow, AJ_SW_TYPE - nArrowSkip, (pJump->bRecord ? &pJump->nSWType : NULL));
+        for (j=0; j<6; j++) ArrowValue(&myArrow, AJ_SPEEDS + j - nArrowSkip, (pJump->bRecord ? &pJump->nSpeeds[j] : NULL));
+        ArrowValue(&myArrow, AJ_EXIT_ALT - nArrowSkip, (pJump->bRecord ? &pJump->nExitAltitude : NULL));
+        ArrowValue(&myArrow, AJ_DEPLOY_ALT - nArrowSkip, (pJump->bRecord ? &pJump->nDeployAltitude : NULL));
+        ArrowValue(&myArrow, AJ_FF_TIME - nArrowSkip, (pJump->bRecord ? &pJump->nFreefallTime : NULL));
+        ArrowValue(&myArrow, AJ_GROUND_ALT - nArrowSkip, (pJump->bProfile ? &pJump->nGroundAltitude : NULL));
+        ArrowValue(&myArrow, AJ_FF_START - nArrowSkip, (pJump->bProfile ? &pJump->nFreefallStartTime : NULL));
+        ArrowValue(&myArrow, AJ_CANOPY_START - nArrowSkip, (pJump->bProfile ? &pJump->nCanopyStartTime : NULL));
+        for (j=0; j<3; j++) ArrowValue(&myArrow, AJ_POINTS + j - nArrowSkip, (pJump->bProfile ? &pJump->nPoints[j] : NULL));
+        if (ArrowRows(&myArrow) >= ARROW_BATCH_ROWS) WriteArrowBatch(&myArrow);
+    }
+    nNumArrowJumps = 0;
+}
+
+void WriteArrowProfile(void)
+{
+    /* The rows of a profile, its numbers straight from its datapoints */
+    JUMP_PROF *pProfile = &myExportProfile;
+    uint32_t nJumpNumber;
+    int32_t nPoint;
     int i;
-    int bNeedHelp;
+    int nPhase;
+
+    nPhase = PerfPhase(&myPerf, PERF_SPEED);
+    myPerf.nDataPoints += pProfile->nNumDataPoints;
+    WorkOutSpeeds(pProfile);
+    PerfPhase(&myPerf, nPhase);
+    nJumpNumber = pProfile->nJumpNumber;
+    for (i=0; i<pProfile->nNumDataPoints; i++) {
+        if (!nArrowSkip) ArrowValue(&myArrow, AP_FILE, pMemberName);
+        ArrowValue(&myArrow, AP_SERIAL - nArrowSkip, pProfile->strSerialNo);
+        ArrowValue(&myArrow, AP_JUMP - nArrowSkip, &nJumpNumber);
+        nPoint = i+1;
+        ArrowValue(&myArrow, AP_POINT - nArrowSkip, &nPoint);
+        ArrowValue(&myArrow, AP_TYPE - nArrowSkip, strPointTypes[pProfile->DataPoints[i].nPointType]);
+    }
+    ArrowValues(&myArrow, AP_TIME - nArrowSkip, &pProfile->DataPoints[0].nTime,
+                    pProfile->nNumDataPoints, sizeof(JUMP_DATAPT));
+    ArrowValues(&myArrow, AP_ALTITUDE - nArrowSkip, &pProfile->DataPoints[0].nAltitude,
+                    pProfile->nNumDataPoints, sizeof(JUMP_DATAPT));
+    ArrowValues(&myArrow, AP_TAS - nArrowSkip, &pProfile->DataPoints[0].nTASpeed,
+                    pProfile->nNumDataPoints, sizeof(JUMP_DATAPT));
+    ArrowValues(&myArrow, AP_SAS - nArrowSkip, &pProfile->DataPoints[0].nSASpeed,
+                    pProfile->nNumDataPoints, sizeof(JUMP_DATAPT));
+    if (ArrowRows(&myArrow) >= ARROW_BATCH_ROWS) WriteArrowBatch(&myArrow);
+}
 
-    /* Check Arguments */
-    bNeedHelp = FALSE;
-    if ((argc < 4) || (argc > 6)) bNeedHelp = TRUE;
-
-    if (argc >= 3) {
-        nJumpNumber = strtoul(argv[1], NULL, 0);
-        nDumpType = DT_UNKNOWN;
-        if (strcmp(argv[2], "s") == 0) nDumpType = DT_SUMMARY;
-        if (strcmp(argv[2], "d") == 0) nDumpType = DT_DETAIL;
-        if (strcmp(argv[2], "t") == 0) nDumpType = DT_PROFILE_TAB;
-        if (strcmp(argv[2], "c") == 0) nDumpType = DT_PROFILE_CSV;
-        if (strcmp(argv[2], "p") == 0) nDumpType = DT_GNUPLOT;
-        if (nDumpType == DT_UNKNOWN) bNeedHelp = TRUE;
-    }
-
-    pSubTypes = NULL;
-    pLocation = NULL;
-    if (argc >= 5) {
-        pSubTypes = argv[3];
-        if (argc > 5) {
-            pLocation = argv[4];
-            pInFilename = argv[5];
+void PrintArrow(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+{
+    /* Note: Unlike the profile report, this goes through the records just once,
+                writing each profile as it's read, so there's no limit to the
+                number of jumps.  The rows of the jump table wait for the end
+                of the session, after its profiles.  A jump downloaded more
+                than once is there once for each download, as in the detail */
+    int type;
+    long datatype;
+    unsigned long ulTemp;
+    int bJumps;
+    int bFindingPoints;
+    JUMP_ROW *pJump;
+    JUMP_PROF *pProfile = &myExportProfile;
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
+
+    bJumps = ((pSubTypes) && (strpbrk(pSubTypes, "j")));
+    if (!bArrowOpen) {
+        /* Once for all the members of a tar archive */
+        nArrowSkip = ((pMemberName) ? 0 : 1);
+        if (bJumps) {
+            OpenArrow(&myArrow, stdout, &ArrowJumpFields[nArrowSkip], NUM_ARROW_JUMP_FIELDS - nArrowSkip,
+                        ((pSubTypes) && (strpbrk(pSubTypes, "s"))));
         } else {
-            pInFilename = argv[4];
-            pLocation = NULL;
+            OpenArrow(&myArrow, stdout, &ArrowProfileFields[nArrowSkip], NUM_ARROW_PROF_FIELDS - nArrowSkip,
+                        ((pSubTypes) && (strpbrk(pSubTypes, "s"))));
         }
-        switch (nDumpType) {
-            case DT_GNUPLOT:
-                for (i=0; i<strlen(pSubTypes); i++) {
-                    if (strpbrk(&pSubTypes[i], "atsrp") == NULL) bNeedHelp = TRUE;
+        bArrowOpen = TRUE;
+    }
+
+    datatype = PT_AIRCRAFT;
+    bFindingPoints = FALSE;
+    pJump = NULL;
+    nNumArrowJumps = 0;
+    PerfPhase(&myPerf, PERF_OUTPUT);
+    while ((type = GetSessionRecord(pInStream, &myFields)) != -1) {
+
+        switch (type) {
+            case -4:    /* Next session */
+            case 2:     /* Starting new Jump Record */
+            case 3:     /* End of all data */
+            case 5:     /* Starting new Jump Profile */
+            case 7:     /* End of Profile */
+                if ((bFindingPoints) && (!bJumps)) WriteArrowProfile();
+                bFindingPoints = FALSE;
+                break;
+        }
+
+        switch (type) {
+            case -4:    /* Next session */
+                if (bJumps) WriteArrowJumps();
+                break;
+            case 2:     /* Jump Record */
+                ulTemp = pValue[RF_JUMP];
+                if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
+                if ((!bJumps) || ((pJump = ArrowJump(strSessionSerialNo, ulTemp, FALSE)) == NULL)) break;
+                RecordRow(pJump, pValue);
+                break;
+            case 4:     /* Jump Profile Data Stream Type */
+                switch (pValue[RF_STREAM_TYPE]) {
+                    case 5:
+                        datatype = PT_FREEFALL;
+                        break;
+                    case 6:
+                    case 7:
+                        datatype = PT_CANOPY;
+                        break;
                 }
                 break;
-            case DT_PROFILE_TAB:
-                for (i=0; i<strlen(pSubTypes); i++) {
-                    if (strpbrk(&pSubTypes[i], "sh") == NULL) bNeedHelp = TRUE;
+            case 5:     /* Profile Start */
+                ulTemp = pValue[RF_JUMP];
+                if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
+                datatype = PT_AIRCRAFT;
+                bFindingPoints = TRUE;
+                if (!bJumps) {
+                    strcpy(pProfile->strSerialNo, strSessionSerialNo);
+                    pProfile->nJumpNumber = ulTemp;
+                    pProfile->nSession = nSession;
+                    pProfile->nAircraftPoints = 0;
+                    pProfile->nFreefallPoints = 0;
+                    pProfile->nCanopyPoints = 0;
+                    pProfile->nNumDataPoints = 0;
+                    break;
+                }
+                pJump = ArrowJump(strSessionSerialNo, ulTemp, TRUE);
+                if (!pJump) {
+                    bFindingPoints = FALSE;
+                    break;
                 }
+                ProfileRow(pJump, pValue);
                 break;
-            case DT_PROFILE_CSV:
-                for (i=0; i<strlen(pSubTypes); i++) {
-                    if (strpbrk(&pSubTypes[i], "h") == NULL) bNeedHelp = TRUE;
+            case 6:     /* Profile Datapoint */
+                if (!bFindingPoints) break;
+                if (bJumps) {
+                    pJump->nPoints[datatype]++;
+                } else if (pProfile->nNumDataPoints < MAX_PROFILE_DATA) {
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nPointType = datatype;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nTime = pValue[RF_TIME]*0.25;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nAltitude = pValue[RF_ALTITUDE]*3.28084;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nTASpeed = 0.0;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nSASpeed = 0.0;
+                    pProfile->nNumDataPoints++;
                 }
                 break;
             default:
-                bNeedHelp = TRUE;
                 break;
         }
     }
 
-    if (argc == 4) {
-        pInFilename = argv[3];
-    }
+    if ((bFindingPoints) && (!bJumps)) WriteArrowProfile();
+    if (bJumps) WriteArrowJumps();
+    PerfPhase(&myPerf, PERF_NONE);
+}
 
-    if ((pSubTypes) && (strlen(pSubTypes) == 0))
-        pSubTypes = NULL;
+int FinishArrow(void)
+{
+    if (!bArrowOpen) return TRUE;
+    bArrowOpen = FALSE;
+    return CloseArrow(&myArrow);
+}
+
+#ifdef HAVE_SQLITE
+int SQLiteFailed(const char *pWhat)
+{
+    fprintf(stderr, "SQLite couldn't %s: %s\n", pWhat, sqlite3_errmsg(pSQLite));
+    bSQLiteError = TRUE;
+    return FALSE;
+}
+
+int OpenSQLite(void)
+{
+    /* Opens (or creates) the database and starts the first transaction */
+    int i;
+    sqlite3_stmt *pStmt;
+
+    if (pSQLite) return !bSQLiteError;
+    if (sqlite3_open(pSQLitePath, &pSQLite) != SQLITE_OK) return SQLiteFailed("open the database");
+
+    /* Being in one transaction after another, it's only synced on each commit */
+    if ((sqlite3_exec(pSQLite, "PRAGMA synchronous = NORMAL; PRAGMA cache_size = -65536;", NULL, NULL, NULL) != SQLITE_OK) ||
+        (sqlite3_exec(pSQLite, strSQLSchema, NULL, NULL, NULL) != SQLITE_OK))
+        return SQLiteFailed("create the tables");
+
+    /* Loading into an empty table is quickest without its index, which is made
+        at the end.  Otherwise the points of a jump loaded again have to be found */
+    if (sqlite3_prepare_v2(pSQLite, "SELECT EXISTS (SELECT 1 FROM points)", -1, &pStmt, NULL) != SQLITE_OK)
+        return SQLiteFailed("read the points");
+    bPointsIndexed = ((sqlite3_step(pStmt) == SQLITE_ROW) && (sqlite3_column_int(pStmt, 0)));
+    sqlite3_finalize(pStmt);
+    if ((!bPointsIndexed) && (sqlite3_exec(pSQLite, "DROP INDEX IF EXISTS points_jump", NULL, NULL, NULL) != SQLITE_OK))
+        return SQLiteFailed("drop the index of the points");
+    if ((bPointsIndexed) &&
+        (sqlite3_exec(pSQLite, "CREATE INDEX IF NOT EXISTS points_jump ON points (serial, jump, point)", NULL, NULL, NULL) != SQLITE_OK))
+        return SQLiteFailed("index the points");
+
+    for (i=0; i<NUM_SQL_STMTS; i++) {
+        if (sqlite3_prepare_v2(pSQLite, strSQLStmts[i], -1, &pSQLiteStmts[i], NULL) != SQLITE_OK)
+            return SQLiteFailed("prepare its statements");
+    }
+    if (sqlite3_exec(pSQLite, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) return SQLiteFailed("begin a transaction");
+    nSQLiteRows = 0;
+
+    return TRUE;
+}
+
+int SQLiteRecord(const JUMP_ROW *pJump)
+{
+    /* Adds or updates the fields of a jump from its Jump Record */
+    sqlite3_stmt *pStmt = pSQLiteStmts[SQL_RECORD];
+    char strDateTime[24];
+    time_t nTime;
+    struct tm myTm;
+    int i;
+
+    if (bSQLiteError) return FALSE;
+    sqlite3_bind_text(pStmt, 1, pJump->strSerialNo, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(pStmt, 2, pJump->nJumpNumber);
+    nTime = pJump->nDateTime;
+    if ((pJump->bDateTime) && (gmtime_r(&nTime, &myTm))) {
+        strftime(strDateTime, sizeof(strDateTime), "%Y-%m-%d %H:%M:%S", &myTm);
+        sqlite3_bind_text(pStmt, 3, strDateTime, -1, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(pStmt, 3);
+    }
+    sqlite3_bind_text(pStmt, 4, strJumpTypes[pJump->nJumpType], -1, SQLITE_STATIC);
+    sqlite3_bind_text(pStmt, 5, pJump->strDataVersion, -1, SQLITE_STATIC);
+    sqlite3_bind_int(pStmt, 6, pJump->nSWType);
+    for (i=0; i<6; i++) sqlite3_bind_double(pStmt, 7+i, pJump->nSpeeds[i]);
+    sqlite3_bind_double(pStmt, 13, pJump->nExitAltitude);
+    sqlite3_bind_double(pStmt, 14, pJump->nDeployAltitude);
+    sqlite3_bind_int64(pStmt, 15, pJump->nFreefallTime);
+    if (sqlite3_step(pStmt) != SQLITE_DONE) SQLiteFailed("add a jump");
+    sqlite3_reset(pStmt);
+
+    return !bSQLiteError;
+}
+
+int SQLiteProfile(const JUMP_ROW *pJump)
+{
+    /* Replaces the points of a jump with those of the profile just read, and
+        adds or updates the fields from the start of its profile */
+    JUMP_PROF *pProfile = &myExportProfile;
+    sqlite3_stmt *pStmt;
+    int bReplace;
+    int nPhase;
+    int i;
+
+    if (bSQLiteError) return FALSE;
+    nPhase = PerfPhase(&myPerf, PERF_SPEED);
+    myPerf.nDataPoints += pProfile->nNumDataPoints;
+    WorkOutSpeeds(pProfile);
+    PerfPhase(&myPerf, nPhase);
+
+    pStmt = pSQLiteStmts[SQL_HAS_POINTS];
+    sqlite3_bind_text(pStmt, 1, pJump->strSerialNo, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(pStmt, 2, pJump->nJumpNumber);
+    bReplace = ((sqlite3_step(pStmt) == SQLITE_ROW) && (sqlite3_column_int(pStmt, 0)));
+    sqlite3_reset(pStmt);
+    if (bReplace) {
+        /* Downloaded again within this load, so the index is needed after all */
+        if ((!bPointsIndexed) &&
+            (sqlite3_exec(pSQLite, "CREATE INDEX points_jump ON points (serial, jump, point)", NULL, NULL, NULL) != SQLITE_OK))
+            return SQLiteFailed("index the points");
+        bPointsIndexed = TRUE;
+        pStmt = pSQLiteStmts[SQL_DELETE_POINTS];
+        sqlite3_bind_text(pStmt, 1, pJump->strSerialNo, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(pStmt, 2, pJump->nJumpNumber);
+        if (sqlite3_step(pStmt) != SQLITE_DONE) SQLiteFailed("delete the points of a jump");
+        sqlite3_reset(pStmt);
+    }
+
+    pStmt = pSQLiteStmts[SQL_POINT];
+    sqlite3_bind_text(pStmt, 1, pJump->strSerialNo, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(pStmt, 2, pJump->nJumpNumber);
+    for (i=0; ((i<pProfile->nNumDataPoints) && (!bSQLiteError)); i++) {
+        sqlite3_bind_int(pStmt, 3, i+1);
+        sqlite3_bind_text(pStmt, 4, strPointTypes[pProfile->DataPoints[i].nPointType], -1, SQLITE_STATIC);
+        sqlite3_bind_double(pStmt, 5, pProfile->DataPoints[i].nTime);
+        sqlite3_bind_double(pStmt, 6, pProfile->DataPoints[i].nAltitude);
+        sqlite3_bind_double(pStmt, 7, pProfile->DataPoints[i].nTASpeed);
+        sqlite3_bind_double(pStmt, 8, pProfile->DataPoints[i].nSASpeed);
+        if (sqlite3_step(pStmt) != SQLITE_DONE) SQLiteFailed("add the points of a jump");
+        sqlite3_reset(pStmt);
+    }
+
+    pStmt = pSQLiteStmts[SQL_PROFILE];
+    sqlite3_bind_text(pStmt, 1, pJump->strSerialNo, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(pStmt, 2, pJump->nJumpNumber);
+    sqlite3_bind_double(pStmt, 3, pJump->nGroundAltitude);
+    sqlite3_bind_double(pStmt, 4, pJump->nFreefallStartTime);
+    sqlite3_bind_double(pStmt, 5, pJump->nCanopyStartTime);
+    for (i=0; i<3; i++) sqlite3_bind_int(pStmt, 6+i, pJump->nPoints[i]);
+    if (sqlite3_step(pStmt) != SQLITE_DONE) SQLiteFailed("add the profile of a jump");
+    sqlite3_reset(pStmt);
+
+    nSQLiteRows += pProfile->nNumDataPoints;
+    if ((nSQLiteRows >= SQLITE_BATCH_ROWS) && (!bSQLiteError)) {
+        if (sqlite3_exec(pSQLite, "COMMIT; BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+            return SQLiteFailed("commit a transaction");
+        nSQLiteRows = 0;
+    }
+
+    return !bSQLiteError;
+}
+
+void PrintSQLite(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+{
+    /* Note: Like the Arrow export, this goes through the records once, with
+                no limit to the number of jumps.  Each Jump Record is added
+                as it's read, and each profile once it ends.  A jump downloaded
+                again in a later session replaces the earlier copy */
+    int type;
+    long datatype;
+    unsigned long ulTemp;
+    int bFindingPoints;
+    JUMP_ROW myRow;
+    JUMP_PROF *pProfile = &myExportProfile;
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
+
+    if (!pSQLitePath) {
+        fprintf(stderr, "The SQLite export needs the database given with -o <database>!\n");
+        bSQLiteError = TRUE;
+        return;
+    }
+    if (!OpenSQLite()) return;
+
+    datatype = PT_AIRCRAFT;
+    bFindingPoints = FALSE;
+    PerfPhase(&myPerf, PERF_OUTPUT);
+    while (((type = GetSessionRecord(pInStream, &myFields)) != -1) && (!bSQLiteError)) {
+
+        switch (type) {
+            case -4:    /* Next session */
+            case 2:     /* Starting new Jump Record */
+            case 3:     /* End of all data */
+            case 5:     /* Starting new Jump Profile */
+            case 7:     /* End of Profile */
+                if (bFindingPoints) SQLiteProfile(&myRow);
+                bFindingPoints = FALSE;
+                break;
+        }
+
+        switch (type) {
+            case 2:     /* Jump Record */
+                ulTemp = pValue[RF_JUMP];
+                if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
+                memset(&myRow, 0, sizeof(myRow));
+                strcpy(myRow.strSerialNo, strSessionSerialNo);
+                myRow.nJumpNumber = ulTemp;
+                RecordRow(&myRow, pValue);
+                SQLiteRecord(&myRow);
+                break;
+            case 4:     /* Jump Profile Data Stream Type */
+                switch (pValue[RF_STREAM_TYPE]) {
+                    case 5:
+                        datatype = PT_FREEFALL;
+                        break;
+                    case 6:
+                    case 7:
+                        datatype = PT_CANOPY;
+                        break;
+                }
+                break;
+            case 5:     /* Profile Start */
+                ulTemp = pValue[RF_JUMP];
+                if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
+                datatype = PT_AIRCRAFT;
+                bFindingPoints = TRUE;
+                memset(&myRow, 0, sizeof(myRow));
+                strcpy(myRow.strSerialNo, strSessionSerialNo);
+                myRow.nJumpNumber = ulTemp;
+                ProfileRow(&myRow, pValue);
+                strcpy(pProfile->strSerialNo, strSessionSerialNo);
+                pProfile->nJumpNumber = ulTemp;
+                pProfile->nSession = nSession;
+                pProfile->nNumDataPoints = 0;
+                break;
+            case 6:     /* Profile Datapoint */
+                if (!bFindingPoints) break;
+                myRow.nPoints[datatype]++;
+                if (pProfile->nNumDataPoints < MAX_PROFILE_DATA) {
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nPointType = datatype;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nTime = pValue[RF_TIME]*0.25;
+                    pProfile->DataPoints[pProfile->nNumDataPoints].nAltitude = pValue[RF_ALTITUDE]*3.28084;
+                    pProfile->nNumDataPoints++;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if ((bFindingPoints) && (!bSQLiteError)) SQLiteProfile(&myRow);
+    PerfPhase(&myPerf, PERF_NONE);
+}
+
+int FinishSQLite(void)
+{
+    /* Indexes what was loaded and commits the last of it */
+    int i;
+
+    if (!pSQLite) return !bSQLiteError;
+    if (!bSQLiteError) {
+        if (sqlite3_exec(pSQLite, strSQLIndexes, NULL, NULL, NULL) != SQLITE_OK) {
+            SQLiteFailed("index the jumps and points");
+        } else if (sqlite3_exec(pSQLite, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+            SQLiteFailed("commit the last transaction");
+        }
+    }
+    for (i=0; i<NUM_SQL_STMTS; i++) {
+        sqlite3_finalize(pSQLiteStmts[i]);
+        pSQLiteStmts[i] = NULL;
+    }
+    if (sqlite3_close(pSQLite) != SQLITE_OK) SQLiteFailed("close the database");
+    pSQLite = NULL;
+
+    return !bSQLiteError;
+}
+#endif
+
+void PrintStats(NEPTUNE_STREAM *pInStream, int nDumpType, unsigned long nJumpNumber, const char *pSubTypes, const char *pLocation)
+{
+    /* Note: Only the Jump Records are looked at, each being added to the
+                statistics as it's read, so memory doesn't grow with the
+                number of jumps.  A jump downloaded more than once is counted
+                once for each download, unless it's read from a store */
+    int type;
+    int j;
+    long nYear;
+    long nMonth;
+    unsigned long ulTemp;
+    REC_FIELDS myFields;
+    const unsigned long *pValue = myFields.nValue;
+
+    if (!bStatsOpen) {
+        /* Once for all the members of a tar archive */
+        InitStats(&myStats, strStatsFields, NUM_STATS_FIELDS);
+        bStatsOpen = TRUE;
+    }
+
+    PerfPhase(&myPerf, PERF_OUTPUT);
+    while ((type = GetSessionRecord(pInStream, &myFields)) != -1) {
+        if (type != 2) continue;
+        ulTemp = pValue[RF_JUMP];
+        if ((nJumpNumber != 0) && (nJumpNumber != ulTemp)) continue;
+
+        nYear = pValue[RF_YEAR];
+        if (nYear < 100) nYear += 2000;
+        nMonth = (((pValue[RF_MONTH] >= 1) && (pValue[RF_MONTH] <= 12)) ? (nYear*100 + pValue[RF_MONTH]) : 0);
+
+        /* A field that's zero wasn't measured, such as the 12K speed of a jump from 10K */
+        for (j=0; j<NUM_STATS_FIELDS; j++) {
+            if ((pValue[nStatsRecFields[j]]) &&
+                (!AddStat(&myStats, pValue[RF_JUMP_TYPE], nMonth, j, pValue[nStatsRecFields[j]], 1))) bStatsError = TRUE;
+        }
+    }
+    PerfPhase(&myPerf, PERF_NONE);
+}
+
+int LoadStats(NEPTUNE_STREAM *pInStream, const char *pInFilename)
+{
+    /* Merges a partial aggregate, its first line having already been read */
+    int i;
+
+    if (!bStatsOpen) {
+        InitStats(&myStats, strStatsFields, NUM_STATS_FIELDS);
+        bStatsOpen = TRUE;
+    }
+    if (!ReadStatsLine(&myStats, (char *)databuff)) {
+        fprintf(stderr, "The partial aggregate \"%s\" is from another version!\n\n", pInFilename);
+        bStatsError = TRUE;
+        return -3;
+    }
+
+    while (ReadString(pInStream, databuff, sizeof(databuff))) {
+        for (i=strlen((char *)databuff)-1; ((i>=0) && (isspace(databuff[i]))); i--) databuff[i] = 0;
+        if (databuff[0] == 0) continue;
+        if (!ReadStatsLine(&myStats, (char *)databuff)) {
+            fprintf(stderr, "Bad line in the partial aggregate \"%s\" at offset %lld:  \"%s\"\n\n",
+                        pInFilename, (long long)nLineOffset, databuff);
+            bStatsError = TRUE;
+            return -3;
+        }
+    }
+
+    return 0;
+}
+
+int FinishStats(const char *pSubTypes)
+{
+    /* Writes the report or partial aggregate, once everything has been read */
+    STATS_GROUP *pGroup;
+    STATS_HIST *pHist;
+    long i;
+    int j,k;
+
+    if (!bStatsOpen) return TRUE;
+    bStatsOpen = FALSE;
+
+    SortStats(&myStats);
+    if (bStatsError) {
+        /* Nothing's written rather than statistics that are missing something */
+    } else if ((pSubTypes) && (strpbrk(pSubTypes, "w"))) {
+        if (!WriteStats(&myStats, stdout)) bStatsError = TRUE;
+    } else {
+        printf("Type\tMonth\tField\tCount\tMean\tMin\tP5\tP25\tMedian\tP75\tP95\tMax\n");
+        for (i=0; i<myStats.nNumGroups; i++) {
+            pGroup = &myStats.pGroups[i];
+            for (j=0; j<NUM_STATS_FIELDS; j++) {
+                pHist = &pGroup->hists[j];
+                if (pHist->nCount == 0) continue;
+                printf("%s\t", (((pGroup->nType >= 0) && (pGroup->nType < NUM_JUMP_TYPES)) ?
+                                    strJumpTypes[pGroup->nType+1] : strJumpTypes[0]));
+                if (pGroup->nMonth) {
+                    printf("%04ld-%02ld\t", pGroup->nMonth / 100, pGroup->nMonth % 100);
+                } else {
+                    printf("<Unknown>\t");
+                }
+                printf("%s\t%llu\t%.1f\t%.1f", strStatsFields[j], pHist->nCount,
+                            ((double)pHist->nSum / pHist->nCount) * nStatsScales[j],
+                            pHist->pBins[0].nValue * nStatsScales[j]);
+                for (k=0; k<NUM_STATS_QUANTILES; k++)
+                    printf("\t%.1f", StatsQuantile(pHist, nStatsQuantiles[k]) * nStatsScales[j]);
+                printf("\t%.1f\n", pHist->pBins[pHist->nNumBins-1].nValue * nStatsScales[j]);
+            }
+        }
+    }
+    FreeStats(&myStats);
+
+    j = !bStatsError;
+    bStatsError = FALSE;
+    return j;
+}
+
+/* ========================================================================== */
+
+int DumpFile(NEPTUNE_STREAM *pInStream, const char *pInFilename, int nDumpType, unsigned long nJumpNumber,
+                const char *pSubTypes, const char *pLocation)
+{
+    int i;
+
+    /* Each file (or tar member) starts over with its first session */
+    nSession = 1;
+    nSessionOffset = 0;
+    bSessionEnded = FALSE;
+    strSessionSerialNo[0] = 0;
+    strFirstSession[0] = 0;
+    myRecovery.nPending = 0;
+
+    /* Check magic tag, which a store always starts with */
+    if (pStore) {
+        if (NextStoreRecord(&myStoreReader, NULL) != -4) {
+            fprintf(stderr, "Couldn't read the store \"%s\"!\n\n", pInFilename);
+            return -2;
+        }
+    } else {
+        if (!ReadString(pInStream, databuff, sizeof(databuff))) {
+            fprintf(stderr, "Couldn't read input file \"%s\"!\n\n", pInFilename);
+            return -2;
+        }
+        for (i=strlen(databuff)-1; i>=0; i--) {
+            if (isspace(databuff[i])) {
+                databuff[i] = 0;
+            } else {
+                break;
+            }
+        }
+        if ((nDumpType == DT_STATS) && (strncmp((char *)databuff, STATS_MAGIC, strlen(STATS_MAGIC)) == 0))
+            return LoadStats(pInStream, pInFilename);
+        if (strcmp(databuff, "#NEPTUNE") != 0) {
+            if (pMemberName) {
+                fprintf(stderr, "Skipping \"%s\" -- not a Neptune Data File\n", pInFilename);
+            } else {
+                fprintf(stderr, "The input file \"%s\" doesn't appear to be a Neptune Data File!\n\n", pInFilename);
+            }
+            return -3;
+        }
+    }
+
+    /* Label the report of a tar member */
+    if (pMemberName) {
+        switch (nDumpType) {
+            case DT_SUMMARY:
+            case DT_DETAIL:
+                printf("==> %s <==\n", pMemberName);
+                break;
+            case DT_GNUPLOT:
+                printf("# %s\n", pMemberName);
+                break;
+        }
+    }
+
+    /* Print Specified Report Type */
+    switch (nDumpType) {
+        case DT_SUMMARY:
+            PrintSummary(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+        case DT_DETAIL:
+            PrintDetail(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+        case DT_PROFILE_TAB:
+        case DT_PROFILE_CSV:
+            PrintProfile(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+        case DT_GNUPLOT:
+            PrintGnuPlot(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+        case DT_ARROW:
+            PrintArrow(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+#ifdef HAVE_SQLITE
+        case DT_SQLITE:
+            PrintSQLite(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+#endif
+        case DT_STATS:
+            PrintStats(pInStream, nDumpType, nJumpNumber, pSubTypes, pLocation);
+            break;
+    }
+
+    return 0;
+}
+
+/* ========================================================================== */
+
+int ParseFilter(const char *pOption, const char *pValue, STORE_QUERY *pQuery)
+{
+    /* The -S, -D and -T options that pick the jumps of a store */
+    if (strcmp(pOption, "-S") == 0) {
+        if (strlen(pValue) > STORE_SERIAL_SIZE) return FALSE;
+        SetStoreSerialNo(pQuery->strSerialNo, pValue);
+        return TRUE;
+    }
+    if (strcmp(pOption, "-D") == 0) return ParseStoreDates(pValue, pQuery);
+    if (strcmp(pOption, "-T") == 0) {
+        pQuery->nJumpType = strtol(pValue, NULL, 0);
+        return ((pQuery->nJumpType >= 0) && (pQuery->nJumpType <= 255));
+    }
+    return FALSE;
+}
+
+int ParseReport(int argc, char *argv[], unsigned long *pJumpNumber, int *pDumpType, char **ppSubTypes, char **ppLocation)
+{
+    /* <jump-num> <dump-type> [<sub-types> [<Location>]], without the input file */
+    int i;
+
+    if ((argc < 2) || (argc > 4)) return FALSE;
+
+    *pJumpNumber = strtoul(argv[0], NULL, 0);
+    *pDumpType = DT_UNKNOWN;
+    if (strcmp(argv[1], "s") == 0) *pDumpType = DT_SUMMARY;
+    if (strcmp(argv[1], "d") == 0) *pDumpType = DT_DETAIL;
+    if (strcmp(argv[1], "t") == 0) *pDumpType = DT_PROFILE_TAB;
+    if (strcmp(argv[1], "c") == 0) *pDumpType = DT_PROFILE_CSV;
+    if (strcmp(argv[1], "p") == 0) *pDumpType = DT_GNUPLOT;
+    if (strcmp(argv[1], "a") == 0) *pDumpType = DT_ARROW;
+#ifdef HAVE_SQLITE
+    if (strcmp(argv[1], "q") == 0) *pDumpType = DT_SQLITE;
+#endif
+    if (strcmp(argv[1], "f") == 0) *pDumpType = DT_STATS;
+    if (*pDumpType == DT_UNKNOWN) return FALSE;
+
+    *ppSubTypes = ((argc > 2) ? argv[2] : NULL);
+    *ppLocation = ((argc > 3) ? argv[3] : NULL);
+    if (*ppSubTypes) {
+        switch (*pDumpType) {
+            case DT_GNUPLOT:
+                for (i=0; i<strlen(*ppSubTypes); i++) {
+                    if (strpbrk(&(*ppSubTypes)[i], "atsrpb") == NULL) return FALSE;
+                }
+                break;
+            case DT_PROFILE_TAB:
+                for (i=0; i<strlen(*ppSubTypes); i++) {
+                    if (strpbrk(&(*ppSubTypes)[i], "sh") == NULL) return FALSE;
+                }
+                break;
+            case DT_PROFILE_CSV:
+                for (i=0; i<strlen(*ppSubTypes); i++) {
+                    if (strpbrk(&(*ppSubTypes)[i], "h") == NULL) return FALSE;
+                }
+                break;
+            case DT_ARROW:
+                for (i=0; i<strlen(*ppSubTypes); i++) {
+                    if (strpbrk(&(*ppSubTypes)[i], "js") == NULL) return FALSE;
+                }
+                break;
+            case DT_STATS:
+                for (i=0; i<strlen(*ppSubTypes); i++) {
+                    if (strpbrk(&(*ppSubTypes)[i], "w") == NULL) return FALSE;
+                }
+                break;
+            default:
+                return FALSE;
+        }
+        if (strlen(*ppSubTypes) == 0) *ppSubTypes = NULL;
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+void HandleSignal(int nSignal)
+{
+    bQuit = TRUE;
+}
+
+int ReadRequest(int fd, char *pBuff, long nBufSize)
+{
+    /* Reads a request line, returning its length without the newline, or -1 */
+    long nSize;
+    ssize_t nRead;
+    char *pEnd;
+
+    nSize = 0;
+    while (nSize < nBufSize-1) {
+        nRead = read(fd, &pBuff[nSize], nBufSize-1-nSize);
+        if ((nRead < 0) && (errno == EINTR)) continue;
+        if (nRead <= 0) return -1;
+        nSize += nRead;
+        pBuff[nSize] = 0;
+        pEnd = strchr(pBuff, '\n');
+        if (pEnd) {
+            if ((pEnd > pBuff) && (pEnd[-1] == '\r')) pEnd--;
+            *pEnd = 0;
+            return (pEnd - pBuff);
+        }
+    }
+    return -1;
+}
+
+int ServeRequest(int fdConn, const char *pStorePath, int fdStdout)
+{
+    /* Note: A request is the arguments of a command line, after any -S, -D and
+                -T options, without the input file:
+                    [-S<tab><serial><tab>][-D<tab><from>[,<to>]<tab>][-T<tab><type><tab>]
+                    <jump-num><tab><dump-type>[<tab><sub-types>[<tab><Location>]]
+                on one line.  The report is sent back in its place, just as the
+                command line would print it, and the connection closed at its end */
+    char strRequest[MAX_REQUEST_SIZE];
+    char strLine[MAX_REQUEST_SIZE];
+    char *pFields[MAX_REQUEST_FIELDS];
+    int nFields;
+    int nArg;
+    char *p;
+    unsigned long nJumpNumber;
+    int nDumpType;
+    char *pSubTypes;
+    char *pLocation;
+    int bOK;
+
+    if (ReadRequest(fdConn, strRequest, sizeof(strRequest)) < 0) return FALSE;
+    strcpy(strLine, strRequest);
+    nFields = 0;
+    for (p=strRequest; ((p) && (nFields<MAX_REQUEST_FIELDS)); ) {
+        pFields[nFields++] = p;
+        p = strchr(p, '\t');
+        if (p) *p++ = 0;
+    }
+
+    memset(&myQuery, 0, sizeof(myQuery));
+    myQuery.nJumpType = -1;
+    bOK = TRUE;
+    for (nArg=0; ((bOK) && (nArg+1<nFields) && (pFields[nArg][0] == '-')); nArg += 2) {
+        bOK = ParseFilter(pFields[nArg], pFields[nArg+1], &myQuery);
+    }
+    if ((!bOK) || (!ParseReport(nFields-nArg, &pFields[nArg], &nJumpNumber, &nDumpType, &pSubTypes, &pLocation)) ||
+        (nDumpType == DT_SQLITE)) {
+        fprintf(stderr, "Bad request:  \"%s\"\n", strLine);
+        return FALSE;
+    }
+    myQuery.nJumpNumber = nJumpNumber;
+
+    /* The report goes out the connection, the same as it does to stdout */
+    if (!OpenStoreReader(&myStoreReader, pStore, &myQuery)) {
+        fprintf(stderr, "Failed to read the jumps of the store \"%s\"!\n", pStorePath);
+        return FALSE;
+    }
+    fflush(stdout);
+    dup2(fdConn, STDOUT_FILENO);
+    pMemberName = NULL;
+    bFirstMember = TRUE;
+    nBadRecords = 0;
+    bOK = (DumpFile(NULL, pStorePath, nDumpType, nJumpNumber, pSubTypes, pLocation) == 0);
+    if (!FinishArrow()) bOK = FALSE;
+    if (!FinishStats(pSubTypes)) bOK = FALSE;
+    fflush(stdout);
+    dup2(fdStdout, STDOUT_FILENO);
+    clearerr(stdout);
+    if (!CloseStoreReader(&myStoreReader)) {
+        fprintf(stderr, "The store \"%s\" couldn't all be read!\n", pStorePath);
+        bOK = FALSE;
+    }
+
+    return bOK;
+}
+
+int ServeWorker(int fdListen, const char *pStorePath)
+{
+    struct timeval tv;
+    sigset_t myTerm;
+    int fdStdout;
+    int fdConn;
+
+    /* Stopped by the server with SIGTERM, held off until the request being
+        served is done.  SIGINT from the terminal is the server's to handle */
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+    sigemptyset(&myTerm);
+    sigaddset(&myTerm, SIGTERM);
+
+    fdStdout = dup(STDOUT_FILENO);
+    if (fdStdout < 0) return -2;
+    setvbuf(stdout, NULL, _IOFBF, 65536);
+
+    while (1) {
+        fdConn = accept(fdListen, NULL, NULL);
+        if (fdConn < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) continue;
+            perror("Accepting a request ");
+            return -2;
+        }
+        sigprocmask(SIG_BLOCK, &myTerm, NULL);
+
+        /* Jumps added to the store, or its being compacted, mean opening it again */
+        if (StoreChanged(pStore)) {
+            CloseStore(pStore);
+            pStore = OpenStore(pStorePath, FALSE);
+            if ((!pStore) || (!LoadStore(pStore))) {
+                fprintf(stderr, "Failed to open the store \"%s\" again!\n", pStorePath);
+                return -2;
+            }
+        }
+
+        tv.tv_sec = REQUEST_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fdConn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ServeRequest(fdConn, pStorePath, fdStdout);
+        close(fdConn);
+        sigprocmask(SIG_UNBLOCK, &myTerm, NULL);
+    }
+}
+
+pid_t StartWorker(int fdListen, const char *pStorePath)
+{
+    pid_t pid;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid == 0) _exit(ServeWorker(fdListen, pStorePath) & 0xFF);
+    if (pid < 0) perror("Starting a worker ");
+    return pid;
+}
+
+int ServeStore(const char *pSocketPath, int nWorkers, const char *pStorePath)
+{
+    /* Note: Serves reports of the store from nWorkers processes, each taking
+                the next connection on the socket, with the store loaded once
+                beforehand so they all share it.  Each opens it again when it
+                changes.  A worker that dies is replaced */
+    struct sockaddr_un myAddr;
+    pid_t nPids[MAX_WORKERS];
+    int fdListen;
+    int nStatus;
+    pid_t pid;
+    int i;
+
+    pStore = OpenStore(pStorePath, FALSE);
+    if (!pStore) {
+        fprintf(stderr, "Failed to open the store \"%s\"!\n\n", pStorePath);
+        return -2;
+    }
+    if (!LoadStore(pStore)) {
+        CloseStore(pStore);
+        return -2;
+    }
+
+    memset(&myAddr, 0, sizeof(myAddr));
+    myAddr.sun_family = AF_UNIX;
+    if (strlen(pSocketPath) >= sizeof(myAddr.sun_path)) {
+        fprintf(stderr, "The socket path \"%s\" is too long!\n\n", pSocketPath);
+        CloseStore(pStore);
+        return -1;
+    }
+    strcpy(myAddr.sun_path, pSocketPath);
+    unlink(pSocketPath);                /* Left by a server that didn't stop cleanly */
+    fdListen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fdListen < 0) || (bind(fdListen, (struct sockaddr *)&myAddr, sizeof(myAddr)) < 0) ||
+        (listen(fdListen, SOMAXCONN) < 0)) {
+        fprintf(stderr, "Couldn't listen on \"%s\":  %s\n\n", pSocketPath, strerror(errno));
+        if (fdListen >= 0) close(fdListen);
+        CloseStore(pStore);
+        return -2;
+    }
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGPIPE, SIG_IGN);           /* A client that goes away just loses its report */
+    bLogSessions = FALSE;
+
+    for (i=0; i<nWorkers; i++) nPids[i] = StartWorker(fdListen, pStorePath);
+    fprintf(stderr, "Serving \"%s\" on \"%s\" with %d workers\n", pStorePath, pSocketPath, nWorkers);
+
+    while (!bQuit) {
+        while ((pid = waitpid(-1, &nStatus, WNOHANG)) > 0) {
+            for (i=0; ((i<nWorkers) && (nPids[i] != pid)); i++)
+                ;
+            if (i == nWorkers) continue;
+            fprintf(stderr, "Worker %ld died (status 0x%X), starting another\n", (long)pid, nStatus);
+            nPids[i] = StartWorker(fdListen, pStorePath);
+        }
+        for (i=0; i<nWorkers; i++) {
+            if (nPids[i] < 0) nPids[i] = StartWorker(fdListen, pStorePath);
+        }
+        sleep(1);                       /* Cut short by a signal */
+    }
+
+    for (i=0; i<nWorkers; i++) {
+        if (nPids[i] > 0) kill(nPids[i], SIGTERM);
+    }
+    for (i=0; i<nWorkers; i++) {
+        if (nPids[i] > 0) waitpid(nPids[i], &nStatus, 0);
+    }
+    close(fdListen);
+    unlink(pSocketPath);
+    CloseStore(pStore);
+    fprintf(stderr, "Stopped serving \"%s\"\n", pStorePath);
+
+    return 0;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    NEPTUNE_STREAM *pInStream;
+    char *pInFilename;
+    char *pLocation;
+    unsigned long nJumpNumber;
+    int nDumpType;
+    char *pSubTypes;
+    int bNeedHelp;
+    int nArg;
+    int bRecover;
+    int bPerf;
+    int bUseCache;
+    int bCached;
+    int bFilters;
+    JUMP_CACHE_PARAMS myCacheParams;
+    long nMaxErrors;
+    long nMaxLogged;
+    int nOutCompression;
+    pid_t nOutPid;
+    int nResult;
+    long nMembers;
+    char *pSocketPath;
+    int nWorkers;
+
+    /* Check Options */
+    bNeedHelp = FALSE;
+    pSocketPath = NULL;
+    nWorkers = DEFAULT_WORKERS;
+    bRecover = FALSE;
+    bPerf = FALSE;
+    bUseCache = TRUE;
+    nOutCompression = STREAM_PLAIN;
+    nMaxErrors = 0;
+    nMaxLogged = DEFAULT_MAX_LOGGED;
+    bFilters = FALSE;
+    memset(&myQuery, 0, sizeof(myQuery));
+    myQuery.nJumpType = -1;
+    for (nArg=1; ((nArg<argc) && (argv[nArg][0] == '-')); nArg++) {
+        if ((strcmp(argv[nArg], "-e") == 0) && (nArg+1 < argc)) {
+            bRecover = TRUE;
+            nMaxErrors = strtol(argv[++nArg], NULL, 0);
+            if (nMaxErrors < 0) bNeedHelp = TRUE;
+        } else if ((strcmp(argv[nArg], "-l") == 0) && (nArg+1 < argc)) {
+            nMaxLogged = strtol(argv[++nArg], NULL, 0);
+            if (nMaxLogged < 0) bNeedHelp = TRUE;
+        } else if ((strcmp(argv[nArg], "-z") == 0) && (nArg+1 < argc)) {
+            nOutCompression = StreamCompression(argv[++nArg]);
+            if (nOutCompression < 0) bNeedHelp = TRUE;
+        } else if (strcmp(argv[nArg], "-p") == 0) {
+            bPerf = TRUE;
+        } else if (strcmp(argv[nArg], "-n") == 0) {
+            bUseCache = FALSE;
+        } else if (((strcmp(argv[nArg], "-S") == 0) || (strcmp(argv[nArg], "-D") == 0) ||
+                    (strcmp(argv[nArg], "-T") == 0)) && (nArg+1 < argc)) {
+            bFilters = TRUE;
+            if (!ParseFilter(argv[nArg], argv[nArg+1], &myQuery)) bNeedHelp = TRUE;
+            nArg++;
+        } else if ((strcmp(argv[nArg], "-s") == 0) && (nArg+1 < argc)) {
+            pSocketPath = argv[++nArg];
+#ifdef HAVE_SQLITE
+        } else if ((strcmp(argv[nArg], "-o") == 0) && (nArg+1 < argc)) {
+            pSQLitePath = argv[++nArg];
+#endif
+        } else if ((strcmp(argv[nArg], "-w") == 0) && (nArg+1 < argc)) {
+            nWorkers = strtol(argv[++nArg], NULL, 0);
+            if ((nWorkers < 1) || (nWorkers > MAX_WORKERS)) bNeedHelp = TRUE;
+        } else {
+            bNeedHelp = TRUE;
+        }
+    }
+    argc -= nArg-1;
+    argv += nArg-1;
+
+    /* Check Arguments.  Serving just takes the store, the reports coming
+        from its requests */
+    pInFilename = NULL;
+    if (pSocketPath) {
+        if ((argc != 2) || (bFilters) || (pSQLitePath)) bNeedHelp = TRUE;
+        if (argc >= 2) pInFilename = argv[argc-1];
+    } else {
+        if ((argc < 4) || (argc > 6) ||
+            (!ParseReport(argc-2, &argv[1], &nJumpNumber, &nDumpType, &pSubTypes, &pLocation))) bNeedHelp = TRUE;
+        if ((nDumpType == DT_SQLITE) != (pSQLitePath != NULL)) bNeedHelp = TRUE;
+        pInFilename = argv[argc-1];
+    }
 
     if (bNeedHelp) {
         fprintf(stderr, "Neptune Dump V%d.%02d\n", VERSION/100, VERSION%100);
-        fprintf(stderr, "Usage: neptune_dump <jump-num> <dump-type> [<sub-types>] [<Location>] <input-file>\n");
+        fprintf(stderr, "Usage: neptune_dump [-e <max-errors> [-l <max-logged>]] [-z <gz|zst>] [-p] [-n]\n");
+        fprintf(stderr, "                    [-S <serial>] [-D <from>[,<to>]] [-T <type>]\n");
+        fprintf(stderr, "                    <jump-num> <dump-type>\n");
+        fprintf(stderr, "                    [<sub-types>] [<Location>] <input-file>\n");
+#ifdef HAVE_SQLITE
+        fprintf(stderr, "       neptune_dump [...] -o <database> <jump-num> q <input-file>\n");
+#endif
+        fprintf(stderr, "       neptune_dump -s <socket> [-w <workers>] <store>\n");
         fprintf(stderr, "\n");
         fprintf(stderr, "       Where:\n");
         fprintf(stderr, "           <jump-num>   = Jump number to dump\n");
@@ -894,6 +2631,15 @@ int main(int argc, char *argv[])
         fprintf(stderr, "                   t    = Profile Data (Tabular Format)\n");
         fprintf(stderr, "                   c    = Profile Data (CSV Format)\n");
         fprintf(stderr, "                   p    = GnuPlot Commands (Can be piped to GnuPlot)\n");
+        fprintf(stderr, "                   a    = Apache Arrow IPC File (Feather V2) of the\n");
+        fprintf(stderr, "                           profiles, for pandas, polars and the like\n");
+#ifdef HAVE_SQLITE
+        fprintf(stderr, "                   q    = Load the jumps and their profiles into the\n");
+        fprintf(stderr, "                           SQLite database given with -o, replacing\n");
+        fprintf(stderr, "                           any of the jumps already there\n");
+#endif
+        fprintf(stderr, "                   f    = Fleet Statistics of the Jump Records by\n");
+        fprintf(stderr, "                           jump type and month (Tabular Format)\n");
         fprintf(stderr, "\n");
         fprintf(stderr, "           <sub-types>  = Subformats for various dump types:\n");
         fprintf(stderr, "               For Type = t (can be zero or more of the following):\n");
@@ -907,6 +2653,14 @@ int main(int argc, char *argv[])
         fprintf(stderr, "                   s    = SAS Speed Plot\n");
         fprintf(stderr, "                   r    = Remove reset command from plot output\n");
         fprintf(stderr, "                   p    = Add pause command to plot output\n");
+        fprintf(stderr, "                   b    = Binary data (float32) instead of text\n");
+        fprintf(stderr, "               For Type = a (can be zero or more of the following):\n");
+        fprintf(stderr, "                   j    = Table of the jumps instead of profiles\n");
+        fprintf(stderr, "                   s    = IPC Stream instead of a File\n");
+        fprintf(stderr, "               For Type = f (can be zero or more of the following):\n");
+        fprintf(stderr, "                   w    = Write a partial aggregate instead, which\n");
+        fprintf(stderr, "                           can be read again as the input, alone or\n");
+        fprintf(stderr, "                           concatenated with others, to merge them\n");
         fprintf(stderr, "\n");
         fprintf(stderr, "           <Location>   = Optionally specifies the location of the\n");
         fprintf(stderr, "                           jump and is added to jump detail and plots.\n");
@@ -915,56 +2669,177 @@ int main(int argc, char *argv[])
         fprintf(stderr, "\n");
         fprintf(stderr, "           <input-file> = Neptune data file to read generated from\n");
         fprintf(stderr, "                           using neptune_read\n");
+        fprintf(stderr, "                           or several of them concatenated together,\n");
+        fprintf(stderr, "                           or a tar archive of them, and may be\n");
+        fprintf(stderr, "                           compressed with gzip or zstd.  Use - for stdin\n");
+        fprintf(stderr, "                           It can also be a neptune_archive store\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       -e <max-errors> salvages a damaged file:  bad records are counted\n");
+        fprintf(stderr, "       instead of printed (beyond the first <max-logged>, default %d),\n", DEFAULT_MAX_LOGGED);
+        fprintf(stderr, "       good records are picked out of garbled lines, and it gives up\n");
+        fprintf(stderr, "       after <max-errors> bad records (0 = never).\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       -z <gz|zst> compresses the report with gzip or zstd.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       -p reports the time, CPU cycles, instructions, branch misses and\n");
+        fprintf(stderr, "       cache misses of each phase (record framing, hex decode, speed\n");
+        fprintf(stderr, "       loop and output) on stderr, per record and per datapoint.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Profiles and plots of a file that's been read before come from\n");
+        fprintf(stderr, "       the cache in $NEPTUNE_CACHE_DIR (default ~/.cache/neptune).\n");
+        fprintf(stderr, "       -n reads the file again anyway, without using the cache.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       -S <serial>, -D <from>[,<to>] and -T <type> pick the jumps of an\n");
+        fprintf(stderr, "       archive store by Neptune serial number, date (YYYYMMDD) and jump\n");
+        fprintf(stderr, "       type as recorded (0 = Group 1), as well as by <jump-num>.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       -s <socket> keeps an archive store loaded and serves its reports\n");
+        fprintf(stderr, "       on a Unix-domain socket, from <workers> processes (default %d).\n", DEFAULT_WORKERS);
+        fprintf(stderr, "       A request is a line of the arguments above, without <input-file>,\n");
+        fprintf(stderr, "       separated by tabs, such as \"-S<tab>D27873<tab>2<tab>p<tab>at\".  The\n");
+        fprintf(stderr, "       report comes back as it would be printed, ending when the server\n");
+        fprintf(stderr, "       closes the connection.\n");
         fprintf(stderr, "\n");
         return -1;
     }
 
-    /* Open Input File */
-    pInFile = fopen(pInFilename, "rb");
-    if (!pInFile) {
-        fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pInFilename);
-        return -2;
+    if (pSocketPath) {
+        if (!IsStore(pInFilename)) {
+            fprintf(stderr, "Only an archive store can be served, which \"%s\" isn't!  neptune_archive makes one.\n\n", pInFilename);
+            return -1;
+        }
+        return ServeStore(pSocketPath, nWorkers, pInFilename);
     }
 
-    /* Check magic tag */
-    if (!ReadString(pInFile, databuff, sizeof(databuff))) {
-        fprintf(stderr, "Couldn't read input file \"%s\"!\n\n", pInFilename);
-        fclose(pInFile);
-        return -2;
+    /* An archive store is read as the records of the jumps the query picks, one download
+        for each Neptune, so every report works the same on it */
+    if (IsStore(pInFilename)) {
+        pStore = OpenStore(pInFilename, FALSE);
+        if (!pStore) {
+            fprintf(stderr, "Failed to open the store \"%s\"!\n\n", pInFilename);
+            return -2;
+        }
+        myQuery.nJumpNumber = nJumpNumber;
+    } else if (bFilters) {
+        fprintf(stderr, "-S, -D and -T are only for an archive store, which \"%s\" isn't!\n\n", pInFilename);
+        return -1;
     }
-    for (i=strlen(databuff)-1; i>=0; i--) {
-        if (isspace(databuff[i])) {
-            databuff[i] = 0;
+
+    /* Profiles and plots of a file that's been read before come from the cache.
+        Salvaging a damaged file always reads it, for the recovery report */
+    bCached = FALSE;
+    if ((bUseCache) && (!bRecover) &&
+        ((nDumpType == DT_PROFILE_TAB) || (nDumpType == DT_PROFILE_CSV) || (nDumpType == DT_GNUPLOT))) {
+        memset(&myCacheParams, 0, sizeof(myCacheParams));
+        myCacheParams.nFormat = JUMP_CACHE_FORMAT;
+        myCacheParams.nJumpNumber = nJumpNumber;
+        myCacheParams.nSpeedInterval = SPEED_INTERVAL;
+        myCacheParams.nMaxProfileData = MAX_PROFILE_DATA;
+        myCacheParams.nJumpRecSize = sizeof(JUMP_REC);
+        if (CacheKey(&myCache, pInFilename, &myCacheParams, sizeof(myCacheParams))) {
+            bCached = LoadJumpCache(&myCache);
+            bSaveCache = !bCached;
+        }
+    }
+
+    /* Open Input File */
+    pInStream = NULL;
+    if (!bCached) {
+        if (pStore) {
+            if (!OpenStoreReader(&myStoreReader, pStore, &myQuery)) {
+                fprintf(stderr, "Failed to read the jumps of the store \"%s\"!\n\n", pInFilename);
+                return -2;
+            }
         } else {
-            break;
+            pInStream = OpenInputStream(pInFilename);
+            if (!pInStream) {
+                fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pInFilename);
+                return -2;
+            }
+            if (pInStream->bTar) bSaveCache = FALSE;
         }
     }
-    if (strcmp(databuff, "#NEPTUNE") != 0) {
-        fprintf(stderr, "The input file \"%s\" doesn't appear to be a Neptune Data File!\n\n", pInFilename);
-        fclose(pInFile);
-        return -3;
+
+    if (!CompressOutput(nOutCompression, &nOutPid)) {
+        if (pInStream) CloseInputStream(pInStream);
+        if (pStore) CloseStoreReader(&myStoreReader);
+        return -2;
     }
 
-    /* Print Specified Report Type */
-    switch (nDumpType) {
-        case DT_SUMMARY:
-            PrintSummary(pInFile, nDumpType, nJumpNumber, pSubTypes, pLocation);
-            break;
-        case DT_DETAIL:
-            PrintDetail(pInFile, nDumpType, nJumpNumber, pSubTypes, pLocation);
-            break;
-        case DT_PROFILE_TAB:
-        case DT_PROFILE_CSV:
-            PrintProfile(pInFile, nDumpType, nJumpNumber, pSubTypes, pLocation);
-            break;
-        case DT_GNUPLOT:
-            PrintGnuPlot(pInFile, nDumpType, nJumpNumber, pSubTypes, pLocation);
-            break;
+    if (bRecover) SetRecovery(&myRecovery, nMaxErrors, nMaxLogged);
+    if (bPerf) StartPerfCounters(&myPerf);
+
+    if (bCached) {
+        nResult = 0;
+        switch (nDumpType) {
+            case DT_PROFILE_TAB:
+            case DT_PROFILE_CSV:
+                PrintProfile(NULL, nDumpType, nJumpNumber, pSubTypes, pLocation);
+                break;
+            case DT_GNUPLOT:
+                PrintGnuPlot(NULL, nDumpType, nJumpNumber, pSubTypes, pLocation);
+                break;
+        }
+    } else if ((pInStream) && (pInStream->bTar)) {
+        /* Every Neptune Data File in a tar archive, in one pass */
+        nResult = -3;
+        nMembers = 0;
+        while (NextTarMember(pInStream)) {
+            pMemberName = pInStream->strMember;
+            bFirstMember = (nMembers == 0);
+            if (DumpFile(pInStream, pMemberName, nDumpType, nJumpNumber, pSubTypes, pLocation) == 0) {
+                nMembers++;
+                nResult = 0;
+            }
+            if ((bRecover) && (myRecovery.bOverBudget)) break;
+        }
+        if (nMembers == 0)
+            fprintf(stderr, "The tar archive \"%s\" doesn't hold any Neptune Data Files!\n\n", pInFilename);
+    } else {
+        nResult = DumpFile(pInStream, pInFilename, nDumpType, nJumpNumber, pSubTypes, pLocation);
     }
 
+    StopPerfCounters(&myPerf);
+
     /* Close everything */
-    fclose(pInFile);
+    if ((pInStream) && (!CloseInputStream(pInStream))) {
+        fprintf(stderr, "The input file \"%s\" is corrupt or was cut short!\n\n", pInFilename);
+        nResult = -5;
+    }
+    if ((pStore) && (!CloseStoreReader(&myStoreReader))) {
+        fprintf(stderr, "The store \"%s\" couldn't all be read!\n\n", pInFilename);
+        nResult = -5;
+    }
+    if (!FinishArrow()) {
+        fprintf(stderr, "Writing the Arrow output failed!\n\n");
+        nResult = -6;
+    }
+#ifdef HAVE_SQLITE
+    if (!FinishSQLite()) {
+        fprintf(stderr, "Loading the SQLite database failed!\n\n");
+        nResult = -6;
+    }
+#endif
+    if (!FinishStats(pSubTypes)) {
+        fprintf(stderr, "Working out the fleet statistics failed!\n\n");
+        nResult = -6;
+    }
+    if (!FinishOutput(nOutPid)) {
+        fprintf(stderr, "Compressing the output failed!\n\n");
+        nResult = -6;
+    }
 
-    return 0;
+    if (bRecover) {
+        PrintRecoveryReport(stderr, &myRecovery);
+        if ((myRecovery.bOverBudget) && (nResult == 0)) nResult = -4;
+    }
+    if (bPerf) PrintPerfReport(stderr, &myPerf);
+    if (pStore) CloseStore(pStore);
+    if ((bJumpsLeftOut) && (nResult == 0)) nResult = -7;
+
+    /* A clean read is saved for next time */
+    if ((bSaveCache) && (nResult == 0) && (nBadRecords == 0)) SaveJumpCache(&myCache);
+
+    return nResult;
 }
 
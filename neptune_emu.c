@@ -0,0 +1,697 @@
+/*
+ * Neptune_Emu
+ *
+ * This app emulates a Neptune Altimeter (by Alti-2) on a pseudo-terminal
+ * so that neptune_read can be exercised in its "driver mode" without
+ * the physical altimeter or an IrDA dongle.  It serves the records
+ * from any existing .nep file in response to the same "01 80 80"
+ * version and data commands the real device answers, and can pace
+ * and corrupt the stream on request for repeatable benchmarking.
+ * It can also listen on a TCP or Unix socket instead, for running
+ * neptune_read's socket transports over loopback.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+
+#include <termios.h>
+#include <fcntl.h>
+
+#include "neptune_rec.h"
+
+/* Defines */
+#define VERSION 100
+#define CMD_BUFFER_SIZE 64
+#define BITS_PER_CHAR 10            /* 8 data bits + start + stop */
+#define MARGINAL_CORRUPT_EVERY 4    /* Every Nth record is garbled at a marginal line rate */
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Custom Types */
+typedef struct emu_line
+{
+    int         nType;              /* Record type code from the second hex byte */
+    long        nSize;              /* Length of line text, including CR/LF */
+    char        *pText;             /* Line text exactly as it will be sent */
+} EMU_LINE;
+
+typedef struct emu_config
+{
+    long        nBaud;              /* Simulated line rate, 0 for unlimited or -1 to follow the reader's line rate */
+    long        nMaxRate;           /* Commands at line rates above this aren't understood (0=any) */
+    long        nMarginalRate;      /* Records are garbled at line rates of this or more (0=never) */
+    long        nCorruptEvery;      /* Corrupt the checksum of every Nth record (0=never) */
+    long        nTruncateEvery;     /* Truncate every Nth record (0=never) */
+    long        nStallEvery;        /* Stall before every Nth record (0=never) */
+    long        nStallMSec;         /* Length of each stall */
+    long        nSessions;          /* Number of data transfers to serve before exiting (0=forever) */
+    long        nFaultShift;        /* Records to shift the -c/-t faults by, so each transfer hits different ones */
+} EMU_CONFIG;
+
+typedef struct emu_stats
+{
+    long        nRate;              /* Reader's line rate or 0 if the link has none */
+    long        nRecords;           /* Records sent */
+    long        nBytes;             /* Bytes sent */
+    long        nCorrupted;         /* Records sent with a bad checksum */
+    long        nTruncated;         /* Records sent short */
+    long        nStalls;            /* Stalls injected */
+    double      nCmdTime;           /* Time the command was received */
+    double      nFirstTime;         /* Time the first record was written */
+    double      nLastTime;          /* Time the last record was written */
+} EMU_STATS;
+
+/* Globals */
+EMU_LINE *pLines = NULL;
+long nNumLines = 0;
+volatile sig_atomic_t bQuit = FALSE;
+
+/* Prototypes */
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
+int ReadLine(void *pSource, DATA_REC *pRecord);
+int LoadNeptuneFile(const char *pFilename);
+int OpenMaster(int *pSlave, char *pSlaveName, long nNameSize);
+int OpenListener(const char *pAddress);
+int WriteAll(int desc, const char *pData, long nSize);
+int SendRecords(int desc, const EMU_CONFIG *pConfig, int bVersion, EMU_STATS *pStats);
+long LineRate(int nSlave);
+void PrintStats(const char *pLabel, const EMU_STATS *pStats);
+double TimeNow(void);
+void SleepUntil(double nTime);
+void HandleSignal(int nSignal);
+
+/* ========================================================================== */
+
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
+{
+    FILE *pFile = (FILE*)pSource;
+
+    if (!fgets((char*)pBuff, nBufSize, pFile)) return FALSE;
+    return TRUE;
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    if (!ReadString(pSource, pRecord->buff, sizeof(pRecord->buff))) return FALSE;
+    pRecord->data = pRecord->buff;
+    pRecord->dwSize = strlen((char*)pRecord->buff);
+    return TRUE;
+}
+
+int LoadNeptuneFile(const char *pFilename)
+{
+    FILE *pInFile;
+    unsigned char buff[MAX_RECORD_SIZE];
+    long nAlloc;
+    long nLen;
+    char *p;
+    EMU_LINE *pNew;
+
+    pInFile = fopen(pFilename, "rb");
+    if (!pInFile) {
+        fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pFilename);
+        return FALSE;
+    }
+
+    if ((!ReadString(pInFile, buff, sizeof(buff))) ||
+        (strncmp((char*)buff, "#NEPTUNE", 8) != 0)) {
+        fprintf(stderr, "The input file \"%s\" doesn't appear to be a Neptune Data File!\n\n", pFilename);
+        fclose(pInFile);
+        return FALSE;
+    }
+
+    nAlloc = 0;
+    while (ReadString(pInFile, buff, sizeof(buff))) {
+        /* Skip leading whitespace, comments and blank lines -- the device never sends those */
+        for (p = (char*)buff; ((*p) && (isspace((unsigned char)*p))); p++);
+        if ((*p == 0) || (*p == '!')) continue;
+
+        /* Strip the line ending and replace it with the CR/LF the device uses */
+        nLen = strlen(p);
+        while ((nLen) && (isspace((unsigned char)p[nLen-1]))) nLen--;
+        p[nLen] = 0;
+
+        if (nNumLines >= nAlloc) {
+            nAlloc = (nAlloc ? nAlloc*2 : 256);
+            pNew = (EMU_LINE*)realloc(pLines, nAlloc*sizeof(EMU_LINE));
+            if (!pNew) {
+                fprintf(stderr, "Out of memory loading \"%s\"!\n\n", pFilename);
+                fclose(pInFile);
+                return FALSE;
+            }
+            pLines = pNew;
+        }
+
+        pLines[nNumLines].pText = (char*)malloc(nLen + 4);
+        if (!pLines[nNumLines].pText) {
+            fprintf(stderr, "Out of memory loading \"%s\"!\n\n", pFilename);
+            fclose(pInFile);
+            return FALSE;
+        }
+        sprintf(pLines[nNumLines].pText, "%s \r\n", p);
+        pLines[nNumLines].nSize = nLen + 3;
+        pLines[nNumLines].nType = ((nLen >= 5) ? ConvHexByte((unsigned char*)&p[3]) : -1);
+        nNumLines++;
+    }
+
+    fclose(pInFile);
+
+    if (nNumLines == 0) {
+        fprintf(stderr, "No records found in \"%s\"!\n\n", pFilename);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int OpenMaster(int *pSlave, char *pSlaveName, long nNameSize)
+{
+    int desc;
+    char *pName;
+    struct termios terminfo;
+
+    desc = posix_openpt(O_RDWR | O_NOCTTY);
+    if (desc < 0) {
+        perror("Opening pseudo-terminal ");
+        return -1;
+    }
+
+    if ((grantpt(desc) != 0) ||
+        (unlockpt(desc) != 0) ||
+        ((pName = ptsname(desc)) == NULL)) {
+        perror("Setting up pseudo-terminal ");
+        close(desc);
+        return -1;
+    }
+    strncpy(pSlaveName, pName, nNameSize-1);
+    pSlaveName[nNameSize-1] = 0;
+
+    /* Hold our own handle to the slave side so the master doesn't
+        see a hangup every time neptune_read closes its end */
+    *pSlave = open(pSlaveName, O_RDWR | O_NOCTTY);
+    if (*pSlave < 0) {
+        perror("Opening pseudo-terminal slave ");
+        close(desc);
+        return -1;
+    }
+
+    /* Start out raw, just like neptune_read will configure it */
+    tcgetattr(*pSlave, &terminfo);
+    terminfo.c_iflag = 0;
+    terminfo.c_oflag = 0;
+    terminfo.c_cflag = CS8|CREAD|CLOCAL;
+    terminfo.c_lflag = 0;
+    cfsetospeed(&terminfo, B9600);
+    cfsetispeed(&terminfo, B9600);
+    tcsetattr(*pSlave, TCSANOW, &terminfo);
+
+    return desc;
+}
+
+int OpenListener(const char *pAddress)
+{
+    int desc;
+    int nOn;
+    struct sockaddr_in addr_in;
+    struct sockaddr_un addr_un;
+    const char *pPort;
+
+    if (strncmp(pAddress, "unix:", 5) == 0) {
+        memset(&addr_un, 0, sizeof(addr_un));
+        addr_un.sun_family = AF_UNIX;
+        strncpy(addr_un.sun_path, pAddress+5, sizeof(addr_un.sun_path)-1);
+        unlink(addr_un.sun_path);
+
+        desc = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((desc < 0) ||
+            (bind(desc, (struct sockaddr*) &addr_un, sizeof(addr_un)) != 0)) {
+            perror("Binding Unix socket ");
+            if (desc >= 0) close(desc);
+            return -1;
+        }
+    } else if (strncmp(pAddress, "tcp:", 4) == 0) {
+        /* Only the port is used, we always listen on the loopback interface */
+        pPort = strrchr(pAddress, ':') + 1;
+        memset(&addr_in, 0, sizeof(addr_in));
+        addr_in.sin_family = AF_INET;
+        addr_in.sin_port = htons((unsigned short)strtoul(pPort, NULL, 0));
+        addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        desc = socket(AF_INET, SOCK_STREAM, 0);
+        nOn = 1;
+        if (desc >= 0) setsockopt(desc, SOL_SOCKET, SO_REUSEADDR, &nOn, sizeof(nOn));
+        if ((desc < 0) ||
+            (bind(desc, (struct sockaddr*) &addr_in, sizeof(addr_in)) != 0)) {
+            perror("Binding TCP socket ");
+            if (desc >= 0) close(desc);
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "Unknown listen address \"%s\"!\n\n", pAddress);
+        return -1;
+    }
+
+    if (listen(desc, 1) != 0) {
+        perror("Listening on socket ");
+        close(desc);
+        return -1;
+    }
+
+    return desc;
+}
+
+int WriteAll(int desc, const char *pData, long nSize)
+{
+    long nWritten;
+
+    while (nSize > 0) {
+        nWritten = write(desc, pData, nSize);
+        if (nWritten < 0) {
+            if (errno == EINTR) continue;
+            perror("Writing to reader ");
+            return FALSE;
+        }
+        pData += nWritten;
+        nSize -= nWritten;
+    }
+
+    return TRUE;
+}
+
+int SendRecords(int desc, const EMU_CONFIG *pConfig, int bVersion, EMU_STATS *pStats)
+{
+    long i;
+    long nIndex;
+    long nSize;
+    char buff[MAX_RECORD_SIZE];
+    double nStart;
+    double nSentBytes;
+    long nBaud;
+
+    nBaud = pConfig->nBaud;
+    if (nBaud < 0) nBaud = (pStats->nRate ? pStats->nRate : 9600);
+
+    nStart = TimeNow();
+    nSentBytes = 0.0;
+    nIndex = 0;
+
+    for (i=0; ((i<nNumLines) && (!bQuit)); i++) {
+        /* The version command only returns the version record, the data command the rest */
+        if ((pLines[i].nType == 0) != (bVersion != FALSE)) continue;
+        nIndex++;
+
+        nSize = pLines[i].nSize;
+        if (nSize >= (long)sizeof(buff)) nSize = sizeof(buff)-1;
+        memcpy(buff, pLines[i].pText, nSize);
+        buff[nSize] = 0;
+
+        if ((pConfig->nStallEvery) && ((nIndex % pConfig->nStallEvery) == 0)) {
+            SleepUntil(TimeNow() + pConfig->nStallMSec/1000.0);
+            nStart += pConfig->nStallMSec/1000.0;
+            pStats->nStalls++;
+        }
+
+        if ((pConfig->nCorruptEvery) && (((nIndex + pConfig->nFaultShift) % pConfig->nCorruptEvery) == 0) && (nSize >= 5)) {
+            /* Flip a bit in the checksum digits, which are just ahead of the " \r\n" */
+            buff[nSize-4] = ((buff[nSize-4] == '0') ? '1' : '0');
+            pStats->nCorrupted++;
+        }
+
+        if ((pConfig->nMarginalRate) && (pStats->nRate >= pConfig->nMarginalRate) &&
+            ((nIndex % MARGINAL_CORRUPT_EVERY) == 0) && (nSize >= 5)) {
+            buff[nSize-4] = ((buff[nSize-4] == '0') ? '1' : '0');
+            pStats->nCorrupted++;
+        }
+
+        if ((pConfig->nTruncateEvery) && (((nIndex + pConfig->nFaultShift) % pConfig->nTruncateEvery) == 0) && (nSize > 6)) {
+            /* Cut the line off in the middle of its data, keeping the line ending */
+            nSize = ((nSize - 2) / 6) * 3;
+            strcpy(&buff[nSize], "\r\n");
+            nSize += 2;
+            pStats->nTruncated++;
+        }
+
+        /* Pace ourselves to the simulated line rate */
+        if (nBaud > 0)
+            SleepUntil(nStart + (nSentBytes * BITS_PER_CHAR) / nBaud);
+
+        if (!WriteAll(desc, buff, nSize)) {
+            /* Reader went away mid-transfer */
+            pStats->nLastTime = TimeNow();
+            return FALSE;
+        }
+        nSentBytes += nSize;
+
+        if (pStats->nRecords == 0) pStats->nFirstTime = TimeNow();
+        pStats->nRecords++;
+        pStats->nBytes += nSize;
+    }
+
+    /* Let the last bytes drain at line rate too, so end-to-end timing is honest */
+    if (nBaud > 0)
+        SleepUntil(nStart + (nSentBytes * BITS_PER_CHAR) / nBaud);
+    pStats->nLastTime = TimeNow();
+
+    return TRUE;
+}
+
+long LineRate(int nSlave)
+{
+    /* The rate the reader has set on its end of the pseudo-terminal */
+    struct termios terminfo;
+
+    if (nSlave < 0) return 0;
+    if (tcgetattr(nSlave, &terminfo) != 0) return 0;
+
+    switch (cfgetospeed(&terminfo)) {
+        case B115200:   return 115200;
+        case B57600:    return 57600;
+        case B38400:    return 38400;
+        case B19200:    return 19200;
+        case B9600:     return 9600;
+        case B4800:     return 4800;
+        case B2400:     return 2400;
+        default:        return 0;
+    }
+}
+
+void PrintStats(const char *pLabel, const EMU_STATS *pStats)
+{
+    double nElapsed;
+
+    nElapsed = pStats->nLastTime - pStats->nCmdTime;
+    fprintf(stderr, "%s: %ld records, %ld bytes", pLabel, pStats->nRecords, pStats->nBytes);
+    if (pStats->nRate) fprintf(stderr, " at %ld baud", pStats->nRate);
+    if (pStats->nRecords) {
+        fprintf(stderr, ", first record after %.3f ms, done after %.3f ms",
+                    (pStats->nFirstTime - pStats->nCmdTime)*1000.0, nElapsed*1000.0);
+        if (nElapsed > 0.0)
+            fprintf(stderr, " (%.0f bytes/sec, %.0f records/sec)",
+                    pStats->nBytes/nElapsed, pStats->nRecords/nElapsed);
+    }
+    fprintf(stderr, "\n");
+    if ((pStats->nCorrupted) || (pStats->nTruncated) || (pStats->nStalls))
+        fprintf(stderr, "    Injected: %ld bad checksums, %ld truncated lines, %ld stalls\n",
+                    pStats->nCorrupted, pStats->nTruncated, pStats->nStalls);
+}
+
+/* ========================================================================== */
+
+double TimeNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
+
+void SleepUntil(double nTime)
+{
+    struct timespec ts;
+    double nDelay;
+
+    nDelay = nTime - TimeNow();
+    if (nDelay <= 0.0) return;
+    ts.tv_sec = (time_t)nDelay;
+    ts.tv_nsec = (long)((nDelay - ts.tv_sec) * 1000000000.0);
+    while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR) && (!bQuit));
+}
+
+void HandleSignal(int nSignal)
+{
+    bQuit = TRUE;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    EMU_CONFIG myConfig;
+    EMU_STATS myStats;
+    int nDesc;
+    int nMaster;
+    int nSlave;
+    int nListen;
+    char strSlaveName[256];
+    char *pLinkName;
+    char *pListenAddress;
+    char cmdbuff[CMD_BUFFER_SIZE];
+    long nCmdLen;
+    char rxbuf[CMD_BUFFER_SIZE];
+    long nRead;
+    int bVersionSent;
+    long nSessions;
+    int opt;
+    int bNeedHelp;
+    long i;
+    char *p;
+    fd_set rfds;
+
+    /* Check Arguments */
+    myConfig.nBaud = 9600;
+    myConfig.nMaxRate = 0;
+    myConfig.nMarginalRate = 0;
+    myConfig.nCorruptEvery = 0;
+    myConfig.nTruncateEvery = 0;
+    myConfig.nStallEvery = 0;
+    myConfig.nStallMSec = 0;
+    myConfig.nSessions = 0;
+    myConfig.nFaultShift = 0;
+    pLinkName = NULL;
+    pListenAddress = NULL;
+    bNeedHelp = FALSE;
+
+    while ((opt = getopt(argc, argv, "b:m:e:c:t:s:n:l:a:")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (strcmp(optarg, "line") == 0) {
+                    myConfig.nBaud = -1;
+                } else {
+                    myConfig.nBaud = strtol(optarg, NULL, 0);
+                    if (myConfig.nBaud < 0) bNeedHelp = TRUE;
+                }
+                break;
+            case 'm':
+                myConfig.nMaxRate = strtol(optarg, NULL, 0);
+                break;
+            case 'e':
+                myConfig.nMarginalRate = strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                myConfig.nCorruptEvery = strtol(optarg, NULL, 0);
+                break;
+            case 't':
+                myConfig.nTruncateEvery = strtol(optarg, NULL, 0);
+                break;
+            case 's':
+                myConfig.nStallEvery = strtol(optarg, &p, 0);
+                if (*p == ':') {
+                    myConfig.nStallMSec = strtol(p+1, NULL, 0);
+                } else {
+                    bNeedHelp = TRUE;
+                }
+                break;
+            case 'n':
+                myConfig.nSessions = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                pLinkName = optarg;
+                break;
+            case 'a':
+                pListenAddress = optarg;
+                break;
+            default:
+                bNeedHelp = TRUE;
+                break;
+        }
+    }
+    if ((myConfig.nMaxRate < 0) || (myConfig.nMarginalRate < 0) || (myConfig.nCorruptEvery < 0) ||
+        (myConfig.nTruncateEvery < 0) || (myConfig.nStallEvery < 0) ||
+        (myConfig.nStallMSec < 0) || (myConfig.nSessions < 0)) bNeedHelp = TRUE;
+    if ((pLinkName) && (pListenAddress)) bNeedHelp = TRUE;
+    if (optind != argc-1) bNeedHelp = TRUE;
+
+    if (bNeedHelp) {
+        fprintf(stderr, "Neptune Emu V%d.%02d\n", VERSION/100, VERSION%100);
+        fprintf(stderr, "Usage: neptune_emu [<options>] <neptune-file>\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Serves the records of <neptune-file> on a pseudo-terminal,\n");
+        fprintf(stderr, "       answering the Neptune version and data commands, so that\n");
+        fprintf(stderr, "       neptune_read can be run against it in driver mode.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Where <options> are:\n");
+        fprintf(stderr, "           -b <baud>    = Simulated line rate (default 9600, 0 = unlimited,\n");
+        fprintf(stderr, "                          \"line\" = the rate the reader sets on the line)\n");
+        fprintf(stderr, "           -m <baud>    = Ignore commands sent at line rates above <baud>\n");
+        fprintf(stderr, "           -e <baud>    = Garble every %dth record at line rates of <baud> or more\n", MARGINAL_CORRUPT_EVERY);
+        fprintf(stderr, "           -c <n>       = Send a bad checksum on every <n>th record\n");
+        fprintf(stderr, "           -t <n>       = Truncate every <n>th record\n");
+        fprintf(stderr, "                          (shifted by one record on each transfer)\n");
+        fprintf(stderr, "           -s <n>:<ms>  = Stall <ms> milliseconds before every <n>th record\n");
+        fprintf(stderr, "           -n <count>   = Exit after serving <count> data transfers\n");
+        fprintf(stderr, "           -l <link>    = Create symlink <link> to the pseudo-terminal\n");
+        fprintf(stderr, "           -a <address> = Listen on \"tcp:<port>\" (loopback) or \"unix:<path>\"\n");
+        fprintf(stderr, "                          instead of using a pseudo-terminal\n");
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    if (!LoadNeptuneFile(argv[optind])) return -2;
+
+    nMaster = -1;
+    nSlave = -1;
+    nListen = -1;
+    if (pListenAddress) {
+        nListen = OpenListener(pListenAddress);
+        if (nListen < 0) return -3;
+        nDesc = -1;
+    } else {
+        nMaster = OpenMaster(&nSlave, strSlaveName, sizeof(strSlaveName));
+        if (nMaster < 0) return -3;
+        nDesc = nMaster;
+
+        if (pLinkName) {
+            unlink(pLinkName);
+            if (symlink(strSlaveName, pLinkName) != 0) {
+                perror("Creating symlink ");
+                close(nSlave);
+                close(nMaster);
+                return -4;
+            }
+        }
+    }
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Neptune emulator on %s  (%ld records, %s)\n",
+                (pListenAddress ? pListenAddress : (pLinkName ? pLinkName : strSlaveName)), nNumLines,
+                ((myConfig.nBaud != 0) ? "paced" : "unlimited rate"));
+    fflush(stdout);
+
+    /* Command loop: wakeup spaces are ignored, each "01 80 80" alternately
+        returns the version record and then the rest of the data */
+    nCmdLen = 0;
+    bVersionSent = FALSE;
+    nSessions = 0;
+    while (!bQuit) {
+        if (nDesc < 0) {
+            /* Socket mode -- wait for the next reader to connect */
+            nDesc = accept(nListen, NULL, NULL);
+            if (nDesc < 0) {
+                if (errno == EINTR) continue;
+                perror("Accepting connection ");
+                break;
+            }
+            nCmdLen = 0;
+            bVersionSent = FALSE;
+        }
+
+        FD_ZERO(&rfds);
+        FD_SET(nDesc, &rfds);
+        if (select(nDesc+1, &rfds, NULL, NULL, NULL) < 0) {
+            if (errno == EINTR) continue;
+            perror("Waiting for command ");
+            break;
+        }
+
+        nRead = read(nDesc, rxbuf, sizeof(rxbuf));
+        if ((nRead == 0) && (nListen >= 0)) {
+            /* Reader hung up */
+            close(nDesc);
+            nDesc = -1;
+            continue;
+        }
+        if (nRead < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EIO)) continue;
+            perror("Reading command ");
+            break;
+        }
+
+        for (i=0; i<nRead; i++) {
+            if (!isxdigit((unsigned char)rxbuf[i])) continue;
+            if (nCmdLen >= CMD_BUFFER_SIZE-1) nCmdLen = 0;
+            cmdbuff[nCmdLen++] = toupper((unsigned char)rxbuf[i]);
+            cmdbuff[nCmdLen] = 0;
+            if ((nCmdLen < 6) || (strcmp(&cmdbuff[nCmdLen-6], "018080") != 0)) continue;
+            nCmdLen = 0;
+
+            memset(&myStats, 0, sizeof(myStats));
+            myStats.nCmdTime = TimeNow();
+            myStats.nRate = LineRate(nSlave);
+            if ((myConfig.nMaxRate) && (myStats.nRate > myConfig.nMaxRate)) {
+                /* A real Neptune just hears noise at the wrong rate */
+                fprintf(stderr, "Command at %ld baud not understood\n", myStats.nRate);
+                break;
+            }
+            if (nMaster >= 0) tcflush(nMaster, TCIFLUSH);
+            if (!bVersionSent) {
+                SendRecords(nDesc, &myConfig, TRUE, &myStats);
+                PrintStats("Version", &myStats);
+                bVersionSent = TRUE;
+            } else {
+                myConfig.nFaultShift = nSessions;
+                SendRecords(nDesc, &myConfig, FALSE, &myStats);
+                PrintStats("Data", &myStats);
+                bVersionSent = FALSE;
+                nSessions++;
+                if ((myConfig.nSessions) && (nSessions >= myConfig.nSessions)) bQuit = TRUE;
+            }
+            break;
+        }
+    }
+
+    /* Give the reader a chance to drain what we've sent before the link goes away */
+    if (nMaster >= 0) tcdrain(nMaster);
+    SleepUntil(TimeNow() + 0.5);
+
+    if (pLinkName) unlink(pLinkName);
+    if ((nDesc >= 0) && (nDesc != nMaster)) close(nDesc);
+    if (nListen >= 0) {
+        close(nListen);
+        if (strncmp(pListenAddress, "unix:", 5) == 0) unlink(pListenAddress+5);
+    }
+    if (nSlave >= 0) close(nSlave);
+    if (nMaster >= 0) close(nMaster);
+
+    for (i=0; i<nNumLines; i++)
+        free(pLines[i].pText);
+    free(pLines);
+
+    return 0;
+}
@@ -0,0 +1,511 @@
+/*
+ * Neptune_Gen
+ *
+ * This app writes synthetic Neptune data files, with any number of
+ * jumps, profiles and datapoints, for exercising and benchmarking the
+ * other tools on more than the one sample jump.  Each jump follows a
+ * simple model of the climb, a freefall with drag up to terminal
+ * velocity and a canopy descent, so the speeds and times the reports
+ * work out are realistic, and every record has a correct checksum.
+ * The same seed always writes the same file.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <sys/types.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Defines */
+#define VERSION 100
+#define OUTPUT_BUFF_SIZE    (1024*1024)
+#define MAX_REC_DATA        32          /* Most data bytes in any record we write */
+#define MAX_PROFILES        255         /* The summary only has a byte for the count */
+#define MAX_PROFILE_TIME    65535       /* Datapoint times are 16-bit quarter-seconds */
+
+#define GRAVITY             9.80665     /* m/s^2 */
+#define AIRCRAFT_STEP       16          /* Quarter-seconds between datapoints in the aircraft */
+#define FREEFALL_STEP       4           /*      in freefall */
+#define CANOPY_STEP         8           /*      and under canopy */
+#define AIRCRAFT_POINTS     45          /* Datapoints of the climb before exit */
+#define CLIMB_RATE          5.0         /* m/s */
+#define OPENING_TIME        12          /* Quarter-seconds for the canopy to slow us down */
+
+#define DATA_VERSION        0x10        /* Data version and revision of the jump records */
+#define DATA_VERSION_REV    0x19
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Custom Types */
+typedef struct gen_jump
+{
+    unsigned long nJump;            /* Jump number (1-based) */
+    unsigned long nSeed;            /* Seed for the noise on this jump's profile */
+    int         nMinute, nHour, nDay, nMonth, nYear;
+    int         nJumpType;
+    double      nExitAlt;           /* AGL in meters */
+    double      nDeployAlt;
+    double      nGroundAlt;         /* MSL in meters */
+    double      nTermVel;           /* Terminal velocity in m/s */
+    double      nCanopyRate;        /* Canopy descent rate in m/s */
+    double      nFFTime;            /* Seconds from exit to deployment */
+} GEN_JUMP;
+
+/* Globals */
+static unsigned long nRandState = 1;
+static off_t nOutputSize = 0;          /* Bytes written so far, as stdout might be a pipe */
+static const char HexDigits[] = "0123456789ABCDEF";
+
+/* Prototypes */
+unsigned long NextRandom(unsigned long *pState);
+double RandomRange(unsigned long *pState, double nMin, double nMax);
+void MakeJump(GEN_JUMP *pJump, unsigned long nJump);
+double FreefallDrop(const GEN_JUMP *pJump, double nTime);
+double FreefallSpeed(const GEN_JUMP *pJump, double nTime);
+int SpeedAtAltitude(const GEN_JUMP *pJump, double nAltitude);
+void WriteRecord(FILE *pOutFile, int type, const unsigned char *pData, int nNumData);
+void WriteSession(FILE *pOutFile, const char *pSerialNo, unsigned long nFirstJump,
+                    long nNumJumps, long nNumProfiles, long nNumPoints, unsigned long *pTotalFFTime);
+long WriteProfile(FILE *pOutFile, const GEN_JUMP *pJump, long nNumPoints);
+
+/* ========================================================================== */
+
+unsigned long NextRandom(unsigned long *pState)
+{
+    /* Our own xorshift, so a seed writes the same file with any C library */
+    unsigned long x = *pState & 0xFFFFFFFFul;
+
+    if (x == 0) x = 0x9E3779B9ul;
+    x ^= (x << 13) & 0xFFFFFFFFul;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xFFFFFFFFul;
+    *pState = x;
+    return x;
+}
+
+double RandomRange(unsigned long *pState, double nMin, double nMax)
+{
+    return nMin + (nMax - nMin) * (NextRandom(pState) / 4294967296.0);
+}
+
+void MakeJump(GEN_JUMP *pJump, unsigned long nJump)
+{
+    pJump->nJump = nJump;
+    pJump->nSeed = NextRandom(&nRandState);
+    pJump->nMinute = (int)RandomRange(&nRandState, 0, 60);
+    pJump->nHour = (int)RandomRange(&nRandState, 8, 19);
+    pJump->nDay = (int)RandomRange(&nRandState, 1, 29);
+    pJump->nMonth = (int)RandomRange(&nRandState, 1, 13);
+    pJump->nYear = 4;
+    pJump->nJumpType = (int)RandomRange(&nRandState, 0, 8);
+    pJump->nExitAlt = RandomRange(&nRandState, 3000, 4300);
+    pJump->nDeployAlt = RandomRange(&nRandState, 900, 1400);
+    pJump->nGroundAlt = RandomRange(&nRandState, 0, 1600);
+    pJump->nTermVel = RandomRange(&nRandState, 48, 62);
+    pJump->nCanopyRate = RandomRange(&nRandState, 4.5, 7.0);
+
+    /* The time to fall from exit to deployment, from FreefallDrop() */
+    pJump->nFFTime = pJump->nTermVel / GRAVITY *
+                        acosh(exp((pJump->nExitAlt - pJump->nDeployAlt) * GRAVITY /
+                                    (pJump->nTermVel * pJump->nTermVel)));
+}
+
+/* Freefall with drag proportional to the square of the speed */
+double FreefallDrop(const GEN_JUMP *pJump, double nTime)
+{
+    return pJump->nTermVel * pJump->nTermVel / GRAVITY * log(cosh(GRAVITY * nTime / pJump->nTermVel));
+}
+
+double FreefallSpeed(const GEN_JUMP *pJump, double nTime)
+{
+    return pJump->nTermVel * tanh(GRAVITY * nTime / pJump->nTermVel);
+}
+
+int SpeedAtAltitude(const GEN_JUMP *pJump, double nAltitude)
+{
+    double nDrop;
+
+    if (nAltitude > pJump->nExitAlt) return 0;
+    if (nAltitude < pJump->nDeployAlt) return (int)(pJump->nCanopyRate + 0.5);
+    nDrop = pJump->nExitAlt - nAltitude;
+    return (int)(FreefallSpeed(pJump, pJump->nTermVel / GRAVITY *
+                    acosh(exp(nDrop * GRAVITY / (pJump->nTermVel * pJump->nTermVel)))) + 0.5);
+}
+
+/* ========================================================================== */
+
+void WriteRecord(FILE *pOutFile, int type, const unsigned char *pData, int nNumData)
+{
+    char strLine[(MAX_REC_DATA+3)*3 + 2];
+    unsigned char bytes[MAX_REC_DATA+3];
+    unsigned char nChecksum;
+    int nNumBytes;
+    int i;
+
+    bytes[0] = nNumData + 1;
+    bytes[1] = type;
+    nChecksum = type;
+    for (i=0; i<nNumData; i++) {
+        bytes[i+2] = pData[i];
+        nChecksum += pData[i];
+    }
+    bytes[nNumData+2] = nChecksum;
+    nNumBytes = nNumData + 3;
+
+    for (i=0; i<nNumBytes; i++) {
+        strLine[i*3] = HexDigits[bytes[i] >> 4];
+        strLine[i*3+1] = HexDigits[bytes[i] & 0x0F];
+        strLine[i*3+2] = ' ';
+    }
+    strLine[nNumBytes*3] = '\r';
+    strLine[nNumBytes*3+1] = '\n';
+    fwrite(strLine, 1, nNumBytes*3+2, pOutFile);
+    nOutputSize += nNumBytes*3+2;
+}
+
+void WriteSession(FILE *pOutFile, const char *pSerialNo, unsigned long nFirstJump,
+                    long nNumJumps, long nNumProfiles, long nNumPoints, unsigned long *pTotalFFTime)
+{
+    GEN_JUMP *pJumps;
+    unsigned char data[MAX_REC_DATA];
+    unsigned long nLastJump;
+    long i;
+    int j;
+
+    pJumps = (GEN_JUMP *)malloc(nNumJumps * sizeof(GEN_JUMP));
+    if (!pJumps) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(-3);
+    }
+    for (i=0; i<nNumJumps; i++) {
+        MakeJump(&pJumps[i], nFirstJump + i);
+        *pTotalFFTime += (unsigned long)(pJumps[i].nFFTime + 0.5);
+    }
+    nLastJump = nFirstJump + nNumJumps - 1;
+
+    fprintf(pOutFile, "#NEPTUNE\r\n");
+    nOutputSize += 10;
+
+    /* Version */
+    memset(data, 0, sizeof(data));
+    data[1] = 0x20;
+    data[2] = 0x19;
+    for (j=0; j<9; j++)
+        data[3+j] = ((j < (int)strlen(pSerialNo)) ? pSerialNo[j] : ' ');
+    WriteRecord(pOutFile, 0, data, 12);
+
+    /* Summary */
+    data[0] = nNumJumps & 0xFF;
+    data[1] = (nNumJumps >> 8) & 0xFF;
+    data[2] = nNumProfiles;
+    data[3] = nLastJump & 0xFF;
+    data[4] = (nLastJump >> 8) & 0xFF;
+    data[5] = *pTotalFFTime & 0xFF;
+    data[6] = (*pTotalFFTime >> 8) & 0xFF;
+    data[7] = (*pTotalFFTime >> 16) & 0xFF;
+    data[8] = (*pTotalFFTime >> 24) & 0xFF;
+    data[9] = (nLastJump - 1) & 0xFF;
+    data[10] = ((nLastJump - 1) >> 8) & 0xFF;
+    WriteRecord(pOutFile, 1, data, 11);
+
+    /* Jump Records */
+    for (i=0; i<nNumJumps; i++) {
+        data[0] = (pJumps[i].nJump - 1) & 0xFF;
+        data[1] = ((pJumps[i].nJump - 1) >> 8) & 0xFF;
+        data[2] = pJumps[i].nMinute;
+        data[3] = pJumps[i].nHour;
+        data[4] = pJumps[i].nDay;
+        data[5] = pJumps[i].nMonth;
+        data[6] = pJumps[i].nYear;
+        data[7] = pJumps[i].nJumpType;
+        data[8] = SpeedAtAltitude(&pJumps[i], pJumps[i].nDeployAlt);
+        data[9] = SpeedAtAltitude(&pJumps[i], 12000 * 0.3048);
+        data[10] = SpeedAtAltitude(&pJumps[i], 9000 * 0.3048);
+        data[11] = SpeedAtAltitude(&pJumps[i], 6000 * 0.3048);
+        data[12] = SpeedAtAltitude(&pJumps[i], 3000 * 0.3048);
+        data[13] = (int)pJumps[i].nExitAlt & 0xFF;
+        data[14] = ((int)pJumps[i].nExitAlt >> 8) & 0xFF;
+        data[15] = (int)pJumps[i].nDeployAlt & 0xFF;
+        data[16] = ((int)pJumps[i].nDeployAlt >> 8) & 0xFF;
+        data[17] = DATA_VERSION;
+        data[18] = DATA_VERSION_REV;
+        data[19] = 0;
+        data[20] = (int)(pJumps[i].nFFTime + 0.5) & 0xFF;
+        data[21] = ((int)(pJumps[i].nFFTime + 0.5) >> 8) & 0xFF;
+        WriteRecord(pOutFile, 2, data, 22);
+    }
+
+    /* Profiles of the most recent jumps */
+    for (i=nNumJumps-nNumProfiles; i<nNumJumps; i++)
+        WriteProfile(pOutFile, &pJumps[i], nNumPoints);
+
+    WriteRecord(pOutFile, 3, data, 0);
+
+    free(pJumps);
+}
+
+/* WriteProfile - Writes the profile of a jump with nNumPoints datapoints, or at the
+        Neptune's own sample rates if 0, returning the number written */
+long WriteProfile(FILE *pOutFile, const GEN_JUMP *pJump, long nNumPoints)
+{
+    unsigned char data[MAX_REC_DATA];
+    unsigned long nSeed;
+    long nFFTime, nCanopyTime;          /* In quarter-seconds */
+    long nAirPoints, nFFPoints, nCanopyPoints;
+    long nAirStep, nFFStep, nCanopyStep;
+    long nExitTime, nDeployTime;
+    long nTime;
+    long nCount;
+    double nAlt, nOpenAlt, nOpenSpeed;
+    long i;
+
+    nSeed = pJump->nSeed;
+    nFFTime = (long)(pJump->nFFTime * 4 + 0.5);
+    nOpenSpeed = FreefallSpeed(pJump, pJump->nFFTime);
+    nOpenAlt = pJump->nDeployAlt - (nOpenSpeed + pJump->nCanopyRate) / 2 * (OPENING_TIME / 4.0);
+    nCanopyTime = OPENING_TIME + (long)(nOpenAlt / pJump->nCanopyRate * 4);
+
+    if (nNumPoints <= 0) {
+        nAirPoints = AIRCRAFT_POINTS;
+        nFFPoints = nFFTime / FREEFALL_STEP;
+        nCanopyPoints = nCanopyTime / CANOPY_STEP;
+    } else {
+        /* Spread them 10/30/60 over the phases, but no closer than a quarter-second,
+            with whatever won't fit going to a longer climb */
+        nFFPoints = nNumPoints * 3 / 10;
+        if (nFFPoints > nFFTime) nFFPoints = nFFTime;
+        nCanopyPoints = nNumPoints * 6 / 10;
+        if (nCanopyPoints > nCanopyTime) nCanopyPoints = nCanopyTime;
+        nAirPoints = nNumPoints - nFFPoints - nCanopyPoints;
+    }
+    if (nAirPoints < 1) nAirPoints = 1;
+    if (nFFPoints < 1) nFFPoints = 1;
+    if (nCanopyPoints < 1) nCanopyPoints = 1;
+    nFFStep = (nFFTime + nFFPoints - 1) / nFFPoints;
+    nCanopyStep = (nCanopyTime + nCanopyPoints - 1) / nCanopyPoints;
+    if (nFFStep < 1) nFFStep = 1;
+    if (nCanopyStep < 1) nCanopyStep = 1;
+    nAirStep = AIRCRAFT_STEP;
+    if (nAirPoints * nAirStep > MAX_PROFILE_TIME - nFFTime - nCanopyTime - 1) {
+        nAirStep = (MAX_PROFILE_TIME - nFFTime - nCanopyTime - 1) / nAirPoints;
+        if (nAirStep < 1) {
+            nAirStep = 1;
+            nAirPoints = MAX_PROFILE_TIME - nFFTime - nCanopyTime - 1;
+        }
+    }
+    nExitTime = nAirPoints * nAirStep;
+    nDeployTime = nExitTime + nFFTime;
+
+    /* Profile Start */
+    data[0] = (pJump->nJump - 1) & 0xFF;
+    data[1] = ((pJump->nJump - 1) >> 8) & 0xFF;
+    data[2] = (int)pJump->nGroundAlt & 0xFF;
+    data[3] = ((int)pJump->nGroundAlt >> 8) & 0xFF;
+    data[4] = (int)pJump->nExitAlt & 0xFF;
+    data[5] = ((int)pJump->nExitAlt >> 8) & 0xFF;
+    data[6] = nExitTime & 0xFF;
+    data[7] = (nExitTime >> 8) & 0xFF;
+    data[8] = nDeployTime & 0xFF;
+    data[9] = (nDeployTime >> 8) & 0xFF;
+    WriteRecord(pOutFile, 5, data, 10);
+
+    nCount = 0;
+
+    /* Climbing to exit altitude, levelling off for jump run */
+    for (i=0; i<nAirPoints; i++) {
+        nTime = i * nAirStep;
+        nAlt = pJump->nExitAlt - CLIMB_RATE * ((nExitTime - nTime) / 4.0 - 60);
+        if (nAlt > pJump->nExitAlt) nAlt = pJump->nExitAlt;
+        nAlt += RandomRange(&nSeed, -1.5, 1.5);
+        if (nAlt < 0) nAlt = 0;
+        data[0] = (int)nAlt & 0xFF;
+        data[1] = ((int)nAlt >> 8) & 0xFF;
+        data[2] = nTime & 0xFF;
+        data[3] = (nTime >> 8) & 0xFF;
+        WriteRecord(pOutFile, 6, data, 4);
+        nCount++;
+    }
+
+    /* Freefall */
+    data[0] = 5;
+    data[1] = nExitTime & 0xFF;
+    data[2] = (nExitTime >> 8) & 0xFF;
+    WriteRecord(pOutFile, 4, data, 3);
+    for (nTime=nExitTime; nTime<nDeployTime; nTime+=nFFStep) {
+        nAlt = pJump->nExitAlt - FreefallDrop(pJump, (nTime - nExitTime) / 4.0);
+        nAlt += RandomRange(&nSeed, -1.0, 1.0);
+        data[0] = (int)nAlt & 0xFF;
+        data[1] = ((int)nAlt >> 8) & 0xFF;
+        data[2] = nTime & 0xFF;
+        data[3] = (nTime >> 8) & 0xFF;
+        WriteRecord(pOutFile, 6, data, 4);
+        nCount++;
+    }
+
+    /* Canopy, slowing from freefall speed as it opens */
+    data[0] = 6;
+    data[1] = nDeployTime & 0xFF;
+    data[2] = (nDeployTime >> 8) & 0xFF;
+    WriteRecord(pOutFile, 4, data, 3);
+    for (nTime=nDeployTime; nTime<=nDeployTime+nCanopyTime; nTime+=nCanopyStep) {
+        i = nTime - nDeployTime;
+        if (i < OPENING_TIME) {
+            nAlt = pJump->nDeployAlt - (nOpenSpeed - (nOpenSpeed - pJump->nCanopyRate) * i / (2.0 * OPENING_TIME)) * (i / 4.0);
+        } else {
+            nAlt = nOpenAlt - pJump->nCanopyRate * ((i - OPENING_TIME) / 4.0);
+        }
+        nAlt += RandomRange(&nSeed, -1.0, 1.0);
+        if (nAlt < 0) nAlt = 0;
+        data[0] = (int)nAlt & 0xFF;
+        data[1] = ((int)nAlt >> 8) & 0xFF;
+        data[2] = nTime & 0xFF;
+        data[3] = (nTime >> 8) & 0xFF;
+        WriteRecord(pOutFile, 6, data, 4);
+        nCount++;
+    }
+
+    return nCount;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    FILE *pOutFile;
+    const char *pSerialNo;
+    unsigned long nFirstJump;
+    unsigned long nTotalFFTime;
+    long nNumJumps;
+    long nNumProfiles;
+    long nNumPoints;
+    long nNumSessions;
+    long nMinSize;
+    long nSession;
+    int bNeedHelp;
+    int opt;
+
+    /* Check Arguments */
+    nNumJumps = 10;
+    nNumProfiles = -1;
+    nNumPoints = 0;
+    nNumSessions = 1;
+    nMinSize = 0;
+    nFirstJump = 1;
+    pSerialNo = "G00001";
+    bNeedHelp = FALSE;
+
+    while ((opt = getopt(argc, argv, "j:p:P:n:m:f:s:S:")) != -1) {
+        switch (opt) {
+            case 'j':
+                nNumJumps = atol(optarg);
+                break;
+            case 'p':
+                nNumProfiles = atol(optarg);
+                break;
+            case 'P':
+                nNumPoints = atol(optarg);
+                break;
+            case 'n':
+                nNumSessions = atol(optarg);
+                break;
+            case 'm':
+                nMinSize = atol(optarg);
+                break;
+            case 'f':
+                nFirstJump = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                nRandState = strtoul(optarg, NULL, 0);
+                break;
+            case 'S':
+                pSerialNo = optarg;
+                break;
+            default:
+                bNeedHelp = TRUE;
+                break;
+        }
+    }
+    if (argc-optind != 1) bNeedHelp = TRUE;
+    if ((nNumJumps < 1) || (nNumJumps > 65535) || (nNumSessions < 1) || (nMinSize < 0) ||
+        (nFirstJump < 1) || (nNumPoints < 0)) bNeedHelp = TRUE;
+
+    if (bNeedHelp) {
+        fprintf(stderr, "Neptune Gen V%d.%02d\n", VERSION/100, VERSION%100);
+        fprintf(stderr, "Usage: neptune_gen [<options>] <output-file>\n\n");
+        fprintf(stderr, "       Writes a synthetic Neptune data file, with realistic jumps\n");
+        fprintf(stderr, "       and profiles and correct checksums.  Use \"-\" for stdout.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Where <options> are:\n");
+        fprintf(stderr, "           -j <jumps> = Jump records per download (default 10)\n");
+        fprintf(stderr, "           -p <profiles> = Profiles per download, of the last jumps\n");
+        fprintf(stderr, "                   (default one for each jump, at most %d)\n", MAX_PROFILES);
+        fprintf(stderr, "           -P <points> = Datapoints per profile (default 0 = the Neptune's\n");
+        fprintf(stderr, "                   own sample rates, a few hundred)\n");
+        fprintf(stderr, "           -n <downloads> = Number of downloads to write, one after\n");
+        fprintf(stderr, "                   the other, as in an archive (default 1)\n");
+        fprintf(stderr, "           -m <MB> = Keep writing downloads until the file is at least\n");
+        fprintf(stderr, "                   this big\n");
+        fprintf(stderr, "           -f <jump> = Number of the first jump (default 1)\n");
+        fprintf(stderr, "           -s <seed> = Random seed (default 1)\n");
+        fprintf(stderr, "           -S <serial> = Serial number of the Neptune (default G00001)\n");
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    if (nNumProfiles < 0) nNumProfiles = nNumJumps;
+    if (nNumProfiles > nNumJumps) nNumProfiles = nNumJumps;
+    if (nNumProfiles > MAX_PROFILES) nNumProfiles = MAX_PROFILES;
+
+    if (strcmp(argv[optind], "-") == 0) {
+        pOutFile = stdout;
+    } else {
+        pOutFile = fopen(argv[optind], "wb");
+        if (!pOutFile) {
+            fprintf(stderr, "Failed to open \"%s\" for writing!\n\n", argv[optind]);
+            return -2;
+        }
+    }
+    setvbuf(pOutFile, NULL, _IOFBF, OUTPUT_BUFF_SIZE);
+
+    /* Each download carries on with the jump numbers of the last, as on one Neptune */
+    nTotalFFTime = 0;
+    for (nSession=0; ((nSession < nNumSessions) ||
+                        (nOutputSize < (off_t)nMinSize*1024*1024)); nSession++) {
+        WriteSession(pOutFile, pSerialNo, nFirstJump, nNumJumps, nNumProfiles, nNumPoints, &nTotalFFTime);
+        nFirstJump += nNumJumps;
+        if (nFirstJump + nNumJumps > 65536) nFirstJump = 1;
+    }
+
+    if ((fflush(pOutFile) != 0) || (ferror(pOutFile))) {
+        perror("Writing output ");
+        if (pOutFile != stdout) fclose(pOutFile);
+        return -3;
+    }
+    if (pOutFile != stdout) fclose(pOutFile);
+
+    return 0;
+}
+
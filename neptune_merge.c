@@ -0,0 +1,332 @@
+/*
+ * Neptune_Merge
+ *
+ * This module collects the records of a Neptune data transfer and
+ * merges repeated transfers of the same log, so that records that
+ * came through corrupted on one pass can be filled in from another.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "neptune_rec.h"
+#include "neptune_merge.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Custom Types */
+typedef struct merge_index
+{
+    MERGE_KEY   key;
+    long        nPos;               /* Position of the record in its set */
+} MERGE_INDEX;
+
+/* Local Prototypes */
+static char *CopyText(const char *pText);
+static int RecordByte(const unsigned char *databuff, long nLen, int nByte);
+static int CompareKeys(const MERGE_KEY *pKey1, const MERGE_KEY *pKey2);
+static int CompareIndex(const void *pEntry1, const void *pEntry2);
+static long FindRecord(const MERGE_INDEX *pIndex, long nNumIndex, const MERGE_KEY *pKey);
+static int AppendRecord(MERGE_SET *pSet, int type, const MERGE_KEY *pKey, char *pText);
+
+/* ========================================================================== */
+
+void InitMergeSet(MERGE_SET *pSet)
+{
+    pSet->pRecs = NULL;
+    pSet->nNumRecs = 0;
+    pSet->nAlloc = 0;
+    pSet->nProfileJump = 0;
+}
+
+void FreeMergeSet(MERGE_SET *pSet)
+{
+    long i;
+
+    for (i=0; i<pSet->nNumRecs; i++)
+        free(pSet->pRecs[i].pText);
+    free(pSet->pRecs);
+    InitMergeSet(pSet);
+}
+
+int AddMergeRecord(MERGE_SET *pSet, int type, const unsigned char *databuff)
+{
+    MERGE_KEY myKey;
+    unsigned long nHash;
+    long nLen;
+    long i;
+
+    /* Identify the record by what it is and the jump it's part of, so the same
+        record can be found again in another pass, wherever it lands */
+    nLen = strlen((const char *)databuff);
+    myKey.type = type;
+    myKey.nJump = 0;
+    myKey.nSub = 0;
+    switch (type) {
+        case 0:     /* Version Info */
+        case 1:     /* Jump Summary */
+        case 3:     /* End of all data */
+            break;
+        case 2:     /* Jump Record */
+            myKey.nJump = RecordByte(databuff, nLen, 0) + RecordByte(databuff, nLen, 1)*256ul;
+            break;
+        case 5:     /* Profile Start */
+            myKey.nJump = RecordByte(databuff, nLen, 0) + RecordByte(databuff, nLen, 1)*256ul;
+            pSet->nProfileJump = myKey.nJump;
+            break;
+        case 4:     /* Profile Stream Type */
+            myKey.nJump = pSet->nProfileJump;
+            myKey.nSub = RecordByte(databuff, nLen, 0) * 65536ul +
+                            RecordByte(databuff, nLen, 1) + RecordByte(databuff, nLen, 2)*256ul;
+            break;
+        case 6:     /* Profile Datapoint -- time is unique within the profile */
+            myKey.nJump = pSet->nProfileJump;
+            myKey.nSub = RecordByte(databuff, nLen, 2) + RecordByte(databuff, nLen, 3)*256ul;
+            break;
+        case 7:     /* End of Profile */
+            myKey.nJump = pSet->nProfileJump;
+            break;
+        default:    /* Anything else (and bad records) are known by their content */
+            if ((type < 0) && (nLen >= 14) && (ConvHexByte(&databuff[3]) == 5)) {
+                /* Most likely a Profile Start with a bad checksum or cut short, whose
+                    jump number still keys the datapoints that follow it */
+                pSet->nProfileJump = RecordByte(databuff, nLen, 0) + RecordByte(databuff, nLen, 1)*256ul;
+            }
+            myKey.nJump = pSet->nProfileJump;
+            nHash = 2166136261ul;
+            for (i=0; i<nLen; i++)
+                nHash = ((nHash ^ databuff[i]) * 16777619ul) & 0xFFFFFFFFul;
+            myKey.nSub = nHash;
+            break;
+    }
+
+    return AppendRecord(pSet, type, &myKey, CopyText((const char *)databuff));
+}
+
+long CountMergeHoles(const MERGE_SET *pSet)
+{
+    long nHoles;
+    long i;
+
+    nHoles = 0;
+    for (i=0; i<pSet->nNumRecs; i++) {
+        if (pSet->pRecs[i].type < 0) nHoles++;
+    }
+
+    return nHoles;
+}
+
+long MergeTransfer(MERGE_SET *pMerged, const MERGE_SET *pRepeat)
+{
+    /* Walk the merged set from one good record (anchor) to the next, and look
+        at what the repeat has between the same two anchors:  if it's all good,
+        it replaces whatever we had there (which also recovers lines that went
+        missing altogether), otherwise if it lines up one for one, each bad
+        record is taken from the repeat where it's good there.  When one of the
+        anchors is bad in the repeat too, the span is lined up one for one from
+        the other anchor */
+    MERGE_INDEX *pIndex;
+    MERGE_SET myResult;
+    const MERGE_REC *pRec;
+    long nNumIndex;
+    long nFilled;
+    long nStart;            /* First record after the previous anchor in pMerged */
+    long nEnd;              /* Next anchor in pMerged (or the end) */
+    long nRepStart;         /* First record after the previous anchor in pRepeat or -1 if not found */
+    long nRepEnd;           /* Next anchor in pRepeat */
+    long nRepPos;
+    int bFoundStart;
+    int bFoundEnd;
+    int bAllGood;
+    int bOK;
+    long i;
+
+    /* Index the good records of the repeat by key */
+    pIndex = (MERGE_INDEX *)malloc((pRepeat->nNumRecs ? pRepeat->nNumRecs : 1) * sizeof(MERGE_INDEX));
+    if (!pIndex) return -1;
+    nNumIndex = 0;
+    for (i=0; i<pRepeat->nNumRecs; i++) {
+        if (pRepeat->pRecs[i].type < 0) continue;
+        pIndex[nNumIndex].key = pRepeat->pRecs[i].key;
+        pIndex[nNumIndex].nPos = i;
+        nNumIndex++;
+    }
+    qsort(pIndex, nNumIndex, sizeof(MERGE_INDEX), CompareIndex);
+
+    InitMergeSet(&myResult);
+    nFilled = 0;
+    bOK = TRUE;
+    nStart = 0;
+    nRepStart = 0;
+    while ((bOK) && (nStart <= pMerged->nNumRecs)) {
+        for (nEnd=nStart; ((nEnd < pMerged->nNumRecs) && (pMerged->pRecs[nEnd].type < 0)); nEnd++);
+
+        if (nEnd < pMerged->nNumRecs) {
+            nRepEnd = FindRecord(pIndex, nNumIndex, &pMerged->pRecs[nEnd].key);
+        } else {
+            nRepEnd = pRepeat->nNumRecs;
+        }
+        bFoundStart = (nRepStart >= 0);
+        bFoundEnd = (nRepEnd >= 0);
+        if ((!bFoundStart) && (bFoundEnd)) nRepStart = nRepEnd - (nEnd - nStart);
+        if ((bFoundStart) && (!bFoundEnd)) nRepEnd = nRepStart + (nEnd - nStart);
+        if ((nRepStart < 0) || (nRepEnd > pRepeat->nNumRecs)) nRepEnd = -1;
+
+        /* Decide what goes between the anchors */
+        bAllGood = FALSE;
+        if ((bFoundStart) && (bFoundEnd) && (nRepEnd >= nRepStart)) {
+            bAllGood = TRUE;
+            for (nRepPos=nRepStart; nRepPos<nRepEnd; nRepPos++) {
+                if (pRepeat->pRecs[nRepPos].type < 0) bAllGood = FALSE;
+            }
+        }
+        if ((bAllGood) && (nEnd - nStart + nRepEnd - nRepStart)) {
+            for (nRepPos=nRepStart; ((bOK) && (nRepPos<nRepEnd)); nRepPos++) {
+                pRec = &pRepeat->pRecs[nRepPos];
+                bOK = AppendRecord(&myResult, pRec->type, &pRec->key, CopyText(pRec->pText));
+            }
+            nFilled += nRepEnd - nRepStart;
+        } else {
+            for (i=nStart; ((bOK) && (i<nEnd)); i++) {
+                pRec = &pMerged->pRecs[i];
+                if ((nRepEnd >= 0) && ((nRepEnd - nRepStart) == (nEnd - nStart)) &&
+                    (pRepeat->pRecs[nRepStart + i - nStart].type >= 0)) {
+                    pRec = &pRepeat->pRecs[nRepStart + i - nStart];
+                    nFilled++;
+                }
+                bOK = AppendRecord(&myResult, pRec->type, &pRec->key, CopyText(pRec->pText));
+            }
+        }
+
+        /* Then the anchor itself */
+        if ((bOK) && (nEnd < pMerged->nNumRecs)) {
+            pRec = &pMerged->pRecs[nEnd];
+            bOK = AppendRecord(&myResult, pRec->type, &pRec->key, CopyText(pRec->pText));
+        }
+
+        nStart = nEnd + 1;
+        nRepStart = ((bFoundEnd) ? nRepEnd + 1 : -1);
+    }
+    free(pIndex);
+
+    if (!bOK) {
+        FreeMergeSet(&myResult);
+        return -1;
+    }
+
+    myResult.nProfileJump = pMerged->nProfileJump;
+    FreeMergeSet(pMerged);
+    *pMerged = myResult;
+
+    return nFilled;
+}
+
+/* ========================================================================== */
+
+static char *CopyText(const char *pText)
+{
+    char *pCopy;
+    long nLen;
+
+    if (!pText) return NULL;
+    nLen = strlen(pText);
+    pCopy = (char *)malloc(nLen + 1);
+    if (pCopy) memcpy(pCopy, pText, nLen + 1);
+
+    return pCopy;
+}
+
+static int RecordByte(const unsigned char *databuff, long nLen, int nByte)
+{
+    /* Data byte nByte of the record text, or 0 if the record is too short */
+    if ((nByte*3 + 8) > nLen) return 0;
+    return ConvHexByte(&databuff[nByte*3 + 6]);
+}
+
+static int CompareKeys(const MERGE_KEY *pKey1, const MERGE_KEY *pKey2)
+{
+    if (pKey1->type != pKey2->type) return ((pKey1->type < pKey2->type) ? -1 : 1);
+    if (pKey1->nJump != pKey2->nJump) return ((pKey1->nJump < pKey2->nJump) ? -1 : 1);
+    if (pKey1->nSub != pKey2->nSub) return ((pKey1->nSub < pKey2->nSub) ? -1 : 1);
+    return 0;
+}
+
+static int CompareIndex(const void *pEntry1, const void *pEntry2)
+{
+    const MERGE_INDEX *pIndex1 = (const MERGE_INDEX *)pEntry1;
+    const MERGE_INDEX *pIndex2 = (const MERGE_INDEX *)pEntry2;
+    int nCompare;
+
+    /* Duplicates sort in stream order, so the first copy is the one found */
+    nCompare = CompareKeys(&pIndex1->key, &pIndex2->key);
+    if (nCompare) return nCompare;
+    if (pIndex1->nPos != pIndex2->nPos) return ((pIndex1->nPos < pIndex2->nPos) ? -1 : 1);
+    return 0;
+}
+
+static long FindRecord(const MERGE_INDEX *pIndex, long nNumIndex, const MERGE_KEY *pKey)
+{
+    /* Returns the position of the first record with the key, or -1 if there isn't one */
+    long nLow;
+    long nHigh;
+    long nMid;
+
+    nLow = 0;
+    nHigh = nNumIndex;
+    while (nLow < nHigh) {
+        nMid = (nLow + nHigh) / 2;
+        if (CompareKeys(&pIndex[nMid].key, pKey) < 0) {
+            nLow = nMid + 1;
+        } else {
+            nHigh = nMid;
+        }
+    }
+    if ((nLow < nNumIndex) && (CompareKeys(&pIndex[nLow].key, pKey) == 0)) return pIndex[nLow].nPos;
+
+    return -1;
+}
+
+static int AppendRecord(MERGE_SET *pSet, int type, const MERGE_KEY *pKey, char *pText)
+{
+    /* Note: Takes ownership of pText, which may be NULL if a copy failed */
+    MERGE_REC *pNew;
+
+    if (!pText) return FALSE;
+    if (pSet->nNumRecs >= pSet->nAlloc) {
+        pNew = (MERGE_REC *)realloc(pSet->pRecs, (pSet->nAlloc ? pSet->nAlloc*2 : 256) * sizeof(MERGE_REC));
+        if (!pNew) {
+            free(pText);
+            return FALSE;
+        }
+        pSet->pRecs = pNew;
+        pSet->nAlloc = (pSet->nAlloc ? pSet->nAlloc*2 : 256);
+    }
+    pSet->pRecs[pSet->nNumRecs].type = type;
+    pSet->pRecs[pSet->nNumRecs].key = *pKey;
+    pSet->pRecs[pSet->nNumRecs].pText = pText;
+    pSet->nNumRecs++;
+
+    return TRUE;
+}
+
@@ -0,0 +1,70 @@
+/*
+ * Neptune_Merge
+ *
+ * This module collects the records of a Neptune data transfer and
+ * merges repeated transfers of the same log, so that records that
+ * came through corrupted on one pass can be filled in from another.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_MERGE_H_
+#define _NEPTUNE_MERGE_H_
+
+typedef struct merge_key
+{
+    int         type;               /* Record type code */
+    unsigned long nJump;            /* Jump number the record belongs to (0 if none) */
+    unsigned long nSub;             /* Position within the jump (profile time, etc) */
+} MERGE_KEY;
+
+typedef struct merge_rec
+{
+    int         type;               /* Record type code or GetNextRecord() error (-2/-3) */
+    MERGE_KEY   key;                /* Identity of the record, valid records only */
+    char        *pText;             /* Record text as returned by GetNextRecord() */
+} MERGE_REC;
+
+typedef struct merge_set
+{
+    MERGE_REC   *pRecs;
+    long        nNumRecs;
+    long        nAlloc;
+    unsigned long nProfileJump;     /* Jump number of the profile being added */
+} MERGE_SET;
+
+/* InitMergeSet - Initializes an empty set of records */
+extern void InitMergeSet(MERGE_SET *pSet);
+
+/* FreeMergeSet - Frees all of the records in a set, leaving it empty */
+extern void FreeMergeSet(MERGE_SET *pSet);
+
+/* AddMergeRecord - Appends the next record of a transfer to the set, where type and
+        databuff are as returned by GetNextRecord().  Returns FALSE if out of memory */
+extern int AddMergeRecord(MERGE_SET *pSet, int type, const unsigned char *databuff);
+
+/* CountMergeHoles - Returns the number of bad records in the set */
+extern long CountMergeHoles(const MERGE_SET *pSet);
+
+/* MergeTransfer - Fills the holes in pMerged from a repeated transfer of the same
+        log, keeping the first valid copy of every record.  Records are aligned by
+        their type and jump number, so lines lost altogether on one pass are put
+        back too.  Returns the number of records filled in, or -1 if out of memory */
+extern long MergeTransfer(MERGE_SET *pMerged, const MERGE_SET *pRepeat);
+
+#endif  /* _NEPTUNE_MERGE_H_ */
+
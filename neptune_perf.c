@@ -0,0 +1,257 @@
+/*
+ * Neptune_Perf
+ *
+ * This module counts CPU cycles, instructions, branch misses and
+ * last level cache misses separately for each phase of a run, using
+ * the Linux perf_event_open() hardware counters, so it's clear what
+ * each of the hot loops is held up by.
+ *
+ * Each phase has its own group of counters, which are switched on
+ * and off together as the phase is entered and left, and only count
+ * user mode, so the switching itself doesn't show up in the counts.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/perf_event.h>
+
+#include "neptune_perf.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Constants */
+static const struct {
+    unsigned long nType;
+    unsigned long nConfig;
+    const char *pName;
+} PerfEvents[PERF_NUM_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,         "Cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,       "Instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,      "Branch Misses" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,       "LLC Misses" },
+};
+
+static const char *strPhaseNames[PERF_NUM_PHASES] = {
+                    "Framing", "Hex Decode", "Speed Loop", "Output"
+                };
+
+/* Local Prototypes */
+static double PerfNow(void);
+static int OpenCounter(int nCounter, int fdGroup);
+static void ReadPhase(PERF_PHASE *pPhase);
+
+/* ========================================================================== */
+
+static double PerfNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int OpenCounter(int nCounter, int fdGroup)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PerfEvents[nCounter].nType;
+    attr.config = PerfEvents[nCounter].nConfig;
+    attr.disabled = ((fdGroup == -1) ? 1 : 0);      /* The leader switches the whole group */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, fdGroup, 0);
+}
+
+void StartPerfCounters(PERF_COUNTERS *pPerf)
+{
+    PERF_PHASE *pPhase;
+    int nMembers;
+    int nError;
+    int i, j;
+
+    memset(pPerf, 0, sizeof(PERF_COUNTERS));
+    pPerf->nPhase = PERF_NONE;
+    nError = 0;
+
+    for (i=0; i<PERF_NUM_PHASES; i++) {
+        pPhase = &pPerf->Phases[i];
+        pPhase->fdLeader = -1;
+        nMembers = 0;
+        for (j=0; j<PERF_NUM_COUNTERS; j++) {
+            pPhase->nIndex[j] = -1;
+            pPhase->fd[j] = OpenCounter(j, pPhase->fdLeader);
+            if (pPhase->fd[j] < 0) {
+                if (nError == 0) nError = errno;
+                continue;
+            }
+            if (pPhase->fdLeader == -1) pPhase->fdLeader = pPhase->fd[j];
+            pPhase->nIndex[j] = nMembers++;
+        }
+        if (pPhase->fdLeader != -1) pPerf->bCounters = TRUE;
+    }
+
+    if (!pPerf->bCounters) {
+        switch (nError) {
+            case EACCES:
+            case EPERM:
+                snprintf(pPerf->strError, sizeof(pPerf->strError), "not permitted, see /proc/sys/kernel/perf_event_paranoid");
+                break;
+            case ENOENT:
+            case ENODEV:
+            case EOPNOTSUPP:
+                snprintf(pPerf->strError, sizeof(pPerf->strError), "no hardware counters on this CPU");
+                break;
+            case ENOSYS:
+                snprintf(pPerf->strError, sizeof(pPerf->strError), "perf_event_open() isn't supported");
+                break;
+            default:
+                snprintf(pPerf->strError, sizeof(pPerf->strError), "%s", strerror(nError));
+                break;
+        }
+    }
+
+    pPerf->bEnabled = TRUE;
+}
+
+int PerfPhase(PERF_COUNTERS *pPerf, int nPhase)
+{
+    PERF_PHASE *pPhase;
+    double nNow;
+    int nPrevious;
+
+    if (!pPerf->bEnabled) return PERF_NONE;
+
+    nPrevious = pPerf->nPhase;
+    if (nPhase == nPrevious) return nPrevious;
+
+    nNow = PerfNow();
+    if (nPrevious != PERF_NONE) {
+        pPhase = &pPerf->Phases[nPrevious];
+        if (pPhase->fdLeader != -1) ioctl(pPhase->fdLeader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        pPhase->nTime += nNow - pPhase->nStart;
+    }
+    if (nPhase != PERF_NONE) {
+        pPhase = &pPerf->Phases[nPhase];
+        pPhase->nStart = nNow;
+        if (pPhase->fdLeader != -1) ioctl(pPhase->fdLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    pPerf->nPhase = nPhase;
+
+    return nPrevious;
+}
+
+static void ReadPhase(PERF_PHASE *pPhase)
+{
+    unsigned long long values[3 + PERF_NUM_COUNTERS];
+    double nScale;
+    int i;
+
+    for (i=0; i<PERF_NUM_COUNTERS; i++)
+        pPhase->nCount[i] = -1;
+    if (pPhase->fdLeader == -1) return;
+
+    /* nr, time_enabled, time_running, then each counter of the group.  If the
+        counters had to share the PMU with others, scale them up to the whole time */
+    if (read(pPhase->fdLeader, values, sizeof(values)) < (ssize_t)(3*sizeof(values[0]))) return;
+    nScale = ((values[2] != 0) ? ((double)values[1] / values[2]) : 0.0);
+    for (i=0; i<PERF_NUM_COUNTERS; i++) {
+        if ((pPhase->nIndex[i] < 0) || (pPhase->nIndex[i] >= (int)values[0])) continue;
+        pPhase->nCount[i] = values[3 + pPhase->nIndex[i]] * nScale;
+    }
+}
+
+void StopPerfCounters(PERF_COUNTERS *pPerf)
+{
+    int i, j;
+
+    if (!pPerf->bEnabled) return;
+    PerfPhase(pPerf, PERF_NONE);
+
+    for (i=0; i<PERF_NUM_PHASES; i++) {
+        ReadPhase(&pPerf->Phases[i]);
+        for (j=0; j<PERF_NUM_COUNTERS; j++) {
+            if (pPerf->Phases[i].fd[j] >= 0) close(pPerf->Phases[i].fd[j]);
+            pPerf->Phases[i].fd[j] = -1;
+        }
+        pPerf->Phases[i].fdLeader = -1;
+    }
+    pPerf->bEnabled = FALSE;
+}
+
+/* ========================================================================== */
+
+void PrintPerfReport(FILE *pOutFile, const PERF_COUNTERS *pPerf)
+{
+    const PERF_PHASE *pPhase;
+    double nUnits;
+    int bPerPoint;
+    int i, j;
+
+    fprintf(pOutFile, "Performance:  %lu records, %lu datapoints\n", pPerf->nRecords, pPerf->nDataPoints);
+    if (!pPerf->bCounters)
+        fprintf(pOutFile, "Hardware counters unavailable (%s), showing times only\n", pPerf->strError);
+
+    fprintf(pOutFile, "%-12s %-6s %10s %10s", "Phase", "Per", "Seconds", "Nanosec");
+    for (j=0; j<PERF_NUM_COUNTERS; j++)
+        fprintf(pOutFile, " %14s", PerfEvents[j].pName);
+    fprintf(pOutFile, " %8s\n", "IPC");
+
+    for (i=0; i<PERF_NUM_PHASES; i++) {
+        pPhase = &pPerf->Phases[i];
+
+        /* The speed loop and the profile output work through the datapoints, the
+            rest through the records (as does the output of summaries and details) */
+        bPerPoint = (((i == PERF_SPEED) || (i == PERF_OUTPUT)) && (pPerf->nDataPoints != 0));
+        nUnits = (bPerPoint ? pPerf->nDataPoints : pPerf->nRecords);
+
+        fprintf(pOutFile, "%-12s %-6s %10.4f %10.1f", strPhaseNames[i], (bPerPoint ? "point" : "record"),
+                    pPhase->nTime, ((nUnits != 0) ? (pPhase->nTime * 1e9 / nUnits) : 0.0));
+        for (j=0; j<PERF_NUM_COUNTERS; j++) {
+            if ((pPhase->nCount[j] < 0) || (nUnits == 0)) {
+                fprintf(pOutFile, " %14s", "n/a");
+            } else {
+                fprintf(pOutFile, " %14.2f", pPhase->nCount[j] / nUnits);
+            }
+        }
+        if ((pPhase->nCount[PERF_CYCLES] > 0) && (pPhase->nCount[PERF_INSTRUCTIONS] >= 0)) {
+            fprintf(pOutFile, " %8.2f\n", pPhase->nCount[PERF_INSTRUCTIONS] / pPhase->nCount[PERF_CYCLES]);
+        } else {
+            fprintf(pOutFile, " %8s\n", "n/a");
+        }
+    }
+}
+
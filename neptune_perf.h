@@ -0,0 +1,85 @@
+/*
+ * Neptune_Perf
+ *
+ * This module counts CPU cycles, instructions, branch misses and
+ * last level cache misses separately for each phase of a run, using
+ * the Linux perf_event_open() hardware counters, so it's clear what
+ * each of the hot loops is held up by.  When the counters can't be
+ * had (no PMU, a VM, or perf_event_paranoid), just the time of each
+ * phase is kept.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_PERF_H_
+#define _NEPTUNE_PERF_H_
+
+#include <stdio.h>
+
+#define PERF_NONE           -1      /* Not in any phase that's counted */
+#define PERF_FRAMING        0       /* GetNextRecord():  Reading and checking records */
+#define PERF_DECODE         1       /* DecodeRecord():  Hex to field values */
+#define PERF_SPEED          2       /* ReadJumpData():  The speed calculation */
+#define PERF_OUTPUT         3       /* Printing the report */
+#define PERF_NUM_PHASES     4
+
+#define PERF_CYCLES         0
+#define PERF_INSTRUCTIONS   1
+#define PERF_BRANCH_MISSES  2
+#define PERF_LLC_MISSES     3
+#define PERF_NUM_COUNTERS   4
+
+typedef struct perf_phase
+{
+    int         fdLeader;           /* Counter group for the phase, -1 if none could be opened */
+    int         fd[PERF_NUM_COUNTERS];          /* Each counter or -1 if unavailable */
+    int         nIndex[PERF_NUM_COUNTERS];      /*      and its place in the group */
+    double      nCount[PERF_NUM_COUNTERS];      /* Totals, once read */
+    double      nTime;              /* Seconds spent in the phase */
+    double      nStart;             /* When it was last entered */
+} PERF_PHASE;
+
+typedef struct perf_counters
+{
+    int         bEnabled;           /* Phases are being counted */
+    int         bCounters;          /* Some hardware counters could be opened */
+    char        strError[80];       /* Why they couldn't, if not */
+    int         nPhase;             /* Current PERF_xxx phase */
+    unsigned long nRecords;         /* Records read, for the per record figures */
+    unsigned long nDataPoints;      /* Profile datapoints processed, for the per point figures */
+    PERF_PHASE  Phases[PERF_NUM_PHASES];
+} PERF_COUNTERS;
+
+/* StartPerfCounters - Opens the counters for each phase and starts timing.  If no
+        hardware counters can be opened, the reason is kept in strError and just
+        the times are reported */
+extern void StartPerfCounters(PERF_COUNTERS *pPerf);
+
+/* PerfPhase - Stops counting the current phase and starts nPhase (or PERF_NONE),
+        returning the phase that was current, so it can be gone back to.  Does
+        nothing unless StartPerfCounters() was called */
+extern int PerfPhase(PERF_COUNTERS *pPerf, int nPhase);
+
+/* StopPerfCounters - Reads the totals and closes the counters */
+extern void StopPerfCounters(PERF_COUNTERS *pPerf);
+
+/* PrintPerfReport - Prints the time and counts of each phase, per record for the
+        parsing phases and per datapoint for the others */
+extern void PrintPerfReport(FILE *pOutFile, const PERF_COUNTERS *pPerf);
+
+#endif  /* _NEPTUNE_PERF_H_ */
+
@@ -24,10 +24,9 @@
  *
  */
 
-#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
-#include <sys/wait.h>
+#include <sys/select.h>
 
 #include <unistd.h>
 #include <stdio.h>
@@ -35,748 +34,799 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
-
-#include <linux/types.h>
-#include <linux/irda.h>
-
-#include <sys/ioctl.h>
-#include <sys/termios.h>
-#include <fcntl.h>
+#include <signal.h>
 
 #include <math.h>
 
 #include "neptune_rec.h"
+#include "neptune_comm.h"
+#include "neptune_merge.h"
+#include "neptune_bus.h"
 
 /* Defines */
-//#define EXTRA_DEBUG 1
 #define VERSION 100
-#define RX_BUFFER_SIZE 1024
-#define MAX_TX_FRAME 64
 
 #ifndef FALSE
 #define FALSE 0
 #define TRUE (!FALSE)
 #endif
 
-/* Memory allocation for discovery */
-#define DISC_MAX_DEVICES 10
-#define DISC_BUF_LEN	sizeof(struct irda_device_list) + \
-			sizeof(struct irda_device_info) * DISC_MAX_DEVICES
+/* Daemon Mode */
+#define MAX_SESSIONS            16
+#define SESSION_RETRY_SECS      1.0     /* Time between discovery and wakeup attempts */
+#define SESSION_WAKEUP_SECS     5.0     /* Time to let the Neptune wake up before commanding it */
+#define SESSION_RX_TIMEOUT      5.0     /* Time without data before giving up on a transfer */
+#define SESSION_HOLDOFF_SECS    30.0    /* Time after a download before looking for the next Neptune */
+
+#define SS_DISCOVER     0       /* Opening the port and looking for a Neptune */
+#define SS_WAKEUP       1       /* Sending wakeup and letting the Neptune settle */
+#define SS_VERSION      2       /* Version command sent, waiting for the version record */
+#define SS_DATA         3       /* Data command sent, reading records until End of all data */
+#define SS_DONE         4       /* Download finished, holding off before the next one */
+#define SS_SKIP         5       /* Nothing new on the Neptune, discarding the rest of the transfer */
+
+/* Rate Fallback -- a transfer with at least this many bad records, making up
+    more than this percentage of them, is repeated at the next lower rate */
+#define RATE_FALLBACK_ERRORS    3
+#define RATE_FALLBACK_PERCENT   2
+
+/* Device State Store */
+#define STATE_FILENAME          "neptune.state"     /* Default name of the state file in the daemon output directory */
 
 /* Custom Types */
-typedef struct comm_port
+typedef struct read_session
 {
-    int         sock;               /* Socket Handle for direct IrCOMM emulation mode or -1 for driver mode */
-    struct irda_device_info info;   /* IrDA Device Info from enumeration */
-    __u8        n_lsap_sel;         /* IrDA:TinyTP LSAP Selector for Neptune */
-
-    int         desc;               /* File Descriptor for driver mode or -1 for IrCOMM emulation mode */
-
-    long        rx_bufsize;         /* size of the receive buffer */
-    unsigned char rxbuf[RX_BUFFER_SIZE];   /* receive buffer */
-    long        dwRead;
-    long        dwReturned;
-} COMM_PORT;
-
-/* Comm Prototypes */
-void InitPort(COMM_PORT *port);
-int OpenPort(COMM_PORT *port, const char *pDevice);
-int ConnectPort(COMM_PORT *port);
-int ClosePort(COMM_PORT *port);
-int Discover(COMM_PORT *port, const char* pDevice);
-int PutChar(COMM_PORT *port, const char c);
-int SendString(COMM_PORT *port, const char *pString);
-int CheckForData(COMM_PORT *port);
-int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
-#ifdef EXTRA_DEBUG
-int DumpParamTuple(unsigned char *pParam);
-#endif
-
-/* Misc Prototypes */
-void SleepFine(long nSeconds, long nuSeconds);
+    const char  *pDevice;           /* Device the session reads from */
+    int         nSource;            /* Device number for the record bus */
+    COMM_PORT   port;
+    int         nState;             /* SS_xxx state */
+    int         bAwake;             /* Wakeup has been sent */
+    double      nDeadline;          /* Time of the next retry or timeout for the state */
+    MERGE_SET   merged;             /* Records merged from the passes so far */
+    MERGE_SET   pass;               /* Records of the pass in progress */
+    int         nPass;              /* Number of passes merged */
+    char        strSerialNo[10];    /* Serial number from the version record */
+    int         bHaveSummary;       /* Summary record has been received in one of the passes */
+    int         bComplete;          /* End of all data record has been received in one of the passes */
+    int         bRateChecked;       /* The rate has been checked against the one this Neptune was last read at */
+    unsigned long nTotalJumps;      /* Total Jumps Made from the summary record */
+    unsigned long nLastJump;        /* Last Jump Number from the summary record */
+    unsigned long nPrevLastJump;    /* Last Jump Number at the previous download or 0 if unknown */
+    long        nRecords;
+    long        nBadRecords;
+} READ_SESSION;
+
+/* Constants */
+const char *strJumpTypes[16] = {
+                    "Group 1", "Group 2", "Group 3", "Group 4",
+                    "4-way", "8-way", "10-way", "16-way",
+                    "Freefly", "Big Way", "Tandem", "AFF",
+                    "Birdman", "Camera", "Student", "Group 5" };
+
+/* Globals */
+volatile sig_atomic_t bQuit = FALSE;
+const char *pStateFilename = NULL;      /* Per-serial state store or NULL for none */
+int bForceDownload = FALSE;             /* Download even when the Neptune has no new jumps */
+long nMaxRate = MAX_LINK_RATE;          /* Line rate to start at */
+int nMaxPasses = 1;                     /* Transfers to try to fill in bad records */
+NEPTUNE_BUS myBus;                      /* Record bus to publish on, if opened */
+
+/* Prototypes */
+void WriteRecordComment(FILE *pOutFile, int type, const unsigned char *databuff, char *pSerialNo, unsigned long nPrevLastJump);
+void GetSerialNo(const unsigned char *databuff, char *pSerialNo);
+int LoadDeviceState(const char *pStateFile, const char *pSerialNo, unsigned long *pTotalJumps, unsigned long *pLastJump,
+                        long *pRate);
+int SaveDeviceState(const char *pStateFile, const char *pSerialNo, unsigned long nTotalJumps, unsigned long nLastJump,
+                        long nRate);
+long RememberedRate(const char *pSerialNo);
+int CheckSummary(const unsigned char *databuff, const char *pSerialNo, unsigned long *pTotalJumps,
+                    unsigned long *pLastJump, unsigned long *pPrevLastJump);
+int WriteMergedFile(FILE *pOutFile, const MERGE_SET *pSet, unsigned long nPrevLastJump, int bNoNewJumps);
+long MergePass(MERGE_SET *pMerged, MERGE_SET *pPass);
+int RateIsMarginal(long nRecords, long nBadRecords);
+double TimeNow(void);
+void HandleSignal(int nSignal);
+int RunDaemon(const char *pOutDir, int nNumDevices, char *pDevices[]);
+void StepSession(READ_SESSION *pSession, const char *pOutDir);
+void ReadSession(READ_SESSION *pSession, const char *pOutDir);
+void EndPass(READ_SESSION *pSession, const char *pOutDir);
+void FinishSession(READ_SESSION *pSession, const char *pOutDir);
+void FallBackSession(READ_SESSION *pSession);
+void RepeatSession(READ_SESSION *pSession);
 
 /* ========================================================================== */
 
-void InitPort(COMM_PORT *port)
+void WriteRecordComment(FILE *pOutFile, int type, const unsigned char *databuff, char *pSerialNo, unsigned long nPrevLastJump)
 {
+    /* Note: When nPrevLastJump is non-zero, the jumps made since then
+                are tagged as [NEW] so only those need be ingested */
+    REC_FIELDS myFields;
+    const unsigned long *pValue;
+    long nAltitude;
+    double nAvgSpeed;
+    double nSpeed;
+    int nNepVersionHi;
+    int nNepVersionLo;
+    int nNepVersionRev;
     int i;
 
-    /* Initialize our port struct: */
-    for (i=0; i<sizeof(COMM_PORT); i++)
-        ((char*)port)[i] = 0;
-    port->sock = -1;
-    port->desc = -1;
-    port->n_lsap_sel = LSAP_ANY;
-    port->rx_bufsize = RX_BUFFER_SIZE;
-    port->dwRead = 0;
-    port->dwReturned = 0;
+    DecodeRecord(type, databuff, &myFields);
+    pValue = myFields.nValue;
+
+    switch (type) {
+        case 0:     /* Version Info */
+            fprintf(pOutFile, "!\r\n! Neptune Altimeter Jump Data\r\n!\r\n");
+            nNepVersionHi = (pValue[RF_VERSION] >> 4) & 0x0F;
+            nNepVersionLo = pValue[RF_VERSION] & 0x0F;
+            nNepVersionRev = pValue[RF_VERSION_REV];
+            if ((nNepVersionHi == 0) && (nNepVersionLo == 0) && (nNepVersionRev < 14))
+                nNepVersionHi = 2;
+            fprintf(pOutFile, "! Neptune Software v%u.%u.%u\r\n",
+                        nNepVersionHi, nNepVersionLo, nNepVersionRev);
+            strcpy(pSerialNo, myFields.strText);
+            fprintf(pOutFile, "! Neptune Serial No: %s\r\n", pSerialNo);
+            fprintf(pOutFile, "!\r\n");
+            break;
+        case 1:     /* Jump Summary */
+            fprintf(pOutFile, "! Jump Summary:\r\n");
+            fprintf(pOutFile, "!    Number Jump Records   = %lu\r\n", pValue[RF_NUM_JUMP_RECORDS]);
+            fprintf(pOutFile, "!    Number Jump Profiles  = %lu\r\n", pValue[RF_NUM_JUMP_PROFILES]);
+            fprintf(pOutFile, "!    Total Jumps Made      = %lu\r\n", pValue[RF_TOTAL_JUMPS]);
+            fprintf(pOutFile, "!    Total FreeFall Time   = %lu sec\r\n", pValue[RF_TOTAL_FF_TIME]);
+            fprintf(pOutFile, "!    Last Jump Number      = %lu\r\n", pValue[RF_LAST_JUMP]);
+            if (nPrevLastJump)
+                fprintf(pOutFile, "!    Previous Last Jump    = %lu\r\n", nPrevLastJump);
+            fprintf(pOutFile, "!\r\n");
+            break;
+        case 2:     /* Jump Record */
+            fprintf(pOutFile, "! Jump Record -- Jump Number %lu%s:\r\n", pValue[RF_JUMP],
+                        (((nPrevLastJump) && (pValue[RF_JUMP] > nPrevLastJump)) ? " [NEW]" : ""));
+            fprintf(pOutFile, "!    Jump Date/Time        = %02lu/%02lu/%02lu  %02lu:%02lu\r\n",
+                        pValue[RF_MONTH], pValue[RF_DAY], pValue[RF_YEAR],
+                        pValue[RF_HOUR], pValue[RF_MINUTE]);
+            fprintf(pOutFile, "!    Jump Type             = %s\r\n",
+                        ((pValue[RF_JUMP_TYPE] < 16) ? strJumpTypes[pValue[RF_JUMP_TYPE]] : "<Unknown>"));
+            fprintf(pOutFile, "!    Data Version          = %lu.%lu.%lu\r\n",
+                        ((pValue[RF_DATA_VERSION]>>4) & 0x0F) + 1,
+                        (pValue[RF_DATA_VERSION] & 0x0F),
+                        pValue[RF_DATA_VERSION_REV]);
+            fprintf(pOutFile, "!    Data SW Type          = %lu\r\n", pValue[RF_SW_TYPE]);
+            nAvgSpeed = 0.0;
+            i = 0;
+            nSpeed = (round(pValue[RF_MAX_SPEED]*22.3694))/10.0;
+            if (nSpeed) {
+                nAvgSpeed += nSpeed;
+                i++;
+            }
+            fprintf(pOutFile, "!    Max FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
+            nSpeed = (round(pValue[RF_SPEED_12K]*22.3694)/10.0);
+            if (nSpeed) {
+                nAvgSpeed += nSpeed;
+                i++;
+            }
+            fprintf(pOutFile, "!    12K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
+            nSpeed = (round(pValue[RF_SPEED_9K]*22.3694)/10.0);
+            if (nSpeed) {
+                nAvgSpeed += nSpeed;
+                i++;
+            }
+            fprintf(pOutFile, "!     9K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
+            nSpeed = (round(pValue[RF_SPEED_6K]*22.3694)/10.0);
+            if (nSpeed) {
+                nAvgSpeed += nSpeed;
+                i++;
+            }
+            fprintf(pOutFile, "!     6K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
+            fprintf(pOutFile, "!     3K FF Speed (TAS)    = %.1f mph\r\n",
+                        (round(pValue[RF_SPEED_3K]*22.3694)/10.0));
+            if (i) nAvgSpeed = round((nAvgSpeed*10.0)/i)/10.0;
+            fprintf(pOutFile, "!    Avg FF Speed (TAS)    = %.1f mph\r\n", nAvgSpeed);
+            fprintf(pOutFile, "!    Exit Altitude (AGL)   = %lu ft\r\n",
+                        (unsigned long)lround(pValue[RF_EXIT_ALT]*3.28084));
+            fprintf(pOutFile, "!    Deploy Altitude (AGL) = %lu ft\r\n",
+                        (unsigned long)lround(pValue[RF_DEPLOY_ALT]*3.28084));
+            fprintf(pOutFile, "!    Freefall Time         = %lu sec\r\n", pValue[RF_FF_TIME]);
+            fprintf(pOutFile, "!\r\n");
+            break;
+        case 5:     /* Profile Start */
+            fprintf(pOutFile, "! Jump Profile -- Jump Number %lu%s:\r\n", pValue[RF_JUMP],
+                        (((nPrevLastJump) && (pValue[RF_JUMP] > nPrevLastJump)) ? " [NEW]" : ""));
+            nAltitude = pValue[RF_GROUND_ALT];
+            if (nAltitude > 32767l) nAltitude = nAltitude - 65534l;     /* Why is this 65534 in paralog and not 65536 ?? */
+            fprintf(pOutFile, "!    Ground Altitude (MSL) = %ld ft\r\n", lround(nAltitude*3.28084));
+            fprintf(pOutFile, "!    Exit Altitude (AGL)   = %lu ft\r\n",
+                        (unsigned long)lround(pValue[RF_EXIT_ALT]*3.28084));
+            fprintf(pOutFile, "!    Freefall Start Time   = %.2f sec\r\n", pValue[RF_FF_START]*0.25);
+            fprintf(pOutFile, "!    Canopy Start Time     = %.2f sec\r\n", pValue[RF_CANOPY_START]*0.25);
+            fprintf(pOutFile, "!\r\n");
+            break;
+        default:    /* Nothing to say about the others */
+            break;
+    }
 }
 
-int OpenPort(COMM_PORT *port, const char *pDevice)
+void GetSerialNo(const unsigned char *databuff, char *pSerialNo)
 {
-    struct termios terminfo;
-
-    /* close port if one is open */
-    ClosePort(port);
-
-    if (pDevice) {
-        /* Here if using real kernel module IrCOMM device driver */
-
-        port->desc = open(pDevice, O_RDWR | O_NOCTTY | O_NONBLOCK);
-        if  (port->desc < 0) {
-            perror("Opening Device ");
-            return FALSE;
-        }
-
-        tcgetattr(port->desc, &terminfo);
-        terminfo.c_iflag = 0;   /* IGNBRK | IGNPAR; */
-        terminfo.c_oflag = 0;
-        terminfo.c_cflag = CS8|CREAD|CLOCAL;
-        terminfo.c_lflag = 0;
-        terminfo.c_cc[4] = 0;
-        terminfo.c_cc[5] = 5;
-
-        cfsetospeed(&terminfo, B9600);
-        cfsetispeed(&terminfo, B9600);
+    REC_FIELDS myFields;
 
-        if (tcsetattr(port->desc, TCSANOW, &terminfo) != 0) {
-            perror( "Configuring Device " );
-            return FALSE;
-        }
-
-        if (fcntl(port->desc, F_SETFL, O_NONBLOCK) < 0) {
-            perror("Device Setup ");
-            return FALSE;
-        }
+    /* Serial number from the version record, pSerialNo must hold 10 chars */
+    DecodeRecord(0, databuff, &myFields);
+    strcpy(pSerialNo, myFields.strText);
+}
 
-        if (tcflush(port->desc, TCIOFLUSH ) == -1) {
-            perror( "Flushing Device " );
-            return FALSE;
-        }
-    } else {
-        /* Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
+int WriteMergedFile(FILE *pOutFile, const MERGE_SET *pSet, unsigned long nPrevLastJump, int bNoNewJumps)
+{
+    char strSerialNo[10];
+    long i;
 
-        port->sock = socket(AF_IRDA, SOCK_STREAM /* SOCK_SEQPACKET */, 0);
-        if (port->sock < 0) {
-            perror("Creating IrDA socket (no IrDA stack?) ");
-            return FALSE;
-        }
+    /* Magic, then the header comments for all records, then the records themselves */
+    fprintf(pOutFile, "#NEPTUNE\r\n");
+    strSerialNo[0] = 0;
+    for (i=0; i<pSet->nNumRecs; i++) {
+        WriteRecordComment(pOutFile, pSet->pRecs[i].type, (const unsigned char *)pSet->pRecs[i].pText,
+                                strSerialNo, nPrevLastJump);
+        if ((bNoNewJumps) && (pSet->pRecs[i].type == 1))
+            fprintf(pOutFile, "! No new jumps since the last download\r\n!\r\n");
     }
+    for (i=0; i<pSet->nNumRecs; i++)
+        fprintf(pOutFile, "%s\r\n", pSet->pRecs[i].pText);
 
-    return TRUE;
+    return !ferror(pOutFile);
 }
 
-int ConnectPort(COMM_PORT *port)
+long MergePass(MERGE_SET *pMerged, MERGE_SET *pPass)
 {
-    struct sockaddr_irda peer;
-    const unsigned char pServiceSelectMessage[] =
-            { 0x03,
-                0x00, 0x01, 0x04                        /* Select 9-Wire Cooked */
-            };
-    const unsigned char pConnectSettingsMessage[] =
-            { 0x0F,
-                0x10, 0x04, 0x00, 0x00, 0x25, 0x80,     /* Baud = 9600 */
-                0x11, 0x01, 0x03,                       /* N, 8, 1 */
-                0x12, 0x01, 0x00,                       /* No Flow Control */
-                0x20, 0x01, 0xC0                        /* DTR=RTS=on, no delta */
-            };
-
-    if ((port->desc < 0) &&
-        (port->sock < 0)) return FALSE;
-
-    printf("Start Neptune Transmitting");
-    fflush(stdout);
-
-    if (port->sock < 0) {
-        /* Here if using real kernel module IrCOMM device driver */
-
-        while (!PutChar(port, ' ')) {
-            SleepFine(1, 0);
-            printf(".");
-            fflush(stdout);
-        }
-        printf("Connected\n");
-    } else {
-        /* Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
-
-        /* Search IrDA for Neptune Device: */
-        while (!Discover(port, "Neptune")) {
-            SleepFine(1, 0);
-            printf(".");
-            fflush(stdout);
-        }
-
-        peer.sir_family = AF_IRDA;
-        peer.sir_lsap_sel = port->n_lsap_sel;
-        peer.sir_addr = port->info.daddr;
-        strncpy(peer.sir_name, "NeptuneRead:IrDA:TinyTP", 25);
-
-        if (connect(port->sock, (struct sockaddr*) &peer, sizeof(struct sockaddr_irda))) {
-            perror("Connect to IrDA socket ");
-            return FALSE;
-        }
-        printf("Connected\n");
-        fflush(stdout);
-
-        if (send(port->sock, pServiceSelectMessage, sizeof(pServiceSelectMessage), 0) == -1)
-            perror("Error Sending Service Type Select ");
-
-        if (send(port->sock, pConnectSettingsMessage, sizeof(pConnectSettingsMessage), 0) == -1)
-            perror("Error Sending Connect Settings ");
-
-        printf("Sending Wakeup");
-        fflush(stdout);
-        while (!PutChar(port, ' ')) {
-            SleepFine(1, 0);
-            printf(".");
-            fflush(stdout);
-        }
-        printf("\n");
+    /* Merges a finished pass into what we have so far and frees it.  Returns
+        the number of bad records filled in, or -1 if out of memory */
+    long nFilled;
+
+    if (pMerged->nNumRecs == 0) {
+        /* First pass is taken as is */
+        FreeMergeSet(pMerged);
+        *pMerged = *pPass;
+        InitMergeSet(pPass);
+        return 0;
     }
 
-    fflush(stdout);
-    SleepFine(5, 0);
+    nFilled = MergeTransfer(pMerged, pPass);
+    FreeMergeSet(pPass);
 
-    return TRUE;
+    return nFilled;
 }
 
-int ClosePort(COMM_PORT *port)
+/* ========================================================================== */
+
+int LoadDeviceState(const char *pStateFile, const char *pSerialNo, unsigned long *pTotalJumps, unsigned long *pLastJump,
+                        long *pRate)
 {
-    if (port->desc >= 0) {
-        close(port->desc);
-        port->desc = -1;
-    }
-    if (port->sock >= 0) {
-        close(port->sock);
-        port->sock = -1;
+    /* State file has a line for each Neptune seen:  <serial> <total-jumps> <last-jump> <rate>
+        where the rate is the one its last download ran at (0 if unknown or the link has none) */
+    FILE *pFile;
+    char strLine[256];
+    char strSerialNo[32];
+    unsigned long nTotalJumps;
+    unsigned long nLastJump;
+    long nRate;
+    int bFound;
+
+    pFile = fopen(pStateFile, "rt");
+    if (!pFile) return FALSE;
+
+    bFound = FALSE;
+    while ((!bFound) && (fgets(strLine, sizeof(strLine), pFile))) {
+        nRate = 0;
+        if (sscanf(strLine, "%31s %lu %lu %ld", strSerialNo, &nTotalJumps, &nLastJump, &nRate) < 3) continue;
+        if (strcmp(strSerialNo, pSerialNo) != 0) continue;
+        *pTotalJumps = nTotalJumps;
+        *pLastJump = nLastJump;
+        *pRate = nRate;
+        bFound = TRUE;
     }
+    fclose(pFile);
 
-    return TRUE;
+    return bFound;
 }
 
-int Discover(COMM_PORT *port, const char* pDevice)
+int SaveDeviceState(const char *pStateFile, const char *pSerialNo, unsigned long nTotalJumps, unsigned long nLastJump,
+                        long nRate)
 {
-    struct irda_device_list *list;      /* List of device */
-    unsigned char buf[DISC_BUF_LEN];    /* Actual memory allocation */
-    int len;
-    int i;
-//    int j;
-//    struct irda_ias_set ias_query;
-//    unsigned char *pParam;
-    
-
-    /* Set the list to point to the correct place */
-    list = (struct irda_device_list *) buf;
-    len = DISC_BUF_LEN;
-
-    /* Ask for the discovery log */
-    if (getsockopt(port->sock, SOL_IRLMP, IRLMP_ENUMDEVICES, buf, &len)) {
-        /* Discovery log empty (normal case) or error */
-        return FALSE;
-    }
-    /* Is there any addresses ? */
-    if (list->len <= 0)
-        /* Discovery log empty (exceptional case) */
-        return FALSE;
-
-    /* Dump list found: */
-#ifdef EXTRA_DEBUG
-    fprintf(stderr, "\nDiscovered %ld devices:\n", list->len);
-    for (i=0; i < list->len; i++) {
-        fprintf(stderr, "    \"%s\"%s\n", list->dev[i].info,
-                ((strcmp(list->dev[i].info, pDevice) == 0) ? " -- Found" : ""));
-    }
-    fflush(stderr);
-#endif
-
-    /* Go through the list */
-    for (i=0; i < list->len; i++) {
-        if (strcmp(list->dev[i].info, pDevice) == 0) {
-            /* Copy device info for our device: */
-            memcpy(&port->info, &list->dev[i], sizeof(struct irda_device_info));
-            port->n_lsap_sel = LSAP_ANY;
-
-//
-// TODO -- Figure out why the following doesn't work:
-//              Returns an LSEL of 0x04 instead of 0x37 and
-//              the parameters query flat out fails:
-//
-//            /* Query the LSAP Selector number for the TinyTP (standard 3-Wire Cooked and 9-Wire Cooked modes) */
-//            len = sizeof(ias_query);
-//            ias_query.daddr = list->dev[i].daddr;
-//            strcpy(ias_query.irda_class_name, "IrCOMM");
-//            strcpy(ias_query.irda_attrib_name, "IrDA:TinyTP:LsapSel");
-//            if ((getsockopt(port->sock, SOL_IRLMP, IRLMP_IAS_QUERY, &ias_query, &len) == 0) &&
-//                (ias_query.irda_attrib_type == IAS_INTEGER)) {
-//                port->n_lsap_sel = ias_query.attribute.irda_attrib_int;
-//#ifdef EXTRA_DEBUG
-//                fprintf(stderr, "LSAP Selector: %d\n", port->n_lsap_sel);
-//#endif
-//            } else {
-//                perror("Couldn't get LSAP Selector -- using LSAP_ANY ");
-//                port->n_lsap_sel = LSAP_ANY;
-//            }
-//
-//#ifdef EXTRA_DEBUG
-//            fprintf(stderr, "\nIrCOMM Parameters :");
-//            len = sizeof(ias_query);
-//            ias_query.daddr = list->dev[i].daddr;
-//            strcpy(ias_query.irda_class_name, "IrCOMM");
-//            strcpy(ias_query.irda_attrib_name, "Parameters");
-//            if ((getsockopt(port->sock, SOL_IRLMP, IRLMP_IAS_QUERY, &ias_query, &len) == 0) &&
-//                (ias_query.irda_attrib_type == IAS_OCT_SEQ)) {
-//                for (j=0; j<ias_query.attribute.irda_attrib_octet_seq.len; j++) {
-//                    fprintf(stderr, " %02X", ias_query.attribute.irda_attrib_octet_seq.octet_seq[j]);
-//                }
-//                fprintf(stderr, "\n");
-//                j = ias_query.attribute.irda_attrib_octet_seq.len;
-//                pParam = &ias_query.attribute.irda_attrib_octet_seq.octet_seq[0];
-//                while (j>0) {
-//                    len = DumpParamTuple(pParam);
-//                    j -= len;
-//                    pParam += len;
-//                }
-//            } else {
-//                fprintf(stderr, " *** Error Couldn't Read Parameters ***\n");
-//            }
-//            fflush(stderr);
-//#endif
-
-            return TRUE;
+    FILE *pOldFile;
+    FILE *pNewFile;
+    char strTmpFilename[1024];
+    char strLine[256];
+    char strSerialNo[32];
+    int bOK;
+
+    /* Rewrite the whole file, replacing (or adding) our line, and swap it
+        in with a rename so a crash never leaves it half written */
+    snprintf(strTmpFilename, sizeof(strTmpFilename), "%s.tmp", pStateFile);
+    pNewFile = fopen(strTmpFilename, "wt");
+    if (!pNewFile) return FALSE;
+
+    pOldFile = fopen(pStateFile, "rt");
+    if (pOldFile) {
+        while (fgets(strLine, sizeof(strLine), pOldFile)) {
+            if ((sscanf(strLine, "%31s", strSerialNo) == 1) &&
+                (strcmp(strSerialNo, pSerialNo) == 0)) continue;
+            fputs(strLine, pNewFile);
         }
+        fclose(pOldFile);
     }
+    fprintf(pNewFile, "%s %lu %lu %ld\n", pSerialNo, nTotalJumps, nLastJump, nRate);
 
-    /* Dump list found: */
-#ifdef EXTRA_DEBUG
-    fprintf(stderr, "Looking for: \"%s\" -- NOT FOUND\n", pDevice);
-#endif
+    bOK = (fclose(pNewFile) == 0);
+    if ((bOK) && (rename(strTmpFilename, pStateFile) != 0)) bOK = FALSE;
+    if (!bOK) remove(strTmpFilename);
 
-    /* No match */
-    return FALSE;
+    return bOK;
 }
 
-int SendString(COMM_PORT *port, const char *pString)
+long RememberedRate(const char *pSerialNo)
 {
-    int len;
-    unsigned char txbuf[MAX_TX_FRAME];
+    /* The rate the last download from this Neptune ran at, or 0 if there isn't one we can use */
+    unsigned long nTotalJumps;
+    unsigned long nLastJump;
+    long nRate;
 
-    if (port->sock < 0) {
-        /* Here if using real kernel module IrCOMM device driver */
+    if ((!pStateFilename) || (!pSerialNo[0])) return 0;
+    if (!LoadDeviceState(pStateFilename, pSerialNo, &nTotalJumps, &nLastJump, &nRate)) return 0;
+    if ((!IsLinkRate(nRate)) || (nRate > nMaxRate)) return 0;
 
-        len = strlen(pString);
-        return (write(port->desc, pString, len) == len);
-    } else {
-        /* Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
-
-        len = strlen(pString) + 1;
-        if (strlen(pString) > (MAX_TX_FRAME-2)) len = MAX_TX_FRAME-1;
-        txbuf[0] = 0;   /* No control stream bytes */
-        strncpy(&txbuf[1], pString, MAX_TX_FRAME-2);
-        if (send(port->sock, txbuf, len, 0) != -1)
-            return TRUE;
-    }
-
-    return FALSE;
+    return nRate;
 }
 
-int PutChar(COMM_PORT *port, const char c)
+int CheckSummary(const unsigned char *databuff, const char *pSerialNo, unsigned long *pTotalJumps,
+                    unsigned long *pLastJump, unsigned long *pPrevLastJump)
 {
-    unsigned char buf[2];
+    /* Note: This function returns TRUE if the Neptune has jumps we haven't
+                downloaded before, and FALSE if it's unchanged since the last
+                time we saw it.  pPrevLastJump is set to the Last Jump Number
+                from that download or 0 if everything should be treated as new */
+    REC_FIELDS myFields;
+    unsigned long nPrevTotalJumps;
+    unsigned long nPrevLastJump;
+    long nPrevRate;
 
-    if (port->sock < 0) {
-        /* Here if using real kernel module IrCOMM device driver */
+    DecodeRecord(1, databuff, &myFields);
+    *pTotalJumps = myFields.nValue[RF_TOTAL_JUMPS];
+    *pLastJump = myFields.nValue[RF_LAST_JUMP];
+    *pPrevLastJump = 0;
 
-        if (write(port->desc, &c, 1) == 1) return TRUE;
-    } else {
-        /* Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
+    if ((!pStateFilename) || (!pSerialNo[0])) return TRUE;
+    if (!LoadDeviceState(pStateFilename, pSerialNo, &nPrevTotalJumps, &nPrevLastJump, &nPrevRate)) return TRUE;
 
-        buf[0] = 0;     /* No control stream bytes */
-        buf[1] = c;
-        if (send(port->sock, buf, 2, 0) != -1)
-            return TRUE;
-    }
+    /* If the log went backwards, it was cleared, so it's all new */
+    if ((*pTotalJumps < nPrevTotalJumps) || (*pLastJump < nPrevLastJump)) return TRUE;
 
-    return FALSE;
+    *pPrevLastJump = nPrevLastJump;
+    if ((*pTotalJumps == nPrevTotalJumps) && (*pLastJump == nPrevLastJump) && (!bForceDownload)) return FALSE;
+
+    return TRUE;
 }
 
-int CheckForData(COMM_PORT *port)
+int RateIsMarginal(long nRecords, long nBadRecords)
 {
-    fd_set rfds;
-    struct timeval tv;
-    int retval;
+    return ((nBadRecords >= RATE_FALLBACK_ERRORS) &&
+            ((nBadRecords * 100) > (nRecords * RATE_FALLBACK_PERCENT)));
+}
 
-    FD_ZERO(&rfds);
-    FD_SET(((port->sock < 0) ? port->desc : port->sock), &rfds);
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
+/* ========================================================================== */
 
-    retval = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
-    /* Note: Don't rely on value of tv now! */
+double TimeNow(void)
+{
+    struct timeval tv;
 
-    return retval;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec/1000000.0;
 }
 
-int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
+void HandleSignal(int nSignal)
 {
-    COMM_PORT *port = (COMM_PORT*)pSource;
-    int havedata;
-    int i;
-    int len;
-    unsigned char *pParam;
-    const unsigned char pDTESettingsMessage[] = { 0x03, 0x20, 0x01, 0xC0 };   /* DTR=RTS=on, no delta */
-
-    if (nBufSize < 1) return FALSE;
-    if (pBuff == 0) return FALSE;
-
-    nBufSize--;     /* Leave room for terminating nul */
-    havedata = FALSE;
-
-    while (1) {
-        while ((nBufSize) && (port->dwReturned < port->dwRead)) {
-            if (port->rxbuf[port->dwReturned] == '\n') {
-                *pBuff = port->rxbuf[port->dwReturned];
-                pBuff++;
-                *pBuff = 0;
-                port->dwReturned++;
-                return TRUE;
-            }
-            *pBuff = port->rxbuf[port->dwReturned];
-            pBuff++;
-            nBufSize--;
-            port->dwReturned++;
-            havedata = TRUE;
-        }
-        if (nBufSize == 0) {
-            *pBuff = 0;
-            return TRUE;
-        }
+    bQuit = TRUE;
+}
 
-        if (!CheckForData(port)) {
-            *pBuff = 0;
-            return havedata;
-        }
+/* ========================================================================== */
 
-        if (port->sock < 0) {
-            /* Here if using real kernel module IrCOMM device driver */
+int RunDaemon(const char *pOutDir, int nNumDevices, char *pDevices[])
+{
+    READ_SESSION *pSessions;
+    READ_SESSION *pSession;
+    fd_set rfds;
+    struct timeval tv;
+    double nNow;
+    double nWait;
+    int nMaxDesc;
+    int i;
 
-            port->dwRead = read(port->desc, port->rxbuf, port->rx_bufsize);
-            port->dwReturned = 0;
+    printf("Keeping device state in \"%s\"\n", pStateFilename);
 
-// Warning: Enabling the following causes so much overhead data loss will be experienced!
-//#ifdef EXTRA_DEBUG
-//            fprintf(stderr, "RxData:");
-//            for (i=0; i<port->dwRead; i++) {
-//                fprintf(stderr, " %02X", port->rxbuf[i]);
-//            }
-//            fprintf(stderr, "\n");
-//            fflush(stderr);
-//#endif
+    pSessions = (READ_SESSION *)calloc(nNumDevices, sizeof(READ_SESSION));
+    if (!pSessions) {
+        fprintf(stderr, "Out of memory!\n\n");
+        return -2;
+    }
 
-            if (port->dwRead == 0) {
-                *pBuff = 0;
-                break;
-            }
-        } else {
-            /* Here if we're emulating the IrCOMM layer and talking direct to TinyTP socket */
+    for (i=0; i<nNumDevices; i++) {
+        pSessions[i].pDevice = pDevices[i];
+        pSessions[i].nSource = i;
+        InitPort(&pSessions[i].port);
+        SetPortRate(&pSessions[i].port, nMaxRate);
+        pSessions[i].port.bNonBlocking = TRUE;
+        InitMergeSet(&pSessions[i].merged);
+        InitMergeSet(&pSessions[i].pass);
+        pSessions[i].nState = SS_DISCOVER;
+        pSessions[i].nDeadline = 0.0;
+        printf("[%s] Waiting for Neptune\n", pDevices[i]);
+    }
+    fflush(stdout);
 
-            port->dwReturned = 0;
-            port->dwRead = recv(port->sock, port->rxbuf, port->rx_bufsize, MSG_TRUNC);
-            if (port->dwRead == -1) {
-                perror("Reading Packet ");
-                port->dwRead = 0;
-            }
-            if (port->dwRead > port->rx_bufsize) {
-                fprintf(stderr, "\n    *** Warning: Truncated packet : Size = %ld  Max Allowed = %ld\n", port->dwRead, port->rx_bufsize);
-                port->dwRead = port->rx_bufsize;
-            }
-            if (port->dwRead == 0) continue;    /* loop if we receive no data -- this should never happen */
-
-// Warning: Enabling the following causes so much overhead data loss will be experienced!
-//#ifdef EXTRA_DEBUG
-//            fprintf(stderr, "RxData:");
-//            for (i=0; i<port->dwRead; i++) {
-//                fprintf(stderr, " %02X", port->rxbuf[i]);
-//            }
-//            fprintf(stderr, "\n");
-//            if (port->rxbuf[0])
-//                fprintf(stderr, "    Num Control Bytes: %ld\n", (long)port->rxbuf[0]);
-//            i = port->rxbuf[0];
-//            pParam = &port->rxbuf[1];
-//            while (i > 0) {
-//                len = DumpParamTuple(pParam);
-//                i -= len;
-//                pParam += len;
-//            }
-//            fflush(stderr);
-//#endif
-
-            port->dwReturned += port->rxbuf[0] + 1;     /* Advance past the control channel info */
-
-            /* Look for and process any request for line status and we'll ignore everything else */
-            i = port->rxbuf[0];
-            pParam = &port->rxbuf[1];
-            while (i > 0) {
-                len = pParam[1] + 2;
-                if (pParam[0] == 0x22) {
-                    if (send(port->sock, pDTESettingsMessage, sizeof(pDTESettingsMessage), 0) == -1)
-                        perror("Error Sending Requested Line Status ");
-                }
-                i -= len;
-                pParam += len;
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* One event loop drives every session through its states, waiting on
+        all of the ports that are mid-transfer at once */
+    while (!bQuit) {
+        FD_ZERO(&rfds);
+        nMaxDesc = -1;
+        nNow = TimeNow();
+        nWait = SESSION_RETRY_SECS;
+        for (i=0; i<nNumDevices; i++) {
+            pSession = &pSessions[i];
+            if (nNow >= pSession->nDeadline) StepSession(pSession, pOutDir);
+            if ((pSession->nDeadline - nNow) < nWait) nWait = pSession->nDeadline - nNow;
+            if (((pSession->nState == SS_VERSION) || (pSession->nState == SS_DATA) ||
+                    (pSession->nState == SS_SKIP)) &&
+                (pSession->port.desc >= 0)) {
+                FD_SET(pSession->port.desc, &rfds);
+                if (pSession->port.desc > nMaxDesc) nMaxDesc = pSession->port.desc;
             }
         }
+        if (nWait < 0.0) nWait = 0.0;
+
+        tv.tv_sec = (long)nWait;
+        tv.tv_usec = (long)((nWait - tv.tv_sec) * 1000000.0);
+        if (select(nMaxDesc+1, &rfds, NULL, NULL, &tv) < 0) {
+            if (errno == EINTR) continue;
+            perror("Waiting for data ");
+            break;
+        }
+
+        for (i=0; i<nNumDevices; i++) {
+            pSession = &pSessions[i];
+            if ((pSession->port.desc >= 0) && (FD_ISSET(pSession->port.desc, &rfds)))
+                ReadSession(pSession, pOutDir);
+        }
+    }
+
+    /* Close everything, discarding any partial transfers */
+    for (i=0; i<nNumDevices; i++) {
+        pSession = &pSessions[i];
+        if ((pSession->nState == SS_VERSION) || (pSession->nState == SS_DATA) || (pSession->nState == SS_SKIP))
+            printf("[%s] Transfer interrupted, nothing saved\n", pSession->pDevice);
+        FreeMergeSet(&pSession->merged);
+        FreeMergeSet(&pSession->pass);
+        ClosePort(&pSession->port);
     }
+    free(pSessions);
 
-    return havedata;
+    return 0;
 }
 
-#ifdef EXTRA_DEBUG
-int DumpParamTuple(unsigned char *pParam)
+void StepSession(READ_SESSION *pSession, const char *pOutDir)
 {
-    int nSize;
-    const char strParamLabel[] = "    Param(%s) =";
-    int i;
+    double nNow;
+    int retval;
 
-    nSize = pParam[1] + 2;      /* Total Param Size is the PL field value +2 -- one for PI and one for PL */
-
-    switch (pParam[0]) {
-        case 0x00:
-        case 0x80:
-            fprintf(stderr, strParamLabel, "Service Type");
-            if (pParam[1]) {
-                if (pParam[2] & 0x01) fprintf(stderr, " 3-WireRaw ");
-                if (pParam[2] & 0x02) fprintf(stderr, " 3-Wire ");
-                if (pParam[2] & 0x04) fprintf(stderr, " 9-Wire ");
-                if (pParam[2] & 0x08) fprintf(stderr, " Centronics ");
-                if (!pParam[2]) fprintf(stderr, " <none>");
-            } else {
-                fprintf(stderr, " ???");
-            }
-            fprintf(stderr, "\n");
-            break;
-        case 0x01:
-        case 0x81:
-            fprintf(stderr, strParamLabel, "Port Type");
-            if (pParam[1]) {
-                if (pParam[2] & 0x01) fprintf(stderr, " Serial ");
-                if (pParam[2] & 0x02) fprintf(stderr, " Parallel ");
-                if (!pParam[2]) fprintf(stderr, " <none>");
-            } else {
-                fprintf(stderr, " ???");
-            }
-            fprintf(stderr, "\n");
-            break;
-        case 0x02:
-        case 0x82:
-            fprintf(stderr, strParamLabel, "Fixed Port Name");
-            fprintf(stderr, " \"");
-            for (i=0; i<(int)pParam[1]; i++) {
-                fprintf(stderr, "%c", pParam[2+i]);
+    nNow = TimeNow();
+
+    switch (pSession->nState) {
+        case SS_DISCOVER:
+            pSession->nDeadline = nNow + SESSION_RETRY_SECS;
+            if (pSession->port.desc < 0) {
+                if (!OpenPort(&pSession->port, pSession->pDevice)) break;
             }
-            fprintf(stderr, "\"\n");
-            break;
-        case 0x10:
-            fprintf(stderr, strParamLabel, "Data Rate");
-            if (pParam[1] == 4) {
-                fprintf(stderr, " %lu\n", pParam[2]*16777216ul + pParam[3]*65536ul + pParam[4]*256ul + pParam[5]);
-            } else {
-                fprintf(stderr, " ???\n");
+            retval = AttachPort(&pSession->port);
+            if (retval < 0) {
+                ClosePort(&pSession->port);
+                break;
             }
+            if (retval == 0) break;
+            printf("[%s] Connected\n", pSession->pDevice);
+            pSession->bAwake = FALSE;
+            pSession->nState = SS_WAKEUP;
+            pSession->nDeadline = nNow;
             break;
-        case 0x11:
-            fprintf(stderr, strParamLabel, "Data Format");
-            if (pParam[1]) {
-                if (pParam[2] & 0x08) {
-                    switch (pParam[2] & 0x30) {
-                        case 0x00:
-                            fprintf(stderr, "O,");
-                            break;
-                        case 0x10:
-                            fprintf(stderr, "E,");
-                            break;
-                        case 0x20:
-                            fprintf(stderr, "M,");
-                            break;
-                        case 0x30:
-                            fprintf(stderr, "S,");
-                            break;
-                    }
-                } else {
-                    fprintf(stderr, "N,");
-                }
-                switch (pParam[2] & 0x03) {
-                    case 0:
-                        fprintf(stderr, "5,");
-                        break;
-                    case 1:
-                        fprintf(stderr, "6,");
-                        break;
-                    case 2:
-                        fprintf(stderr, "7,");
-                        break;
-                    case 3:
-                        fprintf(stderr, "8,");
-                        break;
-                }
-                if (pParam[2] & 0x04) {
-                    if (pParam[2] & 0x03) {
-                        fprintf(stderr, "2\n");
-                    } else {
-                        fprintf(stderr, "1.5\n");
-                    }
-                } else {
-                    fprintf(stderr, "1\n");
-                }
-            } else {
-                fprintf(stderr, " ???\n");
+
+        case SS_WAKEUP:
+            if (!pSession->bAwake) {
+                pSession->nDeadline = nNow + SESSION_RETRY_SECS;
+                if (!PutChar(&pSession->port, ' ')) break;
+                pSession->bAwake = TRUE;
+                pSession->nDeadline = nNow + SESSION_WAKEUP_SECS;
+                break;
             }
-            break;
-        case 0x12:
-            fprintf(stderr, strParamLabel, "Flow Control");
-            if (pParam[1]) {
-                if (pParam[2] & 0x01) fprintf(stderr, " XON/XOFF(in) ");
-                if (pParam[2] & 0x02) fprintf(stderr, " XON/XOFF(out) ");
-                if (pParam[2] & 0x04) fprintf(stderr, " RTS/CTS(in) ");
-                if (pParam[2] & 0x08) fprintf(stderr, " RTS/CTS(out) ");
-                if (pParam[2] & 0x10) fprintf(stderr, " DSR/DTR(in) ");
-                if (pParam[2] & 0x20) fprintf(stderr, " DSR/DTR(out) ");
-                if (pParam[2] & 0x40) fprintf(stderr, " ENQ/ACK(in) ");
-                if (pParam[2] & 0x80) fprintf(stderr, " ENQ/ACK(out) ");
-                if (!pParam[2]) fprintf(stderr, " <none>");
-                fprintf(stderr, "\n");
+
+            FreeMergeSet(&pSession->pass);
+            pSession->strSerialNo[0] = 0;
+            pSession->nPrevLastJump = 0;
+            pSession->nRecords = 0;
+            pSession->nBadRecords = 0;
+
+            /* Whatever is left from before a fallback or repeat, or arrived while
+                the line settled, isn't the answer to this */
+            FlushPort(&pSession->port);
+            if (PortRate(&pSession->port)) {
+                printf("[%s] Commanding Version Transfer at %ld baud\n", pSession->pDevice, PortRate(&pSession->port));
             } else {
-                fprintf(stderr, " ???\n");
+                printf("[%s] Commanding Version Transfer\n", pSession->pDevice);
             }
+            SendString(&pSession->port, " 01 80 80 ");
+            pSession->nState = SS_VERSION;
+            pSession->nDeadline = nNow + SESSION_RX_TIMEOUT;
             break;
-        case 0x13:
-            fprintf(stderr, strParamLabel, "XON/XOFF Chars");
-            if (pParam[1] == 2) {
-                fprintf(stderr, " XON=0x%02X  XOFF=0x%02X\n", pParam[2], pParam[3]);
-            } else {
-                fprintf(stderr, " ???\n");
+
+        case SS_VERSION:
+            if (NextLowerRate(PortRate(&pSession->port))) {
+                FallBackSession(pSession);
+                break;
             }
+            /* Fall through */
+        case SS_SKIP:
+            printf("[%s] Timed out waiting for data\n", pSession->pDevice);
+            FinishSession(pSession, pOutDir);
             break;
-        case 0x14:
-            fprintf(stderr, strParamLabel, "ENQ/ACK Chars");
-            if (pParam[1] == 2) {
-                fprintf(stderr, " ENQ=0x%02X  ACK=0x%02X\n", pParam[2], pParam[3]);
-            } else {
-                fprintf(stderr, " ???\n");
-            }
+
+        case SS_DATA:
+            /* End of all data may have been one of the bad records */
+            printf("[%s] Timed out waiting for data\n", pSession->pDevice);
+            EndPass(pSession, pOutDir);
             break;
-        case 0x15:
-            fprintf(stderr, strParamLabel, "Line Status");
-            if (pParam[1]) {
-                if (pParam[2] & 0x02) fprintf(stderr, " Overrun ");
-                if (pParam[2] & 0x04) fprintf(stderr, " Parity ");
-                if (pParam[2] & 0x08) fprintf(stderr, " Framing ");
-                if (!pParam[2]) {
-                    fprintf(stderr, " <none>");
-                } else {
-                    fprintf(stderr, " Error(s)");
-                }
-                fprintf(stderr, "\n");
-            } else {
-                fprintf(stderr, " ???\n");
-            }
+
+        case SS_DONE:
+            pSession->nState = SS_DISCOVER;
+            pSession->nDeadline = nNow;
             break;
-        case 0x16:
-            fprintf(stderr, strParamLabel, "Break");
-            if (pParam[1]) {
-                if (pParam[2] & 0x01) {
-                    fprintf(stderr, " Set");
-                } else {
-                    fprintf(stderr, " Clr");
-                }
-                fprintf(stderr, "\n");
-            } else {
-                fprintf(stderr, " ???\n");
-            }
+    }
+    fflush(stdout);
+}
+
+void ReadSession(READ_SESSION *pSession, const char *pOutDir)
+{
+    unsigned char databuff[MAX_RECORD_SIZE];
+    long nRead;
+    long nRate;
+    int type;
+    int i;
+
+    nRead = FillPort(&pSession->port);
+    if (nRead == 0) {
+        printf("[%s] Connection closed\n", pSession->pDevice);
+        FinishSession(pSession, pOutDir);
+        return;
+    }
+    if (nRead > 0) pSession->nDeadline = TimeNow() + SESSION_RX_TIMEOUT;   /* Only data keeps the transfer alive */
+
+    /* Process every complete record we have -- like the single port mode,
+        don't stop on bad records or the stupid Neptune will get stuck */
+    while (((pSession->nState == SS_VERSION) || (pSession->nState == SS_DATA) ||
+                (pSession->nState == SS_SKIP)) &&
+            ((type = GetNextRecord(&pSession->port, databuff)) != -1)) {
+        PublishRecord(&myBus, pSession->nSource, type, databuff);
+        if ((pSession->nState == SS_VERSION) && (type != 0) &&
+            (NextLowerRate(PortRate(&pSession->port)))) {
+            /* The Neptune didn't understand us, or we can't understand it */
+            FallBackSession(pSession);
             break;
-        case 0x20:
-            fprintf(stderr, strParamLabel, "DTE Lines");
-            if (pParam[1]) {
-                if (pParam[2] & 0x04) {
-                    fprintf(stderr, "DTR=ON");
-                } else {
-                    fprintf(stderr, "DTR=OFF");
-                }
-                if (pParam[2] & 0x01) fprintf(stderr, "**");
-                fprintf(stderr, "  ");
-                if (pParam[2] & 0x08) {
-                    fprintf(stderr, "RTS=ON");
-                } else {
-                    fprintf(stderr, "RTS=OFF");
+        }
+
+        if ((type == 1) && (pSession->nState == SS_DATA)) {
+            pSession->bHaveSummary = TRUE;
+            if (!CheckSummary(databuff, pSession->strSerialNo, &pSession->nTotalJumps,
+                                &pSession->nLastJump, &pSession->nPrevLastJump)) {
+                /* Nothing new -- drop the link if that stops the Neptune,
+                    otherwise let it finish the transfer into the bit bucket */
+                pSession->nState = SS_SKIP;
+                if (pSession->port.pTransport->bHangUp) {
+                    FinishSession(pSession, pOutDir);
+                    break;
                 }
-                if (pParam[2] & 0x02) fprintf(stderr, "**");
-                fprintf(stderr, "\n");
-            } else {
-                fprintf(stderr, " ???\n");
             }
+        }
+
+        if (pSession->nState == SS_SKIP) {
+            if (type == 3) FinishSession(pSession, pOutDir);
+            continue;
+        }
+
+        if (!AddMergeRecord(&pSession->pass, type, databuff)) {
+            fprintf(stderr, "[%s] Out of memory!\n", pSession->pDevice);
+            FreeMergeSet(&pSession->pass);
+            FreeMergeSet(&pSession->merged);
+            FinishSession(pSession, pOutDir);
             break;
-        case 0x21:
-            fprintf(stderr, strParamLabel, "DCE Lines");
-            if (pParam[1]) {
-                if (pParam[2] & 0x10) {
-                    fprintf(stderr, "CTS=ON");
-                } else {
-                    fprintf(stderr, "CTS=OFF");
-                }
-                if (pParam[2] & 0x01) fprintf(stderr, "**");
-                fprintf(stderr, "  ");
-                if (pParam[2] & 0x20) {
-                    fprintf(stderr, "DSR=ON");
-                } else {
-                    fprintf(stderr, "DSR=OFF");
-                }
-                if (pParam[2] & 0x02) fprintf(stderr, "**");
-                fprintf(stderr, "  ");
-                if (pParam[2] & 0x40) {
-                    fprintf(stderr, "RI=ON");
-                } else {
-                    fprintf(stderr, "RI=OFF");
-                }
-                if (pParam[2] & 0x04) fprintf(stderr, "**");
-                fprintf(stderr, "  ");
-                if (pParam[2] & 0x80) {
-                    fprintf(stderr, "CD=ON");
-                } else {
-                    fprintf(stderr, "CD=OFF");
+        }
+        if (type == 0) GetSerialNo(databuff, pSession->strSerialNo);
+        pSession->nRecords++;
+        if (type < 0) pSession->nBadRecords++;
+
+        switch (type) {
+            case 0:     /* Version Info */
+                if (pSession->nState == SS_VERSION) {
+                    /* The serial number names the output file and keys the state store */
+                    for (i=0; pSession->strSerialNo[i]; i++) {
+                        if (!isalnum((unsigned char)pSession->strSerialNo[i])) pSession->strSerialNo[i] = '_';
+                    }
+
+                    /* Have the data sent at the rate this Neptune was last read at,
+                        unless we've had to fall back to find one that works today */
+                    nRate = RememberedRate(pSession->strSerialNo);
+                    if ((!pSession->bRateChecked) && (PortRate(&pSession->port)) &&
+                        (nRate) && (nRate != PortRate(&pSession->port))) {
+                        printf("[%s] Neptune %s was last read at %ld baud -- Switching to it\n",
+                                    pSession->pDevice, pSession->strSerialNo, nRate);
+                        SetPortRate(&pSession->port, nRate);
+                    }
+                    pSession->bRateChecked = TRUE;
+
+                    printf("[%s] Neptune %s -- Commanding Data Transfer\n", pSession->pDevice, pSession->strSerialNo);
+                    SendString(&pSession->port, "01 80 80 ");
+                    pSession->nState = SS_DATA;
                 }
-                if (pParam[2] & 0x08) fprintf(stderr, "**");
-                fprintf(stderr, "\n");
+                break;
+            case 3:     /* End of all data */
+                pSession->bComplete = TRUE;
+                EndPass(pSession, pOutDir);
+                break;
+        }
+    }
+    fflush(stdout);
+}
+
+void EndPass(READ_SESSION *pSession, const char *pOutDir)
+{
+    long nFilled;
+
+    /* Merge the pass just finished, then go again if there are still
+        bad records and passes left, or save what we have */
+    pSession->nPass++;
+    nFilled = MergePass(&pSession->merged, &pSession->pass);
+    if (nFilled < 0) {
+        fprintf(stderr, "[%s] Out of memory!\n", pSession->pDevice);
+        FreeMergeSet(&pSession->merged);
+        FinishSession(pSession, pOutDir);
+        return;
+    }
+    if (nFilled) printf("[%s] Filled in %ld bad records from pass %d\n", pSession->pDevice, nFilled, pSession->nPass);
+
+    if (CountMergeHoles(&pSession->merged)) {
+        if ((RateIsMarginal(pSession->nRecords, pSession->nBadRecords)) &&
+            (NextLowerRate(PortRate(&pSession->port)))) {
+            FallBackSession(pSession);
+            return;
+        }
+        if (pSession->nPass < nMaxPasses) {
+            RepeatSession(pSession);
+            return;
+        }
+    }
+    FinishSession(pSession, pOutDir);
+}
+
+void FinishSession(READ_SESSION *pSession, const char *pOutDir)
+{
+    char strFilename[1024];
+    char strTmpFilename[1024];
+    const char *pExtension;
+    FILE *pOutFile;
+    long nBadRecords;
+    int bOK;
+
+    /* Keep what we have of a transfer that was cut short, but not in place
+        of the last good download */
+    if ((pSession->nState != SS_SKIP) && (pSession->pass.nNumRecs)) {
+        if (MergePass(&pSession->merged, &pSession->pass) < 0) {
+            fprintf(stderr, "[%s] Out of memory!\n", pSession->pDevice);
+            FreeMergeSet(&pSession->merged);
+        }
+    }
+
+    if (pSession->nState == SS_SKIP) {
+        printf("[%s] Neptune %s: no new jumps since Jump Number %lu, keeping previous download\n",
+                    pSession->pDevice, pSession->strSerialNo, pSession->nLastJump);
+    } else if ((pSession->merged.nNumRecs) && (pSession->strSerialNo[0])) {
+        /* Name the file for the serial number, writing it under a temporary
+            name first so nobody picks up a partial file */
+        pExtension = ((pSession->bComplete) ? "nep" : "partial");
+        snprintf(strFilename, sizeof(strFilename), "%s/%s.%s", pOutDir, pSession->strSerialNo, pExtension);
+        snprintf(strTmpFilename, sizeof(strTmpFilename), "%s/.%s.%s.tmp", pOutDir, pSession->strSerialNo, pExtension);
+        if (!pSession->bComplete)
+            printf("[%s] Neptune %s: End of all data never came -- keeping it as a partial transfer\n",
+                        pSession->pDevice, pSession->strSerialNo);
+
+        bOK = FALSE;
+        pOutFile = fopen(strTmpFilename, "wb");
+        if (pOutFile) {
+            bOK = WriteMergedFile(pOutFile, &pSession->merged, pSession->nPrevLastJump, FALSE);
+            if (fclose(pOutFile) != 0) bOK = FALSE;
+            if ((bOK) && (rename(strTmpFilename, strFilename) != 0)) bOK = FALSE;
+            if (!bOK) remove(strTmpFilename);
+        }
+
+        if (bOK) {
+            nBadRecords = CountMergeHoles(&pSession->merged);
+            if (PortRate(&pSession->port)) {
+                printf("[%s] Neptune %s: %ld records (%ld bad) at %ld baud saved to \"%s\"\n", pSession->pDevice,
+                            pSession->strSerialNo, pSession->merged.nNumRecs, nBadRecords,
+                            PortRate(&pSession->port), strFilename);
             } else {
-                fprintf(stderr, " ???\n");
+                printf("[%s] Neptune %s: %ld records (%ld bad) saved to \"%s\"\n", pSession->pDevice,
+                            pSession->strSerialNo, pSession->merged.nNumRecs, nBadRecords, strFilename);
             }
-            break;
-        case 0x22:
-            fprintf(stderr, "    Param(Line Settings Poll Request)\n");
-            break;
-        default:
-            fprintf(stderr, strParamLabel, "Unknown");
-            for (i=0; i<(int)pParam[1]+2; i++) {
-                fprintf(stderr, " %02X", pParam[i]);
+            /* Only remember it if we got the whole log, which also supersedes
+                any partial transfer left before */
+            if (pSession->bComplete) {
+                if (pSession->bHaveSummary)
+                    SaveDeviceState(pStateFilename, pSession->strSerialNo, pSession->nTotalJumps, pSession->nLastJump,
+                                        PortRate(&pSession->port));
+                snprintf(strFilename, sizeof(strFilename), "%s/%s.partial", pOutDir, pSession->strSerialNo);
+                remove(strFilename);
             }
-            fprintf(stderr, "\n");
-            break;
+        } else {
+            fprintf(stderr, "[%s] Failed to write \"%s\"!\n", pSession->pDevice, strFilename);
+        }
+    } else {
+        printf("[%s] No version record received, nothing saved\n", pSession->pDevice);
     }
 
-    return nSize;
+    FreeMergeSet(&pSession->merged);
+    FreeMergeSet(&pSession->pass);
+    pSession->nPass = 0;
+
+    /* Drop the link so the Neptune goes back to idle, then hold off before
+        looking for the next one.  That starts at the rate this one was read
+        at, most likely being this one again, or back at the top rate */
+    ClosePort(&pSession->port);
+    if (!pSession->bComplete) SetPortRate(&pSession->port, nMaxRate);
+    pSession->bHaveSummary = FALSE;
+    pSession->bComplete = FALSE;
+    pSession->bRateChecked = FALSE;
+    pSession->nState = SS_DONE;
+    pSession->nDeadline = TimeNow() + SESSION_HOLDOFF_SECS;
 }
-#endif
-
-/* ========================================================================== */
 
-void SleepFine(long nSeconds, long nuSeconds)
+void FallBackSession(READ_SESSION *pSession)
 {
-    struct timeval tv;
+    long nRate;
+
+    /* Start over from the version command at the next lower rate, once the
+        line settles, keeping what was merged from the passes so far */
+    nRate = PortRate(&pSession->port);
+    if (pSession->nState == SS_VERSION) {
+        printf("[%s] No answer at %ld baud -- Falling back to %ld baud\n",
+                    pSession->pDevice, nRate, NextLowerRate(nRate));
+    } else {
+        printf("[%s] %ld records (%ld bad) at %ld baud -- Falling back to %ld baud\n", pSession->pDevice,
+                    pSession->nRecords, pSession->nBadRecords, nRate, NextLowerRate(nRate));
+    }
+    SetPortRate(&pSession->port, NextLowerRate(nRate));
+    FreeMergeSet(&pSession->pass);
+    pSession->bRateChecked = TRUE;      /* Finding the rate the hard way now */
 
-    tv.tv_sec = nSeconds;
-    tv.tv_usec = nuSeconds;
+    pSession->nState = SS_WAKEUP;
+    pSession->bAwake = TRUE;
+    pSession->nDeadline = TimeNow() + SESSION_RETRY_SECS;
+}
 
-    /* Use the select method as a fine-grained sleep */
-    select(0, NULL, NULL, NULL, &tv);
-    /* Note: Don't rely on value of tv now! */
+void RepeatSession(READ_SESSION *pSession)
+{
+    /* Run the whole transfer again at the same rate to fill in the bad records */
+    printf("[%s] %ld bad records left -- Repeating transfer (pass %d of %d)\n", pSession->pDevice,
+                CountMergeHoles(&pSession->merged), pSession->nPass+1, nMaxPasses);
+
+    pSession->nState = SS_WAKEUP;
+    pSession->bAwake = TRUE;
+    pSession->nDeadline = TimeNow() + SESSION_RETRY_SECS;
 }
 
 /* ========================================================================== */
@@ -785,240 +835,358 @@ int main(int argc, char *argv[])
 {
     COMM_PORT myPort;
     FILE *pOutFile;
-    FILE *pTmpFile;
+    MERGE_SET myMerged;
+    MERGE_SET myPass;
     unsigned char databuff[MAX_RECORD_SIZE];
-    long nAltitude;
-    double nAvgSpeed;
-    double nSpeed;
     int type;
     int done;
-    long datatype;
+    int skip;
+    int havesummary;
+    int complete;
+    int gotversion;
+    int fallback;
+    int repeat;
+    int nPass;
+    long nRecords;
+    long nBadRecords;
+    long nFilled;
+    long nRate;
+    long nNextRate;
+    int ratechecked;
+    int i;
+    int n;
+    int bOK;
+    int nArg;
+    int bNeedHelp;
     char *pOutFilename;
     char *pDeviceName;
-    int nNepVersionHi;
-    int nNepVersionLo;
-    int nNepVersionRev;
+    char *pOutDir;
+    char *pBusName;
     char strNepSerialNo[10];
-    int i;
-    const char *strJumpTypes[16] = {
-                        "Group 1", "Group 2", "Group 3", "Group 4",
-                        "4-way", "8-way", "10-way", "16-way",
-                        "Freefly", "Big Way", "Tandem", "AFF",
-                        "Birdman", "Camera", "Student", "Group 5" };
+    char strStateFilename[1024];
+    char strTmpFilename[1024];
+    unsigned long nTotalJumps;
+    unsigned long nLastJump;
+    unsigned long nPrevLastJump;
+
+    /* Check Options */
+    bNeedHelp = FALSE;
+    pOutDir = NULL;
+    pBusName = NULL;
+    for (nArg=1; ((nArg<argc) && (argv[nArg][0] == '-')); nArg++) {
+        if ((strcmp(argv[nArg], "-d") == 0) && (nArg+1 < argc)) {
+            pOutDir = argv[++nArg];
+        } else if ((strcmp(argv[nArg], "-s") == 0) && (nArg+1 < argc)) {
+            pStateFilename = argv[++nArg];
+        } else if (strcmp(argv[nArg], "-f") == 0) {
+            bForceDownload = TRUE;
+        } else if ((strcmp(argv[nArg], "-r") == 0) && (nArg+1 < argc)) {
+            nMaxRate = strtol(argv[++nArg], NULL, 10);
+            if (!IsLinkRate(nMaxRate)) bNeedHelp = TRUE;
+        } else if ((strcmp(argv[nArg], "-b") == 0) && (nArg+1 < argc)) {
+            pBusName = argv[++nArg];
+        } else if ((strcmp(argv[nArg], "-p") == 0) && (nArg+1 < argc)) {
+            nMaxPasses = strtol(argv[++nArg], NULL, 10);
+            if (nMaxPasses < 1) bNeedHelp = TRUE;
+        } else {
+            bNeedHelp = TRUE;
+        }
+    }
+
+    /* Daemon mode for reading many ports at once */
+    if ((pOutDir) && (!bNeedHelp) && (nArg < argc)) {
+        if (argc-nArg > MAX_SESSIONS) {
+            fprintf(stderr, "Too many devices -- at most %d are supported!\n\n", MAX_SESSIONS);
+            return -1;
+        }
+        if (!pStateFilename) {
+            snprintf(strStateFilename, sizeof(strStateFilename), "%s/%s", pOutDir, STATE_FILENAME);
+            pStateFilename = strStateFilename;
+        }
+        if ((pBusName) && (!CreateBus(&myBus, pBusName))) return -6;
+        i = RunDaemon(pOutDir, argc-nArg, &argv[nArg]);
+        CloseBus(&myBus);
+        return i;
+    }
 
     /* Check Arguments */
-    if ((argc < 2) || (argc > 3)) {
+    if ((pOutDir) || (argc-nArg < 1) || (argc-nArg > 2)) bNeedHelp = TRUE;
+    if (bNeedHelp) {
         fprintf(stderr, "Neptune Read V%d.%02d\n", VERSION/100, VERSION%100);
-        fprintf(stderr, "Usage: neptune_read [<IrCOMM-Device>] <output-file>\n\n");
+        fprintf(stderr, "Usage: neptune_read [-s <state-file>] [-f] [-r <max-rate>] [-p <max-passes>]\n");
+        fprintf(stderr, "                    [-b <bus-name>] [<IrCOMM-Device>] <output-file>\n");
+        fprintf(stderr, "       neptune_read -d <output-dir> [-s <state-file>] [-f] [-r <max-rate>]\n");
+        fprintf(stderr, "                    [-p <max-passes>] [-b <bus-name>]\n");
+        fprintf(stderr, "                    <IrCOMM-Device> [<IrCOMM-Device> ...]\n\n");
         fprintf(stderr, "       If <IrCOMM-Device> is omitted, this app will emulate the\n");
         fprintf(stderr, "       IrCOMM and do direct comm to the TinyTP IrDA layer, which\n");
         fprintf(stderr, "       is useful on systems where not all layers are supported.\n");
         fprintf(stderr, "       However, to use a kernel module for IrCOMM instead, simply\n");
         fprintf(stderr, "       specify an <IrCOMM-Device>, like /dev/ircomm0, for example.\n\n");
+        fprintf(stderr, "       A Neptune attached to a remote machine (e.g. bridged with socat)\n");
+        fprintf(stderr, "       can be read by giving \"tcp:<host>:<port>\" or \"unix:<path>\"\n");
+        fprintf(stderr, "       as the <IrCOMM-Device>.\n\n");
+        fprintf(stderr, "       With -d, runs as a daemon reading every listed device at once,\n");
+        fprintf(stderr, "       over and over, saving each download to <output-dir> as\n");
+        fprintf(stderr, "       <serial-number>.nep.  Use \"irda\" as the <IrCOMM-Device> for\n");
+        fprintf(stderr, "       the direct TinyTP mode.\n\n");
+        fprintf(stderr, "       The -s <state-file> remembers the jump count of each Neptune\n");
+        fprintf(stderr, "       by serial number (the daemon keeps it in <output-dir>/%s\n", STATE_FILENAME);
+        fprintf(stderr, "       by default).  A Neptune with no new jumps is let go right after\n");
+        fprintf(stderr, "       its summary, and jumps made since the last download are tagged\n");
+        fprintf(stderr, "       [NEW] in the output.  Use -f to download everything anyway.\n\n");
+        fprintf(stderr, "       The link starts at <max-rate> (115200, 57600, 38400, 19200 or\n");
+        fprintf(stderr, "       9600 baud -- default %d) and falls back to the next lower rate\n", MAX_LINK_RATE);
+        fprintf(stderr, "       whenever the Neptune doesn't answer or the checksum errors rise.\n");
+        fprintf(stderr, "       The state file also remembers the rate each Neptune was last read\n");
+        fprintf(stderr, "       at, and its data is sent at that rate the next time.\n\n");
+        fprintf(stderr, "       With -p, a transfer with bad records is repeated, up to <max-passes>\n");
+        fprintf(stderr, "       transfers in all, and the passes are merged record by record\n");
+        fprintf(stderr, "       until every record has come through clean at least once.\n\n");
+        fprintf(stderr, "       With -b, every record received is also published, decoded, on\n");
+        fprintf(stderr, "       the shared memory record bus <bus-name> for neptune_tap and\n");
+        fprintf(stderr, "       other live consumers to follow.\n\n");
         return -1;
     }
-    if (argc == 2) {
+    if (argc-nArg == 1) {
         pDeviceName = NULL;
-        pOutFilename = argv[1];
-    }
-    if (argc >= 3) {
-        pDeviceName = argv[1];
-        pOutFilename = argv[2];
+        pOutFilename = argv[nArg];
+    } else {
+        pDeviceName = argv[nArg];
+        pOutFilename = argv[nArg+1];
     }
 
+    /* Open the record bus */
+    if ((pBusName) && (!CreateBus(&myBus, pBusName)))
+        return -6;
+
     /* Initialize our port struct: */
     InitPort(&myPort);
+    SetPortRate(&myPort, nMaxRate);
 
     /* Open our port */
-    if (!OpenPort(&myPort, pDeviceName))
+    if (!OpenPort(&myPort, pDeviceName)) {
+        CloseBus(&myBus);
         return -2;
+    }
 
-    /* Open Output File */
-    pOutFile = fopen(pOutFilename, "wb");
+    /* Open Output File, under a temporary name until it's all there, so the
+        previous download is only replaced once there's something to replace it */
+    n = snprintf(strTmpFilename, sizeof(strTmpFilename), "%s.tmp", pOutFilename);
+    pOutFile = (((n >= 0) && (n < sizeof(strTmpFilename))) ? fopen(strTmpFilename, "wb") : NULL);
     if (!pOutFile) {
         fprintf(stderr, "Failed to open \"%s\" for writing!\n\n", pOutFilename);
         ClosePort(&myPort);
+        CloseBus(&myBus);
         return -3;
     }
 
-    /* Open Temp File */
-    pTmpFile = tmpfile();
-    if (!pTmpFile) {
-        fprintf(stderr, "Failed to open temporary file!\n\n");
-        ClosePort(&myPort);
-        fclose(pOutFile);
-        return -4;
-    }
-
     /* Start polling loop waiting for Neptune discovery: */
     if (!ConnectPort(&myPort)) {
         ClosePort(&myPort);
         fclose(pOutFile);
-        fclose(pTmpFile);
+        remove(strTmpFilename);
+        CloseBus(&myBus);
         return -5;
     }
 
-    /* Write Magic to output file */
-    fprintf(pOutFile, "#NEPTUNE\r\n");
-
-    /* Start data transfer by sending command to Neptune */
-    printf("Commanding Version Transfer");
-    fflush(stdout);
-    SendString(&myPort, " 01 80 80 ");
-    printf("\n");
-    fflush(stdout);
+    /* Read everything, starting over at a lower rate if this one isn't working out,
+        and repeating the transfer until the merged passes have no bad records left */
+    InitMergeSet(&myMerged);
+    InitMergeSet(&myPass);
+    nPass = 0;
+    complete = FALSE;
+    ratechecked = FALSE;
+    do {
+        /* Start data transfer by sending command to Neptune, after throwing
+            away anything left from before a fallback or repeat */
+        FlushPort(&myPort);
+        nRate = PortRate(&myPort);
+        if (nRate) {
+            printf("Commanding Version Transfer at %ld baud", nRate);
+        } else {
+            printf("Commanding Version Transfer");
+        }
+        fflush(stdout);
+        SendString(&myPort, " 01 80 80 ");
+        printf("\n");
+        fflush(stdout);
 
-    /* Loop, but don't exit on bad records or the stupid Neptune will get stuck */
-    done = FALSE;
-    datatype = 0;
-    while ((!done) &&
-            ((type = GetNextRecord(&myPort, databuff)) != -1)) {
-        fprintf(pTmpFile, "%s\r\n", databuff);
+        /* Loop, but don't exit on bad records or the stupid Neptune will get stuck */
+        done = FALSE;
+        skip = FALSE;
+        havesummary = FALSE;
+        gotversion = FALSE;
+        fallback = FALSE;
+        repeat = FALSE;
+        nRecords = 0;
+        nBadRecords = 0;
+        strNepSerialNo[0] = 0;
+        nPrevLastJump = 0;
+        while ((!done) &&
+                ((type = GetNextRecord(&myPort, databuff)) != -1)) {
+            PublishRecord(&myBus, 0, type, databuff);
+            if ((!gotversion) && (type != 0) && (NextLowerRate(nRate))) {
+                /* The Neptune didn't understand us, or we can't understand it */
+                fallback = TRUE;
+                break;
+            }
 
-        switch (type) {
-            case 0:     /* Version Info */
-                fprintf(pOutFile, "!\r\n! Neptune Altimeter Jump Data\r\n!\r\n");
-                nNepVersionHi = (ConvHexByte(&databuff[9]) >> 4) & 0x0F;
-                nNepVersionLo = ConvHexByte(&databuff[9]) & 0x0F;
-                nNepVersionRev = ConvHexByte(&databuff[12]);
-                if ((nNepVersionHi == 0) && (nNepVersionLo == 0) && (nNepVersionRev < 14))
-                    nNepVersionHi = 2;
-                fprintf(pOutFile, "! Neptune Software v%u.%u.%u\r\n",
-                            nNepVersionHi, nNepVersionLo, nNepVersionRev);
-                for (i=0; i<9; i++) {
-                    strNepSerialNo[i] = ConvHexByte(&databuff[i*3+15]);
-                    if (strNepSerialNo[i] == 0x20) strNepSerialNo[i] = 0x00;    /* String is right padded with spaces, so whitespace trim */
+            if ((type == 1) && (!havesummary)) {
+                havesummary = TRUE;
+                if (!CheckSummary(databuff, strNepSerialNo, &nTotalJumps, &nLastJump, &nPrevLastJump)) {
+                    /* Nothing new -- keep just the version and summary, then drop
+                        the link if that stops the Neptune, otherwise let it finish
+                        the transfer into the bit bucket */
+                    if (!AddMergeRecord(&myPass, type, databuff)) {
+                        fprintf(stderr, "\nOut of memory!\n\n");
+                        FreeMergeSet(&myPass);
+                        FreeMergeSet(&myMerged);
+                        ClosePort(&myPort);
+                        fclose(pOutFile);
+                        remove(strTmpFilename);
+                        CloseBus(&myBus);
+                        return -4;
+                    }
+                    printf("No new jumps");
+                    skip = TRUE;
+                    if (myPort.pTransport->bHangUp) break;
+                    continue;
                 }
-                strNepSerialNo[9] = 0;
-                fprintf(pOutFile, "! Neptune Serial No: %s\r\n", strNepSerialNo);
-                fprintf(pOutFile, "!\r\n");
+            }
 
-                printf("Commanding Data Transfer");
-                SendString(&myPort, "01 80 80 ");
-                printf("\nReading");
-                break;
-            case 1:     /* Jump Summary */
-                fprintf(pOutFile, "! Jump Summary:\r\n");
-                fprintf(pOutFile, "!    Number Jump Records   = %lu\r\n",
-                            ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul);
-                fprintf(pOutFile, "!    Number Jump Profiles  = %u\r\n",
-                            ConvHexByte(&databuff[12]));
-                fprintf(pOutFile, "!    Total Jumps Made      = %lu\r\n",
-                            ConvHexByte(&databuff[15]) + ConvHexByte(&databuff[18])*256ul);
-                fprintf(pOutFile, "!    Total FreeFall Time   = %lu sec\r\n",
-                            ConvHexByte(&databuff[21]) + ConvHexByte(&databuff[24])*256ul +
-                            ConvHexByte(&databuff[27])*65536ul + ConvHexByte(&databuff[30])*16777216ul);
-                fprintf(pOutFile, "!    Last Jump Number      = %lu\r\n",
-                            ConvHexByte(&databuff[33]) + ConvHexByte(&databuff[36])*256ul + 1ul);
-                fprintf(pOutFile, "!\r\n");
-                break;
-            case 2:     /* Jump Record */
-                fprintf(pOutFile, "! Jump Record -- Jump Number %lu:\r\n",
-                            ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul);
-                fprintf(pOutFile, "!    Jump Date/Time        = %02u/%02u/%02u  %02u:%02u\r\n",
-                            ConvHexByte(&databuff[21]), ConvHexByte(&databuff[18]), ConvHexByte(&databuff[24]),
-                            ConvHexByte(&databuff[15]), ConvHexByte(&databuff[12]));
-                fprintf(pOutFile, "!    Jump Type             = %s\r\n",
-                            ((ConvHexByte(&databuff[27]) < 16) ? strJumpTypes[ConvHexByte(&databuff[27])] : "<Unknown>"));
-                fprintf(pOutFile, "!    Data Version          = %u.%u.%u\r\n",
-                            ((ConvHexByte(&databuff[57])>>4) & 0x0F) + 1,
-                            (ConvHexByte(&databuff[57]) & 0x0F),
-                            (ConvHexByte(&databuff[60])));
-                fprintf(pOutFile, "!    Data SW Type          = %u\r\n", ConvHexByte(&databuff[63]));
-                nAvgSpeed = 0.0;
-                i = 0;
-                nSpeed = (round(ConvHexByte(&databuff[30])*22.3694))/10.0;
-                if (nSpeed) {
-                    nAvgSpeed += nSpeed;
-                    i++;
-                }
-                fprintf(pOutFile, "!    Max FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[33])*22.3694)/10.0);
-                if (nSpeed) {
-                    nAvgSpeed += nSpeed;
-                    i++;
-                }
-                fprintf(pOutFile, "!    12K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[36])*22.3694)/10.0);
-                if (nSpeed) {
-                    nAvgSpeed += nSpeed;
-                    i++;
-                }
-                fprintf(pOutFile, "!     9K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
-                nSpeed = (round(ConvHexByte(&databuff[39])*22.3694)/10.0);
-                if (nSpeed) {
-                    nAvgSpeed += nSpeed;
-                    i++;
-                }
-                fprintf(pOutFile, "!     6K FF Speed (TAS)    = %.1f mph\r\n", nSpeed);
-                fprintf(pOutFile, "!     3K FF Speed (TAS)    = %.1f mph\r\n",
-                            (round(ConvHexByte(&databuff[42])*22.3694)/10.0));
-                if (i) nAvgSpeed = round((nAvgSpeed*10.0)/i)/10.0;
-                fprintf(pOutFile, "!    Avg FF Speed (TAS)    = %.1f mph\r\n", nAvgSpeed);
-                fprintf(pOutFile, "!    Exit Altitude (AGL)   = %lu ft\r\n",
-                            (unsigned long)lround((ConvHexByte(&databuff[45]) + ConvHexByte(&databuff[48])*256ul)*3.28084));
-                fprintf(pOutFile, "!    Deploy Altitude (AGL) = %lu ft\r\n",
-                            (unsigned long)lround((ConvHexByte(&databuff[51]) + ConvHexByte(&databuff[54])*256ul)*3.28084));
-                fprintf(pOutFile, "!    Freefall Time         = %lu sec\r\n",
-                            ConvHexByte(&databuff[66]) + ConvHexByte(&databuff[69])*256ul);
-                fprintf(pOutFile, "!\r\n");
-                break;
-            case 3:     /* End of all data */
-                done = TRUE;
-                break;
-            case 4:     /* Jump Profile Data Stream Type */
-                switch (ConvHexByte(&databuff[6])) {
-                    case 5:
-                        datatype = 1;
-                        break;
-                    case 6:
-                    case 7:
-                        datatype = 2;
-                        break;
-                }
-                break;
-            case 5:     /* Profile Start */
-                fprintf(pOutFile, "! Jump Profile -- Jump Number %lu:\r\n",
-                            ConvHexByte(&databuff[6]) + ConvHexByte(&databuff[9])*256ul + 1ul);
-                nAltitude = (ConvHexByte(&databuff[12]) + ConvHexByte(&databuff[15])*256ul);
-                if (nAltitude > 32767l) nAltitude = nAltitude - 65534l;     /* Why is this 65534 in paralog and not 65536 ?? */
-                fprintf(pOutFile, "!    Ground Altitude (MSL) = %ld ft\r\n", lround(nAltitude*3.28084));
-                fprintf(pOutFile, "!    Exit Altitude (AGL)   = %lu ft\r\n",
-                            (unsigned long)lround((ConvHexByte(&databuff[18]) + ConvHexByte(&databuff[21])*256ul)*3.28084));
-                fprintf(pOutFile, "!    Freefall Start Time   = %.2f sec\r\n",
-                            (ConvHexByte(&databuff[24]) + ConvHexByte(&databuff[27])*256ul)*0.25);
-                fprintf(pOutFile, "!    Canopy Start Time     = %.2f sec\r\n",
-                            (ConvHexByte(&databuff[30]) + ConvHexByte(&databuff[33])*256ul)*0.25);
-                fprintf(pOutFile, "!\r\n");
-
-                datatype = 0;
-                break;
-            case 6:     /* Profile Datapoint */
-                break;
-            case 7:     /* End of Profile */
-                break;
-            case -2:    /* Bad Record (Too Short) */
-                break;
-            case -3:    /* Bad Record (Invalid Checksum) */
-                break;
-            default:    /* Unknown Record */
-                break;
+            if (skip) {
+                if (type == 3) done = TRUE;
+                continue;
+            }
+
+            if (!AddMergeRecord(&myPass, type, databuff)) {
+                fprintf(stderr, "\nOut of memory!\n\n");
+                FreeMergeSet(&myPass);
+                FreeMergeSet(&myMerged);
+                ClosePort(&myPort);
+                fclose(pOutFile);
+                remove(strTmpFilename);
+                CloseBus(&myBus);
+                return -4;
+            }
+            nRecords++;
+            if (type < 0) nBadRecords++;
+
+            switch (type) {
+                case 0:     /* Version Info */
+                    gotversion = TRUE;
+                    GetSerialNo(databuff, strNepSerialNo);
+                    /* The serial number keys the state store */
+                    for (i=0; strNepSerialNo[i]; i++) {
+                        if (!isalnum((unsigned char)strNepSerialNo[i])) strNepSerialNo[i] = '_';
+                    }
+                    /* Have the data sent at the rate it was last read at, unless
+                        we've had to fall back to find one that works today */
+                    nNextRate = RememberedRate(strNepSerialNo);
+                    if ((!ratechecked) && (nRate) && (nNextRate) && (nNextRate != nRate)) {
+                        printf("Neptune %s was last read at %ld baud -- Switching to it\n", strNepSerialNo, nNextRate);
+                        SetPortRate(&myPort, nNextRate);
+                        nRate = nNextRate;
+                    }
+                    ratechecked = TRUE;
+                    printf("Commanding Data Transfer");
+                    SendString(&myPort, "01 80 80 ");
+                    printf("\nReading");
+                    break;
+                case 3:     /* End of all data */
+                    complete = TRUE;
+                    done = TRUE;
+                    break;
+            }
+
+            printf(".");
+            fflush(stdout);
         }
+        if ((!gotversion) && (NextLowerRate(nRate))) fallback = TRUE;
 
-        printf(".");
-        fflush(stdout);
+        /* Merge in whatever this pass got, unless the Neptune never answered */
+        if (fallback) {
+            FreeMergeSet(&myPass);
+        } else {
+            nPass++;
+            nFilled = MergePass(&myMerged, &myPass);
+            if (nFilled < 0) {
+                fprintf(stderr, "\nOut of memory!\n\n");
+                FreeMergeSet(&myPass);
+                FreeMergeSet(&myMerged);
+                ClosePort(&myPort);
+                fclose(pOutFile);
+                remove(strTmpFilename);
+                CloseBus(&myBus);
+                return -4;
+            }
+            if (nFilled) printf("\nFilled in %ld bad records from pass %d\n", nFilled, nPass);
+        }
+
+        if ((!skip) && (CountMergeHoles(&myMerged))) {
+            if ((RateIsMarginal(nRecords, nBadRecords)) && (NextLowerRate(nRate))) {
+                fallback = TRUE;
+            } else if (nPass < nMaxPasses) {
+                repeat = TRUE;
+            }
+        }
+
+        if (fallback) {
+            if (!gotversion) {
+                printf("No answer at %ld baud -- Falling back to %ld baud\n", nRate, NextLowerRate(nRate));
+            } else {
+                printf("\n%ld records (%ld bad) at %ld baud -- Falling back to %ld baud\n",
+                            nRecords, nBadRecords, nRate, NextLowerRate(nRate));
+            }
+            fflush(stdout);
+            ratechecked = TRUE;
+            SetPortRate(&myPort, NextLowerRate(nRate));
+            SleepFine(1, 0);
+        } else if (repeat) {
+            printf("\n%ld bad records left -- Repeating transfer (pass %d of %d)\n",
+                        CountMergeHoles(&myMerged), nPass+1, nMaxPasses);
+            fflush(stdout);
+            SleepFine(1, 0);
+        }
+    } while ((fallback) || (repeat));
+    printf("Done\n");
+    if (nPass > 1) {
+        nRecords = myMerged.nNumRecs;
+        nBadRecords = CountMergeHoles(&myMerged);
+    }
+    if (nRate) {
+        printf("%ld records (%ld bad) at %ld baud\n\n", nRecords, nBadRecords, nRate);
+    } else {
+        printf("%ld records (%ld bad)\n\n", nRecords, nBadRecords);
     }
-    printf("Done\n\n");
 
-    fseek(pTmpFile, 0L, SEEK_SET);
-    while ((i = fgetc(pTmpFile)) != EOF)
-        fputc(i, pOutFile);
+    /* Write Magic, header and records to output file, unless there's nothing
+        new and the previous download is there to keep */
+    if ((skip) && (access(pOutFilename, F_OK) == 0)) {
+        fclose(pOutFile);
+        remove(strTmpFilename);
+        printf("Keeping the previous download in \"%s\"\n\n", pOutFilename);
+        bOK = TRUE;
+    } else {
+        bOK = WriteMergedFile(pOutFile, &myMerged, nPrevLastJump, skip);
+        if (fclose(pOutFile) != 0) bOK = FALSE;
+        if ((bOK) && (rename(strTmpFilename, pOutFilename) != 0)) bOK = FALSE;
+        if (!bOK) {
+            remove(strTmpFilename);
+            fprintf(stderr, "Failed to write \"%s\"!\n\n", pOutFilename);
+        }
+    }
+
+    /* Only remember it if we got the whole log */
+    if ((bOK) && (pStateFilename) && (havesummary) && (complete) && (strNepSerialNo[0]))
+        SaveDeviceState(pStateFilename, strNepSerialNo, nTotalJumps, nLastJump, nRate);
 
     /* Close everything */
     ClosePort(&myPort);
-    fclose(pOutFile);
-    fclose(pTmpFile);
+    FreeMergeSet(&myMerged);
+    CloseBus(&myBus);
 
-    return 0;
+    return (bOK ? 0 : -3);
 }
 
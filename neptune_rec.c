@@ -39,27 +39,186 @@
 #define TRUE (!FALSE)
 #endif
 
+#define RESYNC_MAX_TYPE 0x0F        /* Highest record type a resync will accept */
+
+#define DATA_VERSION_BYTE 19         /* Jump Records carry the data version and revision here */
+
+/* Local Variables */
+static REC_RECOVERY *pRecovery = NULL;      /* Recovery mode state or NULL for normal parsing */
+
+/* Record Layouts -- Byte positions count from the length byte, so the
+    record type is byte 1 and the data starts at byte 2 */
+static const REC_FIELD_DESC VersionFields[] = {
+    { RF_VERSION,           3, 1, FALSE, 0 },
+    { RF_VERSION_REV,       4, 1, FALSE, 0 },
+    { RF_SERIAL_NO,         5, 9, TRUE,  0 },
+};
+
+static const REC_FIELD_DESC SummaryFields[] = {
+    { RF_NUM_JUMP_RECORDS,  2, 2, FALSE, 0 },
+    { RF_NUM_JUMP_PROFILES, 4, 1, FALSE, 0 },
+    { RF_TOTAL_JUMPS,       5, 2, FALSE, 0 },
+    { RF_TOTAL_FF_TIME,     7, 4, FALSE, 0 },
+    { RF_LAST_JUMP,        11, 2, FALSE, 1 },
+};
+
+static const REC_FIELD_DESC JumpFields[] = {
+    { RF_JUMP,              2, 2, FALSE, 1 },
+    { RF_MINUTE,            4, 1, FALSE, 0 },
+    { RF_HOUR,              5, 1, FALSE, 0 },
+    { RF_DAY,               6, 1, FALSE, 0 },
+    { RF_MONTH,             7, 1, FALSE, 0 },
+    { RF_YEAR,              8, 1, FALSE, 0 },
+    { RF_JUMP_TYPE,         9, 1, FALSE, 0 },
+    { RF_MAX_SPEED,        10, 1, FALSE, 0 },
+    { RF_SPEED_12K,        11, 1, FALSE, 0 },
+    { RF_SPEED_9K,         12, 1, FALSE, 0 },
+    { RF_SPEED_6K,         13, 1, FALSE, 0 },
+    { RF_SPEED_3K,         14, 1, FALSE, 0 },
+    { RF_EXIT_ALT,         15, 2, FALSE, 0 },
+    { RF_DEPLOY_ALT,       17, 2, FALSE, 0 },
+    { RF_DATA_VERSION,     19, 1, FALSE, 0 },
+    { RF_DATA_VERSION_REV, 20, 1, FALSE, 0 },
+    { RF_SW_TYPE,          21, 1, FALSE, 0 },
+    { RF_FF_TIME,          22, 2, FALSE, 0 },
+};
+
+static const REC_FIELD_DESC StreamTypeFields[] = {
+    { RF_STREAM_TYPE,       2, 1, FALSE, 0 },
+};
+
+static const REC_FIELD_DESC ProfileStartFields[] = {
+    { RF_JUMP,              2, 2, FALSE, 1 },
+    { RF_GROUND_ALT,        4, 2, FALSE, 0 },
+    { RF_EXIT_ALT,          6, 2, FALSE, 0 },
+    { RF_FF_START,          8, 2, FALSE, 0 },
+    { RF_CANOPY_START,     10, 2, FALSE, 0 },
+};
+
+static const REC_FIELD_DESC DatapointFields[] = {
+    { RF_ALTITUDE,          2, 2, FALSE, 0 },
+    { RF_TIME,              4, 2, FALSE, 0 },
+};
+
+#define LAYOUT(t, v, f)     { t, v, f, sizeof(f)/sizeof(f[0]) }
+
+/* Layouts for the same type must be in order of data version */
+static const REC_LAYOUT RecordLayouts[] = {
+    LAYOUT(0, 0x0000, VersionFields),
+    LAYOUT(1, 0x0000, SummaryFields),
+    LAYOUT(2, 0x0000, JumpFields),
+    LAYOUT(4, 0x0000, StreamTypeFields),
+    LAYOUT(5, 0x0000, ProfileStartFields),
+    LAYOUT(6, 0x0000, DatapointFields),
+};
+
+#define NUM_RECORD_LAYOUTS  (sizeof(RecordLayouts)/sizeof(RecordLayouts[0]))
+
+/* Local Prototypes */
+static int HexDigitValue(unsigned char c);
+static int FindRecordStart(const unsigned char *pData, long nSize, long nFrom, long *pStart, long *pEnd);
+static void CountBadRecord(int type, const unsigned char *pBuff);
+
 /* ========================================================================== */
 
 int ReadRecord(void *pSource, DATA_REC *pRecord)
 {
+    pRecord->data = pRecord->buff;
     pRecord->dwSize = 0;
     pRecord->dwReturned = 0;
-    if (!ReadString(pSource, pRecord->data, MAX_RECORD_SIZE)) return FALSE;
-    pRecord->dwSize = strlen(pRecord->data);
+    if (!ReadLine(pSource, pRecord)) return FALSE;
 
     return TRUE;
 }
 
+static int HexDigitValue(unsigned char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    return -1;
+}
+
 unsigned char ConvHexByte(const unsigned char *pData)
 {
     char hexbyte[3];
+    int nHi;
+    int nLo;
+
+    /* Nearly every pair is two good hex digits, so do those directly */
+    nHi = HexDigitValue(pData[0]);
+    nLo = HexDigitValue(pData[1]);
+    if ((nHi >= 0) && (nLo >= 0)) return (unsigned char)((nHi << 4) | nLo);
+
+    /* Anything else gets the same (lenient) treatment it always has */
     hexbyte[0] = pData[0];
     hexbyte[1] = pData[1];
     hexbyte[2] = 0;
     return (unsigned char)strtoul(hexbyte, NULL, 16);
 }
 
+long DecodeRecordBytes(const unsigned char *databuff, unsigned char *pBytes, long nMaxBytes)
+{
+    long nLen;
+    long i;
+
+    nLen = strlen((const char *)databuff);
+    for (i=0; (((i*3 + 2) <= nLen) && (i < nMaxBytes)); i++)
+        pBytes[i] = ConvHexByte(&databuff[i*3]);
+
+    return i;
+}
+
+void DecodeRecord(int type, const unsigned char *databuff, REC_FIELDS *pFields)
+{
+    pFields->nNumBytes = DecodeRecordBytes(databuff, pFields->bytes, MAX_RECORD_BYTES);
+    DecodeRecordFields(type, pFields);
+}
+
+void DecodeRecordFields(int type, REC_FIELDS *pFields)
+{
+    const REC_LAYOUT *pLayout;
+    const REC_FIELD_DESC *pDesc;
+    unsigned int nDataVersion;
+    unsigned long nValue;
+    int i;
+    int j;
+
+    pFields->type = type;
+    memset(pFields->nValue, 0, sizeof(pFields->nValue));
+    pFields->strText[0] = 0;
+
+    nDataVersion = 0;
+    if ((type == 2) && (pFields->nNumBytes >= DATA_VERSION_BYTE + 2))
+        nDataVersion = (pFields->bytes[DATA_VERSION_BYTE] << 8) | pFields->bytes[DATA_VERSION_BYTE+1];
+
+    /* Last layout for the type that's no newer than the record's data version */
+    pLayout = NULL;
+    for (i=0; i<NUM_RECORD_LAYOUTS; i++) {
+        if ((RecordLayouts[i].type == type) && (RecordLayouts[i].nDataVersion <= nDataVersion))
+            pLayout = &RecordLayouts[i];
+    }
+    if (!pLayout) return;
+
+    for (i=0; i<pLayout->nNumFields; i++) {
+        pDesc = &pLayout->pFields[i];
+        if (pDesc->bText) {
+            for (j=0; ((j<pDesc->nWidth) && (j<MAX_FIELD_TEXT-1)); j++) {
+                pFields->strText[j] = (((pDesc->nByte + j) < pFields->nNumBytes) ? pFields->bytes[pDesc->nByte + j] : 0);
+                if (pFields->strText[j] == 0x20) pFields->strText[j] = 0x00;    /* String is right padded with spaces, so whitespace trim */
+            }
+            pFields->strText[j] = 0;
+            continue;
+        }
+        nValue = 0;
+        for (j=pDesc->nWidth-1; j>=0; j--) {
+            nValue <<= 8;
+            if ((pDesc->nByte + j) < pFields->nNumBytes) nValue |= pFields->bytes[pDesc->nByte + j];
+        }
+        pFields->nValue[pDesc->nField] = nValue + pDesc->nBias;
+    }
+}
+
 int ReadChar(DATA_REC *pRecord)
 {
     if (pRecord->dwReturned >= pRecord->dwSize) return -1;
@@ -108,6 +267,7 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
                 -1 = No more data available from device
                 -2 = Bad Record (too short)
                 -3 = Bad Record (Invalid Checksum)
+                -4 = Start of another session (#NEPTUNE header)
     */
     DATA_REC myRecord;
     int type;
@@ -117,10 +277,23 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
     int i;
     int byteval;
     int iscomment;
+    long nStart;
+    long nEnd;
+    long nFound;
 
     while (1) {
         pBuff[0] = 0;
-        if (!ReadRecord(pSource, &myRecord)) return -1;
+        if ((pRecovery) && (pRecovery->bOverBudget)) return -1;
+        if ((pRecovery) && (pRecovery->nPending)) {
+            /* Carry on with the rest of the last line */
+            myRecord.data = pRecovery->pending;
+            myRecord.dwSize = pRecovery->nPending;
+            myRecord.dwReturned = 0;
+            pRecovery->nPending = 0;
+        } else {
+            if (!ReadRecord(pSource, &myRecord)) return -1;
+            if (pRecovery) pRecovery->nLines++;
+        }
 
         /* Search and remove left whitespace and remove comment lines */
         iscomment = FALSE;
@@ -136,13 +309,31 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
         }
         if (iscomment) continue;    /* If this was just a comment line, get next record */
 
+        /* The file header of the next session of a concatenated file */
+        if (((myRecord.dwSize - myRecord.dwReturned) >= 8) &&
+            (memcmp(&myRecord.data[myRecord.dwReturned], "#NEPTUNE", 8) == 0)) {
+            strcpy((char *)pBuff, "#NEPTUNE");
+            if (pRecovery) {
+                /* Keep anything run onto the end of it for the next call */
+                for (i=myRecord.dwReturned+8; ((i < myRecord.dwSize) && (isspace(myRecord.data[i]))); i++);
+                if (i < myRecord.dwSize) {
+                    pRecovery->nPending = myRecord.dwSize - i;
+                    memmove(pRecovery->pending, &myRecord.data[i], pRecovery->nPending);
+                }
+            }
+            return -4;
+        }
+
+        nStart = myRecord.dwReturned;
+        nEnd = nStart;
+
         /* Get Record Length */
         reclen = ReadHexChar(&myRecord, hexbyte);
         if (reclen < 0) {
             type = -2;
             break;
         }
-        strcat(pBuff, hexbyte);
+        nEnd = myRecord.dwReturned;
 
         /* Get Record Type */
         type = ReadHexChar(&myRecord, hexbyte);
@@ -150,7 +341,7 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
             type = -2;
             break;
         }
-        strcat(pBuff, hexbyte);
+        nEnd = myRecord.dwReturned;
         checksum = type;
 
         /* Read Data Bytes */
@@ -160,7 +351,7 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
                 type = -2;
                 break;
             }
-            strcat(pBuff, hexbyte);
+            nEnd = myRecord.dwReturned;
             checksum += byteval;
         }
         if (type < 0) break;
@@ -171,7 +362,7 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
             type = -2;
             break;
         }
-        strcat(pBuff, hexbyte);
+        nEnd = myRecord.dwReturned;
         if (byteval != (checksum & 0xFF)) {
             type = -3;
             break;
@@ -180,6 +371,37 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
         break;      /* Always break out of a valid record read */
     }
 
+    if (pRecovery) {
+        /* Look further along a bad line for a record we can use */
+        if ((type < 0) && (FindRecordStart(myRecord.data, myRecord.dwSize, nStart+1, &nFound, &nEnd))) {
+            pRecovery->nResyncs++;
+            pRecovery->nSkipped += nFound - nStart;
+            nStart = nFound;
+            type = ConvHexByte(&myRecord.data[nStart+3]);
+        }
+    }
+
+    /* Hand back the hex pairs we've read (as far as we got), which are
+        just the span of the line they were read from */
+    memcpy(pBuff, &myRecord.data[nStart], nEnd - nStart);
+    pBuff[nEnd - nStart] = 0;
+
+    if (pRecovery) {
+        if (type < 0) {
+            CountBadRecord(type, pBuff);
+            return type;
+        }
+
+        /* Keep anything after a good record for the next call */
+        pRecovery->nRecords++;
+        for (i=nEnd; ((i < myRecord.dwSize) && (isspace(myRecord.data[i]))); i++);
+        if (i < myRecord.dwSize) {
+            pRecovery->nPending = myRecord.dwSize - i;
+            memmove(pRecovery->pending, &myRecord.data[i], pRecovery->nPending);
+        }
+        return type;
+    }
+
     switch (type) {
         case -2:
             fprintf(stderr, "\n%s  <<< Invalid Record (Too Short)\n", pBuff);
@@ -192,3 +414,107 @@ int GetNextRecord(void *pSource, unsigned char *pBuff)
     return type;
 }
 
+/* ========================================================================== */
+
+void SetRecovery(REC_RECOVERY *pNewRecovery, long nMaxErrors, long nMaxLogged)
+{
+    pRecovery = pNewRecovery;
+    if (!pRecovery) return;
+
+    memset(pRecovery, 0, sizeof(REC_RECOVERY));
+    pRecovery->nMaxErrors = nMaxErrors;
+    pRecovery->nMaxLogged = nMaxLogged;
+}
+
+void PrintRecoveryReport(FILE *pOutFile, const REC_RECOVERY *pRecovery)
+{
+    fprintf(pOutFile, "%ld lines, %ld good records\n", pRecovery->nLines, pRecovery->nRecords);
+    if (pRecovery->nShort)
+        fprintf(pOutFile, "%ld records too short (lines %ld to %ld)\n", pRecovery->nShort,
+                    pRecovery->nFirstShort, pRecovery->nLastShort);
+    if (pRecovery->nChecksum)
+        fprintf(pOutFile, "%ld records with bad checksums (lines %ld to %ld)\n", pRecovery->nChecksum,
+                    pRecovery->nFirstChecksum, pRecovery->nLastChecksum);
+    if (pRecovery->nResyncs)
+        fprintf(pOutFile, "%ld records recovered from bad lines, skipping %ld characters\n",
+                    pRecovery->nResyncs, pRecovery->nSkipped);
+    if (pRecovery->bOverBudget)
+        fprintf(pOutFile, "Gave up after %ld bad records -- error budget exceeded\n",
+                    pRecovery->nShort + pRecovery->nChecksum);
+}
+
+static int FindRecordStart(const unsigned char *pData, long nSize, long nFrom, long *pStart, long *pEnd)
+{
+    /* Finds the first record in pData, at or after nFrom, made of well formed hex
+        pairs with a plausible type and a good checksum.  Working back from the end
+        of the line, nRun[] counts the hex pairs that follow on from each position
+        and nSum[] totals them, so each possible start is checked at a glance */
+    static int nValue[MAX_RECORD_SIZE];
+    static long nRun[MAX_RECORD_SIZE];
+    static long nSum[MAX_RECORD_SIZE];
+    long i;
+    long nLen;
+    long nCS;
+    int nHi;
+    int nLo;
+
+    if (nSize > MAX_RECORD_SIZE) nSize = MAX_RECORD_SIZE;
+    if (nFrom >= nSize) return FALSE;
+
+    for (i=nSize-1; i>=nFrom; i--) {
+        nValue[i] = -1;
+        if (i+1 < nSize) {
+            nHi = HexDigitValue(pData[i]);
+            nLo = HexDigitValue(pData[i+1]);
+            if ((nHi >= 0) && (nLo >= 0) && ((i+2 >= nSize) || (isspace(pData[i+2]))))
+                nValue[i] = (nHi << 4) | nLo;
+        }
+        if (nValue[i] < 0) {
+            nRun[i] = 0;
+            nSum[i] = 0;
+        } else {
+            nRun[i] = 1 + ((i+3 < nSize) ? nRun[i+3] : 0);
+            nSum[i] = nValue[i] + ((i+3 < nSize) ? nSum[i+3] : 0);
+        }
+    }
+
+    for (i=nFrom; i<nSize; i++) {
+        nLen = nValue[i];
+        if ((nLen < 1) || (nRun[i] < nLen+2)) continue;     /* Length, type, data and checksum */
+        if (nValue[i+3] > RESYNC_MAX_TYPE) continue;
+        nCS = i + 3*(nLen+1);
+        if (((nSum[i+3] - nSum[nCS]) & 0xFF) != nValue[nCS]) continue;
+        *pStart = i;
+        *pEnd = ((nCS+3 <= nSize) ? nCS+3 : nSize);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void CountBadRecord(int type, const unsigned char *pBuff)
+{
+    if (type == -2) {
+        if (!pRecovery->nShort) pRecovery->nFirstShort = pRecovery->nLines;
+        pRecovery->nLastShort = pRecovery->nLines;
+        pRecovery->nShort++;
+    } else {
+        if (!pRecovery->nChecksum) pRecovery->nFirstChecksum = pRecovery->nLines;
+        pRecovery->nLastChecksum = pRecovery->nLines;
+        pRecovery->nChecksum++;
+    }
+
+    /* Just a sample of them, so a badly damaged file doesn't bury us */
+    if (pRecovery->nLogged < pRecovery->nMaxLogged) {
+        fprintf(stderr, "Line %ld: %.60s%s  <<< %s\n", pRecovery->nLines, pBuff,
+                    ((strlen((const char *)pBuff) > 60) ? "..." : ""),
+                    ((type == -2) ? "Invalid Record (Too Short)" : "Bad Record Checksum"));
+        pRecovery->nLogged++;
+        if (pRecovery->nLogged == pRecovery->nMaxLogged)
+            fprintf(stderr, "(No more bad records will be shown)\n");
+    }
+
+    if ((pRecovery->nMaxErrors) && ((pRecovery->nShort + pRecovery->nChecksum) > pRecovery->nMaxErrors))
+        pRecovery->bOverBudget = TRUE;
+}
+
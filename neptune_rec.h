@@ -26,20 +26,121 @@
 #define _NEPTUNE_REC_H_
 
 #define MAX_RECORD_SIZE 2053
+#define MAX_RECORD_BYTES ((MAX_RECORD_SIZE+2)/3)   /* Most bytes a record line can hold */
+#define MAX_FIELD_TEXT 16                           /* Longest text field (the serial number) */
+
+/* Fields of the records, as pulled out by DecodeRecord().  Jump numbers
+    are the real (1 based) jump numbers, everything else is as recorded */
+enum rec_field
+{
+    RF_VERSION,                 /* Version Info:  Software version (hi nibble.lo nibble) */
+    RF_VERSION_REV,             /*      Software revision */
+    RF_SERIAL_NO,               /*      Serial number (text field) */
+    RF_NUM_JUMP_RECORDS,        /* Jump Summary */
+    RF_NUM_JUMP_PROFILES,
+    RF_TOTAL_JUMPS,
+    RF_TOTAL_FF_TIME,           /*      Seconds */
+    RF_LAST_JUMP,
+    RF_JUMP,                    /* Jump Record and Profile Start:  Jump number */
+    RF_MINUTE,                  /* Jump Record */
+    RF_HOUR,
+    RF_DAY,
+    RF_MONTH,
+    RF_YEAR,
+    RF_JUMP_TYPE,
+    RF_MAX_SPEED,               /*      Speeds in m/s */
+    RF_SPEED_12K,
+    RF_SPEED_9K,
+    RF_SPEED_6K,
+    RF_SPEED_3K,
+    RF_EXIT_ALT,                /*      Meters AGL (Profile Start too) */
+    RF_DEPLOY_ALT,
+    RF_DATA_VERSION,
+    RF_DATA_VERSION_REV,
+    RF_SW_TYPE,
+    RF_FF_TIME,                 /*      Seconds */
+    RF_STREAM_TYPE,             /* Profile Data Stream Type */
+    RF_GROUND_ALT,              /* Profile Start:  Meters MSL, as unsigned */
+    RF_FF_START,                /*      Quarter seconds */
+    RF_CANOPY_START,
+    RF_ALTITUDE,                /* Profile Datapoint:  Meters AGL */
+    RF_TIME,                    /*      Quarter seconds */
+    RF_NUM_FIELDS
+};
+
+typedef struct rec_field_desc
+{
+    int         nField;                     /* RF_xxx */
+    int         nByte;                      /* Position of its first byte in the record (0 = length byte) */
+    int         nWidth;                     /* Number of bytes, least significant first, or text length */
+    int         bText;                      /* Space padded text instead of a number */
+    unsigned long nBias;                    /* Added to the number (1 for jump numbers) */
+} REC_FIELD_DESC;
+
+typedef struct rec_layout
+{
+    int         type;                       /* Record type code */
+    unsigned int nDataVersion;              /* Lowest data version (version << 8 | rev) the layout is for */
+    const REC_FIELD_DESC *pFields;
+    int         nNumFields;
+} REC_LAYOUT;
+
+typedef struct rec_fields
+{
+    int         type;                       /* Record type code */
+    long        nNumBytes;                  /* Number of bytes in bytes[] */
+    unsigned char bytes[MAX_RECORD_BYTES];  /* Record bytes from the length through the checksum */
+    unsigned long nValue[RF_NUM_FIELDS];    /* Field values, 0 for fields the record doesn't have */
+    char        strText[MAX_FIELD_TEXT];    /* Text field, whitespace trimmed */
+} REC_FIELDS;
 
 typedef struct data_rec
 {
-    unsigned char data[MAX_RECORD_SIZE];    /* One line of record data */
-    long        dwSize;                     /* Length of data (bytes read -- strlen) */
+    const unsigned char *data;              /* One line of record data -- a view into the source's buffer or into buff */
+    unsigned char buff[MAX_RECORD_SIZE];    /* Line storage for sources that can't hand out views */
+    long        dwSize;                     /* Length of data (bytes read) */
     long        dwReturned;                 /* Bytes returned already */
 } DATA_REC;
 
-/* ReadRecord - Reads a string from a data source */
+typedef struct rec_recovery
+{
+    long        nMaxErrors;                 /* Error budget:  Give up after this many bad records (0 = no limit) */
+    long        nMaxLogged;                 /* Number of bad records to print as a sample */
+    long        nLines;                     /* Lines read so far */
+    long        nRecords;                   /* Valid records returned */
+    long        nShort;                     /* Bad records that were too short */
+    long        nChecksum;                  /* Bad records with an invalid checksum */
+    long        nFirstShort;                /* Line numbers of the first and last of each */
+    long        nLastShort;
+    long        nFirstChecksum;
+    long        nLastChecksum;
+    long        nResyncs;                   /* Records found further along a bad line */
+    long        nSkipped;                   /* Characters skipped to get to them */
+    long        nLogged;                    /* Bad records printed so far */
+    int         bOverBudget;                /* Parsing was stopped for too many errors */
+    unsigned char pending[MAX_RECORD_SIZE]; /* Rest of a line that held more than one record */
+    long        nPending;
+} REC_RECOVERY;
+
+/* ReadRecord - Reads a line from a data source */
 extern int ReadRecord(void *pSource, DATA_REC *pRecord);
 
 /* ConvHexByte - Converts ASCII-HEX byte into a character value */
 extern unsigned char ConvHexByte(const unsigned char *pData);
 
+/* DecodeRecordBytes - Converts the ASCII-HEX pairs of a record line to bytes, returning
+        the number of bytes converted (at most nMaxBytes) */
+extern long DecodeRecordBytes(const unsigned char *databuff, unsigned char *pBytes, long nMaxBytes);
+
+/* DecodeRecord - Decodes a valid record, where type and databuff are as returned by
+        GetNextRecord(), and fills in all of its fields from the record layout table
+        for its type (and data version).  Fields beyond the end of a short record are 0 */
+extern void DecodeRecord(int type, const unsigned char *databuff, REC_FIELDS *pFields);
+
+/* DecodeRecordFields - Like DecodeRecord(), for a record whose bytes (length through
+        checksum) are already in pFields->bytes and pFields->nNumBytes */
+extern void DecodeRecordFields(int type, REC_FIELDS *pFields);
+
 /* ReadChar - Returns next character in record buffer and advances pointer */
 extern int ReadChar(DATA_REC *pRecord);
 
@@ -56,12 +157,27 @@ extern int ReadHexChar(DATA_REC *pRecord, unsigned char *pHexByte);
                     -1 = No more data available from device
                     -2 = Bad Record (too short)
                     -3 = Bad Record (Invalid Checksum)
+                    -4 = Start of another session, where files from several
+                            downloads have been concatenated (#NEPTUNE header)
 */
 extern int GetNextRecord(void *pSource, unsigned char *pBuff);
 
-/* ReadString - This function must be implemented by external app to read a string
-        from some arbitrary data source, be it a direct socket, device, file, etc. */
-extern int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
+/* SetRecovery - Puts GetNextRecord() in recovery mode for salvaging damaged files, or
+        back to normal if pRecovery is NULL.  In recovery mode, bad records are counted
+        instead of printed, beyond a small sample, a bad line is searched for a valid
+        record further along it, and records run together on one line are split up.
+        Once the error budget is exceeded, GetNextRecord() returns -1 as if at the end */
+extern void SetRecovery(REC_RECOVERY *pRecovery, long nMaxErrors, long nMaxLogged);
+
+/* PrintRecoveryReport - Prints the error counts of a recovery mode parse */
+extern void PrintRecoveryReport(FILE *pOutFile, const REC_RECOVERY *pRecovery);
+
+/* ReadLine - This function must be implemented by external app to read a line
+        from some arbitrary data source, be it a direct socket, device, file, etc.
+        It either points pRecord->data at the line in its own buffer, which need
+        only stay valid until the next call, or copies the line into pRecord->buff.
+        pRecord->dwSize is set to the line length, which is at most MAX_RECORD_SIZE-1 */
+extern int ReadLine(void *pSource, DATA_REC *pRecord);
 
 #endif  /* _NEPTUNE_REC_H_ */
 
@@ -0,0 +1,227 @@
+/*
+ * Neptune_Stats
+ *
+ * This module keeps fleet statistics of the fields of jumps, grouped
+ * by jump type and month, as histograms of their raw values.
+ *
+ * The fields of a Jump Record are one or two bytes, so a histogram
+ * has at most 65536 values, and usually a few hundred.  Unlike a
+ * t-digest or KLL sketch, which only approximate the quantiles and
+ * merge differently depending on the order, adding histograms is
+ * exact, so the shards of an archive can be read anywhere and in
+ * any order and still agree to the last jump.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "neptune_stats.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define STATS_GROW          64          /* Groups or bins added to an array at a time */
+
+/* Local Prototypes */
+static STATS_GROUP *FindGroup(JUMP_STATS *pStats, long nType, long nMonth);
+static int CompareGroups(const void *p1, const void *p2);
+
+/* ========================================================================== */
+
+static STATS_GROUP *FindGroup(JUMP_STATS *pStats, long nType, long nMonth)
+{
+    /* The group of a jump type and month, a new one if it isn't there yet */
+    STATS_GROUP *pGroup;
+    long i;
+
+    if ((pStats->nLastGroup < pStats->nNumGroups) &&
+        (pStats->pGroups[pStats->nLastGroup].nType == nType) &&
+        (pStats->pGroups[pStats->nLastGroup].nMonth == nMonth)) return &pStats->pGroups[pStats->nLastGroup];
+    for (i=0; i<pStats->nNumGroups; i++) {
+        if ((pStats->pGroups[i].nType == nType) && (pStats->pGroups[i].nMonth == nMonth)) {
+            pStats->nLastGroup = i;
+            return &pStats->pGroups[i];
+        }
+    }
+
+    if (pStats->nNumGroups >= pStats->nGroupAlloc) {
+        pGroup = (STATS_GROUP *)realloc(pStats->pGroups, (pStats->nGroupAlloc + STATS_GROW) * sizeof(STATS_GROUP));
+        if (!pGroup) return NULL;
+        pStats->pGroups = pGroup;
+        pStats->nGroupAlloc += STATS_GROW;
+    }
+    pGroup = &pStats->pGroups[pStats->nNumGroups];
+    memset(pGroup, 0, sizeof(STATS_GROUP));
+    pGroup->nType = nType;
+    pGroup->nMonth = nMonth;
+    pStats->nLastGroup = pStats->nNumGroups++;
+    return pGroup;
+}
+
+static int CompareGroups(const void *p1, const void *p2)
+{
+    const STATS_GROUP *pGroup1 = (const STATS_GROUP *)p1;
+    const STATS_GROUP *pGroup2 = (const STATS_GROUP *)p2;
+
+    if (pGroup1->nType != pGroup2->nType) return ((pGroup1->nType < pGroup2->nType) ? -1 : 1);
+    if (pGroup1->nMonth != pGroup2->nMonth) return ((pGroup1->nMonth < pGroup2->nMonth) ? -1 : 1);
+    return 0;
+}
+
+/* ========================================================================== */
+
+void InitStats(JUMP_STATS *pStats, const char * const *pFieldNames, int nNumFields)
+{
+    memset(pStats, 0, sizeof(JUMP_STATS));
+    pStats->pFieldNames = pFieldNames;
+    pStats->nNumFields = ((nNumFields > MAX_STATS_FIELDS) ? MAX_STATS_FIELDS : nNumFields);
+}
+
+void FreeStats(JUMP_STATS *pStats)
+{
+    long i;
+    int j;
+
+    for (i=0; i<pStats->nNumGroups; i++) {
+        for (j=0; j<pStats->nNumFields; j++) free(pStats->pGroups[i].hists[j].pBins);
+    }
+    free(pStats->pGroups);
+    pStats->pGroups = NULL;
+    pStats->nNumGroups = 0;
+    pStats->nGroupAlloc = 0;
+    pStats->nLastGroup = 0;
+}
+
+int AddStat(JUMP_STATS *pStats, long nType, long nMonth, int nField, unsigned long nValue, unsigned long long nCount)
+{
+    STATS_GROUP *pGroup;
+    STATS_HIST *pHist;
+    STATS_BIN *pBins;
+    long nLow, nHigh, nMid;
+
+    if ((nField < 0) || (nField >= pStats->nNumFields)) return FALSE;
+    pGroup = FindGroup(pStats, nType, nMonth);
+    if (!pGroup) return FALSE;
+    pHist = &pGroup->hists[nField];
+
+    /* Find the value's bin, or where it goes */
+    nLow = 0;
+    nHigh = pHist->nNumBins;
+    while (nLow < nHigh) {
+        nMid = (nLow + nHigh) / 2;
+        if (pHist->pBins[nMid].nValue < nValue) {
+            nLow = nMid + 1;
+        } else {
+            nHigh = nMid;
+        }
+    }
+    if ((nLow >= pHist->nNumBins) || (pHist->pBins[nLow].nValue != nValue)) {
+        if (pHist->nNumBins >= pHist->nBinAlloc) {
+            pBins = (STATS_BIN *)realloc(pHist->pBins, (pHist->nBinAlloc + STATS_GROW) * sizeof(STATS_BIN));
+            if (!pBins) return FALSE;
+            pHist->pBins = pBins;
+            pHist->nBinAlloc += STATS_GROW;
+        }
+        memmove(&pHist->pBins[nLow+1], &pHist->pBins[nLow], (pHist->nNumBins - nLow) * sizeof(STATS_BIN));
+        pHist->pBins[nLow].nValue = nValue;
+        pHist->pBins[nLow].nCount = 0;
+        pHist->nNumBins++;
+    }
+    pHist->pBins[nLow].nCount += nCount;
+    pHist->nCount += nCount;
+    pHist->nSum += nValue * nCount;
+
+    return TRUE;
+}
+
+void SortStats(JUMP_STATS *pStats)
+{
+    if (pStats->nNumGroups > 1) qsort(pStats->pGroups, pStats->nNumGroups, sizeof(STATS_GROUP), CompareGroups);
+    pStats->nLastGroup = 0;
+}
+
+unsigned long StatsQuantile(const STATS_HIST *pHist, double nFraction)
+{
+    unsigned long long nRank;
+    unsigned long long nSoFar;
+    long i;
+
+    /* The nearest rank, counting from 1 */
+    nRank = (unsigned long long)(nFraction * pHist->nCount);
+    if (nRank < nFraction * pHist->nCount) nRank++;
+    if (nRank < 1) nRank = 1;
+
+    nSoFar = 0;
+    for (i=0; i<pHist->nNumBins-1; i++) {
+        nSoFar += pHist->pBins[i].nCount;
+        if (nSoFar >= nRank) break;
+    }
+    return pHist->pBins[i].nValue;
+}
+
+int WriteStats(const JUMP_STATS *pStats, FILE *pOutFile)
+{
+    const STATS_GROUP *pGroup;
+    const STATS_HIST *pHist;
+    long i,k;
+    int j;
+
+    fprintf(pOutFile, "%s %d\n", STATS_MAGIC, STATS_VERSION);
+    for (i=0; i<pStats->nNumGroups; i++) {
+        pGroup = &pStats->pGroups[i];
+        for (j=0; j<pStats->nNumFields; j++) {
+            pHist = &pGroup->hists[j];
+            for (k=0; k<pHist->nNumBins; k++) {
+                fprintf(pOutFile, "%ld %04ld-%02ld %s %lu %llu\n", pGroup->nType,
+                            pGroup->nMonth / 100, pGroup->nMonth % 100,
+                            pStats->pFieldNames[j], pHist->pBins[k].nValue, pHist->pBins[k].nCount);
+            }
+        }
+    }
+
+    return !ferror(pOutFile);
+}
+
+int ReadStatsLine(JUMP_STATS *pStats, const char *pLine)
+{
+    long nType;
+    long nYear;
+    long nMonth;
+    char strField[32];
+    unsigned long nValue;
+    unsigned long long nCount;
+    int nVersion;
+    int j;
+
+    if (strncmp(pLine, STATS_MAGIC, strlen(STATS_MAGIC)) == 0) {
+        return ((sscanf(pLine + strlen(STATS_MAGIC), "%d", &nVersion) == 1) && (nVersion == STATS_VERSION));
+    }
+
+    if (sscanf(pLine, "%ld %4ld-%2ld %31s %lu %llu", &nType, &nYear, &nMonth, strField, &nValue, &nCount) != 6) return FALSE;
+    for (j=0; j<pStats->nNumFields; j++) {
+        if (strcmp(strField, pStats->pFieldNames[j]) == 0)
+            return AddStat(pStats, nType, nYear*100 + nMonth, j, nValue, nCount);
+    }
+    return FALSE;
+}
+
@@ -0,0 +1,100 @@
+/*
+ * Neptune_Stats
+ *
+ * This module keeps fleet statistics of the fields of jumps, grouped
+ * by jump type and month, as histograms of their raw values.  The
+ * fields are all small whole numbers, so a histogram of them is an
+ * exact quantile sketch, never larger than their range however many
+ * jumps go into it.  Statistics are written out and read back as
+ * partial aggregates, which add together into exactly what reading
+ * all of their jumps at once would give.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_STATS_H_
+#define _NEPTUNE_STATS_H_
+
+#include <stdio.h>
+
+#define STATS_MAGIC         "#NEPTUNE-STATS"    /* First line of a partial aggregate */
+#define STATS_VERSION       1
+#define MAX_STATS_FIELDS    16
+
+typedef struct stats_bin
+{
+    unsigned long nValue;
+    unsigned long long nCount;          /* Times the value was added */
+} STATS_BIN;
+
+typedef struct stats_hist           /* The values of one field of a group */
+{
+    STATS_BIN   *pBins;                 /* In order of value */
+    long        nNumBins;
+    long        nBinAlloc;
+    unsigned long long nCount;
+    unsigned long long nSum;
+} STATS_HIST;
+
+typedef struct stats_group
+{
+    long        nType;                  /* Jump type */
+    long        nMonth;                 /* Year*100 + month, or 0 if it isn't known */
+    STATS_HIST  hists[MAX_STATS_FIELDS];
+} STATS_GROUP;
+
+typedef struct jump_stats
+{
+    const char * const *pFieldNames;    /* Names of the fields, for partial aggregates */
+    int         nNumFields;
+    STATS_GROUP *pGroups;
+    long        nNumGroups;
+    long        nGroupAlloc;
+    long        nLastGroup;             /* Group last added to, which the next usually is too */
+} JUMP_STATS;
+
+/* InitStats - Starts empty statistics of the nNumFields fields named in pFieldNames,
+        which are kept rather than copied */
+extern void InitStats(JUMP_STATS *pStats, const char * const *pFieldNames, int nNumFields);
+
+/* FreeStats - Frees the groups and their histograms */
+extern void FreeStats(JUMP_STATS *pStats);
+
+/* AddStat - Adds nCount of nValue to field nField of the group of jump type nType
+        in month nMonth.  Returns FALSE if there wasn't the memory */
+extern int AddStat(JUMP_STATS *pStats, long nType, long nMonth, int nField, unsigned long nValue, unsigned long long nCount);
+
+/* SortStats - Puts the groups in order of jump type and month */
+extern void SortStats(JUMP_STATS *pStats);
+
+/* StatsQuantile - Returns the value a fraction nFraction of the way through a
+        histogram, the smallest one with at least that many values at or below
+        it, which for 0.5 is the median.  The histogram mustn't be empty */
+extern unsigned long StatsQuantile(const STATS_HIST *pHist, double nFraction);
+
+/* WriteStats - Writes the statistics as a partial aggregate, one line for each
+        value of each field of each group.  Returns FALSE if it couldn't be written */
+extern int WriteStats(const JUMP_STATS *pStats, FILE *pOutFile);
+
+/* ReadStatsLine - Adds the value of a line of a partial aggregate to the statistics.
+        Its STATS_MAGIC line is skipped, so partial aggregates can be simply
+        concatenated.  Returns FALSE if the line isn't one, or is for a field
+        it doesn't have */
+extern int ReadStatsLine(JUMP_STATS *pStats, const char *pLine);
+
+#endif  /* _NEPTUNE_STATS_H_ */
+
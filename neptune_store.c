@@ -0,0 +1,1765 @@
+/*
+ * Neptune_Store
+ *
+ * This module keeps an append-only archive of the jumps of any number
+ * of Neptunes, taken from their data files, in a directory of binary
+ * files.  Nothing in it is rewritten short of compacting it, each
+ * download just adds its jumps to the end, so the history of every
+ * jump stays in the store, and only the indexes, which are brought up
+ * to date after each ingest, lead to the latest copy of each.
+ *
+ * Readers don't lock the store.  Profiles are written before the jump
+ * records that point to them, and the jump count is taken from the
+ * size of jumps.dat, so a reader never sees a jump before its profile.
+ * An index that doesn't match the jump count is rebuilt in memory.
+ *
+ * A jump that's the same as the copy already in the store, by the
+ * hashes of its record and profile, isn't added again.  Adding to a
+ * store with up to date indexes doesn't load all of its jumps, just
+ * a Bloom filter of the (serial, jump number) in it, so a new jump
+ * is known to be new without looking it up in serial.idx, and the
+ * indexes are then merged with the jumps added.  Compacting a store
+ * rewrites it with just the latest copy of each jump.
+ *
+ * Profiles are kept as the change in each datapoint's time step and
+ * altitude from the one before, with runs of unchanged ones counted,
+ * which keeps them to around a fifth of their records' size.  They're
+ * read back through a STORE_READER, which decodes each datapoint
+ * straight into its fields, for neptune_dump to read a store the same
+ * as a data file without writing or parsing the record text.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "neptune_store.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define STORE_READ_JUMPS    4096        /* Jump records read at a time when loading */
+#define STORE_COMPACT_JUMPS 4096        /*      and written at a time when compacting */
+#define MIN_SLOTS           1024
+
+#define BLOOM_BITS_PER_JUMP 16          /* Which with 8 hashes is about 1 false positive in 2000 */
+#define BLOOM_HASHES        8
+#define MIN_BLOOM_BITS      65536
+
+#define EncodedSize(n)      ((n) * 2 + 16)  /* Most an encoded profile can take */
+
+#define FNV_OFFSET          0xCBF29CE484222325ull
+#define FNV_PRIME           0x100000001B3ull
+#define FNV32_OFFSET        0x811C9DC5ul
+#define FNV32_PRIME         0x01000193ul
+
+#define READER_HEADER       0           /* STORE_READER nState:  what it reads next */
+#define READER_VERSION      1
+#define READER_SUMMARY      2
+#define READER_RECORDS      3
+#define READER_PROFILES     4
+#define READER_END          5
+#define READER_DONE         6
+
+/* Constants */
+static const char *strIndexNames[STORE_NUM_INDEXES] = {
+                    "serial.idx", "jump.idx", "date.idx", "type.idx"
+                };
+
+static const char *strStoreFiles[] = {
+                    "profiles.dat", "devices.dat", "jumps.dat", "bloom.dat", "lock", NULL
+                };
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+/* Local Prototypes */
+static void StoreFilename(const NEPTUNE_STORE *pStore, const char *pName, char *pPath);
+static int OpenStoreFile(NEPTUNE_STORE *pStore, const char *pName, uint32_t nRecordSize, off_t *pSize);
+static int WriteStoreFile(const NEPTUNE_STORE *pStore, const char *pName, uint32_t nRecordSize,
+                            const void *pData, long nSize);
+static void RemoveStore(const char *pPath);
+static unsigned long long JumpHash(const char *pSerialNo, uint32_t nJumpNumber);
+static uint32_t HashBytes(const uint8_t *pData, long nSize);
+static STORE_SLOT *FindSlot(NEPTUNE_STORE *pStore, const char *pSerialNo, uint32_t nJumpNumber);
+static int UpdateSlot(NEPTUNE_STORE *pStore, const STORE_JUMP *pJump, uint32_t nRecord, uint32_t nOldRecord);
+static int LoadSlots(NEPTUNE_STORE *pStore);
+static int LoadDevices(NEPTUNE_STORE *pStore, off_t nSize);
+static STORE_DEVICE *FindDevice(const NEPTUNE_STORE *pStore, const char *pSerialNo);
+static int BloomJump(NEPTUNE_STORE *pStore, const char *pSerialNo, uint32_t nJumpNumber, int bAdd);
+static int BuildBloom(NEPTUNE_STORE *pStore, const STORE_INDEX_ENTRY *pEntries, long nCount);
+static int LoadBloom(NEPTUNE_STORE *pStore);
+static int FindStored(NEPTUNE_STORE *pStore, const STORE_JUMP *pJump, STORE_JUMP *pEarlier, uint32_t *pOldRecord);
+static void PutBE32(uint8_t *p, uint32_t n);
+static uint32_t GetBE32(const uint8_t *p);
+static void MakeKey(int nIndex, const STORE_SLOT *pSlot, uint8_t *pKey);
+static long FindKey(const STORE_INDEX_ENTRY *pEntries, long nCount, const uint8_t *pKey);
+static int CompareEntries(const void *p1, const void *p2);
+static int CompareJumps(const void *p1, const void *p2);
+static int CompareRecords(const void *p1, const void *p2);
+static STORE_INDEX_ENTRY *BuildIndex(NEPTUNE_STORE *pStore, int nIndex, long *pCount);
+static STORE_INDEX_ENTRY *MergeIndex(NEPTUNE_STORE *pStore, int nIndex, const uint32_t *pReplaced,
+                                        long nReplaced, long *pCount);
+static int IndexFresh(const NEPTUNE_STORE *pStore, int nIndex);
+static STORE_INDEX_ENTRY *MapIndex(const NEPTUNE_STORE *pStore, int nIndex, uint32_t nNumJumps,
+                                        long *pCount, long *pMapSize);
+static STORE_INDEX_ENTRY *LoadIndex(NEPTUNE_STORE *pStore, int nIndex, long *pCount, long *pMapSize);
+static const uint8_t *MapStoreFile(int fd, off_t nSize, size_t *pMapSize);
+static int MatchQuery(const STORE_QUERY *pQuery, const STORE_JUMP *pJump);
+static uint32_t ZigZag(int32_t nValue);
+static int32_t UnZigZag(uint32_t nValue);
+static uint32_t PutVarint(uint8_t *p, uint32_t nValue);
+static int GetVarint(STORE_DECODER *pDecoder, uint32_t *pValue);
+static uint32_t EncodeProfile(const uint8_t *pProfile, uint32_t nSize, uint8_t *pCodes);
+static int DecodeProfile(STORE_DECODER *pDecoder, REC_FIELDS *pFields);
+static int ReaderRecord(STORE_READER *pReader, const uint8_t *pBytes, REC_FIELDS *pFields);
+static void WriteRecordLine(FILE *pOutFile, const uint8_t *pBytes);
+
+/* ========================================================================== */
+
+static void StoreFilename(const NEPTUNE_STORE *pStore, const char *pName, char *pPath)
+{
+    snprintf(pPath, MAX_STORE_PATH+32, "%s/%s", pStore->strPath, pName);
+}
+
+static int OpenStoreFile(NEPTUNE_STORE *pStore, const char *pName, uint32_t nRecordSize, off_t *pSize)
+{
+    char strPath[MAX_STORE_PATH+32];
+    STORE_HEADER myHeader;
+    struct stat st;
+    int fd;
+
+    StoreFilename(pStore, pName, strPath);
+    fd = open(strPath, (pStore->bWrite ? (O_RDWR | O_CREAT) : O_RDONLY), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open \"%s\":  %s\n", strPath, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* A new file just gets its header */
+    if ((st.st_size == 0) && (pStore->bWrite)) {
+        memset(&myHeader, 0, sizeof(myHeader));
+        myHeader.nMagic = STORE_MAGIC;
+        myHeader.nVersion = STORE_VERSION;
+        myHeader.nRecordSize = nRecordSize;
+        if (pwrite(fd, &myHeader, sizeof(myHeader), 0) != sizeof(myHeader)) {
+            close(fd);
+            return -1;
+        }
+        st.st_size = sizeof(myHeader);
+    }
+
+    if ((pread(fd, &myHeader, sizeof(myHeader), 0) != sizeof(myHeader)) ||
+        (myHeader.nMagic != STORE_MAGIC) || (myHeader.nVersion != STORE_VERSION) ||
+        (myHeader.nRecordSize != nRecordSize)) {
+        fprintf(stderr, "\"%s\" isn't a store file of this version!\n", strPath);
+        close(fd);
+        return -1;
+    }
+
+    *pSize = st.st_size - sizeof(STORE_HEADER);
+    return fd;
+}
+
+static int WriteStoreFile(const NEPTUNE_STORE *pStore, const char *pName, uint32_t nRecordSize,
+                            const void *pData, long nSize)
+{
+    char strPath[MAX_STORE_PATH+32];
+    char strTemp[MAX_STORE_PATH+64];
+    STORE_HEADER myHeader;
+    FILE *pFile;
+    int bOK;
+
+    memset(&myHeader, 0, sizeof(myHeader));
+    myHeader.nMagic = STORE_MAGIC;
+    myHeader.nVersion = STORE_VERSION;
+    myHeader.nRecordSize = nRecordSize;
+    myHeader.nNumJumps = pStore->nNumJumps;
+
+    /* Written to the side and renamed into place, so readers never see half of it */
+    StoreFilename(pStore, pName, strPath);
+    snprintf(strTemp, sizeof(strTemp), "%s.%ld", strPath, (long)getpid());
+    pFile = fopen(strTemp, "wb");
+    bOK = (pFile != NULL);
+    if (bOK) {
+        bOK = ((fwrite(&myHeader, sizeof(myHeader), 1, pFile) == 1) &&
+                ((nSize == 0) || (fwrite(pData, nSize, 1, pFile) == 1)));
+        if (fclose(pFile) != 0) bOK = FALSE;
+        if ((bOK) && (rename(strTemp, strPath) < 0)) bOK = FALSE;
+        if (!bOK) unlink(strTemp);
+    }
+    if (!bOK) fprintf(stderr, "Couldn't write \"%s\"!\n", strPath);
+
+    return bOK;
+}
+
+static void RemoveStore(const char *pPath)
+{
+    char strPath[MAX_STORE_PATH+32];
+    int i;
+
+    /* Just our own files, so a directory with anything else in it stays */
+    for (i=0; strStoreFiles[i]; i++) {
+        snprintf(strPath, sizeof(strPath), "%s/%s", pPath, strStoreFiles[i]);
+        unlink(strPath);
+    }
+    for (i=0; i<STORE_NUM_INDEXES; i++) {
+        snprintf(strPath, sizeof(strPath), "%s/%s", pPath, strIndexNames[i]);
+        unlink(strPath);
+    }
+    rmdir(pPath);
+}
+
+/* ========================================================================== */
+
+static unsigned long long JumpHash(const char *pSerialNo, uint32_t nJumpNumber)
+{
+    unsigned long long nHash;
+    int i;
+
+    /* FNV-1a of the serial and jump numbers */
+    nHash = FNV_OFFSET;
+    for (i=0; i<STORE_SERIAL_SIZE; i++) {
+        nHash ^= (uint8_t)pSerialNo[i];
+        nHash *= FNV_PRIME;
+    }
+    for (i=0; i<4; i++) {
+        nHash ^= (nJumpNumber >> (i*8)) & 0xFF;
+        nHash *= FNV_PRIME;
+    }
+    return nHash;
+}
+
+static uint32_t HashBytes(const uint8_t *pData, long nSize)
+{
+    uint32_t nHash;
+    long i;
+
+    /* FNV-1a, as the copies of a jump are only compared with each other */
+    nHash = FNV32_OFFSET;
+    for (i=0; i<nSize; i++) {
+        nHash ^= pData[i];
+        nHash *= FNV32_PRIME;
+    }
+    return nHash;
+}
+
+static STORE_SLOT *FindSlot(NEPTUNE_STORE *pStore, const char *pSerialNo, uint32_t nJumpNumber)
+{
+    STORE_SLOT *pSlot;
+    long i;
+
+    /* Linear probing */
+    i = JumpHash(pSerialNo, nJumpNumber) & (pStore->nNumSlots - 1);
+    while (TRUE) {
+        pSlot = &pStore->pSlots[i];
+        if (!pSlot->bUsed) return pSlot;
+        if ((pSlot->nJumpNumber == nJumpNumber) &&
+            (memcmp(pSlot->strSerialNo, pSerialNo, STORE_SERIAL_SIZE) == 0)) return pSlot;
+        i = (i + 1) & (pStore->nNumSlots - 1);
+    }
+}
+
+static int UpdateSlot(NEPTUNE_STORE *pStore, const STORE_JUMP *pJump, uint32_t nRecord, uint32_t nOldRecord)
+{
+    STORE_SLOT *pOldSlots;
+    STORE_SLOT *pSlot;
+    long nOldSlots;
+    long i;
+
+    /* Kept at most half full, doubling as it grows */
+    if ((pStore->nUsedSlots+1)*2 > pStore->nNumSlots) {
+        pOldSlots = pStore->pSlots;
+        nOldSlots = pStore->nNumSlots;
+        pStore->nNumSlots = ((nOldSlots) ? (nOldSlots * 2) : MIN_SLOTS);
+        pStore->pSlots = (STORE_SLOT *)calloc(pStore->nNumSlots, sizeof(STORE_SLOT));
+        if (!pStore->pSlots) {
+            pStore->pSlots = pOldSlots;
+            pStore->nNumSlots = nOldSlots;
+            return FALSE;
+        }
+        for (i=0; i<nOldSlots; i++) {
+            if (!pOldSlots[i].bUsed) continue;
+            *FindSlot(pStore, pOldSlots[i].strSerialNo, pOldSlots[i].nJumpNumber) = pOldSlots[i];
+        }
+        free(pOldSlots);
+    }
+
+    pSlot = FindSlot(pStore, pJump->strSerialNo, pJump->nJumpNumber);
+    if (!pSlot->bUsed) {
+        pStore->nUsedSlots++;
+        pSlot->nOldRecord = nOldRecord;
+        pSlot->nCopies = 0;
+        pSlot->nDiffers = 0;
+    } else {
+        /* What it disagrees with the copy before it on */
+        if ((pSlot->nFlags & pJump->nFlags & STORE_HAS_RECORD) && (pSlot->nRecordHash != pJump->nRecordHash))
+            pSlot->nDiffers |= STORE_HAS_RECORD;
+        if ((pSlot->nFlags & pJump->nFlags & STORE_HAS_PROFILE) && (pSlot->nProfileHash != pJump->nProfileHash))
+            pSlot->nDiffers |= STORE_HAS_PROFILE;
+    }
+    memcpy(pSlot->strSerialNo, pJump->strSerialNo, STORE_SERIAL_SIZE);
+    pSlot->nJumpType = pJump->nJumpType;
+    pSlot->bUsed = TRUE;
+    pSlot->nJumpNumber = pJump->nJumpNumber;
+    pSlot->nDate = pJump->nDate;
+    pSlot->nTime = pJump->nTime;
+    pSlot->nFlags = pJump->nFlags;
+    pSlot->nRecord = nRecord;
+    pSlot->nCopies++;
+    pSlot->nRecordHash = pJump->nRecordHash;
+    pSlot->nProfileHash = pJump->nProfileHash;
+    return TRUE;
+}
+
+static int LoadSlots(NEPTUNE_STORE *pStore)
+{
+    STORE_JUMP *pJumps;
+    uint32_t nRecord;
+    ssize_t nRead;
+    long nCount;
+    long i;
+
+    if (pStore->pSlots) return pStore->bAllSlots;
+    pJumps = (STORE_JUMP *)malloc(STORE_READ_JUMPS * sizeof(STORE_JUMP));
+    if (!pJumps) return FALSE;
+    pStore->bAllSlots = TRUE;
+
+    /* Later copies replace earlier ones, leaving the latest of each */
+    for (nRecord=0; nRecord<pStore->nNumJumps; nRecord += nCount) {
+        nCount = pStore->nNumJumps - nRecord;
+        if (nCount > STORE_READ_JUMPS) nCount = STORE_READ_JUMPS;
+        nRead = pread(pStore->fdJumps, pJumps, nCount * sizeof(STORE_JUMP),
+                        sizeof(STORE_HEADER) + (off_t)nRecord * sizeof(STORE_JUMP));
+        if (nRead != (ssize_t)(nCount * sizeof(STORE_JUMP))) break;
+        for (i=0; i<nCount; i++) {
+            if (!UpdateSlot(pStore, &pJumps[i], nRecord+i, STORE_NO_RECORD)) break;
+        }
+        if (i < nCount) break;
+    }
+    free(pJumps);
+
+    if (nRecord < pStore->nNumJumps) {
+        fprintf(stderr, "Couldn't read the jumps of the store \"%s\"!\n", pStore->strPath);
+        return FALSE;
+    }
+    if (!pStore->pSlots) {
+        /* An empty store, which still needs a (empty) table */
+        pStore->pSlots = (STORE_SLOT *)calloc(MIN_SLOTS, sizeof(STORE_SLOT));
+        if (!pStore->pSlots) return FALSE;
+        pStore->nNumSlots = MIN_SLOTS;
+    }
+    return TRUE;
+}
+
+static int LoadDevices(NEPTUNE_STORE *pStore, off_t nSize)
+{
+    STORE_DEVICE myDevice;
+    STORE_DEVICE *pDevice;
+    off_t nOffset;
+
+    /* Just the latest of each Neptune, of which there aren't many */
+    for (nOffset=0; nOffset+(off_t)sizeof(STORE_DEVICE) <= nSize; nOffset += sizeof(STORE_DEVICE)) {
+        if (pread(pStore->fdDevices, &myDevice, sizeof(myDevice), sizeof(STORE_HEADER) + nOffset) != sizeof(myDevice))
+            return FALSE;
+        pDevice = FindDevice(pStore, myDevice.strSerialNo);
+        if (!pDevice) {
+            pDevice = (STORE_DEVICE *)realloc(pStore->pDevices, (pStore->nNumDevices+1) * sizeof(STORE_DEVICE));
+            if (!pDevice) return FALSE;
+            pStore->pDevices = pDevice;
+            pDevice = &pStore->pDevices[pStore->nNumDevices++];
+        }
+        *pDevice = myDevice;
+    }
+    pStore->nDevicesSize = nOffset;         /* Where the next one goes */
+    return TRUE;
+}
+
+static STORE_DEVICE *FindDevice(const NEPTUNE_STORE *pStore, const char *pSerialNo)
+{
+    long i;
+
+    for (i=0; i<pStore->nNumDevices; i++) {
+        if (memcmp(pStore->pDevices[i].strSerialNo, pSerialNo, STORE_SERIAL_SIZE) == 0)
+            return &pStore->pDevices[i];
+    }
+    return NULL;
+}
+
+/* ========================================================================== */
+
+static int BloomJump(NEPTUNE_STORE *pStore, const char *pSerialNo, uint32_t nJumpNumber, int bAdd)
+{
+    unsigned long long nHash;
+    uint32_t nHash1, nHash2;
+    uint32_t nBit;
+    int bMaybe;
+    int i;
+
+    /* Each bit from the two halves of the hash (Kirsch and Mitzenmacher) */
+    nHash = JumpHash(pSerialNo, nJumpNumber);
+    nHash1 = (uint32_t)nHash;
+    nHash2 = (uint32_t)(nHash >> 32) | 1;
+    bMaybe = TRUE;
+    for (i=0; i<BLOOM_HASHES; i++) {
+        nBit = (nHash1 + i*nHash2) & (pStore->nBloomBits - 1);
+        if (!(pStore->pBloom[nBit >> 3] & (1 << (nBit & 7)))) {
+            if (!bAdd) return FALSE;
+            bMaybe = FALSE;
+            pStore->pBloom[nBit >> 3] |= (1 << (nBit & 7));
+        }
+    }
+    return bMaybe;
+}
+
+static int BuildBloom(NEPTUNE_STORE *pStore, const STORE_INDEX_ENTRY *pEntries, long nCount)
+{
+    uint32_t nBits;
+    long i;
+
+    nBits = MIN_BLOOM_BITS;
+    while ((nBits < 0x80000000ul) && (nBits < (unsigned long)nCount * BLOOM_BITS_PER_JUMP))
+        nBits *= 2;
+    free(pStore->pBloom);
+    pStore->pBloom = (uint8_t *)calloc(nBits / 8, 1);
+    pStore->nBloomBits = nBits;
+    if (!pStore->pBloom) return FALSE;
+
+    /* serial.idx keys are the serial number then the jump number */
+    for (i=0; i<nCount; i++)
+        BloomJump(pStore, (const char *)pEntries[i].key, GetBE32(&pEntries[i].key[STORE_SERIAL_SIZE]), TRUE);
+    return TRUE;
+}
+
+static int LoadBloom(NEPTUNE_STORE *pStore)
+{
+    char strPath[MAX_STORE_PATH+32];
+    STORE_HEADER myHeader;
+    struct stat st;
+    off_t nSize;
+    int bOK;
+    int fd;
+
+    /* bloom.dat goes with serial.idx, otherwise it's built from it (and saved) */
+    StoreFilename(pStore, "bloom.dat", strPath);
+    fd = open(strPath, O_RDONLY);
+    if (fd >= 0) {
+        bOK = FALSE;
+        nSize = 0;
+        if ((fstat(fd, &st) == 0) && (read(fd, &myHeader, sizeof(myHeader)) == sizeof(myHeader)) &&
+            (myHeader.nMagic == STORE_MAGIC) && (myHeader.nVersion == STORE_VERSION) &&
+            (myHeader.nRecordSize == 1) && (myHeader.nNumJumps == pStore->nNumJumps)) {
+            nSize = st.st_size - sizeof(STORE_HEADER);
+        }
+        if ((nSize*8 >= MIN_BLOOM_BITS) && (nSize*8 <= 0x80000000l) && ((nSize & (nSize-1)) == 0)) {
+            pStore->pBloom = (uint8_t *)malloc(nSize);
+            pStore->nBloomBits = nSize*8;
+            bOK = ((pStore->pBloom) && (read(fd, pStore->pBloom, nSize) == nSize));
+        }
+        close(fd);
+        if (bOK) return TRUE;
+    }
+
+    if (!BuildBloom(pStore, pStore->pSerialIndex, pStore->nSerialEntries)) return FALSE;
+    WriteStoreFile(pStore, "bloom.dat", 1, pStore->pBloom, pStore->nBloomBits / 8);
+    return TRUE;
+}
+
+static int FindStored(NEPTUNE_STORE *pStore, const STORE_JUMP *pJump, STORE_JUMP *pEarlier, uint32_t *pOldRecord)
+{
+    STORE_SLOT *pSlot;
+    uint8_t key[STORE_KEY_SIZE];
+    long nEntry;
+
+    /* Added since opening, or with every jump loaded */
+    *pOldRecord = STORE_NO_RECORD;
+    pSlot = FindSlot(pStore, pJump->strSerialNo, pJump->nJumpNumber);
+    if (pSlot->bUsed) return ReadStoreJump(pStore, pSlot->nRecord, pEarlier);
+    if (pStore->bAllSlots) return FALSE;
+
+    /* Otherwise the Bloom filter says it's new, or it's looked up in serial.idx */
+    if (!BloomJump(pStore, pJump->strSerialNo, pJump->nJumpNumber, FALSE)) return FALSE;
+    memset(key, 0, sizeof(key));
+    memcpy(key, pJump->strSerialNo, STORE_SERIAL_SIZE);
+    PutBE32(&key[STORE_SERIAL_SIZE], pJump->nJumpNumber);
+    nEntry = FindKey(pStore->pSerialIndex, pStore->nSerialEntries, key);
+    if ((nEntry >= pStore->nSerialEntries) ||
+        (memcmp(pStore->pSerialIndex[nEntry].key, key, STORE_KEY_SIZE) != 0)) return FALSE;
+    *pOldRecord = pStore->pSerialIndex[nEntry].nRecord;
+    return ReadStoreJump(pStore, *pOldRecord, pEarlier);
+}
+
+/* ========================================================================== */
+
+int IsStore(const char *pPath)
+{
+    char strPath[MAX_STORE_PATH+32];
+    struct stat st;
+
+    if ((stat(pPath, &st) < 0) || (!S_ISDIR(st.st_mode))) return FALSE;
+    snprintf(strPath, sizeof(strPath), "%s/jumps.dat", pPath);
+    return (stat(strPath, &st) == 0);
+}
+
+NEPTUNE_STORE *OpenStore(const char *pPath, int bWrite)
+{
+    NEPTUNE_STORE *pStore;
+    char strPath[MAX_STORE_PATH+32];
+    struct flock myLock;
+    off_t nSize;
+    int i;
+
+    if (strlen(pPath) >= MAX_STORE_PATH) return NULL;
+    if ((bWrite) && (mkdir(pPath, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "Couldn't create the store \"%s\":  %s\n", pPath, strerror(errno));
+        return NULL;
+    }
+
+    pStore = (NEPTUNE_STORE *)calloc(1, sizeof(NEPTUNE_STORE));
+    if (!pStore) return NULL;
+    strcpy(pStore->strPath, pPath);
+    pStore->bWrite = bWrite;
+    pStore->fdLock = -1;
+    pStore->fdDevices = -1;
+    pStore->fdJumps = -1;
+    pStore->fdProfiles = -1;
+
+    /* One writer at a time, waiting for any other to finish */
+    if (bWrite) {
+        StoreFilename(pStore, "lock", strPath);
+        pStore->fdLock = open(strPath, O_RDWR | O_CREAT, 0644);
+        memset(&myLock, 0, sizeof(myLock));
+        myLock.l_type = F_WRLCK;
+        myLock.l_whence = SEEK_SET;
+        if ((pStore->fdLock < 0) || (fcntl(pStore->fdLock, F_SETLKW, &myLock) < 0)) {
+            fprintf(stderr, "Couldn't lock the store \"%s\":  %s\n", pPath, strerror(errno));
+            CloseStore(pStore);
+            return NULL;
+        }
+    }
+
+    /* The profiles before the jumps, so there's a profile for every jump we see */
+    pStore->fdProfiles = OpenStoreFile(pStore, "profiles.dat", 1, &pStore->nProfilesSize);
+    if (pStore->fdProfiles >= 0) pStore->fdDevices = OpenStoreFile(pStore, "devices.dat", sizeof(STORE_DEVICE), &nSize);
+    if ((pStore->fdDevices < 0) || (!LoadDevices(pStore, nSize))) {
+        CloseStore(pStore);
+        return NULL;
+    }
+    pStore->fdJumps = OpenStoreFile(pStore, "jumps.dat", sizeof(STORE_JUMP), &nSize);
+    if (pStore->fdJumps < 0) {
+        CloseStore(pStore);
+        return NULL;
+    }
+    pStore->nNumJumps = nSize / sizeof(STORE_JUMP);        /* Any part of a record left by a crash is written over */
+    pStore->nOpenJumps = pStore->nNumJumps;
+
+    /* Adding jumps needs the latest copies, for their profiles and the indexes.  With
+        the indexes up to date, they're found through serial.idx and its Bloom filter,
+        and just the jumps added are kept.  Otherwise they're all loaded */
+    if (bWrite) {
+        for (i=0; ((i<STORE_NUM_INDEXES) && (IndexFresh(pStore, i))); i++)
+            ;
+        if (i == STORE_NUM_INDEXES)
+            pStore->pSerialIndex = MapIndex(pStore, STORE_INDEX_SERIAL, pStore->nNumJumps,
+                                                &pStore->nSerialEntries, &pStore->nSerialMapSize);
+        if ((pStore->pSerialIndex) && (LoadBloom(pStore)) &&
+            ((pStore->pSlots = (STORE_SLOT *)calloc(MIN_SLOTS, sizeof(STORE_SLOT))) != NULL)) {
+            pStore->nNumSlots = MIN_SLOTS;
+        } else if (!LoadSlots(pStore)) {
+            CloseStore(pStore);
+            return NULL;
+        }
+    }
+
+    return pStore;
+}
+
+int CloseStore(NEPTUNE_STORE *pStore)
+{
+    STORE_INDEX_ENTRY *pEntries;
+    uint32_t *pReplaced;
+    long nReplaced;
+    long nCount;
+    long i;
+    int bOK;
+
+    bOK = TRUE;
+    if ((pStore->bWrite) && (pStore->fdJumps >= 0) && (pStore->pSlots)) {
+        /* Without every jump loaded, the indexes are merged with the jumps added,
+            dropping the copies they replaced */
+        pReplaced = NULL;
+        nReplaced = 0;
+        if (!pStore->bAllSlots) {
+            pReplaced = (uint32_t *)malloc((pStore->nUsedSlots+1) * sizeof(uint32_t));
+            if (!pReplaced) bOK = FALSE;
+            for (i=0; ((bOK) && (i<pStore->nNumSlots)); i++) {
+                if ((pStore->pSlots[i].bUsed) && (pStore->pSlots[i].nOldRecord != STORE_NO_RECORD))
+                    pReplaced[nReplaced++] = pStore->pSlots[i].nOldRecord;
+            }
+            if (bOK) qsort(pReplaced, nReplaced, sizeof(uint32_t), CompareRecords);
+        }
+
+        for (i=0; ((bOK) && (i<STORE_NUM_INDEXES)); i++) {
+            if (IndexFresh(pStore, i)) continue;
+            if (pStore->bAllSlots) {
+                pEntries = BuildIndex(pStore, i, &nCount);
+            } else {
+                pEntries = MergeIndex(pStore, i, pReplaced, nReplaced, &nCount);
+            }
+            bOK = ((pEntries) && (WriteStoreFile(pStore, strIndexNames[i], sizeof(STORE_INDEX_ENTRY),
+                                                    pEntries, nCount * sizeof(STORE_INDEX_ENTRY))));
+
+            /* The Bloom filter goes with serial.idx */
+            if ((bOK) && (i == STORE_INDEX_SERIAL) && (BuildBloom(pStore, pEntries, nCount)))
+                WriteStoreFile(pStore, "bloom.dat", 1, pStore->pBloom, pStore->nBloomBits / 8);
+            free(pEntries);
+        }
+        if (!bOK) fprintf(stderr, "Couldn't bring the indexes of the store \"%s\" up to date!\n", pStore->strPath);
+        free(pReplaced);
+    }
+
+    if (pStore->pSerialIndex) munmap((char *)pStore->pSerialIndex - sizeof(STORE_HEADER), pStore->nSerialMapSize);
+    for (i=0; i<STORE_NUM_INDEXES; i++) {
+        if (pStore->nIndexMapSize[i]) {
+            munmap((char *)pStore->pIndexes[i] - sizeof(STORE_HEADER), pStore->nIndexMapSize[i]);
+        } else {
+            free(pStore->pIndexes[i]);
+        }
+    }
+    if (pStore->pJumpsMap) munmap((void *)pStore->pJumpsMap, pStore->nJumpsMapSize);
+    if (pStore->pProfilesMap) munmap((void *)pStore->pProfilesMap, pStore->nProfilesMapSize);
+    if (pStore->fdJumps >= 0) close(pStore->fdJumps);
+    if (pStore->fdDevices >= 0) close(pStore->fdDevices);
+    if (pStore->fdProfiles >= 0) close(pStore->fdProfiles);
+    if (pStore->fdLock >= 0) close(pStore->fdLock);     /* Which releases the lock */
+    free(pStore->pBloom);
+    free(pStore->pSlots);
+    free(pStore->pDevices);
+    free(pStore);
+
+    return bOK;
+}
+
+/* ========================================================================== */
+
+static const uint8_t *MapStoreFile(int fd, off_t nSize, size_t *pMapSize)
+{
+    void *pMap;
+
+    /* With its header, which the offsets into it skip */
+    if ((nSize <= 0) || ((off_t)(size_t)(nSize + sizeof(STORE_HEADER)) != nSize + (off_t)sizeof(STORE_HEADER)))
+        return NULL;
+    *pMapSize = nSize + sizeof(STORE_HEADER);
+    pMap = mmap(NULL, *pMapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (pMap == MAP_FAILED) return NULL;
+    posix_madvise(pMap, *pMapSize, POSIX_MADV_WILLNEED);
+    return (const uint8_t *)pMap;
+}
+
+int LoadStore(NEPTUNE_STORE *pStore)
+{
+    int i;
+
+    if (pStore->bWrite) return FALSE;
+
+    /* Whatever can't be mapped, as on a 32-bit build with a store bigger than
+        it can address, is still read from its file */
+    pStore->pJumpsMap = MapStoreFile(pStore->fdJumps, (off_t)pStore->nNumJumps * sizeof(STORE_JUMP),
+                                        &pStore->nJumpsMapSize);
+    pStore->pProfilesMap = MapStoreFile(pStore->fdProfiles, pStore->nProfilesSize, &pStore->nProfilesMapSize);
+
+    for (i=0; i<STORE_NUM_INDEXES; i++) {
+        pStore->pIndexes[i] = LoadIndex(pStore, i, &pStore->nIndexEntries[i], &pStore->nIndexMapSize[i]);
+        if (!pStore->pIndexes[i]) {
+            fprintf(stderr, "Couldn't load the indexes of the store \"%s\"!\n", pStore->strPath);
+            return FALSE;
+        }
+    }
+
+    /* The slots were just needed to build any index that wasn't up to date */
+    free(pStore->pSlots);
+    pStore->pSlots = NULL;
+    pStore->nNumSlots = 0;
+    pStore->nUsedSlots = 0;
+    pStore->bAllSlots = FALSE;
+
+    return TRUE;
+}
+
+int StoreChanged(const NEPTUNE_STORE *pStore)
+{
+    char strPath[MAX_STORE_PATH+32];
+    struct stat stOpen;
+    struct stat stNow;
+
+    /* Compacting puts a new jumps.dat in its place */
+    StoreFilename(pStore, "jumps.dat", strPath);
+    if ((fstat(pStore->fdJumps, &stOpen) < 0) || (stat(strPath, &stNow) < 0)) return TRUE;
+    if ((stOpen.st_dev != stNow.st_dev) || (stOpen.st_ino != stNow.st_ino)) return TRUE;
+    return ((uint32_t)((stNow.st_size - sizeof(STORE_HEADER)) / sizeof(STORE_JUMP)) != pStore->nNumJumps);
+}
+
+int ReadStoreJump(const NEPTUNE_STORE *pStore, uint32_t nRecord, STORE_JUMP *pJump)
+{
+    off_t nOffset = sizeof(STORE_HEADER) + (off_t)nRecord * sizeof(STORE_JUMP);
+
+    if ((pStore->pJumpsMap) && (nOffset + sizeof(STORE_JUMP) <= pStore->nJumpsMapSize)) {
+        memcpy(pJump, &pStore->pJumpsMap[nOffset], sizeof(STORE_JUMP));
+        return TRUE;
+    }
+    return (pread(pStore->fdJumps, pJump, sizeof(STORE_JUMP), nOffset) == sizeof(STORE_JUMP));
+}
+
+/* ========================================================================== */
+
+void SetStoreSerialNo(char *pDest, const char *pSerialNo)
+{
+    int i;
+
+    /* Not necessarily NUL terminated when it fills the field */
+    for (i=0; (i<STORE_SERIAL_SIZE) && (pSerialNo[i]); i++) pDest[i] = pSerialNo[i];
+    for ( ; i<STORE_SERIAL_SIZE; i++) pDest[i] = 0;
+}
+
+/* ========================================================================== */
+
+void SetStoreJump(STORE_JUMP *pJump, const char *pSerialNo, const REC_FIELDS *pFields)
+{
+    const unsigned long *pValue = pFields->nValue;
+    unsigned long nYear;
+    long nNumBytes;
+
+    memset(pJump, 0, sizeof(STORE_JUMP));
+    SetStoreSerialNo(pJump->strSerialNo, pSerialNo);
+    pJump->nJumpNumber = pValue[RF_JUMP];
+    pJump->nJumpType = pValue[RF_JUMP_TYPE];
+    pJump->nFlags = STORE_HAS_RECORD;
+
+    nYear = pValue[RF_YEAR];
+    if (nYear < 100) nYear += 2000;
+    pJump->nDate = nYear*10000 + pValue[RF_MONTH]*100 + pValue[RF_DAY];
+    pJump->nTime = pValue[RF_HOUR]*100 + pValue[RF_MINUTE];
+
+    /* The record without its checksum, cut to fit should a later data version be longer */
+    nNumBytes = pFields->nNumBytes - 1;
+    if (nNumBytes > STORE_JUMP_BYTES) nNumBytes = STORE_JUMP_BYTES;
+    if (nNumBytes < 2) nNumBytes = 0;
+    memcpy(pJump->jump, pFields->bytes, nNumBytes);
+    if (nNumBytes) pJump->jump[0] = nNumBytes - 1;
+}
+
+int StoreSession(NEPTUNE_STORE *pStore, const STORE_SESSION *pSession)
+{
+    STORE_DEVICE *pDevice;
+    STORE_JUMP *pJump;
+    STORE_JUMP *pKept;
+    STORE_JUMP myEarlier;
+    uint32_t *pOldRecords;
+    uint32_t nOldRecord;
+    uint8_t *pProfiles;
+    uint8_t nOwnFlags;
+    uint8_t nDiffers;
+    long nNumKept;
+    long nProfilesSize;
+    off_t nSize;
+    long i;
+    int bOK;
+
+    if (!pStore->bWrite) return FALSE;
+
+    /* The device, when it's new or has changed */
+    if (pSession->bHaveDevice) {
+        pDevice = FindDevice(pStore, pSession->strSerialNo);
+        if ((!pDevice) || (memcmp(pDevice, &pSession->device, sizeof(STORE_DEVICE)) != 0)) {
+            if (pwrite(pStore->fdDevices, &pSession->device, sizeof(STORE_DEVICE),
+                        sizeof(STORE_HEADER) + pStore->nDevicesSize) != sizeof(STORE_DEVICE)) return FALSE;
+            if (!pDevice) {
+                pDevice = (STORE_DEVICE *)realloc(pStore->pDevices, (pStore->nNumDevices+1) * sizeof(STORE_DEVICE));
+                if (!pDevice) return FALSE;
+                pStore->pDevices = pDevice;
+                pDevice = &pStore->pDevices[pStore->nNumDevices++];
+            }
+            *pDevice = pSession->device;
+            pStore->nDevicesSize += sizeof(STORE_DEVICE);
+        }
+    }
+
+    if (pSession->nNumJumps == 0) return TRUE;
+    pKept = (STORE_JUMP *)malloc(pSession->nNumJumps * sizeof(STORE_JUMP));
+    pOldRecords = (uint32_t *)malloc(pSession->nNumJumps * sizeof(uint32_t));
+    pProfiles = (uint8_t *)malloc(((pSession->bEncoded) ? pSession->nProfilesSize : EncodedSize(pSession->nProfilesSize)) + 1);
+    if ((!pKept) || (!pOldRecords) || (!pProfiles)) {
+        free(pKept);
+        free(pOldRecords);
+        free(pProfiles);
+        return FALSE;
+    }
+
+    nNumKept = 0;
+    nProfilesSize = 0;
+    for (i=0; i<pSession->nNumJumps; i++) {
+        pJump = &pKept[nNumKept];
+        *pJump = pSession->pJumps[i];
+        nOwnFlags = pJump->nFlags;
+        pJump->nRecordHash = ((nOwnFlags & STORE_HAS_RECORD) ? HashBytes(pJump->jump, pJump->jump[0] + 1) : 0);
+        if (!pSession->bEncoded) {
+            pJump->nProfileHash = ((nOwnFlags & STORE_HAS_PROFILE) ?
+                        HashBytes(&pSession->pProfiles[pJump->nProfileOffset], pJump->nProfileSize) : 0);
+        }
+
+        if (FindStored(pStore, pJump, &myEarlier, &nOldRecord)) {
+            /* Anything this download didn't have comes from the copy before it */
+            if ((!(pJump->nFlags & STORE_HAS_PROFILE)) && (myEarlier.nFlags & STORE_HAS_PROFILE)) {
+                pJump->nFlags |= STORE_HAS_PROFILE;
+                pJump->nProfileSize = myEarlier.nProfileSize;
+                pJump->nNumPoints = myEarlier.nNumPoints;
+                pJump->nProfileHash = myEarlier.nProfileHash;
+                pJump->nProfileOffset = myEarlier.nProfileOffset;
+            }
+            if ((!(pJump->nFlags & STORE_HAS_RECORD)) && (myEarlier.nFlags & STORE_HAS_RECORD)) {
+                pJump->nFlags |= STORE_HAS_RECORD;
+                pJump->nJumpType = myEarlier.nJumpType;
+                pJump->nDate = myEarlier.nDate;
+                pJump->nTime = myEarlier.nTime;
+                pJump->nRecordHash = myEarlier.nRecordHash;
+                memcpy(pJump->jump, myEarlier.jump, sizeof(pJump->jump));
+            }
+
+            /* The same again isn't added, but one that disagrees replaces it */
+            if ((pJump->nFlags == myEarlier.nFlags) && (pJump->nRecordHash == myEarlier.nRecordHash) &&
+                (pJump->nProfileHash == myEarlier.nProfileHash)) {
+                pStore->nSkipped++;
+                continue;
+            }
+            nDiffers = 0;
+            if ((nOwnFlags & myEarlier.nFlags & STORE_HAS_RECORD) && (pJump->nRecordHash != myEarlier.nRecordHash))
+                nDiffers |= STORE_HAS_RECORD;
+            if ((nOwnFlags & myEarlier.nFlags & STORE_HAS_PROFILE) && (pJump->nProfileHash != myEarlier.nProfileHash))
+                nDiffers |= STORE_HAS_PROFILE;
+            if (nDiffers) {
+                pStore->nConflicts++;
+                if (pStore->pReport)
+                    fprintf(pStore->pReport, "Jump %lu of %.*s has a different %s than the copy in the store, which it replaces\n",
+                                (unsigned long)pJump->nJumpNumber, STORE_SERIAL_SIZE, pJump->strSerialNo,
+                                ((nDiffers == STORE_HAS_RECORD) ? "record" :
+                                 ((nDiffers == STORE_HAS_PROFILE) ? "profile" : "record and profile")));
+            }
+        }
+
+        /* Its own profile moves up to follow the others kept, encoded */
+        if (nOwnFlags & STORE_HAS_PROFILE) {
+            if (pSession->bEncoded) {
+                memcpy(&pProfiles[nProfilesSize], &pSession->pProfiles[pJump->nProfileOffset], pJump->nProfileSize);
+            } else {
+                pJump->nProfileSize = EncodeProfile(&pSession->pProfiles[pJump->nProfileOffset], pJump->nProfileSize,
+                                                    &pProfiles[nProfilesSize]);
+            }
+            pJump->nProfileOffset = pStore->nProfilesSize + nProfilesSize;
+            nProfilesSize += pJump->nProfileSize;
+            pStore->nAddedProfiles++;
+        }
+        pOldRecords[nNumKept++] = nOldRecord;
+    }
+
+    /* Then the profiles, then the jumps that point to them */
+    bOK = TRUE;
+    if (nProfilesSize) {
+        bOK = (pwrite(pStore->fdProfiles, pProfiles, nProfilesSize,
+                        sizeof(STORE_HEADER) + pStore->nProfilesSize) == nProfilesSize);
+    }
+    if ((bOK) && (nNumKept)) {
+        nSize = nNumKept * sizeof(STORE_JUMP);
+        bOK = (pwrite(pStore->fdJumps, pKept, nSize,
+                        sizeof(STORE_HEADER) + (off_t)pStore->nNumJumps * sizeof(STORE_JUMP)) == nSize);
+    }
+    if (bOK) {
+        pStore->nProfilesSize += nProfilesSize;
+        for (i=0; ((bOK) && (i<nNumKept)); i++) {
+            bOK = UpdateSlot(pStore, &pKept[i], pStore->nNumJumps + i, pOldRecords[i]);
+            if (pStore->pBloom) BloomJump(pStore, pKept[i].strSerialNo, pKept[i].nJumpNumber, TRUE);
+        }
+        pStore->nNumJumps += nNumKept;
+        pStore->nAdded += nNumKept;
+    }
+
+    free(pKept);
+    free(pOldRecords);
+    free(pProfiles);
+    return bOK;
+}
+
+/* ========================================================================== */
+
+static void PutBE32(uint8_t *p, uint32_t n)
+{
+    p[0] = (n >> 24) & 0xFF;
+    p[1] = (n >> 16) & 0xFF;
+    p[2] = (n >> 8) & 0xFF;
+    p[3] = n & 0xFF;
+}
+
+static uint32_t GetBE32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void MakeKey(int nIndex, const STORE_SLOT *pSlot, uint8_t *pKey)
+{
+    /* Numbers are big-endian, so the keys sort in order with memcmp() */
+    memset(pKey, 0, STORE_KEY_SIZE);
+    switch (nIndex) {
+        case STORE_INDEX_SERIAL:
+            memcpy(pKey, pSlot->strSerialNo, STORE_SERIAL_SIZE);
+            PutBE32(&pKey[STORE_SERIAL_SIZE], pSlot->nJumpNumber);
+            break;
+        case STORE_INDEX_JUMP:
+            PutBE32(pKey, pSlot->nJumpNumber);
+            memcpy(&pKey[4], pSlot->strSerialNo, STORE_SERIAL_SIZE);
+            break;
+        case STORE_INDEX_DATE:
+            PutBE32(pKey, pSlot->nDate);
+            pKey[4] = (pSlot->nTime >> 8) & 0xFF;
+            pKey[5] = pSlot->nTime & 0xFF;
+            memcpy(&pKey[6], pSlot->strSerialNo, STORE_SERIAL_SIZE);
+            break;
+        case STORE_INDEX_TYPE:
+            pKey[0] = pSlot->nJumpType;
+            memcpy(&pKey[1], pSlot->strSerialNo, STORE_SERIAL_SIZE);
+            PutBE32(&pKey[1+STORE_SERIAL_SIZE], pSlot->nJumpNumber);
+            break;
+    }
+}
+
+static long FindKey(const STORE_INDEX_ENTRY *pEntries, long nCount, const uint8_t *pKey)
+{
+    long nLow, nHigh, nMid;
+
+    /* First entry at or after the key */
+    nLow = 0;
+    nHigh = nCount;
+    while (nLow < nHigh) {
+        nMid = (nLow + nHigh) / 2;
+        if (memcmp(pEntries[nMid].key, pKey, STORE_KEY_SIZE) < 0) {
+            nLow = nMid + 1;
+        } else {
+            nHigh = nMid;
+        }
+    }
+    return nLow;
+}
+
+static int CompareEntries(const void *p1, const void *p2)
+{
+    const STORE_INDEX_ENTRY *pEntry1 = (const STORE_INDEX_ENTRY *)p1;
+    const STORE_INDEX_ENTRY *pEntry2 = (const STORE_INDEX_ENTRY *)p2;
+    int n;
+
+    n = memcmp(pEntry1->key, pEntry2->key, STORE_KEY_SIZE);
+    if (n) return n;
+    return ((pEntry1->nRecord < pEntry2->nRecord) ? -1 : (pEntry1->nRecord > pEntry2->nRecord));
+}
+
+static int CompareJumps(const void *p1, const void *p2)
+{
+    const STORE_JUMP *pJump1 = (const STORE_JUMP *)p1;
+    const STORE_JUMP *pJump2 = (const STORE_JUMP *)p2;
+    int n;
+
+    n = memcmp(pJump1->strSerialNo, pJump2->strSerialNo, STORE_SERIAL_SIZE);
+    if (n) return n;
+    return ((pJump1->nJumpNumber < pJump2->nJumpNumber) ? -1 : (pJump1->nJumpNumber > pJump2->nJumpNumber));
+}
+
+static int CompareRecords(const void *p1, const void *p2)
+{
+    uint32_t nRecord1 = *(const uint32_t *)p1;
+    uint32_t nRecord2 = *(const uint32_t *)p2;
+
+    return ((nRecord1 < nRecord2) ? -1 : (nRecord1 > nRecord2));
+}
+
+static STORE_INDEX_ENTRY *BuildIndex(NEPTUNE_STORE *pStore, int nIndex, long *pCount)
+{
+    STORE_INDEX_ENTRY *pEntries;
+    long nCount;
+    long i;
+
+    pEntries = (STORE_INDEX_ENTRY *)malloc((pStore->nUsedSlots+1) * sizeof(STORE_INDEX_ENTRY));
+    if (!pEntries) return NULL;
+
+    nCount = 0;
+    for (i=0; i<pStore->nNumSlots; i++) {
+        if (!pStore->pSlots[i].bUsed) continue;
+        MakeKey(nIndex, &pStore->pSlots[i], pEntries[nCount].key);
+        pEntries[nCount].nRecord = pStore->pSlots[i].nRecord;
+        nCount++;
+    }
+    qsort(pEntries, nCount, sizeof(STORE_INDEX_ENTRY), CompareEntries);
+
+    *pCount = nCount;
+    return pEntries;
+}
+
+static STORE_INDEX_ENTRY *MergeIndex(NEPTUNE_STORE *pStore, int nIndex, const uint32_t *pReplaced,
+                                        long nReplaced, long *pCount)
+{
+    STORE_INDEX_ENTRY *pOld;
+    STORE_INDEX_ENTRY *pNew;
+    STORE_INDEX_ENTRY *pEntries;
+    long nOld, nNew;
+    long nMapSize;
+    long nCount;
+    long i, j;
+
+    /* The index as it was opened, and the jumps added since, both sorted */
+    pOld = MapIndex(pStore, nIndex, pStore->nOpenJumps, &nOld, &nMapSize);
+    if (!pOld) return NULL;
+    pNew = BuildIndex(pStore, nIndex, &nNew);
+    pEntries = (STORE_INDEX_ENTRY *)malloc((nOld + nNew + 1) * sizeof(STORE_INDEX_ENTRY));
+    if ((!pNew) || (!pEntries)) {
+        munmap((char *)pOld - sizeof(STORE_HEADER), nMapSize);
+        free(pNew);
+        free(pEntries);
+        return NULL;
+    }
+
+    nCount = 0;
+    i = 0;
+    j = 0;
+    while ((i < nOld) || (j < nNew)) {
+        if ((i < nOld) && (bsearch(&pOld[i].nRecord, pReplaced, nReplaced, sizeof(uint32_t), CompareRecords))) {
+            i++;
+        } else if ((j >= nNew) || ((i < nOld) && (CompareEntries(&pOld[i], &pNew[j]) < 0))) {
+            pEntries[nCount++] = pOld[i++];
+        } else {
+            pEntries[nCount++] = pNew[j++];
+        }
+    }
+
+    munmap((char *)pOld - sizeof(STORE_HEADER), nMapSize);
+    free(pNew);
+    *pCount = nCount;
+    return pEntries;
+}
+
+static int IndexFresh(const NEPTUNE_STORE *pStore, int nIndex)
+{
+    char strPath[MAX_STORE_PATH+32];
+    STORE_HEADER myHeader;
+    int fd;
+    int bFresh;
+
+    StoreFilename(pStore, strIndexNames[nIndex], strPath);
+    fd = open(strPath, O_RDONLY);
+    if (fd < 0) return FALSE;
+    bFresh = ((read(fd, &myHeader, sizeof(myHeader)) == sizeof(myHeader)) &&
+                (myHeader.nMagic == STORE_MAGIC) && (myHeader.nVersion == STORE_VERSION) &&
+                (myHeader.nRecordSize == sizeof(STORE_INDEX_ENTRY)) &&
+                (myHeader.nNumJumps == pStore->nNumJumps));
+    close(fd);
+    return bFresh;
+}
+
+static STORE_INDEX_ENTRY *MapIndex(const NEPTUNE_STORE *pStore, int nIndex, uint32_t nNumJumps,
+                                        long *pCount, long *pMapSize)
+{
+    char strPath[MAX_STORE_PATH+32];
+    const STORE_HEADER *pHeader;
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    /* Just when it was built from nNumJumps jumps */
+    StoreFilename(pStore, strIndexNames[nIndex], strPath);
+    fd = open(strPath, O_RDONLY);
+    if (fd < 0) return NULL;
+    pMap = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (st.st_size >= (off_t)sizeof(STORE_HEADER)) && (st.st_size <= 0x7FFFFFFFl))
+        pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) return NULL;
+
+    pHeader = (const STORE_HEADER *)pMap;
+    if ((pHeader->nMagic != STORE_MAGIC) || (pHeader->nVersion != STORE_VERSION) ||
+        (pHeader->nRecordSize != sizeof(STORE_INDEX_ENTRY)) || (pHeader->nNumJumps != nNumJumps)) {
+        munmap(pMap, st.st_size);
+        return NULL;
+    }
+    *pMapSize = st.st_size;
+    *pCount = (st.st_size - sizeof(STORE_HEADER)) / sizeof(STORE_INDEX_ENTRY);
+    return (STORE_INDEX_ENTRY *)((char *)pMap + sizeof(STORE_HEADER));
+}
+
+static STORE_INDEX_ENTRY *LoadIndex(NEPTUNE_STORE *pStore, int nIndex, long *pCount, long *pMapSize)
+{
+    STORE_INDEX_ENTRY *pEntries;
+
+    /* Mapped as is when it's up to date, otherwise built (into memory) */
+    pEntries = MapIndex(pStore, nIndex, pStore->nNumJumps, pCount, pMapSize);
+    if (pEntries) return pEntries;
+    *pMapSize = 0;
+    if (!LoadSlots(pStore)) return NULL;
+    return BuildIndex(pStore, nIndex, pCount);
+}
+
+/* ========================================================================== */
+
+static int MatchQuery(const STORE_QUERY *pQuery, const STORE_JUMP *pJump)
+{
+    if ((pQuery->strSerialNo[0]) && (strncmp(pJump->strSerialNo, pQuery->strSerialNo, STORE_SERIAL_SIZE) != 0))
+        return FALSE;
+    if ((pQuery->nJumpNumber) && (pJump->nJumpNumber != pQuery->nJumpNumber)) return FALSE;
+    if ((pQuery->nFromDate) && (pJump->nDate < pQuery->nFromDate)) return FALSE;
+    if ((pQuery->nToDate) && (pJump->nDate > pQuery->nToDate)) return FALSE;
+    if ((pQuery->nJumpType >= 0) && (pJump->nJumpType != pQuery->nJumpType)) return FALSE;
+    return TRUE;
+}
+
+long QueryStore(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery, STORE_JUMP **ppJumps)
+{
+    STORE_INDEX_ENTRY *pEntries;
+    STORE_SLOT mySlot;
+    STORE_JUMP *pJumps;
+    STORE_JUMP *pNew;
+    uint8_t prefix[STORE_KEY_SIZE];
+    int nPrefix;
+    int nIndex;
+    long nEntries;
+    long nMapSize;
+    long nFound;
+    long nAlloc;
+    long i;
+    int bOK;
+
+    /* The index of the most selective part of the query, and the start of its keys */
+    memset(&mySlot, 0, sizeof(mySlot));
+    if (pQuery->strSerialNo[0]) {
+        nIndex = STORE_INDEX_SERIAL;
+        SetStoreSerialNo(mySlot.strSerialNo, pQuery->strSerialNo);
+        mySlot.nJumpNumber = pQuery->nJumpNumber;       /* Straight to the one jump, if it's asked for */
+        nPrefix = STORE_SERIAL_SIZE + ((pQuery->nJumpNumber) ? 4 : 0);
+    } else if (pQuery->nJumpNumber) {
+        nIndex = STORE_INDEX_JUMP;
+        mySlot.nJumpNumber = pQuery->nJumpNumber;
+        nPrefix = 4;
+    } else if ((pQuery->nFromDate) || (pQuery->nToDate)) {
+        nIndex = STORE_INDEX_DATE;
+        mySlot.nDate = pQuery->nFromDate;
+        nPrefix = 0;                    /* A range, that ends at nToDate */
+    } else if (pQuery->nJumpType >= 0) {
+        nIndex = STORE_INDEX_TYPE;
+        mySlot.nJumpType = pQuery->nJumpType;
+        nPrefix = 1;
+    } else {
+        nIndex = STORE_INDEX_SERIAL;
+        nPrefix = 0;
+    }
+    MakeKey(nIndex, &mySlot, prefix);
+
+    if (pStore->pIndexes[nIndex]) {
+        pEntries = pStore->pIndexes[nIndex];
+        nEntries = pStore->nIndexEntries[nIndex];
+        nMapSize = 0;
+    } else {
+        pEntries = LoadIndex(pStore, nIndex, &nEntries, &nMapSize);
+        if (!pEntries) return -1;
+    }
+
+    pJumps = NULL;
+    nFound = 0;
+    nAlloc = 0;
+    bOK = TRUE;
+    for (i=FindKey(pEntries, nEntries, prefix); i<nEntries; i++) {
+        if ((nPrefix) && (memcmp(pEntries[i].key, prefix, nPrefix) != 0)) break;
+        if (nFound >= nAlloc) {
+            nAlloc = ((nAlloc) ? (nAlloc * 2) : 256);
+            pNew = (STORE_JUMP *)realloc(pJumps, nAlloc * sizeof(STORE_JUMP));
+            if (!pNew) {
+                bOK = FALSE;
+                break;
+            }
+            pJumps = pNew;
+        }
+        if (!ReadStoreJump(pStore, pEntries[i].nRecord, &pJumps[nFound])) {
+            bOK = FALSE;
+            break;
+        }
+        if ((nIndex == STORE_INDEX_DATE) && (pQuery->nToDate) && (pJumps[nFound].nDate > pQuery->nToDate)) break;
+        if (MatchQuery(pQuery, &pJumps[nFound])) nFound++;
+    }
+
+    if (pEntries == pStore->pIndexes[nIndex]) {
+        /* Kept by LoadStore() */
+    } else if (nMapSize) {
+        munmap((char *)pEntries - sizeof(STORE_HEADER), nMapSize);
+    } else {
+        free(pEntries);
+    }
+    if (!bOK) {
+        fprintf(stderr, "Couldn't read the jumps of the store \"%s\"!\n", pStore->strPath);
+        free(pJumps);
+        return -1;
+    }
+
+    qsort(pJumps, nFound, sizeof(STORE_JUMP), CompareJumps);
+    *ppJumps = pJumps;
+    return nFound;
+}
+
+/* ========================================================================== */
+
+static uint32_t ZigZag(int32_t nValue)
+{
+    return ((uint32_t)nValue << 1) ^ (uint32_t)(nValue >> 31);
+}
+
+static int32_t UnZigZag(uint32_t nValue)
+{
+    return (int32_t)(nValue >> 1) ^ -(int32_t)(nValue & 1);
+}
+
+static uint32_t PutVarint(uint8_t *p, uint32_t nValue)
+{
+    uint32_t n;
+
+    /* 7 bits at a time, least significant first, with the high bit on all but the last */
+    for (n=0; nValue >= 0x80; nValue >>= 7) p[n++] = (nValue & 0x7F) | 0x80;
+    p[n++] = nValue;
+    return n;
+}
+
+static int GetVarint(STORE_DECODER *pDecoder, uint32_t *pValue)
+{
+    uint32_t nValue;
+    int nShift;
+    uint8_t c;
+
+    nValue = 0;
+    for (nShift=0; nShift<35; nShift += 7) {
+        if (pDecoder->nPos >= pDecoder->nSize) return FALSE;
+        c = pDecoder->pCodes[pDecoder->nPos++];
+        nValue |= (uint32_t)(c & 0x7F) << nShift;
+        if (!(c & 0x80)) {
+            *pValue = nValue;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static uint32_t EncodeProfile(const uint8_t *pProfile, uint32_t nSize, uint8_t *pCodes)
+{
+    const uint8_t *p;
+    uint32_t nPos;
+    uint32_t nOut;
+    uint32_t nRun;
+    uint16_t nTime;
+    uint16_t nAltitude;
+    int32_t nStep;
+    int32_t nDelta;
+    int32_t nClimb;
+
+    nOut = 0;
+    nRun = 0;
+    nTime = 0;
+    nAltitude = 0;
+    nStep = 0;
+    for (nPos=0; ((nPos < nSize) && (nPos + pProfile[nPos] + 1 <= nSize)); nPos += pProfile[nPos] + 1) {
+        p = &pProfile[nPos];
+        if (p[0] == 0) break;
+        if ((p[0] == 5) && (p[1] == 6)) {
+            /* A datapoint, from the one before */
+            nDelta = (int16_t)(uint16_t)((p[4] | (p[5] << 8)) - nTime);
+            nClimb = (int16_t)(uint16_t)((p[2] | (p[3] << 8)) - nAltitude);
+            nTime = p[4] | (p[5] << 8);
+            nAltitude = p[2] | (p[3] << 8);
+            if ((nDelta == nStep) && (nClimb == 0)) {
+                nRun++;
+                continue;
+            }
+            if (nRun) nOut += PutVarint(&pCodes[nOut], (nRun << 1) | 1);
+            nRun = 0;
+            nOut += PutVarint(&pCodes[nOut], (ZigZag(nDelta - nStep) + 1) << 1);
+            nOut += PutVarint(&pCodes[nOut], ZigZag(nClimb));
+            nStep = nDelta;
+            continue;
+        }
+
+        /* Anything else as it is */
+        if (nRun) nOut += PutVarint(&pCodes[nOut], (nRun << 1) | 1);
+        nRun = 0;
+        pCodes[nOut++] = 0;
+        memcpy(&pCodes[nOut], p, p[0] + 1);
+        nOut += p[0] + 1;
+    }
+    if (nRun) nOut += PutVarint(&pCodes[nOut], (nRun << 1) | 1);
+
+    return nOut;
+}
+
+static int DecodeProfile(STORE_DECODER *pDecoder, REC_FIELDS *pFields)
+{
+    uint32_t nCode;
+    uint32_t nLen;
+    uint32_t nClimb;
+    unsigned int nSum;
+    uint32_t i;
+
+    /* Returns 1 with the next record, 0 at the end, or -1 if it doesn't make sense */
+    if (pDecoder->nRun) {
+        pDecoder->nRun--;
+    } else {
+        if (pDecoder->nPos >= pDecoder->nSize) return 0;
+        if (!GetVarint(pDecoder, &nCode)) return -1;
+        if (nCode == 0) {
+            if (pDecoder->nPos >= pDecoder->nSize) return -1;
+            nLen = pDecoder->pCodes[pDecoder->nPos];
+            if ((nLen == 0) || (nLen + 1 > pDecoder->nSize - pDecoder->nPos)) return -1;
+            memcpy(pFields->bytes, &pDecoder->pCodes[pDecoder->nPos], nLen + 1);
+            pDecoder->nPos += nLen + 1;
+            nSum = 0;
+            for (i=1; i<=nLen; i++) nSum += pFields->bytes[i];
+            pFields->bytes[nLen+1] = nSum & 0xFF;
+            pFields->nNumBytes = nLen + 2;
+            DecodeRecordFields(pFields->bytes[1], pFields);
+            return 1;
+        }
+        if (nCode & 1) {
+            pDecoder->nRun = (nCode >> 1) - 1;
+            if (nCode == 1) return -1;
+        } else {
+            if (!GetVarint(pDecoder, &nClimb)) return -1;
+            pDecoder->nStep += UnZigZag((nCode >> 1) - 1);
+            pDecoder->nAltitude += UnZigZag(nClimb);
+        }
+    }
+    pDecoder->nTime += pDecoder->nStep;
+
+    /* The datapoint, without going through the layouts */
+    pFields->type = 6;
+    pFields->nNumBytes = 7;
+    pFields->bytes[0] = 5;
+    pFields->bytes[1] = 6;
+    pFields->bytes[2] = pDecoder->nAltitude & 0xFF;
+    pFields->bytes[3] = pDecoder->nAltitude >> 8;
+    pFields->bytes[4] = pDecoder->nTime & 0xFF;
+    pFields->bytes[5] = pDecoder->nTime >> 8;
+    pFields->bytes[6] = (6 + pFields->bytes[2] + pFields->bytes[3] + pFields->bytes[4] + pFields->bytes[5]) & 0xFF;
+    memset(pFields->nValue, 0, sizeof(pFields->nValue));
+    pFields->strText[0] = 0;
+    pFields->nValue[RF_ALTITUDE] = pDecoder->nAltitude;
+    pFields->nValue[RF_TIME] = pDecoder->nTime;
+    return 1;
+}
+
+/* ========================================================================== */
+
+static int ReaderRecord(STORE_READER *pReader, const uint8_t *pBytes, REC_FIELDS *pFields)
+{
+    unsigned int nSum;
+    int i;
+
+    /* Length, type and data bytes as stored, then the checksum of the type and data */
+    nSum = 0;
+    for (i=0; i<=pBytes[0]; i++) {
+        pFields->bytes[i] = pBytes[i];
+        if (i) nSum += pBytes[i];
+    }
+    pFields->bytes[i] = nSum & 0xFF;
+    pFields->nNumBytes = i + 1;
+    DecodeRecordFields(pBytes[1], pFields);
+
+    pReader->nOffset = pReader->nNextOffset;
+    pReader->nNextOffset += pFields->nNumBytes * 3 + 2;
+    return pFields->type;
+}
+
+int OpenStoreReader(STORE_READER *pReader, NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery)
+{
+    memset(pReader, 0, sizeof(STORE_READER));
+    pReader->pStore = pStore;
+    pReader->nNumJumps = QueryStore(pStore, pQuery, &pReader->pJumps);
+    if (pReader->nNumJumps < 0) {
+        pReader->nNumJumps = 0;
+        pReader->bError = TRUE;
+        pReader->nState = READER_DONE;
+        return FALSE;
+    }
+    pReader->nState = READER_HEADER;
+    return TRUE;
+}
+
+int NextStoreRecord(STORE_READER *pReader, REC_FIELDS *pFields)
+{
+    static const uint8_t EndRecord[2] = { 0x01, 0x03 };
+    const STORE_DEVICE *pDevice;
+    const STORE_JUMP *pJump;
+    uint8_t summary[STORE_DEVICE_BYTES];
+    uint8_t *pNew;
+    int nResult;
+
+    while (1) {
+        switch (pReader->nState) {
+            case READER_HEADER:
+                /* A download for each Neptune, of its jumps that were asked for, or an empty one
+                    when nothing matched */
+                if ((pReader->nFirst >= pReader->nNumJumps) && (pReader->nNextOffset != 0)) {
+                    pReader->nState = READER_DONE;
+                    break;
+                }
+                pReader->nRecords = 0;
+                pReader->nProfiles = 0;
+                for (pReader->nLast=pReader->nFirst; ((pReader->nLast<pReader->nNumJumps) &&
+                        (memcmp(pReader->pJumps[pReader->nLast].strSerialNo,
+                                pReader->pJumps[pReader->nFirst].strSerialNo, STORE_SERIAL_SIZE) == 0)); pReader->nLast++) {
+                    if (pReader->pJumps[pReader->nLast].nFlags & STORE_HAS_RECORD) pReader->nRecords++;
+                    if (pReader->pJumps[pReader->nLast].nFlags & STORE_HAS_PROFILE) pReader->nProfiles++;
+                }
+                pReader->nState = ((pReader->nLast > pReader->nFirst) ? READER_VERSION : READER_END);
+                pReader->nOffset = pReader->nNextOffset;
+                pReader->nNextOffset += 10;         /* #NEPTUNE\r\n */
+                return -4;
+
+            case READER_VERSION:
+                pReader->nState = READER_SUMMARY;
+                pDevice = FindDevice(pReader->pStore, pReader->pJumps[pReader->nFirst].strSerialNo);
+                if ((pDevice) && (pDevice->version[0])) return ReaderRecord(pReader, pDevice->version, pFields);
+                break;
+
+            case READER_SUMMARY:
+                pReader->nState = READER_RECORDS;
+                pReader->nNext = pReader->nFirst;
+                pDevice = FindDevice(pReader->pStore, pReader->pJumps[pReader->nFirst].strSerialNo);
+                if ((pDevice) && (pDevice->summary[0] >= 5)) {
+                    /* Its totals, but with the numbers of records and profiles that follow */
+                    memcpy(summary, pDevice->summary, sizeof(summary));
+                    summary[2] = pReader->nRecords & 0xFF;
+                    summary[3] = (pReader->nRecords >> 8) & 0xFF;
+                    summary[4] = ((pReader->nProfiles > 255) ? 255 : pReader->nProfiles);
+                    return ReaderRecord(pReader, summary, pFields);
+                }
+                break;
+
+            case READER_RECORDS:
+                if (pReader->nNext >= pReader->nLast) {
+                    pReader->nState = READER_PROFILES;
+                    pReader->nNext = pReader->nFirst;
+                    pReader->decoder.pCodes = NULL;
+                    break;
+                }
+                pJump = &pReader->pJumps[pReader->nNext++];
+                if ((pJump->nFlags & STORE_HAS_RECORD) && (pJump->jump[0])) return ReaderRecord(pReader, pJump->jump, pFields);
+                break;
+
+            case READER_PROFILES:
+                if (pReader->decoder.pCodes) {
+                    nResult = DecodeProfile(&pReader->decoder, pFields);
+                    if (nResult > 0) {
+                        pReader->nOffset = pReader->nNextOffset;
+                        pReader->nNextOffset += pFields->nNumBytes * 3 + 2;
+                        return pFields->type;
+                    }
+                    if (nResult < 0) {
+                        pJump = &pReader->pJumps[pReader->nNext];
+                        fprintf(stderr, "The profile of jump %lu of %.*s in the store is corrupt!\n",
+                                    (unsigned long)pJump->nJumpNumber, STORE_SERIAL_SIZE, pJump->strSerialNo);
+                        pReader->bError = TRUE;
+                        pReader->nState = READER_DONE;
+                        break;
+                    }
+                    pReader->decoder.pCodes = NULL;
+                    pReader->nNext++;
+                    break;
+                }
+                if (pReader->nNext >= pReader->nLast) {
+                    pReader->nState = READER_END;
+                    break;
+                }
+                pJump = &pReader->pJumps[pReader->nNext];
+                if (!(pJump->nFlags & STORE_HAS_PROFILE)) {
+                    pReader->nNext++;
+                    break;
+                }
+                memset(&pReader->decoder, 0, sizeof(STORE_DECODER));
+                pReader->decoder.nSize = pJump->nProfileSize;
+                if ((pReader->pStore->pProfilesMap) &&
+                    (sizeof(STORE_HEADER) + (off_t)pJump->nProfileOffset + pJump->nProfileSize <=
+                                                            (off_t)pReader->pStore->nProfilesMapSize)) {
+                    pReader->decoder.pCodes = &pReader->pStore->pProfilesMap[sizeof(STORE_HEADER) + pJump->nProfileOffset];
+                    break;
+                }
+                if (pJump->nProfileSize > pReader->nProfileAlloc) {
+                    pNew = (uint8_t *)realloc(pReader->pProfile, pJump->nProfileSize);
+                    if (!pNew) {
+                        pReader->bError = TRUE;
+                        pReader->nState = READER_DONE;
+                        break;
+                    }
+                    pReader->pProfile = pNew;
+                    pReader->nProfileAlloc = pJump->nProfileSize;
+                }
+                if (pread(pReader->pStore->fdProfiles, pReader->pProfile, pJump->nProfileSize,
+                            sizeof(STORE_HEADER) + pJump->nProfileOffset) != pJump->nProfileSize) {
+                    fprintf(stderr, "Couldn't read the profile of jump %lu of %.*s from the store!\n",
+                                (unsigned long)pJump->nJumpNumber, STORE_SERIAL_SIZE, pJump->strSerialNo);
+                    pReader->bError = TRUE;
+                    pReader->nState = READER_DONE;
+                    break;
+                }
+                pReader->decoder.pCodes = pReader->pProfile;
+                break;
+
+            case READER_END:
+                pReader->nState = READER_HEADER;
+                pReader->nFirst = pReader->nLast;
+                return ReaderRecord(pReader, EndRecord, pFields);
+
+            default:
+                return -1;
+        }
+    }
+}
+
+int CloseStoreReader(STORE_READER *pReader)
+{
+    free(pReader->pProfile);
+    free(pReader->pJumps);
+    pReader->pProfile = NULL;
+    pReader->pJumps = NULL;
+    pReader->nState = READER_DONE;
+    return (!pReader->bError);
+}
+
+/* ========================================================================== */
+
+static void WriteRecordLine(FILE *pOutFile, const uint8_t *pBytes)
+{
+    char strLine[MAX_RECORD_SIZE];
+    int nNumBytes;
+    int i;
+
+    /* Length through checksum */
+    nNumBytes = pBytes[0] + 2;
+    for (i=0; i<nNumBytes; i++) {
+        strLine[i*3] = HexDigits[pBytes[i] >> 4];
+        strLine[i*3+1] = HexDigits[pBytes[i] & 0x0F];
+        strLine[i*3+2] = ' ';
+    }
+    strLine[i*3] = '\r';
+    strLine[i*3+1] = '\n';
+    fwrite(strLine, i*3+2, 1, pOutFile);
+}
+
+int WriteStoreQuery(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery, FILE *pOutFile)
+{
+    STORE_READER myReader;
+    REC_FIELDS myFields;
+    int nType;
+    int bOK;
+
+    if (!OpenStoreReader(&myReader, pStore, pQuery)) return FALSE;
+    while ((nType = NextStoreRecord(&myReader, &myFields)) != -1) {
+        if (nType == -4) {
+            fprintf(pOutFile, "#NEPTUNE\r\n");
+        } else {
+            WriteRecordLine(pOutFile, myFields.bytes);
+        }
+    }
+    bOK = CloseStoreReader(&myReader);
+    if (ferror(pOutFile)) bOK = FALSE;
+    return bOK;
+}
+
+/* ========================================================================== */
+
+int CompactStore(const char *pPath, FILE *pReport)
+{
+    NEPTUNE_STORE *pStore;
+    NEPTUNE_STORE *pCompact;
+    STORE_INDEX_ENTRY *pEntries;
+    STORE_SESSION mySession;
+    const STORE_SLOT *pSlot;
+    STORE_JUMP *pJumps;
+    STORE_JUMP *pJump;
+    uint8_t *pProfiles;
+    uint8_t *pNew;
+    char strCompact[MAX_STORE_PATH+32];
+    char strOld[MAX_STORE_PATH+32];
+    off_t nCompactSize;
+    long nProfileAlloc;
+    long nConflicts;
+    long nCount;
+    long nFirst;
+    long i;
+    int bOK;
+
+    if (strlen(pPath) + 16 >= MAX_STORE_PATH) return FALSE;
+    snprintf(strCompact, sizeof(strCompact), "%s.compact", pPath);
+    snprintf(strOld, sizeof(strOld), "%s.old", pPath);
+
+    /* Every copy of every jump, which counts them and what they disagree on */
+    pStore = OpenStore(pPath, TRUE);
+    if (!pStore) return FALSE;
+    if (!pStore->bAllSlots) {
+        free(pStore->pSlots);
+        pStore->pSlots = NULL;
+        pStore->nNumSlots = 0;
+        pStore->nUsedSlots = 0;
+    }
+    pEntries = NULL;
+    nCount = 0;
+    bOK = ((LoadSlots(pStore)) && ((pEntries = BuildIndex(pStore, STORE_INDEX_SERIAL, &nCount)) != NULL));
+
+    /* Written to the side, with the latest device of each Neptune, then its jumps */
+    RemoveStore(strCompact);
+    pCompact = ((bOK) ? OpenStore(strCompact, TRUE) : NULL);
+    if (!pCompact) bOK = FALSE;
+    memset(&mySession, 0, sizeof(mySession));
+    mySession.bEncoded = TRUE;      /* The profiles are copied as they are */
+    for (i=0; ((bOK) && (i<pStore->nNumDevices)); i++) {
+        memcpy(mySession.strSerialNo, pStore->pDevices[i].strSerialNo, STORE_SERIAL_SIZE);
+        mySession.bHaveDevice = TRUE;
+        mySession.device = pStore->pDevices[i];
+        bOK = StoreSession(pCompact, &mySession);
+    }
+    mySession.bHaveDevice = FALSE;
+
+    pJumps = (STORE_JUMP *)malloc(STORE_COMPACT_JUMPS * sizeof(STORE_JUMP));
+    if (!pJumps) bOK = FALSE;
+    pProfiles = NULL;
+    nProfileAlloc = 0;
+    nConflicts = 0;
+    for (nFirst=0; ((bOK) && (nFirst<nCount)); nFirst += mySession.nNumJumps) {
+        /* Some of the jumps of one Neptune at a time, in order */
+        memcpy(mySession.strSerialNo, pEntries[nFirst].key, STORE_SERIAL_SIZE);
+        mySession.pJumps = pJumps;
+        mySession.nNumJumps = 0;
+        mySession.nProfilesSize = 0;
+        for (i=nFirst; ((bOK) && (i<nCount) && (i-nFirst < STORE_COMPACT_JUMPS) &&
+                (memcmp(pEntries[i].key, mySession.strSerialNo, STORE_SERIAL_SIZE) == 0)); i++) {
+            pJump = &pJumps[mySession.nNumJumps];
+            if (!ReadStoreJump(pStore, pEntries[i].nRecord, pJump)) {
+                bOK = FALSE;
+                break;
+            }
+            pSlot = FindSlot(pStore, pJump->strSerialNo, pJump->nJumpNumber);
+            if (pSlot->nDiffers) {
+                nConflicts++;
+                if (pReport)
+                    fprintf(pReport, "Jump %lu of %.*s:  %lu copies with different %s, keeping the latest\n",
+                                (unsigned long)pJump->nJumpNumber, STORE_SERIAL_SIZE, pJump->strSerialNo,
+                                (unsigned long)pSlot->nCopies,
+                                ((pSlot->nDiffers == STORE_HAS_RECORD) ? "records" :
+                                 ((pSlot->nDiffers == STORE_HAS_PROFILE) ? "profiles" : "records and profiles")));
+            }
+            if (pJump->nFlags & STORE_HAS_PROFILE) {
+                if (mySession.nProfilesSize + pJump->nProfileSize > nProfileAlloc) {
+                    pNew = (uint8_t *)realloc(pProfiles, (mySession.nProfilesSize + pJump->nProfileSize) * 2);
+                    if (!pNew) {
+                        bOK = FALSE;
+                        break;
+                    }
+                    pProfiles = pNew;
+                    nProfileAlloc = (mySession.nProfilesSize + pJump->nProfileSize) * 2;
+                }
+                if (pread(pStore->fdProfiles, &pProfiles[mySession.nProfilesSize], pJump->nProfileSize,
+                            sizeof(STORE_HEADER) + pJump->nProfileOffset) != pJump->nProfileSize) {
+                    bOK = FALSE;
+                    break;
+                }
+                pJump->nProfileOffset = mySession.nProfilesSize;
+                mySession.nProfilesSize += pJump->nProfileSize;
+            }
+            mySession.nNumJumps++;
+        }
+        mySession.pProfiles = pProfiles;
+        if (bOK) bOK = StoreSession(pCompact, &mySession);
+    }
+    free(pJumps);
+    free(pProfiles);
+    free(pEntries);
+
+    nCompactSize = ((pCompact) ? pCompact->nProfilesSize : 0);
+    if ((pCompact) && (!CloseStore(pCompact))) bOK = FALSE;
+    if ((bOK) && (pReport)) {
+        fprintf(pReport, "Kept %ld jumps of %lu copies, %ld of them with conflicting copies\n",
+                    nCount, (unsigned long)pStore->nNumJumps, nConflicts);
+        fprintf(pReport, "Jumps %llu -> %llu bytes, profiles %llu -> %llu bytes\n",
+                    (unsigned long long)pStore->nNumJumps * sizeof(STORE_JUMP),
+                    (unsigned long long)nCount * sizeof(STORE_JUMP),
+                    (unsigned long long)pStore->nProfilesSize, (unsigned long long)nCompactSize);
+    }
+    if (bOK) {
+        /* Swapped in while the old store is still locked */
+        RemoveStore(strOld);
+        if (rename(pPath, strOld) < 0) {
+            bOK = FALSE;
+        } else if (rename(strCompact, pPath) < 0) {
+            rename(strOld, pPath);
+            bOK = FALSE;
+        }
+        if (!bOK) fprintf(stderr, "Couldn't replace the store \"%s\":  %s\n", pPath, strerror(errno));
+    }
+    pStore->bWrite = FALSE;         /* Its path may be the new store now */
+    CloseStore(pStore);
+    RemoveStore((bOK) ? strOld : strCompact);
+
+    return bOK;
+}
+
+/* ========================================================================== */
+
+int ParseStoreDates(const char *pText, STORE_QUERY *pQuery)
+{
+    char *pEnd;
+
+    /* YYYYMMDD for just that day, or a range with either end left off */
+    pQuery->nFromDate = 0;
+    pQuery->nToDate = 0;
+    if (*pText != ',') {
+        pQuery->nFromDate = strtoul(pText, &pEnd, 10);
+        if ((pEnd == pText) || (pQuery->nFromDate < 10000101ul) || (pQuery->nFromDate > 99991231ul)) return FALSE;
+        pText = pEnd;
+        if (*pText == 0) {
+            pQuery->nToDate = pQuery->nFromDate;
+            return TRUE;
+        }
+    }
+    if (*pText++ != ',') return FALSE;
+    if (*pText == 0) return (pQuery->nFromDate != 0);
+    pQuery->nToDate = strtoul(pText, &pEnd, 10);
+    if ((*pEnd != 0) || (pQuery->nToDate < 10000101ul) || (pQuery->nToDate > 99991231ul)) return FALSE;
+    return TRUE;
+}
+
@@ -0,0 +1,292 @@
+/*
+ * Neptune_Store
+ *
+ * This module keeps an append-only archive of the jumps of any number
+ * of Neptunes, taken from their data files, in a directory of binary
+ * files.  Each jump is kept once per download as a fixed size record,
+ * holding its Jump Record bytes and where its profile is, and the
+ * profiles are kept as their binary records.  Sorted indexes on the
+ * serial number, jump number, date and jump type lead to the latest
+ * copy of each (serial number, jump number), so a query only reads
+ * the jumps it wants.  Each copy carries hashes of its Jump Record and
+ * profile, so a download already in the store isn't added again, and
+ * copies that disagree are reported.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_STORE_H_
+#define _NEPTUNE_STORE_H_
+
+#include <sys/types.h>
+#include <stdint.h>                 /* The files are the same for 32 and 64-bit builds */
+#include <stdio.h>
+
+#include "neptune_rec.h"
+
+#define STORE_MAGIC         0x5350454Eul    /* "NEPS" */
+#define STORE_VERSION       3
+#define MAX_STORE_PATH      1024
+
+#define STORE_SERIAL_SIZE   10      /* Serial number, NUL padded */
+#define STORE_DEVICE_BYTES  16      /* Version Info and Jump Summary records (length byte on) */
+#define STORE_JUMP_BYTES    32      /* Jump Record (length byte on) */
+
+#define STORE_HAS_RECORD    0x01    /* The Jump Record was downloaded */
+#define STORE_HAS_PROFILE   0x02    /*      and the profile */
+
+#define STORE_INDEX_SERIAL  0       /* Serial number, jump number */
+#define STORE_INDEX_JUMP    1       /* Jump number, serial number */
+#define STORE_INDEX_DATE    2       /* Date and time, serial number */
+#define STORE_INDEX_TYPE    3       /* Jump type, serial number, jump number */
+#define STORE_NUM_INDEXES   4
+#define STORE_KEY_SIZE      16
+#define STORE_NO_RECORD     0xFFFFFFFFul
+
+/* Each file starts with this header, then its fixed size records */
+typedef struct store_header
+{
+    uint32_t    nMagic;
+    uint32_t    nVersion;
+    uint32_t    nRecordSize;        /* Size of each record */
+    uint32_t    nNumJumps;          /* Index:  Number of jump records it was built from */
+} STORE_HEADER;
+
+/* devices.dat:  The Version Info and Jump Summary of each download, when they changed */
+typedef struct store_device
+{
+    char        strSerialNo[STORE_SERIAL_SIZE];
+    uint8_t     nReserved[6];
+    uint8_t     version[STORE_DEVICE_BYTES];    /* Length, type and data bytes, without the checksum */
+    uint8_t     summary[STORE_DEVICE_BYTES];
+} STORE_DEVICE;
+
+/* jumps.dat:  Each jump of each download */
+typedef struct store_jump
+{
+    char        strSerialNo[STORE_SERIAL_SIZE];
+    uint8_t     nJumpType;          /* As recorded (0 = Group 1) */
+    uint8_t     nFlags;             /* STORE_HAS_xxx */
+    uint32_t    nJumpNumber;        /* Real (1 based) jump number */
+    uint32_t    nDate;              /* YYYYMMDD */
+    uint16_t    nTime;              /* HHMM */
+    uint8_t     jump[STORE_JUMP_BYTES];     /* Length, type and data bytes, without the checksum */
+    uint16_t    nReserved;
+    uint32_t    nProfileSize;       /* Bytes of its profile in profiles.dat */
+    uint32_t    nNumPoints;         /*      and the datapoints in it */
+    uint32_t    nRecordHash;        /* FNV-1a of the jump bytes, 0 if none */
+    uint32_t    nProfileHash;       /*      and of the profile */
+    uint64_t    nProfileOffset;     /* Where the profile starts in profiles.dat */
+} STORE_JUMP;
+
+/* <name>.idx:  Entries sorted by key, one for the latest copy of each jump */
+typedef struct store_index_entry
+{
+    uint8_t     key[STORE_KEY_SIZE];    /* Compared with memcmp() */
+    uint32_t    nRecord;            /* Jump record number in jumps.dat */
+} STORE_INDEX_ENTRY;
+
+/* A download being added:  its jumps, with the offsets of their profiles in pProfiles,
+    which hold the records of each profile from its Profile Start through its End
+    of Profile, each as length, type and data bytes (no checksum).
+
+    profiles.dat holds them encoded, as a varint code for each record.  A code of 0
+    is followed by the record as is.  Datapoints are coded from the one before (or
+    0's at the start):  an odd code is (n << 1 | 1) for n points that keep the same
+    time step and altitude, as the Neptune sitting in the aircraft or on the ground
+    records, and any other is ((zigzag(time step change) + 1) << 1), followed by
+    the zigzag varint of the altitude change */
+typedef struct store_session
+{
+    char        strSerialNo[STORE_SERIAL_SIZE];
+    int         bHaveDevice;        /* The Version Info (and maybe Jump Summary) were read */
+    STORE_DEVICE device;
+    STORE_JUMP  *pJumps;
+    long        nNumJumps;
+    const uint8_t *pProfiles;
+    long        nProfilesSize;
+    int         bEncoded;           /* pProfiles are already encoded, with their hashes set */
+} STORE_SESSION;
+
+/* Which jumps a query wants, 0 or "" for any */
+typedef struct store_query
+{
+    char        strSerialNo[STORE_SERIAL_SIZE+1];
+    uint32_t    nJumpNumber;
+    uint32_t    nFromDate;          /* YYYYMMDD */
+    uint32_t    nToDate;
+    int         nJumpType;          /* As recorded, or -1 for any */
+} STORE_QUERY;
+
+typedef struct store_slot           /* Latest copy of a jump, in a hash table */
+{
+    char        strSerialNo[STORE_SERIAL_SIZE];
+    uint8_t     nJumpType;
+    uint8_t     bUsed;
+    uint32_t    nJumpNumber;
+    uint32_t    nDate;
+    uint16_t    nTime;
+    uint8_t     nFlags;             /* STORE_HAS_xxx */
+    uint8_t     nDiffers;           /* STORE_HAS_xxx of the parts its copies disagree on */
+    uint32_t    nRecord;
+    uint32_t    nOldRecord;         /* Copy it replaces in the indexes, or STORE_NO_RECORD */
+    uint32_t    nCopies;
+    uint32_t    nRecordHash;
+    uint32_t    nProfileHash;
+} STORE_SLOT;
+
+typedef struct store_decoder        /* Where decoding a profile is up to */
+{
+    const uint8_t *pCodes;
+    uint32_t    nSize;
+    uint32_t    nPos;
+    uint32_t    nRun;               /* Points left of a run */
+    uint16_t    nTime;              /* Last point */
+    uint16_t    nAltitude;
+    int32_t     nStep;              /*      and its time step */
+} STORE_DECODER;
+
+typedef struct neptune_store
+{
+    char        strPath[MAX_STORE_PATH];    /* Store directory */
+    int         bWrite;             /* Opened for adding to */
+    int         fdLock;
+    int         fdDevices;
+    int         fdJumps;
+    int         fdProfiles;
+    uint32_t    nNumJumps;          /* Records in jumps.dat */
+    off_t       nProfilesSize;      /* Bytes in profiles.dat */
+    off_t       nDevicesSize;       /* Bytes in devices.dat */
+    STORE_DEVICE *pDevices;         /* Latest of each Neptune */
+    long        nNumDevices;
+    STORE_SLOT  *pSlots;            /* Latest copy of each jump, once loaded */
+    long        nNumSlots;          /*      size of the table, a power of two */
+    long        nUsedSlots;
+    int         bAllSlots;          /*      or just those added since opening */
+    uint32_t    nOpenJumps;         /* Records in jumps.dat when it was opened */
+    STORE_INDEX_ENTRY *pSerialIndex;    /* serial.idx as it was opened, when not bAllSlots */
+    long        nSerialEntries;
+    long        nSerialMapSize;
+    uint8_t     *pBloom;            /* Bloom filter of the (serial, jump) in the store */
+    uint32_t    nBloomBits;         /*      a power of two */
+    FILE        *pReport;           /* Where conflicting copies are reported, or NULL */
+    const uint8_t *pJumpsMap;       /* jumps.dat, profiles.dat and the indexes, when held by LoadStore() */
+    size_t      nJumpsMapSize;
+    const uint8_t *pProfilesMap;
+    size_t      nProfilesMapSize;
+    STORE_INDEX_ENTRY *pIndexes[STORE_NUM_INDEXES];
+    long        nIndexEntries[STORE_NUM_INDEXES];
+    long        nIndexMapSize[STORE_NUM_INDEXES];   /*      0 if built into memory */
+    long        nAdded;             /* Jumps added since opening */
+    long        nAddedProfiles;     /*      with their own profiles */
+    long        nSkipped;           /*      already there */
+    long        nConflicts;         /*      that disagree with the copy there */
+} NEPTUNE_STORE;
+
+/* Reads the jumps of a query as the records of a Neptune Data File, straight from the store */
+typedef struct store_reader
+{
+    NEPTUNE_STORE *pStore;
+    STORE_JUMP  *pJumps;            /* The jumps picked */
+    long        nNumJumps;
+    long        nFirst;             /* Those of the Neptune being read */
+    long        nLast;
+    long        nNext;              /*      and the next of them */
+    long        nRecords;           /*      with records */
+    long        nProfiles;          /*      and profiles */
+    int         nState;             /* What's read next */
+    uint8_t     *pProfile;          /* Profile being read, as stored */
+    uint32_t    nProfileAlloc;
+    STORE_DECODER decoder;
+    off_t       nOffset;            /* Where the last record read would be in the file */
+    off_t       nNextOffset;
+    int         bError;             /* Something couldn't be read */
+} STORE_READER;
+
+/* IsStore - Returns TRUE if pPath is a store directory */
+extern int IsStore(const char *pPath);
+
+/* OpenStore - Opens the store in directory pPath, for adding jumps to if bWrite, which
+        creates it if need be and locks it against other writers.  Returns NULL if
+        it couldn't be opened */
+extern NEPTUNE_STORE *OpenStore(const char *pPath, int bWrite);
+
+/* CloseStore - Closes a store, first bringing its indexes up to date if it was opened
+        for writing.  Returns FALSE if they couldn't be written */
+extern int CloseStore(NEPTUNE_STORE *pStore);
+
+/* LoadStore - Maps the jumps, profiles and indexes of a store opened for reading and
+        keeps them, so queries and readers just look them up, without reading
+        or mapping anything more.  Returns FALSE if they couldn't be */
+extern int LoadStore(NEPTUNE_STORE *pStore);
+
+/* StoreChanged - Returns TRUE if jumps were added to the store since it was opened,
+        or it was compacted, so it needs opening again to see them */
+extern int StoreChanged(const NEPTUNE_STORE *pStore);
+
+/* SetStoreSerialNo - Copies a serial number into a NUL padded store field */
+extern void SetStoreSerialNo(char *pDest, const char *pSerialNo);
+
+/* SetStoreJump - Fills in a jump from its Jump Record (type 2) */
+extern void SetStoreJump(STORE_JUMP *pJump, const char *pSerialNo, const REC_FIELDS *pFields);
+
+/* StoreSession - Appends the device and jumps of a download.  A jump downloaded
+        without its profile keeps the profile of an earlier copy, and one that's
+        the same as the copy in the store is skipped.  A jump whose record or
+        profile differs from the copy in the store replaces it, and is reported
+        to pReport.  Returns FALSE if it couldn't all be written */
+extern int StoreSession(NEPTUNE_STORE *pStore, const STORE_SESSION *pSession);
+
+/* ReadStoreJump - Reads the jump record nRecord, in the order they were added, so the
+        jumps added by StoreSession() are those from the nNumJumps before it on */
+extern int ReadStoreJump(const NEPTUNE_STORE *pStore, uint32_t nRecord, STORE_JUMP *pJump);
+
+/* QueryStore - Finds the latest copy of each jump matching the query, using the most
+        selective index, and sets *ppJumps to a malloc()ed array of them sorted by
+        serial and jump number.  Returns the number found or -1 on error */
+extern long QueryStore(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery, STORE_JUMP **ppJumps);
+
+/* OpenStoreReader - Starts reading the jumps matching the query as a Neptune Data File,
+        the same as WriteStoreQuery() writes, returning FALSE if they can't be found */
+extern int OpenStoreReader(STORE_READER *pReader, NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery);
+
+/* NextStoreRecord - Reads the next record into pFields, with its fields decoded, and
+        returns its type, -4 for the #NEPTUNE header of each download, or -1 at the
+        end.  Datapoints are decoded from the stored profile straight into their
+        fields, without going through the record text */
+extern int NextStoreRecord(STORE_READER *pReader, REC_FIELDS *pFields);
+
+/* CloseStoreReader - Finishes reading, returning FALSE if anything couldn't be read */
+extern int CloseStoreReader(STORE_READER *pReader);
+
+/* WriteStoreQuery - Writes the jumps matching the query as a Neptune Data File, one
+        download for each Neptune, with its latest Version Info and Jump Summary.
+        Returns FALSE if it couldn't all be read or written */
+extern int WriteStoreQuery(NEPTUNE_STORE *pStore, const STORE_QUERY *pQuery, FILE *pOutFile);
+
+/* CompactStore - Rewrites the store in pPath with just the latest copy of each
+        jump and the latest device of each Neptune, reporting the jumps whose
+        copies disagreed and the totals to pReport.  Returns FALSE if it
+        couldn't be rewritten, leaving the store as it was */
+extern int CompactStore(const char *pPath, FILE *pReport);
+
+/* ParseStoreDates - Parses a date range of "YYYYMMDD[,YYYYMMDD]" into the query.
+        Returns FALSE if it isn't one */
+extern int ParseStoreDates(const char *pText, STORE_QUERY *pQuery);
+
+#endif  /* _NEPTUNE_STORE_H_ */
+
@@ -0,0 +1,452 @@
+/*
+ * Neptune_Stream
+ *
+ * This module reads and writes compressed (gzip or zstd) data
+ * streams, by running them through the external compressor as
+ * they go, and reads tar archives a member at a time, so nothing
+ * is ever unpacked to disk.
+ *
+ * The compressors run as child processes connected by pipes, so
+ * the work is spread over another CPU and the data is only ever
+ * held a pipe's worth at a time.  Where pigz is installed it's
+ * used for gzip, and zstd is run with a thread per core.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "neptune_stream.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define MAX_FILTERS 3               /* Most alternative commands for one job */
+
+/* Filter commands, in order of preference */
+static const char *const GzipDecompress[MAX_FILTERS][4] = {
+    { "pigz", "-dc", NULL },
+    { "gzip", "-dc", NULL },
+    { NULL }
+};
+
+static const char *const ZstdDecompress[MAX_FILTERS][4] = {
+    { "zstd", "-qdc", NULL },
+    { NULL }
+};
+
+static const char *const GzipCompress[MAX_FILTERS][4] = {
+    { "pigz", "-c", NULL },
+    { "gzip", "-c", NULL },
+    { NULL }
+};
+
+static const char *const ZstdCompress[MAX_FILTERS][4] = {
+    { "zstd", "-qc", "-T0", NULL },
+    { NULL }
+};
+
+/* Local Prototypes */
+static int FillStream(NEPTUNE_STREAM *pStream, long nWanted);
+static int ReadStreamBytes(NEPTUNE_STREAM *pStream, unsigned char *pBuff, off_t nBytes);
+static off_t TarNumber(const unsigned char *pField, int nWidth);
+static int FeedPipe(NEPTUNE_STREAM *pStream);
+static pid_t RunFilter(const char *const pCommands[MAX_FILTERS][4], int fdIn, int fdOut, int fdClose);
+static int WaitFilter(pid_t nPid);
+
+/* ========================================================================== */
+
+int StreamCompression(const char *pName)
+{
+    if ((strcmp(pName, "gz") == 0) || (strcmp(pName, "gzip") == 0)) return STREAM_GZIP;
+    if ((strcmp(pName, "zst") == 0) || (strcmp(pName, "zstd") == 0)) return STREAM_ZSTD;
+    return -1;
+}
+
+/* ========================================================================== */
+
+NEPTUNE_STREAM *OpenInputStream(const char *pFilename)
+{
+    NEPTUNE_STREAM *pStream;
+    int fdPipe[2];
+    int fd;
+    long n;
+
+    pStream = (NEPTUNE_STREAM *)malloc(sizeof(NEPTUNE_STREAM));
+    if (!pStream) return NULL;
+    pStream->nPid = 0;
+    pStream->nFeedPid = 0;
+    pStream->nCompression = STREAM_PLAIN;
+    pStream->bTar = FALSE;
+    pStream->bEOF = FALSE;
+    pStream->nOffset = 0;
+    pStream->nRemaining = -1;
+    pStream->nPadding = 0;
+    pStream->strMember[0] = 0;
+    pStream->nPos = 0;
+    pStream->nLen = 0;
+
+    fd = ((strcmp(pFilename, "-") == 0) ? STDIN_FILENO : open(pFilename, O_RDONLY));
+    pStream->fd = fd;
+    if (fd < 0) {
+        free(pStream);
+        return NULL;
+    }
+
+    /* Look at the magic bytes, which stay in the buffer for a plain file */
+    FillStream(pStream, 4);
+    if (pStream->nLen >= 4) {
+        if ((pStream->buff[0] == 0x1F) && (pStream->buff[1] == 0x8B)) pStream->nCompression = STREAM_GZIP;
+        if ((pStream->buff[0] == 0x28) && (pStream->buff[1] == 0xB5) &&
+            (pStream->buff[2] == 0x2F) && (pStream->buff[3] == 0xFD)) pStream->nCompression = STREAM_ZSTD;
+    }
+
+    if (pStream->nCompression != STREAM_PLAIN) {
+        /* The decompressor reads the file from the start and we read what it writes */
+        if ((lseek(fd, 0, SEEK_SET) < 0) && ((fd = FeedPipe(pStream)) < 0)) {
+            CloseInputStream(pStream);
+            return NULL;
+        }
+        if (pipe(fdPipe) < 0) {
+            if (fd != STDIN_FILENO) close(fd);
+            CloseInputStream(pStream);
+            return NULL;
+        }
+        n = RunFilter(((pStream->nCompression == STREAM_GZIP) ? GzipDecompress : ZstdDecompress),
+                        fd, fdPipe[1], fdPipe[0]);
+        close(fdPipe[1]);
+        if (fd != STDIN_FILENO) close(fd);
+        pStream->fd = fdPipe[0];
+        if (n < 0) {
+            CloseInputStream(pStream);
+            return NULL;
+        }
+        pStream->nPid = n;
+        pStream->nLen = 0;
+        pStream->bEOF = FALSE;
+    }
+
+    /* A tar archive has the ustar magic in its first header */
+    FillStream(pStream, TAR_BLOCK_SIZE);
+    if ((pStream->nLen >= TAR_BLOCK_SIZE) && (memcmp(&pStream->buff[257], "ustar", 5) == 0)) {
+        pStream->bTar = TRUE;
+        pStream->nRemaining = 0;
+    }
+
+    return pStream;
+}
+
+int CloseInputStream(NEPTUNE_STREAM *pStream)
+{
+    int bOK;
+
+    bOK = TRUE;
+    if ((pStream->fd >= 0) && (pStream->fd != STDIN_FILENO)) close(pStream->fd);
+    if ((pStream->nPid > 0) && (!WaitFilter(pStream->nPid))) bOK = FALSE;
+    if ((pStream->nFeedPid > 0) && (!WaitFilter(pStream->nFeedPid))) bOK = FALSE;
+    free(pStream);
+
+    return bOK;
+}
+
+long ReadStreamLine(NEPTUNE_STREAM *pStream, unsigned char *pBuff, long nBufSize)
+{
+    unsigned char *pEnd;
+    long nRead;
+    long n;
+
+    nRead = 0;
+    while (nRead < nBufSize-1) {
+        if ((pStream->nPos >= pStream->nLen) && (!FillStream(pStream, 1))) break;
+
+        /* Up to the end of the line, the buffer, the member or pBuff, whichever is first */
+        n = pStream->nLen - pStream->nPos;
+        if (n > nBufSize-1 - nRead) n = nBufSize-1 - nRead;
+        if ((pStream->bTar) && (n > pStream->nRemaining)) n = pStream->nRemaining;
+        if (n <= 0) break;
+        pEnd = memchr(&pStream->buff[pStream->nPos], '\n', n);
+        if (pEnd) n = pEnd - &pStream->buff[pStream->nPos] + 1;
+
+        memcpy(&pBuff[nRead], &pStream->buff[pStream->nPos], n);
+        pStream->nPos += n;
+        pStream->nOffset += n;
+        if (pStream->bTar) pStream->nRemaining -= n;
+        nRead += n;
+        if (pEnd) break;
+    }
+    pBuff[nRead] = 0;
+
+    return nRead;
+}
+
+int NextTarMember(NEPTUNE_STREAM *pStream)
+{
+    unsigned char header[TAR_BLOCK_SIZE];
+    char strLongName[MAX_MEMBER_NAME];
+    unsigned long nSum;
+    unsigned long nCheck;
+    off_t nSize;
+    char *p;
+    int i;
+
+    if (!pStream->bTar) return FALSE;
+
+    strLongName[0] = 0;
+    while (1) {
+        /* The rest of the last member (or one we're not interested in) */
+        if (!ReadStreamBytes(pStream, NULL, pStream->nRemaining + pStream->nPadding)) return FALSE;
+        pStream->nRemaining = 0;
+        pStream->nPadding = 0;
+
+        if (!ReadStreamBytes(pStream, header, TAR_BLOCK_SIZE)) return FALSE;
+        nSum = 0;
+        for (i=0; i<TAR_BLOCK_SIZE; i++)
+            nSum += (((i >= 148) && (i < 156)) ? ' ' : header[i]);
+        if (nSum == 8*' ') return FALSE;                /* An empty block ends the archive */
+        nCheck = (unsigned long)TarNumber(&header[148], 8);
+        if (nSum != nCheck) {
+            fprintf(stderr, "Bad tar header at member after \"%s\"\n", pStream->strMember);
+            return FALSE;
+        }
+
+        nSize = TarNumber(&header[124], 12);
+        pStream->nRemaining = nSize;
+        pStream->nPadding = (TAR_BLOCK_SIZE - (nSize % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+
+        switch (header[156]) {
+            case 'L':       /* GNU long name of the next member */
+                i = ((nSize < MAX_MEMBER_NAME) ? nSize : MAX_MEMBER_NAME-1);
+                if (!ReadStreamBytes(pStream, (unsigned char *)strLongName, i)) return FALSE;
+                strLongName[i] = 0;
+                pStream->nRemaining -= i;
+                break;
+            case 'x':       /* pax extended header, which may have the path of the next member */
+                i = ((nSize < MAX_MEMBER_NAME) ? nSize : MAX_MEMBER_NAME-1);
+                if (!ReadStreamBytes(pStream, (unsigned char *)strLongName, i)) return FALSE;
+                strLongName[i] = 0;
+                pStream->nRemaining -= i;
+                p = strstr(strLongName, " path=");
+                if (p) {
+                    p += 6;
+                    memmove(strLongName, p, strcspn(p, "\n"));
+                    strLongName[strcspn(p, "\n")] = 0;
+                } else {
+                    strLongName[0] = 0;
+                }
+                break;
+            case '0':       /* Regular files */
+            case '7':
+            case 0:
+                if (strLongName[0]) {
+                    strcpy(pStream->strMember, strLongName);
+                } else if (header[345]) {
+                    snprintf(pStream->strMember, sizeof(pStream->strMember), "%.155s/%.100s",
+                                (char *)&header[345], (char *)&header[0]);
+                } else {
+                    snprintf(pStream->strMember, sizeof(pStream->strMember), "%.100s", (char *)&header[0]);
+                }
+                pStream->nOffset = 0;
+                return TRUE;
+            default:        /* Directories, links, etc */
+                strLongName[0] = 0;
+                break;
+        }
+    }
+}
+
+/* ========================================================================== */
+
+static int FillStream(NEPTUNE_STREAM *pStream, long nWanted)
+{
+    long n;
+
+    /* Note: Reads until there are at least nWanted bytes in the buffer,
+                or the end of the file.  Returns FALSE if there are none */
+    if (pStream->nPos > 0) {
+        memmove(pStream->buff, &pStream->buff[pStream->nPos], pStream->nLen - pStream->nPos);
+        pStream->nLen -= pStream->nPos;
+        pStream->nPos = 0;
+    }
+    while ((!pStream->bEOF) && (pStream->nLen < nWanted)) {
+        n = read(pStream->fd, &pStream->buff[pStream->nLen], STREAM_BUFF_SIZE - pStream->nLen);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Reading input ");
+        }
+        if (n <= 0) {
+            pStream->bEOF = TRUE;
+            break;
+        }
+        pStream->nLen += n;
+    }
+
+    return (pStream->nLen > 0);
+}
+
+static int ReadStreamBytes(NEPTUNE_STREAM *pStream, unsigned char *pBuff, off_t nBytes)
+{
+    long n;
+
+    /* Note: Reads exactly nBytes into pBuff, or skips them if pBuff is NULL */
+    while (nBytes > 0) {
+        if ((pStream->nPos >= pStream->nLen) && (!FillStream(pStream, 1))) return FALSE;
+        n = pStream->nLen - pStream->nPos;
+        if (n > nBytes) n = nBytes;
+        if (pBuff) {
+            memcpy(pBuff, &pStream->buff[pStream->nPos], n);
+            pBuff += n;
+        }
+        pStream->nPos += n;
+        nBytes -= n;
+    }
+
+    return TRUE;
+}
+
+static off_t TarNumber(const unsigned char *pField, int nWidth)
+{
+    off_t nValue;
+    int i;
+
+    /* Octal, or big-endian binary when the top bit is set (GNU, for sizes over 8 GB) */
+    nValue = 0;
+    if (pField[0] & 0x80) {
+        nValue = pField[0] & 0x7F;
+        for (i=1; i<nWidth; i++)
+            nValue = (nValue << 8) | pField[i];
+        return nValue;
+    }
+    for (i=0; ((i<nWidth) && (pField[i] == ' ')); i++);
+    for (; ((i<nWidth) && (pField[i] >= '0') && (pField[i] <= '7')); i++)
+        nValue = (nValue << 3) | (pField[i] - '0');
+
+    return nValue;
+}
+
+static int FeedPipe(NEPTUNE_STREAM *pStream)
+{
+    int fdPipe[2];
+    pid_t nPid;
+    long n;
+
+    /* Note: A pipe can't be rewound to hand the decompressor the bytes we've
+                already read, so a child process passes them on, followed
+                by the rest of the pipe.  Returns the end to read it from,
+                with the child left to CloseInputStream() to wait for */
+    if (pipe(fdPipe) < 0) return -1;
+    switch (nPid = fork()) {
+        case -1:
+            close(fdPipe[0]);
+            close(fdPipe[1]);
+            return -1;
+        case 0:
+            close(fdPipe[0]);
+            n = pStream->nLen;
+            do {
+                if (write(fdPipe[1], pStream->buff, n) != n) _exit(1);
+            } while ((n = read(pStream->fd, pStream->buff, STREAM_BUFF_SIZE)) > 0);
+            _exit((n < 0) ? 1 : 0);
+    }
+    close(fdPipe[1]);
+    pStream->nFeedPid = nPid;
+
+    return fdPipe[0];
+}
+
+/* ========================================================================== */
+
+int CompressOutput(int nCompression, pid_t *pPid)
+{
+    int fdPipe[2];
+
+    *pPid = 0;
+    if (nCompression == STREAM_PLAIN) return TRUE;
+
+    /* The compressor takes over our stdout and we write to it instead */
+    fflush(stdout);
+    if (pipe(fdPipe) < 0) {
+        perror("Starting compressor ");
+        return FALSE;
+    }
+    *pPid = RunFilter(((nCompression == STREAM_GZIP) ? GzipCompress : ZstdCompress),
+                        fdPipe[0], STDOUT_FILENO, fdPipe[1]);
+    close(fdPipe[0]);
+    if ((*pPid < 0) || (dup2(fdPipe[1], STDOUT_FILENO) < 0)) {
+        close(fdPipe[1]);
+        *pPid = 0;
+        return FALSE;
+    }
+    close(fdPipe[1]);
+
+    return TRUE;
+}
+
+int FinishOutput(pid_t nPid)
+{
+    fflush(stdout);
+    if (nPid <= 0) return TRUE;
+    close(STDOUT_FILENO);           /* So the compressor sees the end */
+    return WaitFilter(nPid);
+}
+
+/* ========================================================================== */
+
+static pid_t RunFilter(const char *const pCommands[MAX_FILTERS][4], int fdIn, int fdOut, int fdClose)
+{
+    pid_t nPid;
+    int i;
+
+    nPid = fork();
+    if (nPid < 0) {
+        perror("Starting filter ");
+        return -1;
+    }
+    if (nPid > 0) return nPid;
+
+    /* Child:  Hook up the pipes and run the first command that's installed */
+    if (fdIn != STDIN_FILENO) dup2(fdIn, STDIN_FILENO);
+    if (fdOut != STDOUT_FILENO) dup2(fdOut, STDOUT_FILENO);
+    close(fdClose);
+    for (i=0; ((i<MAX_FILTERS) && (pCommands[i][0])); i++)
+        execvp(pCommands[i][0], (char *const *)pCommands[i]);
+    fprintf(stderr, "Couldn't run \"%s\" -- is it installed?\n", pCommands[i-1][0]);
+    _exit(127);
+}
+
+static int WaitFilter(pid_t nPid)
+{
+    int nStatus;
+
+    while (waitpid(nPid, &nStatus, 0) < 0) {
+        if (errno != EINTR) return FALSE;
+    }
+    return ((WIFEXITED(nStatus)) && (WEXITSTATUS(nStatus) == 0));
+}
+
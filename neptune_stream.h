@@ -0,0 +1,90 @@
+/*
+ * Neptune_Stream
+ *
+ * This module reads and writes compressed (gzip or zstd) data
+ * streams, by running them through the external compressor as
+ * they go, and reads tar archives a member at a time, so nothing
+ * is ever unpacked to disk.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_STREAM_H_
+#define _NEPTUNE_STREAM_H_
+
+#include <sys/types.h>
+
+#define STREAM_PLAIN    0
+#define STREAM_GZIP     1
+#define STREAM_ZSTD     2
+
+#define STREAM_BUFF_SIZE    65536
+#define TAR_BLOCK_SIZE      512
+#define MAX_MEMBER_NAME     1024
+
+typedef struct neptune_stream
+{
+    int         fd;                 /* File or decompressor pipe */
+    pid_t       nPid;               /* Decompressor process or 0 */
+    pid_t       nFeedPid;           /* Process feeding it from a pipe or 0 */
+    int         nCompression;       /* STREAM_xxx of the file */
+    int         bTar;               /* The (decompressed) file is a tar archive */
+    int         bEOF;
+    off_t       nOffset;            /* Offset of the next byte, from the start of the member of a tar archive */
+    off_t       nRemaining;         /* Tar archive:  Bytes left of the current member */
+    off_t       nPadding;           /*      and of the padding after it */
+    char        strMember[MAX_MEMBER_NAME];     /* Name of the current member */
+    long        nPos;               /* Next byte in buff[] */
+    long        nLen;               /* Bytes in buff[] */
+    unsigned char buff[STREAM_BUFF_SIZE];
+} NEPTUNE_STREAM;
+
+/* StreamCompression - Returns the STREAM_xxx for a compression name ("gz", "gzip",
+        "zst" or "zstd"), or -1 if it isn't one we know */
+extern int StreamCompression(const char *pName);
+
+/* OpenInputStream - Opens a file ("-" for stdin) for reading, recognizing gzip and
+        zstd files by their magic bytes and decompressing them on the fly, and tar
+        archives (plain or compressed), which are then read a member at a time with
+        NextTarMember().  Returns NULL if the file couldn't be opened */
+extern NEPTUNE_STREAM *OpenInputStream(const char *pFilename);
+
+/* CloseInputStream - Closes a stream opened with OpenInputStream(), returning FALSE
+        if its decompressor failed (a corrupt or truncated file) */
+extern int CloseInputStream(NEPTUNE_STREAM *pStream);
+
+/* ReadStreamLine - Reads the next line, like fgets(), but only as far as the end of
+        the current member of a tar archive.  Returns the number of bytes read
+        (which may hold NULs), or 0 at the end */
+extern long ReadStreamLine(NEPTUNE_STREAM *pStream, unsigned char *pBuff, long nBufSize);
+
+/* NextTarMember - Skips whatever is left of the current member of a tar archive and
+        moves on to the next regular file in it, setting strMember to its name.
+        Returns FALSE at the end of the archive */
+extern int NextTarMember(NEPTUNE_STREAM *pStream);
+
+/* CompressOutput - Sends everything written to stdout from now on through the
+        compressor for nCompression, using a multi-threaded one when it's installed.
+        pPid is set to the compressor process.  Returns FALSE if it couldn't be started */
+extern int CompressOutput(int nCompression, pid_t *pPid);
+
+/* FinishOutput - Flushes and closes stdout and waits for the compressor to finish
+        writing, returning FALSE if it failed */
+extern int FinishOutput(pid_t nPid);
+
+#endif  /* _NEPTUNE_STREAM_H_ */
+
@@ -0,0 +1,246 @@
+/*
+ * Neptune_Tap
+ *
+ * This app follows the record bus that neptune_read publishes on
+ * with its -b option, printing each record as it arrives, or saving
+ * them as a Neptune data file.  Any number of taps can follow the
+ * same bus at once, each reading straight out of the shared memory.
+ * It can also publish the records of an existing .nep file on a bus,
+ * for trying out consumers without a Neptune.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <sys/types.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+
+#include "neptune_rec.h"
+#include "neptune_bus.h"
+
+/* Defines */
+#define VERSION 100
+#define POLL_MSEC 10                /* Time between looks at the bus when it's idle */
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+/* Globals */
+volatile sig_atomic_t bQuit = FALSE;
+
+/* Prototypes */
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize);
+int ReadLine(void *pSource, DATA_REC *pRecord);
+int PublishFile(NEPTUNE_BUS *pBus, const char *pFilename);
+void PrintRecord(const BUS_RECORD *pRecord, unsigned long nSeq, int bRecordsOnly);
+void HandleSignal(int nSignal);
+
+/* ========================================================================== */
+
+int ReadString(void *pSource, unsigned char *pBuff, long nBufSize)
+{
+    FILE *pFile = (FILE*)pSource;
+
+    if (!fgets((char*)pBuff, nBufSize, pFile)) return FALSE;
+    return TRUE;
+}
+
+int ReadLine(void *pSource, DATA_REC *pRecord)
+{
+    if (!ReadString(pSource, pRecord->buff, sizeof(pRecord->buff))) return FALSE;
+    pRecord->data = pRecord->buff;
+    pRecord->dwSize = strlen((char*)pRecord->buff);
+    return TRUE;
+}
+
+int PublishFile(NEPTUNE_BUS *pBus, const char *pFilename)
+{
+    FILE *pInFile;
+    unsigned char databuff[MAX_RECORD_SIZE];
+    long nRecords;
+    int type;
+
+    pInFile = fopen(pFilename, "rb");
+    if (!pInFile) {
+        fprintf(stderr, "Failed to open \"%s\" for reading!\n\n", pFilename);
+        return FALSE;
+    }
+    if ((!ReadString(pInFile, databuff, sizeof(databuff))) ||
+        (strncmp((char*)databuff, "#NEPTUNE", 8) != 0)) {
+        fprintf(stderr, "The input file \"%s\" doesn't appear to be a Neptune Data File!\n\n", pFilename);
+        fclose(pInFile);
+        return FALSE;
+    }
+
+    nRecords = 0;
+    while ((!bQuit) && ((type = GetNextRecord(pInFile, databuff)) != -1)) {
+        if (type == -4) continue;       /* Just the header of the next download in the file */
+        PublishRecord(pBus, 0, type, databuff);
+        nRecords++;
+    }
+    fclose(pInFile);
+
+    printf("%ld records published on \"%s\"\n", nRecords, pBus->strName);
+
+    return TRUE;
+}
+
+void PrintRecord(const BUS_RECORD *pRecord, unsigned long nSeq, int bRecordsOnly)
+{
+    char strTime[32];
+    time_t nTime;
+    long i;
+
+    /* Either just the record line, as in a .nep file, or with everything we know about it */
+    if (!bRecordsOnly) {
+        nTime = pRecord->nTimeSec;
+        strftime(strTime, sizeof(strTime), "%H:%M:%S", localtime(&nTime));
+        printf("%8lu %s.%03ld  %2d  ", nSeq, strTime, pRecord->nTimeUSec/1000, pRecord->nSource);
+        if (pRecord->nType >= 0) {
+            printf("%02X ", pRecord->nType);
+        } else {
+            printf("-- ");
+        }
+        printf("%5lu  %s  ", pRecord->nJump,
+                    ((pRecord->nStatus == 0) ? "OK   " : ((pRecord->nStatus == -3) ? "CKSUM" : "SHORT")));
+    }
+    for (i=0; i<pRecord->nNumBytes; i++)
+        printf("%02X ", pRecord->bytes[i]);
+    printf(bRecordsOnly ? "\r\n" : "\n");
+}
+
+void HandleSignal(int nSignal)
+{
+    bQuit = TRUE;
+}
+
+/* ========================================================================== */
+
+int main(int argc, char *argv[])
+{
+    NEPTUNE_BUS myBus;
+    const BUS_RECORD *pRecord;
+    BUS_RECORD myRecord;
+    unsigned long nSeq;
+    unsigned long nLost;
+    struct timespec ts;
+    int bPublish;
+    int bRecordsOnly;
+    int bOneDownload;
+    int bNeedHelp;
+    int opt;
+
+    /* Check Arguments */
+    bPublish = FALSE;
+    bRecordsOnly = FALSE;
+    bOneDownload = FALSE;
+    bNeedHelp = FALSE;
+
+    while ((opt = getopt(argc, argv, "pn1")) != -1) {
+        switch (opt) {
+            case 'p':
+                bPublish = TRUE;
+                break;
+            case 'n':
+                bRecordsOnly = TRUE;
+                break;
+            case '1':
+                bOneDownload = TRUE;
+                break;
+            default:
+                bNeedHelp = TRUE;
+                break;
+        }
+    }
+    if (argc-optind != (bPublish ? 2 : 1)) bNeedHelp = TRUE;
+
+    if (bNeedHelp) {
+        fprintf(stderr, "Neptune Tap V%d.%02d\n", VERSION/100, VERSION%100);
+        fprintf(stderr, "Usage: neptune_tap [-n] [-1] <bus-name>\n");
+        fprintf(stderr, "       neptune_tap -p <bus-name> <neptune-file>\n\n");
+        fprintf(stderr, "       Follows the record bus that \"neptune_read -b <bus-name>\"\n");
+        fprintf(stderr, "       publishes on, printing each record with its sequence number,\n");
+        fprintf(stderr, "       time, device, type, jump number and checksum status.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "       Where <options> are:\n");
+        fprintf(stderr, "           -n = Print just the records, as a Neptune data file\n");
+        fprintf(stderr, "           -1 = Exit after the End of all data record\n");
+        fprintf(stderr, "           -p = Publish the records of <neptune-file> on the bus instead\n");
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+
+    if (bPublish) {
+        if (!CreateBus(&myBus, argv[optind])) return -2;
+        if (!PublishFile(&myBus, argv[optind+1])) {
+            CloseBus(&myBus);
+            return -3;
+        }
+        CloseBus(&myBus);
+        return 0;
+    }
+
+    if (!AttachBus(&myBus, argv[optind])) return -2;
+    fprintf(stderr, "Following \"%s\"\n", myBus.strName);
+    if (bRecordsOnly) printf("#NEPTUNE\r\n");
+    fflush(stdout);
+
+    nLost = 0;
+    while (!bQuit) {
+        pRecord = NextBusRecord(&myBus, &nSeq);
+        if (myBus.nLost != nLost) {
+            fprintf(stderr, "*** %lu records lost -- fell behind the bus\n", myBus.nLost - nLost);
+            nLost = myBus.nLost;
+        }
+        if (!pRecord) {
+            fflush(stdout);
+            ts.tv_sec = 0;
+            ts.tv_nsec = POLL_MSEC * 1000000L;
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        /* Take our copy of the record only if it's still there once we have it */
+        memcpy(&myRecord, pRecord, sizeof(myRecord));
+        if (!BusRecordValid(pRecord, nSeq)) {
+            myBus.nLost++;
+            continue;
+        }
+
+        PrintRecord(&myRecord, nSeq, bRecordsOnly);
+        if ((bOneDownload) && (myRecord.nType == 3) && (myRecord.nStatus == 0)) break;
+    }
+    fflush(stdout);
+
+    CloseBus(&myBus);
+
+    return 0;
+}
+
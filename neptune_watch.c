@@ -0,0 +1,254 @@
+/*
+ * Neptune_Watch
+ *
+ * This module watches a directory, with inotify, for Neptune data
+ * files being written into it or changed, and hands them out once
+ * they've been left alone long enough that whatever is writing them
+ * has finished, so a file copied over slowly is only read once.
+ *
+ * Every write to a file, as well as its closing or being moved in,
+ * puts off when it's ready, so a file copied in pieces over a share
+ * isn't read half-written.  Nothing is done while nothing changes:
+ * the only wait is on the inotify descriptor, with a timeout just
+ * when a file is waiting to be left alone.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/inotify.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "neptune_watch.h"
+
+/* Defines */
+#ifndef FALSE
+#define FALSE 0
+#define TRUE (!FALSE)
+#endif
+
+#define WATCH_EVENTS        (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+#define WATCH_BUFF_SIZE     65536
+
+/* Local Prototypes */
+static double WatchTime(void);
+static int QueueFile(NEPTUNE_WATCH *pWatch, const char *pName, double nQuiet);
+static void DropFile(NEPTUNE_WATCH *pWatch, const char *pName);
+static int ScanWatch(NEPTUNE_WATCH *pWatch, double nQuiet);
+static int ReadEvents(NEPTUNE_WATCH *pWatch);
+
+/* ========================================================================== */
+
+static double WatchTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
+
+static int QueueFile(NEPTUNE_WATCH *pWatch, const char *pName, double nQuiet)
+{
+    WATCH_FILE *pNew;
+    long i;
+
+    if (strlen(pName) >= MAX_WATCH_NAME) return TRUE;
+
+    /* A file changed again just waits longer */
+    for (i=0; i<pWatch->nNumFiles; i++) {
+        if (strcmp(pWatch->pFiles[i].strName, pName) == 0) {
+            pWatch->pFiles[i].nQuiet = nQuiet;
+            return TRUE;
+        }
+    }
+
+    if (pWatch->nNumFiles >= pWatch->nFileAlloc) {
+        pNew = (WATCH_FILE *)realloc(pWatch->pFiles, (pWatch->nFileAlloc + 64) * sizeof(WATCH_FILE));
+        if (!pNew) return FALSE;
+        pWatch->pFiles = pNew;
+        pWatch->nFileAlloc += 64;
+    }
+    strcpy(pWatch->pFiles[pWatch->nNumFiles].strName, pName);
+    pWatch->pFiles[pWatch->nNumFiles].nQuiet = nQuiet;
+    pWatch->nNumFiles++;
+    return TRUE;
+}
+
+static void DropFile(NEPTUNE_WATCH *pWatch, const char *pName)
+{
+    long i;
+
+    for (i=0; i<pWatch->nNumFiles; i++) {
+        if (strcmp(pWatch->pFiles[i].strName, pName) == 0) {
+            pWatch->pFiles[i] = pWatch->pFiles[--pWatch->nNumFiles];
+            return;
+        }
+    }
+}
+
+static int ScanWatch(NEPTUNE_WATCH *pWatch, double nQuiet)
+{
+    struct dirent *pEntry;
+    DIR *pDir;
+    int bOK;
+
+    pDir = opendir(pWatch->strDir);
+    if (!pDir) return FALSE;
+    bOK = TRUE;
+    while ((bOK) && ((pEntry = readdir(pDir)) != NULL)) {
+        if (IsWatchName(pEntry->d_name)) bOK = QueueFile(pWatch, pEntry->d_name, nQuiet);
+    }
+    closedir(pDir);
+    return bOK;
+}
+
+static int ReadEvents(NEPTUNE_WATCH *pWatch)
+{
+    static long buff[WATCH_BUFF_SIZE / sizeof(long)];       /* Aligned for the events */
+    const struct inotify_event *pEvent;
+    double nQuiet;
+    ssize_t nRead;
+    ssize_t nPos;
+
+    nRead = read(pWatch->fd, buff, sizeof(buff));
+    if (nRead < 0) return ((errno == EINTR) || (errno == EAGAIN));
+
+    nQuiet = WatchTime() + pWatch->nQuietSecs;
+    for (nPos=0; nPos + (ssize_t)sizeof(struct inotify_event) <= nRead;
+                    nPos += sizeof(struct inotify_event) + pEvent->len) {
+        pEvent = (const struct inotify_event *)((const char *)buff + nPos);
+        if (pEvent->mask & IN_Q_OVERFLOW) {
+            /* Events were lost, so anything may have changed */
+            if (!ScanWatch(pWatch, nQuiet)) return FALSE;
+            continue;
+        }
+        if (pEvent->mask & IN_IGNORED) {
+            fprintf(stderr, "The directory \"%s\" being watched is gone!\n", pWatch->strDir);
+            return FALSE;
+        }
+        if ((pEvent->len == 0) || (!IsWatchName(pEvent->name))) continue;
+        if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            DropFile(pWatch, pEvent->name);
+        } else if (!QueueFile(pWatch, pEvent->name, nQuiet)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================== */
+
+int IsWatchName(const char *pName)
+{
+    const char *p;
+
+    if (pName[0] == '.') return FALSE;
+    for (p=pName; (p = strstr(p, ".nep")) != NULL; p += 4) {
+        if ((p[4] == 0) || (p[4] == '.')) return TRUE;
+    }
+    return FALSE;
+}
+
+NEPTUNE_WATCH *OpenWatch(const char *pDir, double nQuietSecs)
+{
+    NEPTUNE_WATCH *pWatch;
+
+    if (strlen(pDir) >= MAX_WATCH_PATH) return NULL;
+    pWatch = (NEPTUNE_WATCH *)malloc(sizeof(NEPTUNE_WATCH));
+    if (!pWatch) return NULL;
+    memset(pWatch, 0, sizeof(NEPTUNE_WATCH));
+    strcpy(pWatch->strDir, pDir);
+    pWatch->nQuietSecs = nQuietSecs;
+
+    /* Watched before it's read, so nothing written in between is missed */
+    pWatch->fd = inotify_init();
+    if (pWatch->fd < 0) {
+        perror("Starting inotify ");
+        free(pWatch);
+        return NULL;
+    }
+    if ((inotify_add_watch(pWatch->fd, pDir, WATCH_EVENTS) < 0) || (!ScanWatch(pWatch, WatchTime()))) {
+        fprintf(stderr, "Couldn't watch \"%s\":  %s\n", pDir, strerror(errno));
+        CloseWatch(pWatch);
+        return NULL;
+    }
+
+    return pWatch;
+}
+
+int NextWatchFile(NEPTUNE_WATCH *pWatch, double nWait, char *pPath, long nPathSize)
+{
+    struct timeval tv;
+    fd_set rfds;
+    double nNow;
+    double nEnd;
+    double nDelay;
+    long nFirst;
+    long i;
+    int n;
+
+    nEnd = WatchTime() + nWait;
+    while (1) {
+        /* The file left alone longest, if it's been long enough */
+        nNow = WatchTime();
+        nFirst = -1;
+        for (i=0; i<pWatch->nNumFiles; i++) {
+            if ((nFirst < 0) || (pWatch->pFiles[i].nQuiet < pWatch->pFiles[nFirst].nQuiet)) nFirst = i;
+        }
+        if ((nFirst >= 0) && (pWatch->pFiles[nFirst].nQuiet <= nNow)) {
+            n = snprintf(pPath, nPathSize, "%s/%s", pWatch->strDir, pWatch->pFiles[nFirst].strName);
+            pWatch->pFiles[nFirst] = pWatch->pFiles[--pWatch->nNumFiles];
+            if ((n < 0) || (n >= nPathSize)) continue;
+            return 1;
+        }
+
+        /* Otherwise wait for it, or for something else to change */
+        nDelay = ((nFirst >= 0) ? (pWatch->pFiles[nFirst].nQuiet - nNow) : -1.0);
+        if ((nWait >= 0.0) && ((nDelay < 0.0) || (nEnd - nNow < nDelay))) nDelay = nEnd - nNow;
+        if ((nWait >= 0.0) && (nDelay <= 0.0)) return 0;
+        tv.tv_sec = (long)nDelay;
+        tv.tv_usec = (long)((nDelay - tv.tv_sec) * 1000000.0);
+        FD_ZERO(&rfds);
+        FD_SET(pWatch->fd, &rfds);
+        n = select(pWatch->fd+1, &rfds, NULL, NULL, ((nDelay >= 0.0) ? &tv : NULL));
+        if (n < 0) {
+            if (errno == EINTR) return 0;
+            perror("Watching for files ");
+            return -1;
+        }
+        if ((n > 0) && (!ReadEvents(pWatch))) return -1;
+    }
+}
+
+void CloseWatch(NEPTUNE_WATCH *pWatch)
+{
+    if (pWatch->fd >= 0) close(pWatch->fd);
+    free(pWatch->pFiles);
+    free(pWatch);
+}
+
@@ -0,0 +1,68 @@
+/*
+ * Neptune_Watch
+ *
+ * This module watches a directory, with inotify, for Neptune data
+ * files being written into it or changed, and hands them out once
+ * they've been left alone long enough that whatever is writing them
+ * has finished, so a file copied over slowly is only read once.
+ *
+ * Copyright(C)2004 by Donna Whisnant
+ *
+ * GNU General Public License Usage
+ * This file may be used under the terms of the GNU General Public License
+ * version 2.0 as published by the Free Software Foundation and appearing
+ * in the file gpl-2.0.txt included in the packaging of this file. Please
+ * review the following information to ensure the GNU General Public License
+ * version 2.0 requirements will be met:
+ * http://www.gnu.org/copyleft/gpl.html.
+ *
+ * Other Usage
+ * Alternatively, this file may be used in accordance with the terms and
+ * conditions contained in a signed written agreement between you and
+ * Donna Whisnant.
+ *
+ */
+
+#ifndef _NEPTUNE_WATCH_H_
+#define _NEPTUNE_WATCH_H_
+
+#define MAX_WATCH_PATH      1024
+#define MAX_WATCH_NAME      256
+#define WATCH_QUIET_SECS    2.0         /* Default time a file must be left alone before it's read */
+
+typedef struct watch_file           /* A file that's been written or changed */
+{
+    char        strName[MAX_WATCH_NAME];
+    double      nQuiet;             /* When it will have been left alone long enough */
+} WATCH_FILE;
+
+typedef struct neptune_watch
+{
+    int         fd;                 /* inotify */
+    char        strDir[MAX_WATCH_PATH];
+    double      nQuietSecs;
+    WATCH_FILE  *pFiles;            /* Files waiting to be left alone */
+    long        nNumFiles;
+    long        nFileAlloc;
+} NEPTUNE_WATCH;
+
+/* IsWatchName - Returns TRUE if a file name is one of a Neptune data file,
+        "*.nep", maybe compressed ("*.nep.gz"), and not hidden, as the
+        temporary files of copies often are */
+extern int IsWatchName(const char *pName);
+
+/* OpenWatch - Starts watching the directory pDir for Neptune data files, handing out
+        each once it's gone nQuietSecs without being changed.  The files already
+        there are handed out first.  Returns NULL if it can't be watched */
+extern NEPTUNE_WATCH *OpenWatch(const char *pDir, double nQuietSecs);
+
+/* NextWatchFile - Waits up to nWait seconds (forever if negative) for a file to be
+        ready and puts its path in pPath, returning 1, or 0 if none was ready in
+        time or a signal interrupted the wait, or -1 if watching failed */
+extern int NextWatchFile(NEPTUNE_WATCH *pWatch, double nWait, char *pPath, long nPathSize);
+
+/* CloseWatch - Stops watching, forgetting any files still waiting */
+extern void CloseWatch(NEPTUNE_WATCH *pWatch);
+
+#endif  /* _NEPTUNE_WATCH_H_ */
+